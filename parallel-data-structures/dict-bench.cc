@@ -0,0 +1,139 @@
+#include "dict.hh"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/****** Dictionary Benchmarks ******/
+
+// Sorted-key stress: insert N keys in increasing order, which degenerates an
+// unbalanced tree into a list, then read, scan and destroy them. Everything
+// runs on a thread with a small fixed stack, so an operation that recursed
+// once per key (or even per few keys) would crash instead of finishing.
+// The dictionary is then saved to an image and loaded back, which should take
+// the same time for any number of keys, followed by the first write that
+// builds the tree from the image.
+
+#define DEFAULT_KEYS 10000000
+#define BENCH_STACK (64 * 1024)
+#define BENCH_IMAGE "/tmp/dict-bench.img"
+
+typedef struct bench_args {
+  long num_keys;
+  int failures;
+} bench_args_t;
+
+/**
+ * @brief  Get the current time in seconds
+ * @note
+ * @retval seconds on a monotonic clock
+ */
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief  Scan callback counting entries and checking their order
+ * @note
+ * @param  *key: key of the entry
+ * @param  value: value of the entry
+ * @param  *arg: number of entries seen so far, as a long
+ * @retval whether to keep scanning
+ */
+static bool count_entry(const char *key, int value, void *arg) {
+  long *seen = (long *)arg;
+  if (value != *seen)
+    return false;
+  (*seen)++;
+  return true;
+}
+
+/**
+ * @brief  Run the sorted-key stress benchmark
+ * @note
+ * @param  *arg: bench_args_t
+ * @retval None
+ */
+static void *sorted_keys(void *arg) {
+  bench_args_t *args = (bench_args_t *)arg;
+  my_dict_t d;
+  dict_init(&d);
+  char key[24];
+
+  double start = now();
+  for (long i = 0; i < args->num_keys; i++) {
+    snprintf(key, sizeof(key), "%012ld", i);
+    dict_set(&d, key, (int)i);
+  }
+  double inserted = now();
+
+  for (long i = 0; i < args->num_keys; i++) {
+    snprintf(key, sizeof(key), "%012ld", i);
+    if (dict_get(&d, key) != (int)i)
+      args->failures++;
+  }
+  double read = now();
+
+  long seen = 0;
+  dict_scan(&d, NULL, NULL, count_entry, &seen);
+  if (seen != args->num_keys)
+    args->failures++;
+  double scanned = now();
+
+  if (!dict_save(&d, BENCH_IMAGE))
+    args->failures++;
+  double saved = now();
+
+  dict_destroy(&d);
+  double destroyed = now();
+
+  if (!dict_load_mmap(&d, BENCH_IMAGE))
+    args->failures++;
+  snprintf(key, sizeof(key), "%012ld", args->num_keys / 2);
+  if (dict_get(&d, key) != (int)(args->num_keys / 2))
+    args->failures++;
+  double loaded = now();
+  dict_set(&d, "first write", 0);
+  double promoted = now();
+  dict_destroy(&d);
+  unlink(BENCH_IMAGE);
+
+  double n = args->num_keys;
+  printf("sorted keys:  %ld\n", args->num_keys);
+  printf("insert:       %8.3f s  %8.1f ns/op\n", inserted - start, (inserted - start) / n * 1e9);
+  printf("get:          %8.3f s  %8.1f ns/op\n", read - inserted, (read - inserted) / n * 1e9);
+  printf("scan:         %8.3f s  %8.1f ns/op\n", scanned - read, (scanned - read) / n * 1e9);
+  printf("save:         %8.3f s  %8.1f ns/op\n", saved - scanned, (saved - scanned) / n * 1e9);
+  printf("destroy:      %8.3f s  %8.1f ns/op\n", destroyed - saved, (destroyed - saved) / n * 1e9);
+  printf("load + get:   %8.6f s\n", loaded - destroyed);
+  printf("first write:  %8.3f s  %8.1f ns/op\n", promoted - loaded, (promoted - loaded) / n * 1e9);
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  bench_args_t args;
+  args.num_keys = argc > 1 ? atol(argv[1]) : DEFAULT_KEYS;
+  args.failures = 0;
+
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, BENCH_STACK);
+  pthread_t thread;
+  if (pthread_create(&thread, &attr, sorted_keys, &args) != 0) {
+    perror("Error creating thread");
+    return 1;
+  }
+  if (pthread_join(thread, NULL) != 0)
+    perror("Error joining thread");
+  pthread_attr_destroy(&attr);
+
+  if (args.failures != 0) {
+    printf("FAILED: %d checks did not match\n", args.failures);
+    return 1;
+  }
+  return 0;
+}
@@ -2,7 +2,11 @@
 
 #include "dict.hh"
 #include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 /****** Dictionary Invariants ******/
 
@@ -22,28 +26,72 @@
 // Under what circumstances can accesses to your dictionary structure can
 // proceed in parallel? Answer below.
 //
-// Any functions that read (contains, get) can run in parallel using a
-// reader-writer lock
+// Any functions that read (contains, get) take no lock at all and run in
+// parallel with each other and with writers: writers copy the nodes they
+// change and publish a new root, and replaced nodes are only freed once every
+// reader that might still see them has left (epoch-based reclamation).
 //
 
 // When will two accesses to your dictionary structure be ordered by
 // synchronization? Answer below.
 //
 // Any function that write(destroy, set, remove) will run in order since they
-// cannot run in parallel using a reader-writer lock
+// take the writer lock
 //
 
 /****** Begin Tests ******/
 
-// A utility function to do inorder traversal of BST
+// A utility function to do inorder traversal of the B-tree
 void inorder(node_t *root) {
   if (root != NULL) {
-    inorder(root->left);
-    printf("Key: %s, value %d \n", root->key, root->value);
-    inorder(root->right);
+    for (int i = 0; i < root->num_keys; i++) {
+      if (!root->leaf)
+        inorder(root->children[i]);
+      printf("Key: %s, value %d \n", dict_key_str(root->keys[i]), (int)root->values[i]);
+    }
+    if (!root->leaf)
+      inorder(root->children[root->num_keys]);
   }
 }
 
+// A utility function to check the B-tree shape: keys are sorted and within the
+// bounds set by the parent, every non-root node is at least half full, and all
+// leaves are at the same depth. Returns the height of the subtree.
+int check_btree(node_t *node, const char *lo, const char *hi, bool is_root) {
+  if (node == NULL)
+    return 0;
+  EXPECT_LE(node->num_keys, DICT_MAX_KEYS);
+  if (!is_root) {
+    EXPECT_GE(node->num_keys, DICT_MIN_KEYS);
+  }
+  for (int i = 0; i < node->num_keys; i++) {
+    const char *key = dict_key_str(node->keys[i]);
+    EXPECT_EQ(node->keys[i]->prefix, node->prefixes[i]);
+    EXPECT_EQ(strlen(key), node->keys[i]->len);
+    if (i > 0) {
+      EXPECT_LT(strcmp(dict_key_str(node->keys[i - 1]), key), 0);
+    }
+    if (lo != NULL) {
+      EXPECT_GT(strcmp(key, lo), 0);
+    }
+    if (hi != NULL) {
+      EXPECT_LT(strcmp(key, hi), 0);
+    }
+  }
+  if (node->leaf)
+    return 1;
+  int height = -1;
+  for (int i = 0; i <= node->num_keys; i++) {
+    const char *child_lo = i == 0 ? lo : dict_key_str(node->keys[i - 1]);
+    const char *child_hi = i == node->num_keys ? hi : dict_key_str(node->keys[i]);
+    int h = check_btree(node->children[i], child_lo, child_hi, false);
+    if (height == -1)
+      height = h;
+    EXPECT_EQ(height, h);
+  }
+  return height + 1;
+}
+
 // Basic functionality for the dictionary
 TEST(DictionaryTest, BasicDictionaryOps) {
   my_dict_t d;
@@ -358,3 +406,913 @@ TEST(DictionaryTest, Invariant_3) {
   // clean up
   dict_destroy(&d);
 }
+
+#define NUM_KEYS 20000
+
+/**
+ * @brief  Insert keys in sorted order, which degenerates an unbalanced tree into
+ * a list, and check that the B-tree stays shallow and balanced
+ * @note
+ * @retval
+ */
+TEST(DictionaryTest, SortedInsertStaysBalanced) {
+  my_dict_t d;
+  dict_init(&d);
+
+  static char keys[NUM_KEYS][16];
+  for (int i = 0; i < NUM_KEYS; i++) {
+    snprintf(keys[i], sizeof(keys[i]), "key%08d", i);
+    dict_set(&d, keys[i], i);
+  }
+
+  // with at least 8 children per internal node, 20000 keys need at most
+  // 1 + log_8(10000) levels
+  int height = check_btree(d.root, NULL, NULL, true);
+  ASSERT_LE(height, 5);
+
+  for (int i = 0; i < NUM_KEYS; i++)
+    ASSERT_EQ(i, dict_get(&d, keys[i]));
+
+  // remove every other key in reverse order and check the tree again
+  for (int i = NUM_KEYS - 1; i >= 0; i -= 2)
+    dict_remove(&d, keys[i]);
+  check_btree(d.root, NULL, NULL, true);
+
+  for (int i = 0; i < NUM_KEYS; i++) {
+    if (i % 2 == 1) {
+      ASSERT_FALSE(dict_contains(&d, keys[i]));
+    } else {
+      ASSERT_EQ(i, dict_get(&d, keys[i]));
+    }
+  }
+
+  // clean up
+  dict_destroy(&d);
+}
+
+/**
+ * @brief  Interleave pseudo-random inserts and removals, exercising the node
+ * split, merge and borrow paths, and compare against a flat array of values
+ * @note
+ * @retval
+ */
+TEST(DictionaryTest, RandomOpsMatchReference) {
+  my_dict_t d;
+  dict_init(&d);
+
+  static char keys[NUM_KEYS / 4][16];
+  static int expected[NUM_KEYS / 4];
+  for (int i = 0; i < NUM_KEYS / 4; i++) {
+    snprintf(keys[i], sizeof(keys[i]), "%d", i * 7919);
+    expected[i] = -1;
+  }
+
+  unsigned int seed = 213;
+  for (int op = 0; op < NUM_KEYS * 4; op++) {
+    int k = rand_r(&seed) % (NUM_KEYS / 4);
+    if (rand_r(&seed) % 3 == 0) {
+      dict_remove(&d, keys[k]);
+      expected[k] = -1;
+    } else {
+      dict_set(&d, keys[k], op);
+      expected[k] = op;
+    }
+  }
+
+  check_btree(d.root, NULL, NULL, true);
+  for (int i = 0; i < NUM_KEYS / 4; i++) {
+    ASSERT_EQ(expected[i] != -1, dict_contains(&d, keys[i]));
+    ASSERT_EQ(expected[i], dict_get(&d, keys[i]));
+  }
+
+  // removing everything leaves an empty tree
+  for (int i = 0; i < NUM_KEYS / 4; i++)
+    dict_remove(&d, keys[i]);
+  ASSERT_TRUE(d.root == NULL);
+
+  // clean up
+  dict_destroy(&d);
+}
+
+#define BATCH 512
+
+// Invariants 2 and 3 through the batch operations, which must agree with the
+// single-key ones
+TEST(DictionaryTest, BatchOpsMatchSingleOps) {
+  my_dict_t d;
+  dict_init(&d);
+
+  static char keys[NUM_KEYS / 4][16];
+  static int expected[NUM_KEYS / 4];
+  for (int i = 0; i < NUM_KEYS / 4; i++) {
+    snprintf(keys[i], sizeof(keys[i]), "%d", i * 7919);
+    expected[i] = -1;
+  }
+
+  // random batches, repeating some keys within a batch
+  unsigned int seed = 213;
+  const char *batch_keys[BATCH];
+  int batch_values[BATCH];
+  for (int round = 0; round < 20; round++) {
+    int n = rand_r(&seed) % BATCH + 1;
+    for (int i = 0; i < n; i++) {
+      int k = rand_r(&seed) % (NUM_KEYS / 4);
+      batch_keys[i] = keys[k];
+      batch_values[i] = round * BATCH + i;
+      expected[k] = batch_values[i];
+    }
+    dict_set_many(&d, batch_keys, batch_values, n);
+    check_btree(d.root, NULL, NULL, true);
+  }
+
+  // look everything up in batches, including keys that were never set
+  for (int start = 0; start < NUM_KEYS / 4; start += BATCH) {
+    int n = NUM_KEYS / 4 - start < BATCH ? NUM_KEYS / 4 - start : BATCH;
+    for (int i = 0; i < n; i++)
+      batch_keys[n - 1 - i] = keys[start + i];
+    dict_get_many(&d, batch_keys, batch_values, n);
+    for (int i = 0; i < n; i++) {
+      ASSERT_EQ(expected[start + i], batch_values[n - 1 - i]);
+      ASSERT_EQ(expected[start + i], dict_get(&d, keys[start + i]));
+    }
+  }
+
+  // empty batches and batches against an empty dictionary
+  dict_set_many(&d, batch_keys, batch_values, 0);
+  dict_get_many(&d, batch_keys, batch_values, 0);
+  for (int i = 0; i < NUM_KEYS / 4; i++)
+    dict_remove(&d, keys[i]);
+  batch_keys[0] = keys[0];
+  dict_get_many(&d, batch_keys, batch_values, 1);
+  ASSERT_EQ(-1, batch_values[0]);
+
+  // clean up
+  dict_destroy(&d);
+}
+
+#define SCAN_MAX 4096
+
+typedef struct scan_result {
+  char keys[SCAN_MAX][24];
+  int values[SCAN_MAX];
+  int count;
+  int limit;  // stop after this many entries, or 0 for no limit
+} scan_result_t;
+
+/**
+ * @brief  Scan callback recording every entry it is given
+ * @note
+ * @param  *key: key of the entry
+ * @param  value: value of the entry
+ * @param  *arg: scan_result_t to record into
+ * @retval whether to keep scanning
+ */
+bool record_entry(const char *key, int value, void *arg) {
+  scan_result_t *r = (scan_result_t *)arg;
+  snprintf(r->keys[r->count], sizeof(r->keys[0]), "%s", key);
+  r->values[r->count] = value;
+  r->count++;
+  return r->limit == 0 || r->count < r->limit;
+}
+
+/**
+ * @brief  Scan a range and check the result against a brute-force filter of the keys
+ * @note
+ * @param  *d: dictionary holding exactly the keys "k000".."k999" with their numbers as values
+ * @param  *from: lower bound or NULL
+ * @param  *to: upper bound or NULL
+ * @retval None
+ */
+void check_scan(my_dict_t *d, const char *from, const char *to) {
+  static scan_result_t r;
+  r.count = 0;
+  r.limit = 0;
+  dict_scan(d, from, to, record_entry, &r);
+
+  int expected = 0;
+  char key[8];
+  for (int i = 0; i < 1000; i++) {
+    snprintf(key, sizeof(key), "k%03d", i);
+    if ((from != NULL && strcmp(key, from) < 0) || (to != NULL && strcmp(key, to) >= 0))
+      continue;
+    ASSERT_LT(expected, r.count);
+    ASSERT_STREQ(key, r.keys[expected]);
+    ASSERT_EQ(i, r.values[expected]);
+    expected++;
+  }
+  ASSERT_EQ(expected, r.count);
+}
+
+// Scans visit exactly the keys in range, in order
+TEST(DictionaryTest, RangeScans) {
+  my_dict_t d;
+  dict_init(&d);
+
+  // insert in a scrambled order
+  char key[8];
+  for (int i = 0; i < 1000; i++) {
+    int k = i * 7 % 1000;
+    snprintf(key, sizeof(key), "k%03d", k);
+    dict_set(&d, key, k);
+  }
+
+  check_scan(&d, NULL, NULL);
+  check_scan(&d, "k100", "k200");
+  check_scan(&d, "k1005", "k2");
+  check_scan(&d, "a", "k0005");
+  check_scan(&d, "k999", NULL);
+  check_scan(&d, NULL, "k000");
+  check_scan(&d, "k500", "k500");
+  check_scan(&d, "z", NULL);
+
+  // the callback can stop the scan early
+  static scan_result_t r;
+  r.count = 0;
+  r.limit = 5;
+  dict_scan(&d, "k123", NULL, record_entry, &r);
+  ASSERT_EQ(5, r.count);
+  ASSERT_STREQ("k127", r.keys[4]);
+
+  // prefix scans
+  r.count = 0;
+  r.limit = 0;
+  dict_scan_prefix(&d, "k12", record_entry, &r);
+  ASSERT_EQ(10, r.count);
+  ASSERT_STREQ("k120", r.keys[0]);
+  ASSERT_STREQ("k129", r.keys[9]);
+  r.count = 0;
+  dict_scan_prefix(&d, "k5", record_entry, &r);
+  ASSERT_EQ(100, r.count);
+  r.count = 0;
+  dict_scan_prefix(&d, "", record_entry, &r);
+  ASSERT_EQ(1000, r.count);
+  r.count = 0;
+  dict_scan_prefix(&d, "j", record_entry, &r);
+  ASSERT_EQ(0, r.count);
+
+  // a prefix ending in 0xff bytes
+  dict_set(&d, "k\xff", 1);
+  dict_set(&d, "k\xff\xff", 2);
+  dict_set(&d, "k\xffz", 3);
+  dict_set(&d, "l", 4);
+  r.count = 0;
+  dict_scan_prefix(&d, "k\xff", record_entry, &r);
+  ASSERT_EQ(3, r.count);
+  r.count = 0;
+  dict_scan_prefix(&d, "k\xff\xff", record_entry, &r);
+  ASSERT_EQ(1, r.count);
+
+  // clean up
+  dict_destroy(&d);
+}
+
+typedef struct scan_args {
+  my_dict_t *d;
+  bool done;
+  int bad_scans;
+} scan_args_t;
+
+/**
+ * @brief  Keep adding and removing odd keys while scans run
+ * @note
+ * @param  *arg: scan_args_t
+ * @retval None
+ */
+void *scan_writer(void *arg) {
+  scan_args_t *args = (scan_args_t *)arg;
+  char key[8];
+  for (int round = 0; round < 5; round++) {
+    for (int i = 1; i < 1000; i += 2) {
+      snprintf(key, sizeof(key), "k%03d", i);
+      if (round % 2 == 0)
+        dict_set(args->d, key, i);
+      else
+        dict_remove(args->d, key);
+    }
+  }
+  __atomic_store_n(&args->done, true, __ATOMIC_SEQ_CST);
+  return NULL;
+}
+
+// Scans running alongside a writer still see sorted keys and every key the
+// writer leaves alone
+TEST(DictionaryTest, ScansDuringWrites) {
+  my_dict_t d;
+  dict_init(&d);
+  char key[8];
+  for (int i = 0; i < 1000; i += 2) {
+    snprintf(key, sizeof(key), "k%03d", i);
+    dict_set(&d, key, i);
+  }
+
+  scan_args_t args = {&d, false, 0};
+  pthread_t writer;
+  if (pthread_create(&writer, NULL, scan_writer, &args) != 0)
+    perror("Error creating thread");
+
+  static scan_result_t r;
+  do {
+    r.count = 0;
+    r.limit = 0;
+    dict_scan(&d, NULL, NULL, record_entry, &r);
+    int even = 0;
+    for (int i = 0; i < r.count; i++) {
+      if (i > 0 && strcmp(r.keys[i - 1], r.keys[i]) >= 0)
+        args.bad_scans++;
+      if (r.values[i] % 2 == 0)
+        even++;
+    }
+    if (even != 500)
+      args.bad_scans++;
+  } while (!__atomic_load_n(&args.done, __ATOMIC_SEQ_CST));
+
+  if (pthread_join(writer, NULL) != 0)
+    perror("Error joining thread");
+  ASSERT_EQ(0, args.bad_scans);
+
+  // clean up
+  dict_destroy(&d);
+}
+
+#define STABLE_KEYS 500
+#define CHURN_KEYS 2000
+#define CHURN_ROUNDS 5
+
+typedef struct churn_args {
+  my_dict_t *d;
+  char (*keys)[16];
+  bool writer;
+  int bad_reads;
+} churn_args_t;
+
+/**
+ * @brief  Writers insert and remove the churn keys over and over, splitting
+ * and merging nodes; readers keep checking that the stable keys keep their values
+ * @note
+ * @param  *thread_args: struct with the dictionary, the keys and the role
+ * @retval None
+ */
+void *churn_run(void *thread_args) {
+  churn_args_t *arguments = (churn_args_t *)thread_args;
+  my_dict_t *d = arguments->d;
+  if (arguments->writer) {
+    for (int round = 0; round < CHURN_ROUNDS; round++) {
+      for (int i = STABLE_KEYS; i < STABLE_KEYS + CHURN_KEYS; i++)
+        dict_set(d, arguments->keys[i], round);
+      for (int i = STABLE_KEYS; i < STABLE_KEYS + CHURN_KEYS; i++)
+        dict_remove(d, arguments->keys[i]);
+    }
+  } else {
+    for (int round = 0; round < CHURN_ROUNDS * 4; round++) {
+      for (int i = 0; i < STABLE_KEYS; i++) {
+        if (dict_get(d, arguments->keys[i]) != i)
+          arguments->bad_reads++;
+      }
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief  Lock-free readers running against writers never see a half-modified
+ * tree or a freed node
+ * @note
+ * @retval
+ */
+TEST(DictionaryTest, ReadersDuringWrites) {
+  my_dict_t d;
+  dict_init(&d);
+
+  static char keys[STABLE_KEYS + CHURN_KEYS][16];
+  for (int i = 0; i < STABLE_KEYS + CHURN_KEYS; i++)
+    snprintf(keys[i], sizeof(keys[i]), "%c%d", i < STABLE_KEYS ? 's' : 'c', i);
+  for (int i = 0; i < STABLE_KEYS; i++)
+    dict_set(&d, keys[i], i);
+
+  pthread_t threads[4];
+  churn_args_t arguments[4];
+  for (int i = 0; i < 4; i++) {
+    arguments[i].d = &d;
+    arguments[i].keys = keys;
+    arguments[i].writer = i % 2 == 0;
+    arguments[i].bad_reads = 0;
+    int ret = pthread_create(&threads[i], NULL, churn_run, &arguments[i]);
+    if (ret != 0)
+      perror("Error creating thread");
+  }
+  for (int i = 0; i < 4; i++) {
+    int ret = pthread_join(threads[i], NULL);
+    if (ret != 0)
+      perror("Error joining thread");
+  }
+
+  for (int i = 0; i < 4; i++)
+    ASSERT_EQ(0, arguments[i].bad_reads);
+  check_btree(d.root, NULL, NULL, true);
+  for (int i = STABLE_KEYS; i < STABLE_KEYS + CHURN_KEYS; i++)
+    ASSERT_FALSE(dict_contains(&d, keys[i]));
+
+  // clean up
+  dict_destroy(&d);
+}
+
+/**
+ * @brief  The dictionary keeps its own copy of each key, stores each distinct
+ * key once, and orders keys that share their first eight bytes correctly
+ * @note
+ * @retval
+ */
+TEST(DictionaryTest, OwnedKeys) {
+  my_dict_t d;
+  dict_init(&d);
+
+  // reuse one buffer for every key
+  char key[64];
+  for (int i = 0; i < 1000; i++) {
+    snprintf(key, sizeof(key), "shared-prefix-%d", i);
+    dict_set(&d, key, i);
+  }
+  memset(key, 0, sizeof(key));
+  for (int i = 0; i < 1000; i++) {
+    snprintf(key, sizeof(key), "shared-prefix-%d", i);
+    ASSERT_EQ(i, dict_get(&d, key));
+  }
+
+  // keys that are prefixes of each other around the eight byte boundary
+  const char *edge[] = {"", "a", "abcdefg", "abcdefgh", "abcdefghi", "abcdefgi", "\xff"};
+  for (int i = 0; i < 7; i++)
+    dict_set(&d, edge[i], 5000 + i);
+  for (int i = 0; i < 7; i++)
+    ASSERT_EQ(5000 + i, dict_get(&d, edge[i]));
+  ASSERT_FALSE(dict_contains(&d, "abcdefghij"));
+  ASSERT_FALSE(dict_contains(&d, "abcdef"));
+  check_btree(d.root, NULL, NULL, true);
+
+  // setting and removing the same key again reuses its stored copy
+  size_t stored = d.keys.count;
+  for (int i = 0; i < 1000; i++) {
+    dict_set(&d, "churn", i);
+    dict_remove(&d, "churn");
+  }
+  ASSERT_EQ(stored + 1, d.keys.count);
+
+  // clean up
+  dict_destroy(&d);
+}
+
+#define SNAPSHOT_KEYS 5000
+
+typedef struct snapshot_reader_args {
+  my_dict_t *d;
+  bool done;
+  int bad_reads;
+} snapshot_reader_args_t;
+
+/**
+ * @brief  Read the even keys of a loaded snapshot until told to stop
+ * @note
+ * @param  *arg: snapshot_reader_args_t
+ * @retval None
+ */
+void *snapshot_reader(void *arg) {
+  snapshot_reader_args_t *args = (snapshot_reader_args_t *)arg;
+  char key[16];
+  int i = 0;
+  while (!__atomic_load_n(&args->done, __ATOMIC_SEQ_CST)) {
+    snprintf(key, sizeof(key), "snap-%05d", i);
+    if (dict_get(args->d, key) != i)
+      __atomic_add_fetch(&args->bad_reads, 1, __ATOMIC_SEQ_CST);
+    i = (i + 2) % SNAPSHOT_KEYS;
+  }
+  return NULL;
+}
+
+// A saved dictionary loads with the same entries, answers reads straight from
+// the image, and turns into a regular tree on the first write while readers
+// keep going
+TEST(DictionaryTest, SnapshotSaveAndLoad) {
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/dict-tests-%d.img", (int)getpid());
+
+  my_dict_t d;
+  dict_init(&d);
+  char key[16];
+  for (int i = 0; i < SNAPSHOT_KEYS; i++) {
+    snprintf(key, sizeof(key), "snap-%05d", i);
+    dict_set(&d, key, i);
+  }
+  ASSERT_TRUE(dict_save(&d, path));
+  dict_destroy(&d);
+
+  my_dict_t loaded;
+  ASSERT_TRUE(dict_load_mmap(&loaded, path));
+  ASSERT_TRUE(loaded.root == NULL);
+  for (int i = 0; i < SNAPSHOT_KEYS; i++) {
+    snprintf(key, sizeof(key), "snap-%05d", i);
+    ASSERT_EQ(i, dict_get(&loaded, key));
+  }
+  ASSERT_FALSE(dict_contains(&loaded, "snap"));
+  ASSERT_FALSE(dict_contains(&loaded, "snap-99999"));
+
+  const char *batch[3] = {"snap-00042", "missing", "snap-04999"};
+  int values[3];
+  dict_get_many(&loaded, batch, values, 3);
+  ASSERT_EQ(42, values[0]);
+  ASSERT_EQ(-1, values[1]);
+  ASSERT_EQ(4999, values[2]);
+
+  static scan_result_t r;
+  r.count = 0;
+  r.limit = 0;
+  dict_scan_prefix(&loaded, "snap-012", record_entry, &r);
+  ASSERT_EQ(100, r.count);
+  ASSERT_STREQ("snap-01200", r.keys[0]);
+  ASSERT_EQ(1299, r.values[99]);
+
+  // the first write builds the tree while readers use the image
+  snapshot_reader_args_t args = {&loaded, false, 0};
+  pthread_t readers[2];
+  for (int i = 0; i < 2; i++) {
+    if (pthread_create(&readers[i], NULL, snapshot_reader, &args) != 0)
+      perror("Error creating thread");
+  }
+  for (int i = 1; i < SNAPSHOT_KEYS; i += 2) {
+    snprintf(key, sizeof(key), "snap-%05d", i);
+    dict_remove(&loaded, key);
+  }
+  __atomic_store_n(&args.done, true, __ATOMIC_SEQ_CST);
+  for (int i = 0; i < 2; i++) {
+    if (pthread_join(readers[i], NULL) != 0)
+      perror("Error joining thread");
+  }
+  ASSERT_EQ(0, args.bad_reads);
+  ASSERT_TRUE(loaded.image == NULL);
+  check_btree(loaded.root, NULL, NULL, true);
+
+  // the promoted tree can be saved and loaded again
+  dict_set(&loaded, "new", 7);
+  ASSERT_TRUE(dict_save(&loaded, path));
+  dict_destroy(&loaded);
+  ASSERT_TRUE(dict_load_mmap(&loaded, path));
+  r.count = 0;
+  dict_scan(&loaded, NULL, NULL, record_entry, &r);
+  ASSERT_EQ(SNAPSHOT_KEYS / 2 + 1, r.count);
+  ASSERT_EQ(7, dict_get(&loaded, "new"));
+  dict_set(&loaded, "newer", 8);
+  ASSERT_EQ(2, dict_get(&loaded, "snap-00002"));
+  dict_destroy(&loaded);
+
+  // clean up
+  unlink(path);
+}
+
+// Missing or malformed files load as an empty dictionary
+TEST(DictionaryTest, SnapshotRejectsBadFiles) {
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/dict-tests-%d.bad", (int)getpid());
+
+  my_dict_t d;
+  unlink(path);
+  ASSERT_FALSE(dict_load_mmap(&d, path));
+  dict_destroy(&d);
+
+  FILE *file = fopen(path, "w");
+  fputs("not a dictionary image at all", file);
+  fclose(file);
+  ASSERT_FALSE(dict_load_mmap(&d, path));
+  ASSERT_EQ(-1, dict_get(&d, "A"));
+  dict_set(&d, "A", 1);
+  ASSERT_EQ(1, dict_get(&d, "A"));
+  dict_destroy(&d);
+
+  // an empty dictionary round-trips
+  dict_init(&d);
+  ASSERT_TRUE(dict_save(&d, path));
+  dict_destroy(&d);
+  ASSERT_TRUE(dict_load_mmap(&d, path));
+  ASSERT_FALSE(dict_contains(&d, "A"));
+  dict_set(&d, "A", 1);
+  ASSERT_EQ(1, dict_get(&d, "A"));
+  dict_destroy(&d);
+
+  // clean up
+  unlink(path);
+}
+
+typedef struct point {
+  double x, y, z;
+  int id;
+} point_t;
+
+/**
+ * @brief  Value scan callback summing the ids of points
+ * @note
+ * @param  *key: key of the entry
+ * @param  *value: point_t
+ * @param  *arg: running sum
+ * @retval true, to see every entry
+ */
+bool sum_ids(const char *key, const void *value, void *arg) {
+  *(long *)arg += ((const point_t *)value)->id;
+  return true;
+}
+
+// Values larger than a slot are stored out of line and freed exactly once
+// whether they are replaced, removed or still present at destroy
+TEST(DictionaryTest, TypedValues) {
+  my_dict_t d;
+  dict_init_typed(&d, sizeof(point_t));
+
+  char key[16];
+  point_t p;
+  for (int i = 0; i < 2000; i++) {
+    snprintf(key, sizeof(key), "p%04d", i);
+    p.x = i;
+    p.y = -i;
+    p.z = i / 2.0;
+    p.id = i;
+    dict_set_value(&d, key, &p);
+  }
+  // overwrite every other point, and remove every third
+  for (int i = 0; i < 2000; i += 2) {
+    snprintf(key, sizeof(key), "p%04d", i);
+    p.x = p.y = p.z = 0;
+    p.id = -i;
+    dict_set_value(&d, key, &p);
+  }
+  for (int i = 0; i < 2000; i += 3) {
+    snprintf(key, sizeof(key), "p%04d", i);
+    dict_remove(&d, key);
+  }
+  check_btree(d.root, NULL, NULL, true);
+
+  long expected = 0;
+  for (int i = 0; i < 2000; i++) {
+    snprintf(key, sizeof(key), "p%04d", i);
+    if (i % 3 == 0) {
+      ASSERT_FALSE(dict_get_value(&d, key, &p));
+      ASSERT_FALSE(dict_contains(&d, key));
+      continue;
+    }
+    ASSERT_TRUE(dict_get_value(&d, key, &p));
+    ASSERT_EQ(i % 2 == 0 ? -i : i, p.id);
+    ASSERT_EQ(i % 2 == 0 ? 0.0 : i / 2.0, p.z);
+    expected += p.id;
+  }
+  long sum = 0;
+  dict_scan_values(&d, NULL, NULL, sum_ids, &sum);
+  ASSERT_EQ(expected, sum);
+
+  // heap-allocated values cannot be put into an image
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/dict-tests-%d.typed", (int)getpid());
+  ASSERT_FALSE(dict_save(&d, path));
+
+  // clean up
+  dict_destroy(&d);
+
+  // a stored -1 is told apart from a missing key
+  dict_init(&d);
+  int value = 0;
+  dict_set(&d, "minus", -1);
+  ASSERT_TRUE(dict_get_value(&d, "minus", &value));
+  ASSERT_EQ(-1, value);
+  ASSERT_FALSE(dict_get_value(&d, "missing", &value));
+  dict_destroy(&d);
+}
+
+/**
+ * @brief  Update function adding to a long counter, starting from zero
+ * @note
+ * @param  *value: counter
+ * @param  found: whether the counter exists
+ * @param  *arg: amount to add, as a long
+ * @retval true, to store the sum
+ */
+bool add_long(void *value, bool found, void *arg) {
+  *(long *)value += *(long *)arg;
+  return true;
+}
+
+#define COUNTER_KEYS 8
+#define COUNTER_OPS 5000
+
+/**
+ * @brief  Increment counters with dict_update, dict_cas and dict_get_or_insert
+ * @note
+ * @param  *arg: dictionary of long counters
+ * @retval None
+ */
+void *counter_run(void *arg) {
+  my_dict_t *d = (my_dict_t *)arg;
+  char key[16];
+  long one = 1;
+  for (int i = 0; i < COUNTER_OPS; i++) {
+    snprintf(key, sizeof(key), "counter%d", i % COUNTER_KEYS);
+    switch (i % 3) {
+      case 0:
+        dict_update(d, key, add_long, &one);
+        break;
+      case 1: {
+        // retry the compare and swap until no other thread got in between
+        long zero = 0, current;
+        dict_get_or_insert(d, key, &zero, &current);
+        long next = current + 1;
+        while (!dict_cas(d, key, &current, &next)) {
+          dict_get_value(d, key, &current);
+          next = current + 1;
+        }
+        break;
+      }
+      default:
+        dict_update(d, "total", add_long, &one);
+        dict_update(d, key, add_long, &one);
+        dict_update(d, "total", add_long, &one);
+    }
+  }
+  return NULL;
+}
+
+// Read-modify-write operations are atomic: no increment is lost
+TEST(DictionaryTest, AtomicUpdates) {
+  my_dict_t d;
+  dict_init_typed(&d, sizeof(long));
+
+  // get_or_insert only inserts once, and cas only replaces a matching value
+  long value = 5, out = 0;
+  ASSERT_TRUE(dict_get_or_insert(&d, "x", &value, &out));
+  ASSERT_EQ(5, out);
+  value = 6;
+  ASSERT_FALSE(dict_get_or_insert(&d, "x", &value, &out));
+  ASSERT_EQ(5, out);
+  long expected = 4, desired = 7;
+  ASSERT_FALSE(dict_cas(&d, "x", &expected, &desired));
+  expected = 5;
+  ASSERT_TRUE(dict_cas(&d, "x", &expected, &desired));
+  ASSERT_TRUE(dict_get_value(&d, "x", &out));
+  ASSERT_EQ(7, out);
+  ASSERT_FALSE(dict_cas(&d, "y", &expected, &desired));
+  ASSERT_FALSE(dict_contains(&d, "y"));
+  dict_remove(&d, "x");
+
+  // an update that stores nothing leaves even an empty dictionary untouched
+  ASSERT_FALSE(dict_cas(&d, "y", &expected, &desired));
+  ASSERT_TRUE(d.root == NULL);
+
+  pthread_t threads[4];
+  for (int i = 0; i < 4; i++) {
+    if (pthread_create(&threads[i], NULL, counter_run, &d) != 0)
+      perror("Error creating thread");
+  }
+  for (int i = 0; i < 4; i++) {
+    if (pthread_join(threads[i], NULL) != 0)
+      perror("Error joining thread");
+  }
+
+  long sum = 0;
+  char key[16];
+  for (int i = 0; i < COUNTER_KEYS; i++) {
+    snprintf(key, sizeof(key), "counter%d", i);
+    ASSERT_TRUE(dict_get_value(&d, key, &value));
+    sum += value;
+  }
+  ASSERT_EQ(4 * COUNTER_OPS, sum);
+  ASSERT_TRUE(dict_get_value(&d, "total", &value));
+  ASSERT_EQ(4 * 2 * (COUNTER_OPS / 3), value);
+
+  // 8-byte values round-trip through an image
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/dict-tests-%d.long", (int)getpid());
+  ASSERT_TRUE(dict_save(&d, path));
+  dict_destroy(&d);
+  ASSERT_TRUE(dict_load_mmap(&d, path));
+  ASSERT_EQ(sizeof(long), d.value_size);
+  ASSERT_TRUE(dict_get_value(&d, "total", &value));
+  ASSERT_EQ(4 * 2 * (COUNTER_OPS / 3), value);
+  long one = 1;
+  dict_update(&d, "total", add_long, &one);
+  ASSERT_TRUE(dict_get_value(&d, "total", &value));
+  ASSERT_EQ(4 * 2 * (COUNTER_OPS / 3) + 1, value);
+
+  // clean up
+  dict_destroy(&d);
+  unlink(path);
+}
+
+// Cached lookups return what the tree holds, and writes invalidate them
+TEST(DictionaryTest, HotKeyCache) {
+  my_dict_t d;
+  dict_init(&d);
+  dict_cache_stats_t stats;
+  dict_cache_stats(&d, &stats);
+  ASSERT_EQ(0u, stats.entries);
+  dict_enable_cache(&d, 100);
+
+  char key[16];
+  for (int i = 0; i < 1000; i++) {
+    snprintf(key, sizeof(key), "key%04d", i);
+    dict_set(&d, key, i);
+  }
+  // a skewed workload: key0000 to key0009 are read over and over
+  for (int round = 0; round < 100; round++) {
+    for (int i = 0; i < 10; i++) {
+      snprintf(key, sizeof(key), "key%04d", i);
+      ASSERT_EQ(i, dict_get(&d, key));
+    }
+  }
+  dict_cache_stats(&d, &stats);
+  ASSERT_EQ(128u, stats.entries);
+  ASSERT_EQ(1000u, stats.hits + stats.misses);
+  ASSERT_GT(stats.hits, 900u);
+
+  // every kind of write is seen by the next lookup
+  dict_set(&d, "key0001", -1);
+  ASSERT_EQ(-1, dict_get(&d, "key0001"));
+  int value = 0;
+  ASSERT_TRUE(dict_get_value(&d, "key0001", &value));
+  ASSERT_EQ(-1, value);
+  dict_remove(&d, "key0002");
+  ASSERT_FALSE(dict_contains(&d, "key0002"));
+  ASSERT_EQ(-1, dict_get(&d, "key0002"));
+  const char *keys[2] = {"key0003", "key0002"};
+  int values[2] = {33, 22};
+  dict_set_many(&d, keys, values, 2);
+  ASSERT_EQ(33, dict_get(&d, "key0003"));
+  ASSERT_EQ(22, dict_get(&d, "key0002"));
+  int expected = 4, desired = 44;
+  ASSERT_TRUE(dict_cas(&d, "key0004", &expected, &desired));
+  ASSERT_EQ(44, dict_get(&d, "key0004"));
+  dict_cache_stats(&d, &stats);
+  ASSERT_GE(stats.invalidations, 5u);
+
+  // keys that share an entry evict each other without mixing up their values
+  for (int i = 0; i < 1000; i++) {
+    snprintf(key, sizeof(key), "key%04d", i);
+    if (i > 4) {
+      ASSERT_EQ(i, dict_get(&d, key));
+    }
+  }
+
+  // clean up
+  dict_destroy(&d);
+}
+
+#define HOT_WRITES 20000
+
+typedef struct hot_reader_args {
+  my_dict_t *d;
+  bool done;
+  int went_back;
+} hot_reader_args_t;
+
+/**
+ * @brief  Read a counter that only goes up, checking it never goes back
+ * @note
+ * @param  *arg: hot_reader_args_t
+ * @retval None
+ */
+void *hot_reader_run(void *arg) {
+  hot_reader_args_t *args = (hot_reader_args_t *)arg;
+  int last = -1;
+  while (!__atomic_load_n(&args->done, __ATOMIC_SEQ_CST)) {
+    int value = dict_get(args->d, "hot");
+    if (value < last)
+      args->went_back++;
+    last = value;
+    dict_get(args->d, "cold");
+  }
+  return NULL;
+}
+
+// Readers filling the cache race with writers invalidating it, and never see
+// a value older than one they saw before
+TEST(DictionaryTest, CacheReadersDuringWrites) {
+  my_dict_t d;
+  dict_init(&d);
+  dict_enable_cache(&d, 16);
+  dict_set(&d, "hot", 0);
+  dict_set(&d, "cold", 0);
+
+  hot_reader_args_t args[2] = {{&d, false, 0}, {&d, false, 0}};
+  pthread_t readers[2];
+  for (int i = 0; i < 2; i++) {
+    if (pthread_create(&readers[i], NULL, hot_reader_run, &args[i]) != 0)
+      perror("Error creating thread");
+  }
+  for (int i = 1; i <= HOT_WRITES; i++) {
+    dict_set(&d, "hot", i);
+    if (i % 100 == 0)
+      sched_yield();
+  }
+  for (int i = 0; i < 2; i++) {
+    __atomic_store_n(&args[i].done, true, __ATOMIC_SEQ_CST);
+    if (pthread_join(readers[i], NULL) != 0)
+      perror("Error joining thread");
+  }
+  ASSERT_EQ(0, args[0].went_back);
+  ASSERT_EQ(0, args[1].went_back);
+  ASSERT_EQ(HOT_WRITES, dict_get(&d, "hot"));
+
+  // clean up
+  dict_destroy(&d);
+}
@@ -1,39 +1,580 @@
 #include "dict.hh"
 
+#include <fcntl.h>
 #include <pthread.h>
-#include <semaphore.h>
+#include <sched.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+// Cache counter slot of the calling thread, assigned round-robin on first use
+static __thread int cache_slot = -1;
+static int next_cache_slot = 0;
 
-// Code and function for reader-writer lock from Operating Systems: Three Easy Pieces by Remzi H. Arpaci-Dusseau and Andrea C. Arpaci-Dusseau
+// Operations the instrumentation times
+enum {
+  DICT_OP_GET,
+  DICT_OP_SET,
+  DICT_OP_UPDATE,
+  DICT_OP_REMOVE,
+  DICT_OP_GET_MANY,
+  DICT_OP_SET_MANY,
+  DICT_OP_SCAN,
+  DICT_NUM_OPS
+};
+#ifdef INSTRUMENT
+static const char *const dict_op_names[DICT_NUM_OPS] = {"get", "set", "update", "remove", "get_many", "set_many", "scan"};
+#endif
 
-void rwlock_init(rwlock_t *rw) {
-  rw->readers = 0;
-  sem_init(&rw->lock, 0, 1);
-  sem_init(&rw->writelock, 0, 1);
+// A key being looked up, described the same way as a stored key
+typedef struct key_probe {
+  const char *str;
+  size_t len;
+  uint64_t prefix;
+} key_probe_t;
+
+/**
+ * @brief  Describe a caller's key for comparisons
+ * @note   
+ * @param  *key: NUL-terminated key
+ * @retval the key's length and big-endian, zero-padded first eight bytes
+ */
+static key_probe_t make_probe(const char *key) {
+  key_probe_t probe;
+  probe.str = key;
+  probe.prefix = 0;
+  size_t len = 0;
+  for (; len < 8 && key[len] != '\0'; len++)
+    probe.prefix |= (uint64_t)(unsigned char)key[len] << (56 - 8 * len);
+  probe.len = len + strlen(key + len);
+  return probe;
+}
+
+/**
+ * @brief  Describe a stored key for comparisons
+ * @note   
+ * @param  *key: key owned by the dictionary
+ * @retval the key's probe
+ */
+static key_probe_t probe_of(const dict_key_t *key) {
+  key_probe_t probe;
+  probe.str = dict_key_str(key);
+  probe.len = key->len;
+  probe.prefix = key->prefix;
+  return probe;
+}
+
+/**
+ * @brief  Compare two probes, in strcmp order
+ * @note   Only keys sharing their first eight bytes have their bytes compared
+ * @param  *a: first key
+ * @param  *b: second key
+ * @retval negative, zero or positive like strcmp
+ */
+static int probe_compare(const key_probe_t *a, const key_probe_t *b) {
+  if (a->prefix != b->prefix)
+    return a->prefix < b->prefix ? -1 : 1;
+  // equal prefixes: a key of at most eight bytes is a prefix of the other key
+  if (a->len > 8 && b->len > 8) {
+    size_t n = a->len < b->len ? a->len : b->len;
+    int cmp = memcmp(a->str + 8, b->str + 8, n - 8);
+    if (cmp != 0)
+      return cmp;
+  }
+  return (a->len > b->len) - (a->len < b->len);
+}
+
+/**
+ * @brief  Compare a probe with a stored key, in strcmp order
+ * @note   The stored key is only dereferenced when the prefixes are equal
+ * @param  *probe: key being looked up
+ * @param  prefix: prefix of the stored key, as copied into the node
+ * @param  *key: stored key
+ * @retval negative, zero or positive like strcmp
+ */
+static int key_compare(const key_probe_t *probe, uint64_t prefix, const dict_key_t *key) {
+  if (probe->prefix != prefix)
+    return probe->prefix < prefix ? -1 : 1;
+  key_probe_t stored = probe_of(key);
+  return probe_compare(probe, &stored);
+}
+
+/**
+ * @brief  Hash the bytes of a key with 64-bit FNV-1a
+ * @note   
+ * @param  *str: bytes to hash
+ * @param  len: number of bytes
+ * @retval the hash
+ */
+static uint64_t hash_bytes(const char *str, size_t len) {
+  uint64_t hash = 14695981039346656037UL;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= (unsigned char)str[i];
+    hash *= 1099511628211UL;
+  }
+  return hash;
+}
+
+/**
+ * @brief  Allocate memory for a key from the arena
+ * @note   Called under the writer lock. Arena memory is only freed with the dictionary.
+ * @param  *keys: key storage of the dictionary
+ * @param  *alloc: allocator for new chunks
+ * @param  size: number of bytes
+ * @retval pointer to 8-byte aligned memory
+ */
+static void *arena_alloc(dict_keys_t *keys, const dict_allocator_t *alloc, size_t size) {
+  size = (size + 7) & ~(size_t)7;
+  dict_arena_chunk_t *chunk = keys->chunks;
+  if (chunk == NULL || chunk->size - chunk->used < size) {
+    size_t data = size > DICT_ARENA_CHUNK ? size : DICT_ARENA_CHUNK;
+    chunk = (dict_arena_chunk_t *)alloc->alloc_fn(sizeof(dict_arena_chunk_t) + data, alloc->arg);
+    chunk->size = data;
+    chunk->used = 0;
+    chunk->next = keys->chunks;
+    keys->chunks = chunk;
+  }
+  void *ptr = (char *)(chunk + 1) + chunk->used;
+  chunk->used += size;
+  return ptr;
+}
+
+/**
+ * @brief  Make room for one more key in the intern table
+ * @note   Keeps the open-addressed table at most half full
+ * @param  *keys: key storage of the dictionary
+ * @retval None
+ */
+static void intern_reserve(dict_keys_t *keys) {
+  if (keys->count * 2 >= keys->capacity) {
+    size_t capacity = keys->capacity == 0 ? 64 : keys->capacity * 2;
+    dict_key_t **table = (dict_key_t **)calloc(capacity, sizeof(dict_key_t *));
+    for (size_t i = 0; i < keys->capacity; i++) {
+      if (keys->table[i] == NULL)
+        continue;
+      size_t j = keys->table[i]->hash & (capacity - 1);
+      while (table[j] != NULL)
+        j = (j + 1) & (capacity - 1);
+      table[j] = keys->table[i];
+    }
+    free(keys->table);
+    keys->table = table;
+    keys->capacity = capacity;
+  }
+}
+
+/**
+ * @brief  Add a key known not to be in the intern table yet
+ * @note   Called under the writer lock
+ * @param  *keys: key storage of the dictionary
+ * @param  *key: key to add
+ * @retval None
+ */
+static void intern_add(dict_keys_t *keys, dict_key_t *key) {
+  intern_reserve(keys);
+  size_t i = key->hash & (keys->capacity - 1);
+  while (keys->table[i] != NULL)
+    i = (i + 1) & (keys->capacity - 1);
+  keys->table[i] = key;
+  keys->count++;
+}
+
+/**
+ * @brief  Find the dictionary's copy of a key, copying it into the arena if there is none
+ * @note   Called under the writer lock
+ * @param  *keys: key storage of the dictionary
+ * @param  *alloc: allocator for the arena
+ * @param  *probe: key to intern
+ * @retval the dictionary's copy of the key
+ */
+static const dict_key_t *intern_key(dict_keys_t *keys, const dict_allocator_t *alloc, const key_probe_t *probe) {
+  intern_reserve(keys);
+  uint64_t hash = hash_bytes(probe->str, probe->len);
+  size_t i = hash & (keys->capacity - 1);
+  while (keys->table[i] != NULL) {
+    dict_key_t *key = keys->table[i];
+    if (key->hash == hash && key->len == probe->len && memcmp(dict_key_str(key), probe->str, probe->len) == 0)
+      return key;
+    i = (i + 1) & (keys->capacity - 1);
+  }
+
+  dict_key_t *key = (dict_key_t *)arena_alloc(keys, alloc, sizeof(dict_key_t) + probe->len + 1);
+  key->hash = hash;
+  key->len = probe->len;
+  key->prefix = probe->prefix;
+  memcpy((char *)(key + 1), probe->str, probe->len + 1);
+  keys->table[i] = key;
+  keys->count++;
+  return key;
+}
+
+/**
+ * @brief  Free every key of a dictionary at once
+ * @note   
+ * @param  *keys: key storage of the dictionary
+ * @param  *alloc: allocator the arena came from
+ * @retval None
+ */
+static void keys_destroy(dict_keys_t *keys, const dict_allocator_t *alloc) {
+  dict_arena_chunk_t *chunk = keys->chunks;
+  while (chunk != NULL) {
+    dict_arena_chunk_t *next = chunk->next;
+    alloc->free_fn(chunk);
+    chunk = next;
+  }
+  free(keys->table);
+  keys->chunks = NULL;
+  keys->table = NULL;
+  keys->capacity = 0;
+  keys->count = 0;
+}
+
+/****** Snapshot images ******/
+
+// A snapshot file holds a header, the entries sorted by key, then the key
+// records. Each key record is a dict_key_t followed by its NUL-terminated
+// bytes, padded to 8 bytes, exactly as the arena stores it, so a mapped image
+// can be searched and its keys shared with the tree in place. All offsets are
+// relative, so the file can be mapped anywhere. Integers are in native byte
+// order.
+#define IMAGE_MAGIC "DICTIMG2"
+
+typedef struct image_header {
+  char magic[8];
+  uint64_t value_size;   // at most the size of a value slot
+  uint64_t count;        // number of entries
+  uint64_t keys_offset;  // file offset of the key records
+  uint64_t size;         // size of the whole file
+} image_header_t;
+
+typedef struct image_entry {
+  uint64_t prefix;      // copy of the key's prefix, so searches stay in the entry array
+  uint64_t key_offset;  // offset of the key record from the first key record
+  dict_value_t value;
+} image_entry_t;
+
+typedef struct dict_image {
+  void *map;
+  size_t size;
+  const image_entry_t *entries;
+  size_t count;
+  const char *keys;
+} dict_image_t;
+
+/**
+ * @brief  Get the key record of an image entry
+ * @note   
+ * @param  *image: mapped image
+ * @param  i: index of the entry
+ * @retval the key
+ */
+static const dict_key_t *image_key(const dict_image_t *image, size_t i) {
+  return (const dict_key_t *)(image->keys + image->entries[i].key_offset);
 }
 
-void rwlock_acquire_readlock(rwlock_t *rw) {
-  sem_wait(&rw->lock);
-  rw->readers++;
-  if (rw->readers == 1)
-    sem_wait(&rw->writelock);
-  sem_post(&rw->lock);
+/**
+ * @brief  Binary search for the first entry of an image not below a key
+ * @note   
+ * @param  *image: mapped image
+ * @param  lo: first entry to consider
+ * @param  *probe: key to look for
+ * @param  *found: set to whether that entry holds the key
+ * @retval index of the entry, or the entry count if every key is smaller
+ */
+static size_t image_find(const dict_image_t *image, size_t lo, const key_probe_t *probe, bool *found) {
+  size_t hi = image->count;
+  *found = false;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    int cmp = key_compare(probe, image->entries[mid].prefix, image_key(image, mid));
+    if (cmp == 0) {
+      *found = true;
+      return mid;
+    } else if (cmp < 0) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  return lo;
+}
+
+/**
+ * @brief  Unmap an image and free its descriptor
+ * @note   
+ * @param  *image: image to unmap
+ * @retval None
+ */
+static void image_unmap(dict_image_t *image) {
+  munmap(image->map, image->size);
+  free(image);
 }
 
-void rwlock_release_readlock(rwlock_t *rw) {
-  sem_wait(&rw->lock);
-  rw->readers--;
-  if (rw->readers == 0)
-    sem_post(&rw->writelock);
-  sem_post(&rw->lock);
+/**
+ * @brief  Store a value in a slot
+ * @note   Values larger than a slot are copied to the heap
+ * @param  *dict: dictionary the value belongs to
+ * @param  *value: value_size bytes to store
+ * @retval the slot
+ */
+static dict_value_t value_encode(const my_dict_t *dict, const void *value) {
+  dict_value_t slot = 0;
+  if (dict->value_size <= sizeof(dict_value_t)) {
+    memcpy(&slot, value, dict->value_size);
+  } else {
+    void *copy = dict->alloc.alloc_fn(dict->value_size, dict->alloc.arg);
+    memcpy(copy, value, dict->value_size);
+    slot = (dict_value_t)(uintptr_t)copy;
+  }
+  return slot;
 }
 
-void rwlock_acquire_writelock(rwlock_t *rw) { sem_wait(&rw->writelock); }
+/**
+ * @brief  Get the bytes of a stored value
+ * @note   
+ * @param  *dict: dictionary the value belongs to
+ * @param  *slot: slot holding the value
+ * @retval pointer to value_size bytes
+ */
+static const void *value_bytes(const my_dict_t *dict, const dict_value_t *slot) {
+  return dict->value_size <= sizeof(dict_value_t) ? (const void *)slot : (const void *)(uintptr_t)*slot;
+}
 
-void rwlock_release_writelock(rwlock_t *rw) { sem_post(&rw->writelock); }
+/**
+ * @brief  Let go of a value that is being replaced or removed
+ * @note   Called under the writer lock. The value may still be reachable from
+ *         the published tree, so it is only retired once the write has
+ *         published its new root, like the nodes it replaced.
+ * @param  *dict: dictionary the value belongs to
+ * @param  slot: slot that held the value
+ * @retval None
+ */
+static void value_release(my_dict_t *dict, dict_value_t slot) {
+  if (dict->value_size <= sizeof(dict_value_t))
+    return;
+  value_list_t *list = &dict->stale_values;
+  if (list->count == list->capacity) {
+    list->capacity = list->capacity == 0 ? 32 : list->capacity * 2;
+    list->values = (void **)realloc(list->values, list->capacity * sizeof(void *));
+  }
+  list->values[list->count++] = (void *)(uintptr_t)slot;
+}
+
+/**
+ * @brief  Get the calling thread's counters in a cache
+ * @note   
+ * @param  *cache: cache being used
+ * @retval the counters
+ */
+static dict_cache_counters_t *cache_counters(dict_cache_t *cache) {
+  if (cache_slot == -1)
+    cache_slot = __atomic_fetch_add(&next_cache_slot, 1, __ATOMIC_RELAXED) % DICT_CACHE_STAT_SLOTS;
+  return &cache->counters[cache_slot];
+}
+
+/**
+ * @brief  Look a key up in the cache
+ * @note   Called inside an epoch section, so a large value the entry points to
+ *         is still allocated. A hit needs an entry that did not change while
+ *         it was copied.
+ * @param  *cache: cache to search
+ * @param  *probe: key to look for
+ * @param  hash: hash of the key
+ * @param  *seq: set to the entry's version, to fill it with after a miss
+ * @param  *value: set to the cached slot on a hit
+ * @retval whether the key was found
+ */
+static bool cache_lookup(dict_cache_t *cache, const key_probe_t *probe, uint64_t hash, uint64_t *seq,
+                         dict_value_t *value) {
+  dict_cache_entry_t *entry = &cache->entries[hash & cache->mask];
+  *seq = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+  if ((*seq & 1) != 0)
+    return false;
+  // acquire loads keep the second look at seq after them, and see seq odd if
+  // they see a fill's stores
+  uint64_t entry_hash = __atomic_load_n(&entry->hash, __ATOMIC_ACQUIRE);
+  const dict_key_t *key = __atomic_load_n(&entry->key, __ATOMIC_ACQUIRE);
+  dict_value_t slot = __atomic_load_n(&entry->value, __ATOMIC_ACQUIRE);
+  if (__atomic_load_n(&entry->seq, __ATOMIC_RELAXED) != *seq)
+    return false;
+  // keys live until the dictionary is destroyed, so even a key that has since
+  // been removed can be compared
+  if (key == NULL || entry_hash != hash || key->len != probe->len ||
+      memcmp(dict_key_str(key), probe->str, probe->len) != 0)
+    return false;
+  *value = slot;
+  return true;
+}
+
+/**
+ * @brief  Remember the entry a lookup found in the tree
+ * @note   Called inside the same epoch section as the lookup. Gives up if a
+ *         writer locked the entry since seq was read, since the tree may have
+ *         been older than that write.
+ * @param  *cache: cache to fill
+ * @param  seq: version of the entry read before the lookup
+ * @param  hash: hash of the key
+ * @param  *key: the dictionary's copy of the key
+ * @param  value: slot holding the key's value
+ * @retval None
+ */
+static void cache_fill(dict_cache_t *cache, uint64_t seq, uint64_t hash, const dict_key_t *key, dict_value_t value) {
+  dict_cache_entry_t *entry = &cache->entries[hash & cache->mask];
+  if ((seq & 1) != 0 ||
+      !__atomic_compare_exchange_n(&entry->seq, &seq, seq + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+    return;
+  __atomic_store_n(&entry->hash, hash, __ATOMIC_RELEASE);
+  __atomic_store_n(&entry->key, key, __ATOMIC_RELEASE);
+  __atomic_store_n(&entry->value, value, __ATOMIC_RELEASE);
+  __atomic_store_n(&entry->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief  Order two cache entry indices
+ * @note   
+ * @param  *a: first index
+ * @param  *b: second index
+ * @retval negative, zero or positive like strcmp
+ */
+static int index_compare(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief  Lock and empty the cache entries of the keys the write in progress changed
+ * @note   Called under the writer lock before the new root is published.
+ *         Until cache_unlock, lookups of those keys go to the tree and nothing
+ *         fills their entries, and a lookup that read an entry's version before
+ *         it was locked cannot fill it afterwards.
+ * @param  *dict: dictionary being written
+ * @retval None
+ */
+static void cache_lock(my_dict_t *dict) {
+  dict_cache_t *cache = dict->cache;
+  dict_hashes_t *touched = &dict->touched;
+  if (cache == NULL || touched->count == 0)
+    return;
+  // several keys can share an entry, and it must only be locked once
+  for (int i = 0; i < touched->count; i++)
+    touched->hashes[i] &= cache->mask;
+  qsort(touched->hashes, touched->count, sizeof(uint64_t), index_compare);
+  int count = 0;
+  for (int i = 0; i < touched->count; i++) {
+    if (count == 0 || touched->hashes[count - 1] != touched->hashes[i])
+      touched->hashes[count++] = touched->hashes[i];
+  }
+  touched->count = count;
+
+  for (int i = 0; i < count; i++) {
+    dict_cache_entry_t *entry = &cache->entries[touched->hashes[i]];
+    uint64_t seq = __atomic_load_n(&entry->seq, __ATOMIC_RELAXED);
+    while (true) {
+      // a reader filling the entry is done after three stores, unless it was preempted
+      if ((seq & 1) != 0) {
+        sched_yield();
+        seq = __atomic_load_n(&entry->seq, __ATOMIC_RELAXED);
+      } else if (__atomic_compare_exchange_n(&entry->seq, &seq, seq + 1, false, __ATOMIC_SEQ_CST,
+                                             __ATOMIC_RELAXED)) {
+        break;
+      }
+    }
+    __atomic_store_n(&entry->key, (const dict_key_t *)NULL, __ATOMIC_RELEASE);
+  }
+  __atomic_store_n(&cache->invalidations, cache->invalidations + count, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief  Unlock the entries cache_lock locked
+ * @note   Called under the writer lock once the new root is published, so
+ *         lookups that fill the entries from now on find the new tree
+ * @param  *dict: dictionary being written
+ * @retval None
+ */
+static void cache_unlock(my_dict_t *dict) {
+  dict_cache_t *cache = dict->cache;
+  dict_hashes_t *touched = &dict->touched;
+  if (cache == NULL)
+    return;
+  for (int i = 0; i < touched->count; i++)
+    __atomic_add_fetch(&cache->entries[touched->hashes[i]].seq, 1, __ATOMIC_RELEASE);
+  touched->count = 0;
+}
+
+/**
+ * @brief  Note that the write in progress changes a key
+ * @note   Called under the writer lock
+ * @param  *dict: dictionary being written
+ * @param  *probe: key being changed
+ * @retval None
+ */
+static void cache_touch(my_dict_t *dict, const key_probe_t *probe) {
+  if (dict->cache == NULL)
+    return;
+  dict_hashes_t *touched = &dict->touched;
+  if (touched->count == touched->capacity) {
+    touched->capacity = touched->capacity == 0 ? 32 : touched->capacity * 2;
+    touched->hashes = (uint64_t *)realloc(touched->hashes, touched->capacity * sizeof(uint64_t));
+  }
+  touched->hashes[touched->count++] = hash_bytes(probe->str, probe->len);
+}
+
+/**
+ * @brief  Add a hot-key cache to a dictionary
+ * @note   
+ * @param  *dict: dictionary to cache
+ * @param  entries: minimum number of entries
+ * @retval None
+ */
+void dict_enable_cache(my_dict_t *dict, size_t entries) {
+  size_t capacity = 1;
+  while (capacity < entries)
+    capacity *= 2;
+  dict_cache_t *cache;
+  if (posix_memalign((void **)&cache, 64, sizeof(dict_cache_t)) != 0 ||
+      posix_memalign((void **)&cache->entries, 64, capacity * sizeof(dict_cache_entry_t)) != 0)
+    return;
+  memset(cache->counters, 0, sizeof(cache->counters));
+  memset(cache->entries, 0, capacity * sizeof(dict_cache_entry_t));
+  cache->mask = capacity - 1;
+  cache->invalidations = 0;
+  dict->cache = cache;
+}
+
+/**
+ * @brief  Get the counters of a dictionary's cache
+ * @note   
+ * @param  *dict: dictionary
+ * @param  *stats: filled in with the counters
+ * @retval None
+ */
+void dict_cache_stats(my_dict_t *dict, dict_cache_stats_t *stats) {
+  memset(stats, 0, sizeof(*stats));
+  dict_cache_t *cache = dict->cache;
+  if (cache == NULL)
+    return;
+  stats->entries = cache->mask + 1;
+  for (int i = 0; i < DICT_CACHE_STAT_SLOTS; i++) {
+    stats->hits += __atomic_load_n(&cache->counters[i].hits, __ATOMIC_RELAXED);
+    stats->misses += __atomic_load_n(&cache->counters[i].misses, __ATOMIC_RELAXED);
+  }
+  stats->invalidations = __atomic_load_n(&cache->invalidations, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief  Default allocator of a dictionary
+ * @note   
+ * @param  size: number of bytes
+ * @param  *arg: unused
+ * @retval the memory, from malloc
+ */
+static void *heap_alloc(size_t size, void *arg) {
+  return malloc(size);
+}
 
 /**
  * @brief  Initialize the dictionary
@@ -42,31 +583,86 @@ void rwlock_release_writelock(rwlock_t *rw) { sem_post(&rw->writelock); }
  * @retval None
  */
 void dict_init(my_dict_t *dict) {
-  // set the root to NULL and intialize the reader-writer lock
+  dict_init_typed(dict, sizeof(int));
+}
+
+/**
+ * @brief  Initialize a dictionary with values of a given size
+ * @note   
+ * @param  *dict: dictionary to initialize
+ * @param  value_size: size of every value in bytes
+ * @retval None
+ */
+void dict_init_typed(my_dict_t *dict, size_t value_size) {
+  // set the root to NULL and intialize the epoch domain and the writer lock
   dict->root = NULL;
-  rwlock_init(&dict->rwlock);
+  dict->value_size = value_size;
+  epoch_init(&dict->epoch);
+  pthread_mutex_init(&dict->write_lock, NULL);
+  dict->keys.chunks = NULL;
+  dict->keys.table = NULL;
+  dict->keys.capacity = 0;
+  dict->keys.count = 0;
+  dict->image = NULL;
+  dict->snapshot = NULL;
+  dict->next_root = NULL;
+  dict->fresh.nodes = NULL;
+  dict->fresh.count = dict->fresh.capacity = 0;
+  dict->stale.nodes = NULL;
+  dict->stale.count = dict->stale.capacity = 0;
+  dict->stale_values.values = NULL;
+  dict->stale_values.count = dict->stale_values.capacity = 0;
+  dict->touched.hashes = NULL;
+  dict->touched.count = dict->touched.capacity = 0;
+  dict->cache = NULL;
+  dict->alloc.alloc_fn = heap_alloc;
+  dict->alloc.free_fn = free;
+  dict->alloc.arg = NULL;
+  INSTRUMENT_INIT(&dict->instrument, "dict", dict_op_names, DICT_NUM_OPS);
 }
 
 /**
- * @brief  Helper function to destroy a dictionary
+ * @brief  Make a dictionary allocate its memory with a custom allocator
  * @note   
+ * @param  *dict: empty dictionary
+ * @param  *alloc: allocator to use from now on
+ * @retval None
+ */
+void dict_set_allocator(my_dict_t *dict, const dict_allocator_t *alloc) {
+  dict->alloc = *alloc;
+}
+
+/**
+ * @brief  Helper function to destroy a dictionary
+ * @note   Post-order walk with an explicit stack, so it needs no call stack
+ *         however many keys the tree holds
+ * @param  *dict: dictionary being destroyed
  * @param  *node: pointer to the root node of the dictionary
- * @retval pointer to a new node - used for recursion
+ * @retval None
  */
-node_t *dict_destroy_helper(node_t *node) {
-  // if the node is null, return this node
+void dict_destroy_helper(my_dict_t *dict, node_t *node) {
   if (node == NULL)
-    return node;
-  else {
-    // call this function recursively for each subtree
-    if (node->right != NULL)
-      node->right = dict_destroy_helper(node->right);
-    if (node->left != NULL)
-      node->left = dict_destroy_helper(node->left);
-    // free current node
-    free(node);
+    return;
+  node_t *path[DICT_MAX_HEIGHT];
+  int next_child[DICT_MAX_HEIGHT];
+  int depth = 0;
+  path[0] = node;
+  next_child[0] = 0;
+  while (depth >= 0) {
+    node = path[depth];
+    // free a node once every subtree below it is gone
+    if (node->leaf || next_child[depth] > node->num_keys) {
+      if (dict->value_size > sizeof(dict_value_t)) {
+        for (int i = 0; i < node->num_keys; i++)
+          dict->alloc.free_fn((void *)(uintptr_t)node->values[i]);
+      }
+      dict->alloc.free_fn(node);
+      depth--;
+      continue;
+    }
+    path[depth + 1] = node->children[next_child[depth]++];
+    next_child[++depth] = 0;
   }
-  return node;
 }
 
 /**
@@ -76,57 +672,502 @@ node_t *dict_destroy_helper(node_t *node) {
  * @retval None
  */
 void dict_destroy(my_dict_t *dict) {
-  // acquire the writelock, destroy and release the writelock
-  rwlock_acquire_writelock(&dict->rwlock);
-  dict->root = dict_destroy_helper(dict->root);
-  rwlock_release_writelock(&dict->rwlock);
+  // acquire the writer lock, destroy the tree, everything waiting to be
+  // reclaimed and all the keys, and release the writer lock
+  pthread_mutex_lock(&dict->write_lock);
+  dict_destroy_helper(dict, dict->root);
+  dict->root = NULL;
+  epoch_destroy(&dict->epoch);
+  keys_destroy(&dict->keys, &dict->alloc);
+  if (dict->snapshot != NULL)
+    image_unmap(dict->snapshot);
+  dict->image = dict->snapshot = NULL;
+  free(dict->fresh.nodes);
+  free(dict->stale.nodes);
+  dict->fresh.nodes = dict->stale.nodes = NULL;
+  dict->fresh.capacity = dict->stale.capacity = 0;
+  free(dict->stale_values.values);
+  dict->stale_values.values = NULL;
+  dict->stale_values.capacity = 0;
+  free(dict->touched.hashes);
+  dict->touched.hashes = NULL;
+  dict->touched.capacity = 0;
+  if (dict->cache != NULL) {
+    free(dict->cache->entries);
+    free(dict->cache);
+    dict->cache = NULL;
+  }
+  pthread_mutex_unlock(&dict->write_lock);
+}
+
+/**
+ * @brief  Append a node to a node list
+ * @note   
+ * @param  *list: list to append to
+ * @param  *node: node to append
+ * @retval None
+ */
+static void node_list_push(node_list_t *list, node_t *node) {
+  if (list->count == list->capacity) {
+    list->capacity = list->capacity == 0 ? 32 : list->capacity * 2;
+    list->nodes = (node_t **)realloc(list->nodes, list->capacity * sizeof(node_t *));
+  }
+  list->nodes[list->count++] = node;
 }
 
 /**
- * @brief  Make new node with given key and value
- * @note  
- * @param  *key: Key for the new node
- * @param  value:  Value for the new node
+ * @brief  Size of a node's allocation
+ * @note   Leaves are allocated without the trailing child array
+ * @param  leaf: whether the node is a leaf
+ * @retval size in bytes
+ */
+static size_t node_size(bool leaf) {
+  return leaf ? offsetof(node_t, children) : sizeof(node_t);
+}
+
+/**
+ * @brief  Make a new, empty B-tree node for the write in progress
+ * @note   
+ * @param  *dict: dictionary being written
+ * @param  leaf: whether the new node is a leaf
  * @retval pointer to the new node
  */
-node_t *makeNode(const char *key, int value) {
-  // allocate space for the new node and assign the right values
-  node_t *newNode = (node_t *)malloc(sizeof(node_t));
-  newNode->key = key;
-  newNode->value = value;
-  newNode->left = NULL;
-  newNode->right = NULL;
+static node_t *makeNode(my_dict_t *dict, bool leaf) {
+  node_t *newNode = (node_t *)dict->alloc.alloc_fn(node_size(leaf), dict->alloc.arg);
+  newNode->num_keys = 0;
+  newNode->leaf = leaf;
+  newNode->published = false;
+  node_list_push(&dict->fresh, newNode);
   return newNode;
 }
 
 /**
- * @brief  Helper function to add a value to a dictionary
- * @note Citation: https://www.geeksforgeeks.org/binary-search-tree-set-1-search-and-insertion/
- * @param  *node: node to which the new entry is to be added
+ * @brief  Drop a node from the tree being written
+ * @note   Published nodes may still be in use by readers, so they are retired
+ *         after the new root is published; unpublished ones are freed then too
+ * @param  *dict: dictionary being written
+ * @param  *node: node to drop
+ * @retval None
+ */
+static void discard(my_dict_t *dict, node_t *node) {
+  if (node->published)
+    node_list_push(&dict->stale, node);
+  else
+    node->num_keys = -1;
+}
+
+/**
+ * @brief  Get a version of a node the write in progress may modify
+ * @note   The caller links the returned node in place of the original
+ * @param  *dict: dictionary being written
+ * @param  *node: node about to be modified
+ * @retval the node itself if this write created it, otherwise a private copy
+ */
+static node_t *writable(my_dict_t *dict, node_t *node) {
+  if (!node->published)
+    return node;
+  node_t *copy = makeNode(dict, node->leaf);
+  memcpy(copy, node, node_size(node->leaf));
+  copy->published = false;
+  discard(dict, node);
+  return copy;
+}
+
+/**
+ * @brief  Binary search for a key within a single node
+ * @note   
+ * @param  *node: node to search
+ * @param  *probe: key to look for
+ * @param  *found: set to whether the key is stored in this node
+ * @retval index of the key if found, otherwise the index of the child to descend into
+ */
+static int node_find(const node_t *node, const key_probe_t *probe, bool *found) {
+  int lo = 0;
+  int hi = node->num_keys;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    int cmp = key_compare(probe, node->prefixes[mid], node->keys[mid]);
+    if (cmp == 0) {
+      *found = true;
+      return mid;
+    } else if (cmp < 0) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  *found = false;
+  return lo;
+}
+
+/**
+ * @brief  Insert an entry into a node at the given position
+ * @note   The caller makes sure the node is not full and moves any children
+ * @param  *node: node to insert into
+ * @param  i: position of the new entry
  * @param  *key: key of the new entry
  * @param  value: value of the new entry
- * @retval pointer to a new node - used for recursion
+ * @retval None
+ */
+static void node_insert_at(node_t *node, int i, const dict_key_t *key, dict_value_t value) {
+  int after = node->num_keys - i;
+  memmove(&node->prefixes[i + 1], &node->prefixes[i], after * sizeof(node->prefixes[0]));
+  memmove(&node->keys[i + 1], &node->keys[i], after * sizeof(node->keys[0]));
+  memmove(&node->values[i + 1], &node->values[i], after * sizeof(node->values[0]));
+  node->prefixes[i] = key->prefix;
+  node->keys[i] = key;
+  node->values[i] = value;
+  node->num_keys++;
+}
+
+/**
+ * @brief  Remove the entry at the given position of a node
+ * @note   The caller moves any children
+ * @param  *node: node to remove from
+ * @param  i: position of the entry to remove
+ * @retval None
  */
-node_t *dict_set_helper(node_t *node, const char *key, int value) {
-  if (node == NULL) {
-    // If the current node is null, then make a new node at the current position.
-    node_t *newNode = makeNode(key, value);
-    return newNode;
+static void node_remove_at(node_t *node, int i) {
+  int after = node->num_keys - i - 1;
+  memmove(&node->prefixes[i], &node->prefixes[i + 1], after * sizeof(node->prefixes[0]));
+  memmove(&node->keys[i], &node->keys[i + 1], after * sizeof(node->keys[0]));
+  memmove(&node->values[i], &node->values[i + 1], after * sizeof(node->values[0]));
+  node->num_keys--;
+}
+
+/**
+ * @brief  Copy entries from one node to another
+ * @note   The ranges must not overlap
+ * @param  *dst: node to copy into
+ * @param  di: first position to copy into
+ * @param  *src: node to copy from
+ * @param  si: first position to copy from
+ * @param  n: number of entries
+ * @retval None
+ */
+static void copy_entries(node_t *dst, int di, const node_t *src, int si, int n) {
+  memcpy(&dst->prefixes[di], &src->prefixes[si], n * sizeof(dst->prefixes[0]));
+  memcpy(&dst->keys[di], &src->keys[si], n * sizeof(dst->keys[0]));
+  memcpy(&dst->values[di], &src->values[si], n * sizeof(dst->values[0]));
+}
+
+/**
+ * @brief  Build a tree holding every entry of an image
+ * @note   Called under the writer lock on the first write after loading. Builds
+ *         bottom up, one level at a time: each level is split into as few nodes
+ *         as fit, with the keys spread evenly between them and one key left
+ *         between neighbours to become a separator in the level above. The
+ *         tree shares the image's key records, which stay mapped until the
+ *         dictionary is destroyed.
+ * @param  *dict: dictionary being written
+ * @param  *image: mapped image
+ * @retval root of the new tree, or NULL if the image is empty
+ */
+static node_t *image_promote(my_dict_t *dict, const dict_image_t *image) {
+  size_t count = image->count;
+  if (count == 0)
+    return NULL;
+  const dict_key_t **keys = (const dict_key_t **)malloc(count * sizeof(dict_key_t *));
+  dict_value_t *values = (dict_value_t *)malloc(count * sizeof(dict_value_t));
+  for (size_t i = 0; i < count; i++) {
+    keys[i] = image_key(image, i);
+    values[i] = image->entries[i].value;
+    intern_add(&dict->keys, (dict_key_t *)keys[i]);
+  }
+
+  node_t **children = NULL;
+  while (true) {
+    // as few nodes as can hold the level, counting one separator between each pair
+    size_t num_nodes = (count + DICT_MAX_KEYS) / (DICT_MAX_KEYS + 1);
+    size_t per_node = count - (num_nodes - 1);
+    node_t **nodes = (node_t **)malloc(num_nodes * sizeof(node_t *));
+    size_t pos = 0;
+    size_t child = 0;
+    size_t separators = 0;
+    for (size_t j = 0; j < num_nodes; j++) {
+      int n = per_node / num_nodes + (j < per_node % num_nodes);
+      node_t *node = nodes[j] = makeNode(dict, children == NULL);
+      for (int k = 0; k < n; k++)
+        node_insert_at(node, k, keys[pos + k], values[pos + k]);
+      pos += n;
+      if (children != NULL) {
+        memcpy(node->children, &children[child], (n + 1) * sizeof(node_t *));
+        child += n + 1;
+      }
+      // the key after each node but the last moves up, into the front of the arrays
+      if (j + 1 < num_nodes) {
+        keys[separators] = keys[pos];
+        values[separators] = values[pos];
+        separators++;
+        pos++;
+      }
+    }
+    free(children);
+    children = nodes;
+    count = separators;
+    if (num_nodes == 1)
+      break;
+  }
+
+  node_t *root = children[0];
+  free(children);
+  free(keys);
+  free(values);
+  return root;
+}
+
+/**
+ * @brief  Start a write: take the writer lock and begin from the current root
+ * @note   
+ * @param  *dict: dictionary to write
+ * @retval None
+ */
+static void write_begin(my_dict_t *dict) {
+  INSTRUMENT_LOCK(&dict->instrument, &dict->write_lock);
+  dict->next_root = dict->root;
+  // a dictionary loaded from an image gets its tree on the first write
+  if (dict->image != NULL)
+    dict->next_root = image_promote(dict, dict->image);
+}
+
+/**
+ * @brief  Finish a write: publish the new root and hand replaced nodes and values to the epoch domain
+ * @note   
+ * @param  *dict: dictionary being written
+ * @retval None
+ */
+static void write_commit(my_dict_t *dict) {
+  for (int i = 0; i < dict->fresh.count; i++) {
+    node_t *node = dict->fresh.nodes[i];
+    if (node->num_keys == -1)
+      dict->alloc.free_fn(node);
+    else
+      node->published = true;
+  }
+  dict->fresh.count = 0;
+
+  // every node reachable from the new root is fully written before it is
+  // published, and no cached entry of a changed key outlives the old root
+  cache_lock(dict);
+  __atomic_store_n(&dict->root, dict->next_root, __ATOMIC_RELEASE);
+  // readers that stop using the image find the tree that replaced it
+  if (dict->image != NULL)
+    __atomic_store_n(&dict->image, NULL, __ATOMIC_RELEASE);
+  cache_unlock(dict);
+
+  for (int i = 0; i < dict->stale.count; i++)
+    epoch_retire(&dict->epoch, dict->stale.nodes[i], dict->alloc.free_fn);
+  dict->stale.count = 0;
+  for (int i = 0; i < dict->stale_values.count; i++)
+    epoch_retire(&dict->epoch, dict->stale_values.values[i], dict->alloc.free_fn);
+  dict->stale_values.count = 0;
+  epoch_reclaim(&dict->epoch);
+  INSTRUMENT_UNLOCK(&dict->instrument, &dict->write_lock);
+}
+
+/**
+ * @brief  Split the full i-th child of a node in two around its median
+ * @note   The parent must be writable and not full; the median entry moves up into it
+ * @param  *dict: dictionary being written
+ * @param  *parent: parent of the full child
+ * @param  i: index of the full child
+ * @retval None
+ */
+static void split_child(my_dict_t *dict, node_t *parent, int i) {
+  node_t *full = writable(dict, parent->children[i]);
+  node_t *right = makeNode(dict, full->leaf);
+  parent->children[i] = full;
+
+  // the upper half of the entries (and children) move to the new right node
+  right->num_keys = DICT_MIN_KEYS;
+  copy_entries(right, 0, full, DICT_MIN_KEYS + 1, DICT_MIN_KEYS);
+  if (!full->leaf)
+    memcpy(right->children, &full->children[DICT_MIN_KEYS + 1], (DICT_MIN_KEYS + 1) * sizeof(right->children[0]));
+  full->num_keys = DICT_MIN_KEYS;
+
+  // link the new node after the full one and move the median up
+  memmove(&parent->children[i + 2], &parent->children[i + 1], (parent->num_keys - i) * sizeof(parent->children[0]));
+  parent->children[i + 1] = right;
+  node_insert_at(parent, i, full->keys[DICT_MIN_KEYS], full->values[DICT_MIN_KEYS]);
+}
+
+/**
+ * @brief  Merge the i-th and (i+1)-th children of a node together with the entry between them
+ * @note   The parent must be writable and both children must hold the minimum number of entries
+ * @param  *dict: dictionary being written
+ * @param  *parent: parent of the two children
+ * @param  i: index of the left child
+ * @retval None
+ */
+static void merge_children(my_dict_t *dict, node_t *parent, int i) {
+  node_t *left = writable(dict, parent->children[i]);
+  node_t *right = parent->children[i + 1];
+  parent->children[i] = left;
+
+  // pull the separating entry down and append the right node to the left one
+  copy_entries(left, left->num_keys, parent, i, 1);
+  copy_entries(left, left->num_keys + 1, right, 0, right->num_keys);
+  if (!left->leaf)
+    memcpy(&left->children[left->num_keys + 1], right->children, (right->num_keys + 1) * sizeof(left->children[0]));
+  left->num_keys += right->num_keys + 1;
+
+  // drop the separating entry and the right child from the parent
+  node_remove_at(parent, i);
+  memmove(&parent->children[i + 1], &parent->children[i + 2], (parent->num_keys - i) * sizeof(parent->children[0]));
+  discard(dict, right);
+}
+
+/**
+ * @brief  Rotate one entry from the (i-1)-th child of a node into its i-th child
+ * @note   The parent must be writable
+ * @param  *dict: dictionary being written
+ * @param  *parent: parent of the two children
+ * @param  i: index of the child receiving the entry
+ * @retval None
+ */
+static void borrow_from_left(my_dict_t *dict, node_t *parent, int i) {
+  node_t *child = parent->children[i] = writable(dict, parent->children[i]);
+  node_t *sibling = parent->children[i - 1] = writable(dict, parent->children[i - 1]);
+
+  node_insert_at(child, 0, parent->keys[i - 1], parent->values[i - 1]);
+  if (!child->leaf) {
+    memmove(&child->children[1], &child->children[0], child->num_keys * sizeof(child->children[0]));
+    child->children[0] = sibling->children[sibling->num_keys];
+  }
+  copy_entries(parent, i - 1, sibling, sibling->num_keys - 1, 1);
+  sibling->num_keys--;
+}
+
+/**
+ * @brief  Rotate one entry from the (i+1)-th child of a node into its i-th child
+ * @note   The parent must be writable
+ * @param  *dict: dictionary being written
+ * @param  *parent: parent of the two children
+ * @param  i: index of the child receiving the entry
+ * @retval None
+ */
+static void borrow_from_right(my_dict_t *dict, node_t *parent, int i) {
+  node_t *child = parent->children[i] = writable(dict, parent->children[i]);
+  node_t *sibling = parent->children[i + 1] = writable(dict, parent->children[i + 1]);
+
+  copy_entries(child, child->num_keys, parent, i, 1);
+  if (!child->leaf) {
+    child->children[child->num_keys + 1] = sibling->children[0];
+    memmove(&sibling->children[0], &sibling->children[1], sibling->num_keys * sizeof(sibling->children[0]));
+  }
+  child->num_keys++;
+  copy_entries(parent, i, sibling, 0, 1);
+  node_remove_at(sibling, 0);
+}
+
+/**
+ * @brief  Let an update function decide the new value of an entry
+ * @note   Called under the writer lock, on a slot the write may modify
+ * @param  *dict: dictionary being written
+ * @param  *slot: slot of the entry, or where a new entry's value goes
+ * @param  found: whether the entry exists
+ * @param  fn: update function
+ * @param  *arg: passed to fn
+ * @retval whether fn stored a value in the slot
+ */
+static bool update_slot(my_dict_t *dict, dict_value_t *slot, bool found, dict_update_fn fn, void *arg) {
+  dict_value_t small[8];
+  void *value = dict->value_size <= sizeof(small) ? small : malloc(dict->value_size);
+  if (found)
+    memcpy(value, value_bytes(dict, slot), dict->value_size);
+  else
+    memset(value, 0, dict->value_size);
+  bool store = fn(value, found, arg);
+  if (store) {
+    if (found)
+      value_release(dict, *slot);
+    *slot = value_encode(dict, value);
+  }
+  if (value != small)
+    free(value);
+  return store;
+}
+
+/**
+ * @brief  Helper function to add or update an entry of a dictionary
+ * @note   Full nodes are split on the way down so there is always room to
+ *         insert, and every node on the path is made writable before it is
+ *         entered. The update function runs once, where the entry is or would go.
+ * @param  *dict: dictionary to which the entry is to be added
+ * @param  *probe: key of the entry
+ * @param  fn: computes the entry's value
+ * @param  *arg: passed to fn
+ * @retval whether fn stored a value
+ */
+bool dict_update_helper(my_dict_t *dict, const key_probe_t *probe, dict_update_fn fn, void *arg) {
+  cache_touch(dict, probe);
+  if (dict->next_root == NULL) {
+    dict->next_root = makeNode(dict, true);
+  } else if (dict->next_root->num_keys == DICT_MAX_KEYS) {
+    // a full root grows the tree by one level
+    node_t *newRoot = makeNode(dict, false);
+    newRoot->children[0] = dict->next_root;
+    dict->next_root = newRoot;
+    split_child(dict, newRoot, 0);
   } else {
-    // compare the current key with the new entry and recursively call this function on the appropriate subtree
-    if (strcmp(key, node->key) == 0) {
-      node->value = value;
-    } else if (strcmp(key, node->key) < 0) {
-      node->left = dict_set_helper(node->left, key, value);
-    } else if (strcmp(key, node->key) > 0) {
-      node->right = dict_set_helper(node->right, key, value);
-    } else {
-      perror("Issue in dict_set_helper");
+    dict->next_root = writable(dict, dict->next_root);
+  }
+
+  node_t *node = dict->next_root;
+  while (true) {
+    bool found;
+    int i = node_find(node, probe, &found);
+    if (found)
+      return update_slot(dict, &node->values[i], true, fn, arg);
+    if (node->leaf) {
+      // only new entries need the dictionary's own copy of the key
+      dict_value_t value;
+      if (!update_slot(dict, &value, false, fn, arg)) {
+        // an empty leaf can only be a root made for this entry
+        if (node->num_keys == 0) {
+          dict->next_root = NULL;
+          discard(dict, node);
+        }
+        return false;
+      }
+      node_insert_at(node, i, intern_key(&dict->keys, &dict->alloc, probe), value);
+      return true;
     }
-    return node;
+    if (node->children[i]->num_keys == DICT_MAX_KEYS) {
+      // split the full child, then decide which half the key belongs to
+      split_child(dict, node, i);
+      int cmp = key_compare(probe, node->prefixes[i], node->keys[i]);
+      if (cmp == 0)
+        return update_slot(dict, &node->values[i], true, fn, arg);
+      else if (cmp > 0)
+        i++;
+    }
+    node = node->children[i] = writable(dict, node->children[i]);
   }
 }
 
+// Arguments of the update functions behind the value operations
+typedef struct value_op {
+  const void *value;
+  const void *expected;
+  void *out;
+  size_t size;
+} value_op_t;
+
+/**
+ * @brief  Update function that stores a given value
+ * @note   
+ * @param  *value: value being updated
+ * @param  found: whether the key is present
+ * @param  *arg: value_op_t with the value to store
+ * @retval true
+ */
+static bool store_value(void *value, bool found, void *arg) {
+  value_op_t *op = (value_op_t *)arg;
+  memcpy(value, op->value, op->size);
+  return true;
+}
+
 /**
  * @brief  Add a new entry to the dictionary
  * @note   
@@ -136,36 +1177,184 @@ node_t *dict_set_helper(node_t *node, const char *key, int value) {
  * @retval None
  */
 void dict_set(my_dict_t *dict, const char *key, int value) {
-  // acquire the writelock, add the entry, and release the writelock
-  rwlock_acquire_writelock(&dict->rwlock);
-  dict->root = dict_set_helper(dict->root, key, value);
-  rwlock_release_writelock(&dict->rwlock);
+  dict_set_value(dict, key, &value);
 }
 
 /**
- * @brief  Helper function to check if an entry in present
+ * @brief  Add a new entry to the dictionary, or replace the value of an existing one
  * @note   
- * @param  *node: root node for the dictionary
- * @param  *key: key to check the existence
- * @retval 
+ * @param  *dict: pointer to the dictionary the entry is to be added
+ * @param  *key: key of the entry
+ * @param  *value: value_size bytes to copy
+ * @retval None
+ */
+void dict_set_value(my_dict_t *dict, const char *key, const void *value) {
+  // copy the path to the entry, add it, and publish the new tree
+  INSTRUMENT_START(start);
+  value_op_t op = {value, NULL, NULL, dict->value_size};
+  key_probe_t probe = make_probe(key);
+  write_begin(dict);
+  dict_update_helper(dict, &probe, store_value, &op);
+  write_commit(dict);
+  INSTRUMENT_OP(&dict->instrument, DICT_OP_SET, start);
+}
+
+/**
+ * @brief  Read, modify and write the value of a key atomically
+ * @note   One writer lock hold and one traversal
+ * @param  *dict: dictionary to update
+ * @param  *key: key of the entry
+ * @param  fn: computes the new value from the current one
+ * @param  *arg: passed to fn
+ * @retval whether fn stored a value
  */
-bool dict_contains_helper(node_t *node, const char *key) {
-  // if the node is null, the dictionary doesn't have the value
-  if (node == NULL) {
+bool dict_update(my_dict_t *dict, const char *key, dict_update_fn fn, void *arg) {
+  INSTRUMENT_START(start);
+  key_probe_t probe = make_probe(key);
+  write_begin(dict);
+  bool ret = dict_update_helper(dict, &probe, fn, arg);
+  write_commit(dict);
+  INSTRUMENT_OP(&dict->instrument, DICT_OP_UPDATE, start);
+  return ret;
+}
+
+/**
+ * @brief  Update function for dict_cas
+ * @note   
+ * @param  *value: value being updated
+ * @param  found: whether the key is present
+ * @param  *arg: value_op_t with the expected and desired values
+ * @retval whether the value matched and was replaced
+ */
+static bool cas_value(void *value, bool found, void *arg) {
+  value_op_t *op = (value_op_t *)arg;
+  if (!found || memcmp(value, op->expected, op->size) != 0)
     return false;
-  } else {
-    // compare the key with the interested key and run this function recursively on the appropriate subtree
-    if (strcmp(key, node->key) == 0) {
+  memcpy(value, op->value, op->size);
+  return true;
+}
+
+/**
+ * @brief  Compare and swap the value of a present key
+ * @note   
+ * @param  *dict: dictionary to update
+ * @param  *key: key of the entry
+ * @param  *expected: value the entry must have
+ * @param  *desired: value to replace it with
+ * @retval whether the value was replaced
+ */
+bool dict_cas(my_dict_t *dict, const char *key, const void *expected, const void *desired) {
+  value_op_t op = {desired, expected, NULL, dict->value_size};
+  return dict_update(dict, key, cas_value, &op);
+}
+
+/**
+ * @brief  Update function for dict_get_or_insert
+ * @note   
+ * @param  *value: value being updated
+ * @param  found: whether the key is present
+ * @param  *arg: value_op_t with the value to insert and where to copy the result
+ * @retval whether the key was missing and the value inserted
+ */
+static bool get_or_insert_value(void *value, bool found, void *arg) {
+  value_op_t *op = (value_op_t *)arg;
+  if (!found)
+    memcpy(value, op->value, op->size);
+  memcpy(op->out, value, op->size);
+  return !found;
+}
+
+/**
+ * @brief  Get the value of a key, inserting a value first if the key is missing
+ * @note   
+ * @param  *dict: dictionary to update
+ * @param  *key: key of the entry
+ * @param  *value: value to insert if the key is missing
+ * @param  *out: set to the value of the key afterwards
+ * @retval whether the key was inserted
+ */
+bool dict_get_or_insert(my_dict_t *dict, const char *key, const void *value, void *out) {
+  value_op_t op = {value, NULL, out, dict->value_size};
+  return dict_update(dict, key, get_or_insert_value, &op);
+}
+
+/**
+ * @brief  Helper function to find the node holding a key
+ * @note   
+ * @param  *node: root node for the dictionary
+ * @param  *probe: key to look for
+ * @param  *index: set to the position of the key within the returned node
+ * @retval the node holding the key, or NULL if it is not present
+ */
+static node_t *dict_find_helper(node_t *node, const key_probe_t *probe, int *index) {
+  while (node != NULL) {
+    bool found;
+    int i = node_find(node, probe, &found);
+    if (found) {
+      *index = i;
+      return node;
+    }
+    node = node->leaf ? NULL : node->children[i];
+  }
+  return NULL;
+}
+
+/**
+ * @brief  Helper function to look up a key in the current version of the dictionary
+ * @note   
+ * @param  *dict: dictionary to search
+ * @param  *probe: key to look for
+ * @param  *value: set to the value of the key, if present
+ * @retval whether the key is present
+ */
+static bool dict_get_helper(my_dict_t *dict, const key_probe_t *probe, void *value) {
+  // enter an epoch section so no node we visit is freed, try the cache, and
+  // search the image if the dictionary has not been written since it was
+  // loaded, else the tree
+  INSTRUMENT_START(start);
+  bool found;
+  const dict_key_t *key = NULL;
+  dict_value_t slot = 0;
+  uint64_t hash = 0, seq = 1;
+  unsigned long e = epoch_enter(&dict->epoch);
+  dict_cache_t *cache = dict->cache;
+  if (cache != NULL) {
+    hash = hash_bytes(probe->str, probe->len);
+    if (cache_lookup(cache, probe, hash, &seq, &slot)) {
+      __atomic_fetch_add(&cache_counters(cache)->hits, 1, __ATOMIC_RELAXED);
+      memcpy(value, value_bytes(dict, &slot), dict->value_size);
+      epoch_exit(&dict->epoch, e);
+      INSTRUMENT_OP(&dict->instrument, DICT_OP_GET, start);
       return true;
-    } else if (strcmp(key, node->key) < 0) {
-      return dict_contains_helper(node->left, key);
-    } else if (strcmp(key, node->key) > 0) {
-      return dict_contains_helper(node->right, key);
     }
+    __atomic_fetch_add(&cache_counters(cache)->misses, 1, __ATOMIC_RELAXED);
   }
-  perror("Reaching invalid line in dict_contains_helper");
-  return false;
+  const dict_image_t *image = __atomic_load_n(&dict->image, __ATOMIC_ACQUIRE);
+  if (image != NULL) {
+    size_t i = image_find(image, 0, probe, &found);
+    if (found) {
+      key = image_key(image, i);
+      slot = image->entries[i].value;
+    }
+  } else {
+    int i;
+    node_t *node = dict_find_helper(__atomic_load_n(&dict->root, __ATOMIC_ACQUIRE), probe, &i);
+    found = node != NULL;
+    if (found) {
+      key = node->keys[i];
+      slot = node->values[i];
+    }
+  }
+  if (found) {
+    memcpy(value, value_bytes(dict, &slot), dict->value_size);
+    if (cache != NULL)
+      cache_fill(cache, seq, hash, key, slot);
+  }
+  epoch_exit(&dict->epoch, e);
+  INSTRUMENT_OP(&dict->instrument, DICT_OP_GET, start);
+  return found;
 }
+
 /**
  * @brief  Function to check if the given key is in the dictionary
  * @note   
@@ -174,105 +1363,446 @@ bool dict_contains_helper(node_t *node, const char *key) {
  * @retval boolean
  */
 bool dict_contains(my_dict_t *dict, const char *key) {
-  // acquire the readlock, find whether or not the value is present and release the lock
-  rwlock_acquire_readlock(&dict->rwlock);
-  bool ret = dict_contains_helper(dict->root, key);
-  rwlock_release_readlock(&dict->rwlock);
+  key_probe_t probe = make_probe(key);
+  dict_value_t small[8];
+  void *value = dict->value_size <= sizeof(small) ? small : malloc(dict->value_size);
+  bool ret = dict_get_helper(dict, &probe, value);
+  if (value != small)
+    free(value);
   return ret;
 }
 
 /**
- * @brief  Helper function to retrieve the value of an entry
+ * @brief  Function to get the value for a given key
  * @note   
- * @param  *node: root node of the dictionary
+ * @param  *dict: dictionary from which the value is retreived
  * @param  *key: key of the interested entry
  * @retval the value of the corresponding key, if not present -1
  */
-int dict_get_helper(node_t *node, const char *key) {
-  // if the current node is null, then there isn't such entry
-  if (node == NULL) {
-    return -1;
-  } else {
-    // compare the key and run this function on the appropriate subtree
-    if (strcmp(key, node->key) == 0) {
-      return node->value;
-    } else if (strcmp(key, node->key) < 0) {
-      return dict_get_helper(node->left, key);
-    } else if (strcmp(key, node->key) > 0) {
-      return dict_get_helper(node->right, key);
-    } else {
-    }
-  }
-  perror("Reaching invalid line in dict_get_helper");
-  return -1;
+int dict_get(my_dict_t *dict, const char *key) {
+  key_probe_t probe = make_probe(key);
+  int value;
+  return dict_get_helper(dict, &probe, &value) ? value : -1;
 }
 
 /**
- * @brief  Function to get the value for a given key
+ * @brief  Copy the value of a key
  * @note   
  * @param  *dict: dictionary from which the value is retreived
  * @param  *key: key of the interested entry
- * @retval the value of the corresponding key, if not present -1
+ * @param  *value: set to the value, if the key is present
+ * @retval whether the key is present
  */
-int dict_get(my_dict_t *dict, const char *key) {
-  // acquire the readlock, get the value for the desired key, and release the readlock
-  rwlock_acquire_readlock(&dict->rwlock);
-  int ret = dict_get_helper(dict->root, key);
-  rwlock_release_readlock(&dict->rwlock);
-  return ret;
+bool dict_get_value(my_dict_t *dict, const char *key, void *value) {
+  key_probe_t probe = make_probe(key);
+  return dict_get_helper(dict, &probe, value);
+}
+
+// One key of a batch, remembering where it came from in the caller's arrays
+typedef struct batch_entry {
+  key_probe_t probe;
+  size_t index;
+} batch_entry_t;
+
+/**
+ * @brief  qsort comparator ordering a batch by key, then by position in the batch
+ * @note   
+ * @param  *a: first batch_entry_t
+ * @param  *b: second batch_entry_t
+ * @retval negative, zero or positive
+ */
+static int batch_entry_compare(const void *a, const void *b) {
+  const batch_entry_t *x = (const batch_entry_t *)a;
+  const batch_entry_t *y = (const batch_entry_t *)b;
+  int cmp = probe_compare(&x->probe, &y->probe);
+  if (cmp != 0)
+    return cmp;
+  return (x->index > y->index) - (x->index < y->index);
 }
 
 /**
- * @brief  Find the next smallest node in the BST
- * @note Citation: https://www.geeksforgeeks.org/binary-search-tree-set-2-delete/
- * @param  *node: node from which to find the next smallest node
- * @retval pointer to the next smallest node 
+ * @brief  Describe and sort the keys of a batch
+ * @note   
+ * @param  **keys: keys of the batch
+ * @param  n: number of keys
+ * @retval array of n entries in key order, to be freed by the caller
  */
-node_t *findMinValNode(node_t *node) {
+static batch_entry_t *batch_sort(const char **keys, size_t n) {
+  batch_entry_t *batch = (batch_entry_t *)malloc(n * sizeof(batch_entry_t));
+  for (size_t i = 0; i < n; i++) {
+    batch[i].probe = make_probe(keys[i]);
+    batch[i].index = i;
+  }
+  qsort(batch, n, sizeof(batch_entry_t), batch_entry_compare);
+  return batch;
+}
 
-  node_t *cur = node;
-  while (cur && cur->left != NULL) {
-    cur = cur->left;
+/**
+ * @brief  Add or update a batch of entries
+ * @note   Uses a single write. The nodes it copies are not published until the
+ *         end, so keys landing in the same nodes update those copies in place.
+ *         If a key repeats, its last value wins.
+ * @param  *dict: dictionary to which the entries are to be added
+ * @param  **keys: keys of the entries
+ * @param  *values: values of the entries
+ * @param  n: number of entries
+ * @retval None
+ */
+void dict_set_many(my_dict_t *dict, const char **keys, const int *values, size_t n) {
+  // insert in key order so consecutive keys share the copied path
+  INSTRUMENT_START(start);
+  batch_entry_t *batch = batch_sort(keys, n);
+  write_begin(dict);
+  for (size_t i = 0; i < n; i++) {
+    value_op_t op = {&values[batch[i].index], NULL, NULL, sizeof(int)};
+    dict_update_helper(dict, &batch[i].probe, store_value, &op);
   }
-  return cur;
+  write_commit(dict);
+  free(batch);
+  INSTRUMENT_OP(&dict->instrument, DICT_OP_SET_MANY, start);
 }
 
+// A node on the path of a batch lookup and the part of the batch still to be
+// looked up below it
+typedef struct batch_frame {
+  const node_t *node;
+  size_t lo;
+  size_t hi;
+} batch_frame_t;
+
 /**
- * @brief  Helper function to remove an entry from a dictionary
- * @note Citation: https://www.geeksforgeeks.org/binary-search-tree-set-2-delete/
- * @param  *node: root node of the dictionary from which to remove an entry
- * @param  *key: key of the entry to be removed
- * @retval new head node after removal
+ * @brief  Helper function to look up a sorted batch below a node
+ * @note   Keys that fall into the same child descend together, so each node on
+ *         the paths of the batch is searched once per group rather than once per key
+ * @param  *dict: dictionary the tree belongs to
+ * @param  *root: tree to search
+ * @param  *batch: sorted batch
+ * @param  n: number of entries in the batch
+ * @param  *values: caller's output array
+ * @retval None
  */
-node_t *dict_remove_helper(node_t *node, const char *key) {
-  if (node == NULL) {
-    return node;
+static void dict_get_many_helper(const my_dict_t *dict, const node_t *root, const batch_entry_t *batch, size_t n,
+                                 int *values) {
+  batch_frame_t path[DICT_MAX_HEIGHT];
+  int depth = 0;
+  path[0].node = root;
+  path[0].lo = 0;
+  path[0].hi = n;
+  while (depth >= 0) {
+    batch_frame_t *frame = &path[depth];
+    if (frame->lo == frame->hi) {
+      depth--;
+      continue;
+    }
+    const node_t *node = frame->node;
+    size_t i = frame->lo;
+    bool found;
+    int child = node_find(node, &batch[i].probe, &found);
+    if (found || node->leaf) {
+      values[batch[i].index] = -1;
+      if (found)
+        memcpy(&values[batch[i].index], value_bytes(dict, &node->values[child]), sizeof(int));
+      frame->lo++;
+      continue;
+    }
+    // every following key below the separator at position child goes down with this one
+    size_t end = i + 1;
+    while (end < frame->hi && (child == node->num_keys ||
+                               key_compare(&batch[end].probe, node->prefixes[child], node->keys[child]) < 0))
+      end++;
+    frame->lo = end;
+    path[++depth].node = node->children[child];
+    path[depth].lo = i;
+    path[depth].hi = end;
+  }
+}
+
+/**
+ * @brief  Get the values of a batch of keys
+ * @note   All keys are looked up in the same version of the tree
+ * @param  *dict: dictionary from which the values are retrieved
+ * @param  **keys: keys of the interested entries
+ * @param  *values: set to the value of each key, or -1 if it is not present
+ * @param  n: number of keys
+ * @retval None
+ */
+void dict_get_many(my_dict_t *dict, const char **keys, int *values, size_t n) {
+  INSTRUMENT_START(start);
+  batch_entry_t *batch = batch_sort(keys, n);
+
+  // enter a single epoch section and walk the current image or tree once for the whole batch
+  unsigned long e = epoch_enter(&dict->epoch);
+  const dict_image_t *image = __atomic_load_n(&dict->image, __ATOMIC_ACQUIRE);
+  node_t *root = image == NULL ? __atomic_load_n(&dict->root, __ATOMIC_ACQUIRE) : NULL;
+  if (image != NULL) {
+    // the batch is sorted, so each search starts where the previous one ended
+    size_t lo = 0;
+    for (size_t i = 0; i < n; i++) {
+      bool found;
+      lo = image_find(image, lo, &batch[i].probe, &found);
+      values[batch[i].index] = -1;
+      if (found)
+        memcpy(&values[batch[i].index], &image->entries[lo].value, sizeof(int));
+    }
+  } else if (root == NULL) {
+    for (size_t i = 0; i < n; i++)
+      values[i] = -1;
   } else {
-    // compare the key and the current key and run this function recursively on the appropriate subtree
-    if (strcmp(key, node->key) < 0) {
-      node->left = dict_remove_helper(node->left, key);
-    } else if (strcmp(key, node->key) > 0) {
-      node->right = dict_remove_helper(node->right, key);
-    } else {
-      // we are at the node to remove. if either left or right is null, remove the current node and replace it with its child
-      if (node->left == NULL) {
-        node_t *temp = node->right;
-        free(node);
-        return temp;
-      } else if (node->right == NULL) {
-        node_t *temp = node->left;
-        free(node);
-        return temp;
+    dict_get_many_helper(dict, root, batch, n, values);
+  }
+  epoch_exit(&dict->epoch, e);
+  free(batch);
+  INSTRUMENT_OP(&dict->instrument, DICT_OP_GET_MANY, start);
+}
+
+/**
+ * @brief  Helper function to visit the entries of a tree within a range, in order
+ * @note   Keeps the path to the current entry on an explicit stack. Each level
+ *         records the next entry to visit; the child left of it is done.
+ * @param  *dict: dictionary the tree belongs to
+ * @param  *root: tree to scan
+ * @param  *from: smallest key to visit, or NULL for no lower bound
+ * @param  *to: key to stop before, or NULL for no upper bound
+ * @param  fn: function called for each entry
+ * @param  *arg: passed to fn
+ * @retval None
+ */
+static void dict_scan_helper(const my_dict_t *dict, const node_t *root, const key_probe_t *from,
+                             const key_probe_t *to, dict_value_scan_fn fn, void *arg) {
+  const node_t *path[DICT_MAX_HEIGHT];
+  int next_entry[DICT_MAX_HEIGHT];
+  int depth = -1;
+
+  // descend to the first entry in range, skipping everything below it
+  const node_t *node = root;
+  while (node != NULL) {
+    bool found = false;
+    int i = from == NULL ? 0 : node_find(node, from, &found);
+    path[++depth] = node;
+    next_entry[depth] = i;
+    // the child left of a matching key only holds smaller keys
+    node = found || node->leaf ? NULL : node->children[i];
+  }
+
+  while (depth >= 0) {
+    node = path[depth];
+    int i = next_entry[depth];
+    if (i == node->num_keys) {
+      depth--;
+      continue;
+    }
+    if (to != NULL && key_compare(to, node->prefixes[i], node->keys[i]) <= 0)
+      return;
+    if (!fn(dict_key_str(node->keys[i]), value_bytes(dict, &node->values[i]), arg))
+      return;
+    next_entry[depth] = i + 1;
+    // visit the child right of the entry, starting from its smallest key
+    for (node = node->leaf ? NULL : node->children[i + 1]; node != NULL; node = node->leaf ? NULL : node->children[0]) {
+      path[++depth] = node;
+      next_entry[depth] = 0;
+    }
+  }
+}
+
+/**
+ * @brief  Visit the entries with keys in [from, to), in key order
+ * @note   The scan sees a single version of the tree and never blocks writers,
+ *         although nodes they replace are not freed until it is done
+ * @param  *dict: dictionary to scan
+ * @param  *from: smallest key to visit, or NULL to start at the first key
+ * @param  *to: key to stop before, or NULL to run to the last key
+ * @param  fn: function called for each entry; returning false stops the scan
+ * @param  *arg: passed to fn
+ * @retval None
+ */
+void dict_scan_values(my_dict_t *dict, const char *from, const char *to, dict_value_scan_fn fn, void *arg) {
+  INSTRUMENT_START(start);
+  key_probe_t from_probe, to_probe;
+  if (from != NULL)
+    from_probe = make_probe(from);
+  if (to != NULL)
+    to_probe = make_probe(to);
+
+  // enter an epoch section so no node we visit is freed, and walk the current image or tree
+  unsigned long e = epoch_enter(&dict->epoch);
+  const dict_image_t *image = __atomic_load_n(&dict->image, __ATOMIC_ACQUIRE);
+  if (image != NULL) {
+    bool found;
+    size_t i = from == NULL ? 0 : image_find(image, 0, &from_probe, &found);
+    for (; i < image->count; i++) {
+      const dict_key_t *key = image_key(image, i);
+      if (to != NULL && key_compare(&to_probe, image->entries[i].prefix, key) <= 0)
+        break;
+      if (!fn(dict_key_str(key), &image->entries[i].value, arg))
+        break;
+    }
+  } else {
+    node_t *root = __atomic_load_n(&dict->root, __ATOMIC_ACQUIRE);
+    if (root != NULL)
+      dict_scan_helper(dict, root, from == NULL ? NULL : &from_probe, to == NULL ? NULL : &to_probe, fn, arg);
+  }
+  epoch_exit(&dict->epoch, e);
+  INSTRUMENT_OP(&dict->instrument, DICT_OP_SCAN, start);
+}
+
+// Callback of an int scan, carried through a scan of values of any size
+typedef struct int_scan {
+  dict_scan_fn fn;
+  void *arg;
+} int_scan_t;
+
+/**
+ * @brief  Value scan callback passing int values on to an int scan callback
+ * @note   
+ * @param  *key: key of the entry
+ * @param  *value: value of the entry
+ * @param  *arg: int_scan_t
+ * @retval what the int callback returns
+ */
+static bool scan_int(const char *key, const void *value, void *arg) {
+  int_scan_t *scan = (int_scan_t *)arg;
+  int v;
+  memcpy(&v, value, sizeof(int));
+  return scan->fn(key, v, scan->arg);
+}
+
+/**
+ * @brief  Visit the entries with keys in [from, to), in key order
+ * @note   Same as dict_scan_values, for int values
+ * @param  *dict: dictionary to scan
+ * @param  *from: smallest key to visit, or NULL to start at the first key
+ * @param  *to: key to stop before, or NULL to run to the last key
+ * @param  fn: function called for each entry; returning false stops the scan
+ * @param  *arg: passed to fn
+ * @retval None
+ */
+void dict_scan(my_dict_t *dict, const char *from, const char *to, dict_scan_fn fn, void *arg) {
+  int_scan_t scan = {fn, arg};
+  dict_scan_values(dict, from, to, scan_int, &scan);
+}
+
+/**
+ * @brief  Visit the entries whose keys start with a prefix, in key order
+ * @note   Same guarantees as dict_scan_values
+ * @param  *dict: dictionary to scan
+ * @param  *prefix: prefix of the keys to visit
+ * @param  fn: function called for each entry; returning false stops the scan
+ * @param  *arg: passed to fn
+ * @retval None
+ */
+void dict_scan_prefix_values(my_dict_t *dict, const char *prefix, dict_value_scan_fn fn, void *arg) {
+  // the keys with this prefix are those from the prefix up to, but not
+  // including, the prefix with its last byte below 0xff incremented
+  size_t len = strlen(prefix);
+  char *to = (char *)malloc(len + 1);
+  memcpy(to, prefix, len + 1);
+  while (len > 0 && (unsigned char)to[len - 1] == 0xff)
+    len--;
+  to[len] = '\0';
+  if (len > 0)
+    to[len - 1]++;
+  dict_scan_values(dict, prefix, len > 0 ? to : NULL, fn, arg);
+  free(to);
+}
+
+/**
+ * @brief  Visit the entries whose keys start with a prefix, in key order
+ * @note   Same as dict_scan_prefix_values, for int values
+ * @param  *dict: dictionary to scan
+ * @param  *prefix: prefix of the keys to visit
+ * @param  fn: function called for each entry; returning false stops the scan
+ * @param  *arg: passed to fn
+ * @retval None
+ */
+void dict_scan_prefix(my_dict_t *dict, const char *prefix, dict_scan_fn fn, void *arg) {
+  int_scan_t scan = {fn, arg};
+  dict_scan_prefix_values(dict, prefix, scan_int, &scan);
+}
+
+/**
+ * @brief  Helper function to remove an entry from a dictionary
+ * @note   Single top-down pass: every node we descend into is first made
+ *         writable and topped up above the minimum occupancy, so removing from
+ *         a leaf never underflows
+ * @param  *dict: dictionary from which to remove an entry
+ * @param  *probe: key of the entry to be removed
+ * @retval None
+ */
+void dict_remove_helper(my_dict_t *dict, key_probe_t probe) {
+  if (dict->next_root == NULL)
+    return;
+  node_t *node = dict->next_root = writable(dict, dict->next_root);
+  // once the entry is overwritten by its predecessor or successor, the entry
+  // removed from the leaf is that neighbour, whose value lives on
+  bool replaced = false;
+
+  while (true) {
+    bool found;
+    int i = node_find(node, &probe, &found);
+    if (node->leaf) {
+      if (found) {
+        if (!replaced)
+          value_release(dict, node->values[i]);
+        node_remove_at(node, i);
+      }
+      break;
+    }
+
+    if (found) {
+      node_t *left = node->children[i];
+      node_t *right = node->children[i + 1];
+      if (left->num_keys > DICT_MIN_KEYS) {
+        // replace the entry with its predecessor, then remove the predecessor from the left subtree
+        left = node->children[i] = writable(dict, left);
+        node_t *pred = left;
+        while (!pred->leaf)
+          pred = pred->children[pred->num_keys];
+        value_release(dict, node->values[i]);
+        replaced = true;
+        copy_entries(node, i, pred, pred->num_keys - 1, 1);
+        probe = probe_of(node->keys[i]);
+        node = left;
+      } else if (right->num_keys > DICT_MIN_KEYS) {
+        // replace the entry with its successor, then remove the successor from the right subtree
+        right = node->children[i + 1] = writable(dict, right);
+        node_t *succ = right;
+        while (!succ->leaf)
+          succ = succ->children[0];
+        value_release(dict, node->values[i]);
+        replaced = true;
+        copy_entries(node, i, succ, 0, 1);
+        probe = probe_of(node->keys[i]);
+        node = right;
       } else {
-        // If both children aren't null, then find the next smallest child, replace the entries and remove that node
-        node_t *minValNode = findMinValNode(node->right);
-        node->key = minValNode->key;
-        node->value = minValNode->value;
-        node->right = dict_remove_helper(node->right, minValNode->key);
+        // both neighbours are minimal: merge them around the entry and remove it from the merged node
+        merge_children(dict, node, i);
+        node = node->children[i];
       }
+      continue;
     }
+
+    // the key can only be in the i-th subtree; make sure that child can lose an entry
+    if (node->children[i]->num_keys == DICT_MIN_KEYS) {
+      if (i > 0 && node->children[i - 1]->num_keys > DICT_MIN_KEYS) {
+        borrow_from_left(dict, node, i);
+      } else if (i < node->num_keys && node->children[i + 1]->num_keys > DICT_MIN_KEYS) {
+        borrow_from_right(dict, node, i);
+      } else if (i < node->num_keys) {
+        merge_children(dict, node, i);
+      } else {
+        merge_children(dict, node, i - 1);
+        i--;
+      }
+    }
+    node = node->children[i] = writable(dict, node->children[i]);
+  }
+
+  // a merge may have emptied the root, which shrinks the tree by one level
+  node_t *root = dict->next_root;
+  if (root->num_keys == 0) {
+    dict->next_root = root->leaf ? NULL : root->children[0];
+    discard(dict, root);
   }
-  return node;
 }
 
 /**
@@ -283,8 +1813,167 @@ node_t *dict_remove_helper(node_t *node, const char *key) {
  * @retval None
  */
 void dict_remove(my_dict_t *dict, const char *key) {
-  // acquire the writelock, remove the entry, and release the key. 
-  rwlock_acquire_writelock(&dict->rwlock);
-  dict->root = dict_remove_helper(dict->root, key);
-  rwlock_release_writelock(&dict->rwlock);
+  // copy the path to the entry, remove it, and publish the new tree. Removing
+  // a missing key would copy the path for nothing, so check for it first.
+  INSTRUMENT_START(start);
+  key_probe_t probe = make_probe(key);
+  write_begin(dict);
+  int i;
+  if (dict_find_helper(dict->next_root, &probe, &i) != NULL) {
+    cache_touch(dict, &probe);
+    dict_remove_helper(dict, probe);
+  }
+  write_commit(dict);
+  INSTRUMENT_OP(&dict->instrument, DICT_OP_REMOVE, start);
+}
+
+// Entries of a dictionary gathered for dict_save
+typedef struct save_buffer {
+  const dict_key_t **keys;
+  dict_value_t *values;
+  size_t value_size;
+  size_t count;
+  size_t capacity;
+} save_buffer_t;
+
+/**
+ * @brief  Scan callback gathering entries for dict_save
+ * @note   Keys handed to scan callbacks are always the bytes of a dictionary-owned
+ *         key record, from the arena or an image, so the record sits right before them
+ * @param  *key: key of the entry
+ * @param  *value: value of the entry
+ * @param  *arg: save_buffer_t to append to
+ * @retval true, to see every entry
+ */
+static bool save_entry(const char *key, const void *value, void *arg) {
+  save_buffer_t *buffer = (save_buffer_t *)arg;
+  if (buffer->count == buffer->capacity) {
+    buffer->capacity = buffer->capacity == 0 ? 1024 : buffer->capacity * 2;
+    buffer->keys = (const dict_key_t **)realloc(buffer->keys, buffer->capacity * sizeof(dict_key_t *));
+    buffer->values = (dict_value_t *)realloc(buffer->values, buffer->capacity * sizeof(dict_value_t));
+  }
+  buffer->keys[buffer->count] = (const dict_key_t *)key - 1;
+  buffer->values[buffer->count] = 0;
+  memcpy(&buffer->values[buffer->count], value, buffer->value_size);
+  buffer->count++;
+  return true;
+}
+
+/**
+ * @brief  Size of a key record in an image
+ * @note   
+ * @param  *key: key to store
+ * @retval size in bytes, padded so the next record is 8-byte aligned
+ */
+static uint64_t image_record_size(const dict_key_t *key) {
+  return (sizeof(dict_key_t) + key->len + 1 + 7) & ~(uint64_t)7;
+}
+
+/**
+ * @brief  Write an image of the dictionary to a file
+ * @note   Writes a single version of the dictionary without blocking writers.
+ *         The image goes to a temporary file that is renamed over path, so a
+ *         crash never leaves a partial image behind.
+ * @param  *dict: dictionary to save
+ * @param  *path: file to write
+ * @retval whether the image was written
+ */
+bool dict_save(my_dict_t *dict, const char *path) {
+  // larger values live on the heap, outside what an image can hold
+  if (dict->value_size > sizeof(dict_value_t))
+    return false;
+  save_buffer_t buffer = {NULL, NULL, dict->value_size, 0, 0};
+  dict_scan_values(dict, NULL, NULL, save_entry, &buffer);
+
+  size_t tmp_len = strlen(path) + 5;
+  char *tmp = (char *)malloc(tmp_len);
+  snprintf(tmp, tmp_len, "%s.tmp", path);
+  FILE *file = fopen(tmp, "wb");
+  bool ok = file != NULL;
+
+  // header and entries, with key offsets laid out in entry order
+  image_header_t header;
+  memcpy(header.magic, IMAGE_MAGIC, sizeof(header.magic));
+  header.value_size = dict->value_size;
+  header.count = buffer.count;
+  header.keys_offset = sizeof(image_header_t) + buffer.count * sizeof(image_entry_t);
+  header.size = header.keys_offset;
+  for (size_t i = 0; i < buffer.count; i++)
+    header.size += image_record_size(buffer.keys[i]);
+  if (ok)
+    ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+  uint64_t key_offset = 0;
+  for (size_t i = 0; ok && i < buffer.count; i++) {
+    image_entry_t entry;
+    entry.prefix = buffer.keys[i]->prefix;
+    entry.key_offset = key_offset;
+    entry.value = buffer.values[i];
+    ok = fwrite(&entry, sizeof(entry), 1, file) == 1;
+    key_offset += image_record_size(buffer.keys[i]);
+  }
+
+  // key records in the same order, each padded with zeros
+  static const char padding[8] = {0};
+  for (size_t i = 0; ok && i < buffer.count; i++) {
+    size_t size = sizeof(dict_key_t) + buffer.keys[i]->len + 1;
+    ok = fwrite(buffer.keys[i], size, 1, file) == 1;
+    if (ok && image_record_size(buffer.keys[i]) > size)
+      ok = fwrite(padding, image_record_size(buffer.keys[i]) - size, 1, file) == 1;
+  }
+
+  if (file != NULL && fclose(file) != 0)
+    ok = false;
+  if (ok)
+    ok = rename(tmp, path) == 0;
+  else if (file != NULL)
+    remove(tmp);
+  free(tmp);
+  free(buffer.keys);
+  free(buffer.values);
+  return ok;
+}
+
+/**
+ * @brief  Initialize a dictionary from an image written by dict_save
+ * @note   Only the header is checked, so loading takes the same time for any
+ *         image size; the entries are trusted to be what dict_save wrote
+ * @param  *dict: dictionary to initialize
+ * @param  *path: file to map
+ * @retval whether the image was loaded; if not, the dictionary is empty
+ */
+bool dict_load_mmap(my_dict_t *dict, const char *path) {
+  dict_init(dict);
+  int fd = open(path, O_RDONLY);
+  if (fd == -1)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(image_header_t)) {
+    close(fd);
+    return false;
+  }
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return false;
+
+  const image_header_t *header = (const image_header_t *)map;
+  if (memcmp(header->magic, IMAGE_MAGIC, sizeof(header->magic)) != 0 || header->size != (uint64_t)st.st_size ||
+      header->value_size == 0 || header->value_size > sizeof(dict_value_t) ||
+      header->count > header->size / sizeof(image_entry_t) ||
+      header->keys_offset != sizeof(image_header_t) + header->count * sizeof(image_entry_t) ||
+      header->keys_offset > header->size) {
+    munmap(map, st.st_size);
+    return false;
+  }
+
+  dict_image_t *image = (dict_image_t *)malloc(sizeof(dict_image_t));
+  image->map = map;
+  image->size = st.st_size;
+  image->entries = (const image_entry_t *)(header + 1);
+  image->count = header->count;
+  image->keys = (const char *)map + header->keys_offset;
+  dict->value_size = header->value_size;
+  dict->image = dict->snapshot = image;
+  return true;
 }
@@ -2,35 +2,167 @@
 #define DICT_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <pthread.h>
-#include <semaphore.h>
 
-typedef struct rwlock_t {
-  sem_t lock;
-  sem_t writelock;
-  int readers;
-} rwlock_t;
+#include "epoch.hh"
+#include "instrument.hh"
 
+// B-tree fan-out. A full internal node (key prefixes, keys, value slots and
+// child pointers) spans eight 64-byte cache lines and a leaf, which omits the
+// child array, spans six.
+#define DICT_ORDER 16
+#define DICT_MAX_KEYS (DICT_ORDER - 1)
+#define DICT_MIN_KEYS (DICT_ORDER / 2 - 1)
 
+// Bound on the height of the tree. Every node but the root has at least
+// DICT_ORDER / 2 children, so even 2^64 keys fit in 22 levels. Traversals keep
+// their path in arrays of this size rather than recursing.
+#define DICT_MAX_HEIGHT 32
+
+// Size of the chunks the dictionary copies its keys into
+#define DICT_ARENA_CHUNK 65536
+
+// A key owned by the dictionary. Each distinct key is stored once, followed by
+// its NUL-terminated bytes, and lives until the dictionary is destroyed.
+typedef struct dict_key {
+  uint64_t hash;
+  size_t len;
+  uint64_t prefix;  // first eight bytes, big-endian and zero padded
+} dict_key_t;
+
+// Get the bytes of a key
+static inline const char* dict_key_str(const dict_key_t* key) {
+  return (const char*)(key + 1);
+}
+
+typedef struct dict_arena_chunk {
+  struct dict_arena_chunk* next;
+  size_t used;
+  size_t size;
+} dict_arena_chunk_t;
+
+// Storage for one value. Values of up to 8 bytes are stored in the slot itself;
+// larger ones are copied to the heap and the slot holds the pointer. A stored
+// value is never modified in place, so readers can copy it out without a lock.
+typedef uint64_t dict_value_t;
+
+typedef struct dict_keys {
+  dict_arena_chunk_t* chunks;  // newest first
+  dict_key_t** table;          // open-addressed intern table
+  size_t capacity;
+  size_t count;
+} dict_keys_t;
+
+// Published nodes are never modified: writers copy every node they change
+// and swap in a new root, so readers need no lock. Keys are ordered by their
+// bytes, and the prefixes copied into the node settle most comparisons
+// without following the key pointer.
 typedef struct my_node {
-  const char* key;
-  int value;
-  struct my_node* left;
-  struct my_node* right;
+  int num_keys;
+  bool leaf;
+  bool published;  // false while only the writer that made it can see it
+  uint64_t prefixes[DICT_MAX_KEYS];
+  const dict_key_t* keys[DICT_MAX_KEYS];
+  dict_value_t values[DICT_MAX_KEYS];
+  struct my_node* children[DICT_ORDER];  // not allocated for leaves
 } node_t;
 
+// Read-only snapshot of a dictionary mapped from a file by dict_load_mmap
+typedef struct dict_image dict_image_t;
+
+typedef struct node_list {
+  node_t** nodes;
+  int count;
+  int capacity;
+} node_list_t;
+
+typedef struct value_list {
+  void** values;
+  int count;
+  int capacity;
+} value_list_t;
+
+// Counter slots of a hot-key cache. Threads are assigned one round-robin, so
+// readers on different cores normally count on different cache lines.
+#define DICT_CACHE_STAT_SLOTS 16
+
+// Entry of the hot-key cache. seq is odd while the entry is being written;
+// readers copy the entry and check that seq did not change meanwhile.
+typedef struct dict_cache_entry {
+  uint64_t seq;
+  uint64_t hash;
+  const dict_key_t* key;  // NULL if empty
+  dict_value_t value;
+} __attribute__((aligned(32))) dict_cache_entry_t;
+
+typedef struct dict_cache_counters {
+  unsigned long hits;
+  unsigned long misses;
+} __attribute__((aligned(64))) dict_cache_counters_t;
+
+// Direct-mapped cache of recently read keys, indexed by key hash. Readers
+// fill it after a lookup in the tree; writers lock and empty the entries of
+// the keys they change around publishing their root.
+typedef struct dict_cache {
+  dict_cache_counters_t counters[DICT_CACHE_STAT_SLOTS];
+  dict_cache_entry_t* entries;
+  size_t mask;
+  unsigned long invalidations;  // only written under write_lock
+} dict_cache_t;
+
+typedef struct dict_hashes {
+  uint64_t* hashes;
+  int count;
+  int capacity;
+} dict_hashes_t;
+
+// Where a dictionary gets the memory for its nodes, keys and out-of-line
+// values. free_fn gets no argument, since the epoch domain frees with it later.
+typedef struct dict_allocator {
+  void* (*alloc_fn)(size_t size, void* arg);
+  void (*free_fn)(void* ptr);
+  void* arg;
+} dict_allocator_t;
+
 typedef struct my_dict {
-  node_t* root;
-  rwlock_t rwlock;
+  node_t* root;  // readers load it inside an epoch section
+  size_t value_size;
+  epoch_t epoch;
+  pthread_mutex_t write_lock;
+  dict_keys_t keys;  // only touched under write_lock
+  // Image that serves reads until the first write builds the tree from it.
+  // Readers load it inside an epoch section; NULL once the tree takes over.
+  dict_image_t* image;
+  dict_image_t* snapshot;  // mapping behind image, kept until destroy since the tree shares its keys
+  // State of the write in progress, only touched under write_lock
+  node_t* next_root;  // root that will be published
+  node_list_t fresh;  // nodes created by this write
+  node_list_t stale;  // published nodes this write replaced
+  value_list_t stale_values;  // out-of-line values this write replaced or removed
+  dict_hashes_t touched;  // keys this write changed, to invalidate in the cache
+  dict_cache_t* cache;    // NULL unless dict_enable_cache was called
+  dict_allocator_t alloc;  // malloc and free unless dict_set_allocator replaced them
+  INSTRUMENT_FIELD(instrument)  // waits for and holds of write_lock
 } my_dict_t;
 
-// Initialize a dictionary
+// Initialize a dictionary of int values
 void dict_init(my_dict_t* dict);
 
+// Initialize a dictionary whose values are value_size bytes each. Use the
+// *_value functions below with it; the int functions assume dict_init.
+void dict_init_typed(my_dict_t* dict, size_t value_size);
+
+// Allocate the dictionary's memory with alloc instead of malloc. Call right
+// after initializing, before any other operation.
+void dict_set_allocator(my_dict_t* dict, const dict_allocator_t* alloc);
+
 // Destroy a dictionary
 void dict_destroy(my_dict_t* dict);
 
-// Set a value in a dictionary
+// Set a value in a dictionary. The key is copied, so the caller's string may
+// be reused as soon as this returns.
 void dict_set(my_dict_t* dict, const char* key, int value);
 
 // Check if a dictionary contains a key
@@ -42,4 +174,91 @@ int dict_get(my_dict_t* dict, const char* key);
 // Remove a value from a dictionary
 void dict_remove(my_dict_t* dict, const char* key);
 
+// Set n values in a single write. If a key repeats, its last value wins.
+void dict_set_many(my_dict_t* dict, const char** keys, const int* values, size_t n);
+
+// Get the values of n keys in a single traversal, -1 for missing keys. All
+// keys are looked up in the same version of the dictionary.
+void dict_get_many(my_dict_t* dict, const char** keys, int* values, size_t n);
+
+// Called for each entry of a scan, in key order. The key stays valid until the
+// dictionary is destroyed. Return false to stop the scan.
+typedef bool (*dict_scan_fn)(const char* key, int value, void* arg);
+
+// Visit the entries with keys in [from, to) in key order. A NULL bound leaves
+// that end open. The scan sees one version of the dictionary and does not block
+// writers.
+void dict_scan(my_dict_t* dict, const char* from, const char* to, dict_scan_fn fn, void* arg);
+
+// Visit the entries whose keys start with prefix in key order, like dict_scan
+void dict_scan_prefix(my_dict_t* dict, const char* prefix, dict_scan_fn fn, void* arg);
+
+/****** Values of any size ******/
+
+// Set the value of a key, copying value_size bytes from value
+void dict_set_value(my_dict_t* dict, const char* key, const void* value);
+
+// Copy the value of a key into value. Returns whether the key is present,
+// leaving value untouched if it is not, so every stored value is distinguishable
+// from a missing key.
+bool dict_get_value(my_dict_t* dict, const char* key, void* value);
+
+// Called with the writer lock held to compute a key's new value in place.
+// value holds the current value, or zeros if found is false. Return whether
+// to store the result; returning false leaves the dictionary unchanged.
+typedef bool (*dict_update_fn)(void* value, bool found, void* arg);
+
+// Read, modify and write the value of a key as one atomic step, with a single
+// traversal. Returns whether fn chose to store a value.
+bool dict_update(my_dict_t* dict, const char* key, dict_update_fn fn, void* arg);
+
+// Replace the value of a present key with desired if it currently equals
+// expected, byte for byte. Returns whether it was replaced.
+bool dict_cas(my_dict_t* dict, const char* key, const void* expected, const void* desired);
+
+// Copy the value of a key into out, first inserting value if the key is
+// missing. Returns whether the key was inserted.
+bool dict_get_or_insert(my_dict_t* dict, const char* key, const void* value, void* out);
+
+// Called for each entry of a scan like dict_scan_fn, with a pointer to the
+// value that is only valid during the call
+typedef bool (*dict_value_scan_fn)(const char* key, const void* value, void* arg);
+
+// dict_scan and dict_scan_prefix for values of any size
+void dict_scan_values(my_dict_t* dict, const char* from, const char* to, dict_value_scan_fn fn, void* arg);
+void dict_scan_prefix_values(my_dict_t* dict, const char* prefix, dict_value_scan_fn fn, void* arg);
+
+/****** Hot-key cache ******/
+
+typedef struct dict_cache_stats {
+  size_t entries;
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long invalidations;
+} dict_cache_stats_t;
+
+// Serve repeated lookups of the same keys from a cache of at least entries
+// entries, rounded up to a power of two. A hit costs a hash of the key and one
+// or two cache lines instead of a walk down the tree. Call before other
+// threads use the dictionary.
+void dict_enable_cache(my_dict_t* dict, size_t entries);
+
+// Get the counters of the cache, all zero if it is not enabled. Counters are
+// read without stopping other threads, so they may miss lookups in progress.
+void dict_cache_stats(my_dict_t* dict, dict_cache_stats_t* stats);
+
+/****** Snapshots ******/
+
+// Write a sorted, position-independent image of the dictionary to a file,
+// replacing it atomically. Returns false if the file could not be written or
+// the values are larger than 8 bytes.
+bool dict_save(my_dict_t* dict, const char* path);
+
+// Initialize a dictionary from an image written by dict_save. The file is
+// mapped and queried in place, so loading takes the same time for any size;
+// the first write builds the mutable tree from the image, and the dictionary
+// takes the image's value size. Returns false, with the dictionary initialized
+// empty for int values, if the file is missing or not an image.
+bool dict_load_mmap(my_dict_t* dict, const char* path);
+
 #endif
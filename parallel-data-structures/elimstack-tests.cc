@@ -0,0 +1,116 @@
+#include <gtest/gtest.h>
+
+#include "elimstack.hh"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+
+/****** Stack Invariants ******/
+
+// Invariant 1
+// For every value V that has been pushed onto the stack p times and returned by pop q times, there must be p-q copies of this value on the stack. This only holds if p >= q.
+
+// Invariant 2
+// No value should ever be returned by pop if it was not first passed to push by some thread.
+
+// Invariant 3
+// If a thread pushes value A and then pushes value B, and no other thread pushes these specific values, A must not be popped from the stack before popping B.
+
+/****** Begin Tests ******/
+
+// Basic stack functionality
+TEST(ElimStackTest, BasicStackOps) {
+  my_elimstack_t s;
+  elimstack_init(&s);
+
+  // Make sure the stack is empty and popping from it returns -1
+  ASSERT_TRUE(elimstack_empty(&s));
+  ASSERT_EQ(-1, elimstack_pop(&s));
+
+  // Push some values and make sure they come off in the right order
+  elimstack_push(&s, 1);
+  elimstack_push(&s, 2);
+  elimstack_push(&s, 3);
+  ASSERT_FALSE(elimstack_empty(&s));
+  ASSERT_EQ(3, elimstack_pop(&s));
+  ASSERT_EQ(2, elimstack_pop(&s));
+  ASSERT_EQ(1, elimstack_pop(&s));
+  ASSERT_TRUE(elimstack_empty(&s));
+  ASSERT_EQ(-1, elimstack_pop(&s));
+
+  // Without contention nothing goes through the elimination array
+  ASSERT_EQ(0u, elimstack_exchanges(&s));
+
+  // Destroying a stack with elements left frees them
+  elimstack_push(&s, 4);
+  elimstack_destroy(&s);
+}
+
+#define NUM_THREADS 8
+#define PAIRS_PER_THREAD 50000
+
+typedef struct elimstack_thread_args {
+  int id;
+  my_elimstack_t *stack;
+  long pushed;
+  long popped;
+  bool values_valid;
+} elimstack_thread_args_t;
+
+/**
+ * @brief  Push id * PAIRS_PER_THREAD + i and pop once, for increasing i
+ * @note   A pop may return any thread's value, but never -1: every thread
+ *         pushes before it pops
+ * @param  *arg: elimstack_thread_args_t
+ * @retval None
+ */
+void *elimstack_pairs(void *arg) {
+  elimstack_thread_args_t *args = (elimstack_thread_args_t *)arg;
+  args->pushed = 0;
+  args->popped = 0;
+  args->values_valid = true;
+  for (int i = 0; i < PAIRS_PER_THREAD; i++) {
+    int value = args->id * PAIRS_PER_THREAD + i;
+    elimstack_push(args->stack, value);
+    args->pushed += value;
+    int popped = elimstack_pop(args->stack);
+    if (popped < 0 || popped >= NUM_THREADS * PAIRS_PER_THREAD)
+      args->values_valid = false;
+    else
+      args->popped += popped;
+  }
+  return NULL;
+}
+
+// Invariants 1 and 2 with balanced pushes and pops from many threads, so that
+// pushes and pops collide and meet in the elimination array
+TEST(ElimStackTest, BalancedPushAndPop) {
+  my_elimstack_t s;
+  elimstack_init(&s);
+
+  pthread_t threads[NUM_THREADS];
+  elimstack_thread_args_t args[NUM_THREADS];
+  for (int i = 0; i < NUM_THREADS; i++) {
+    args[i].id = i;
+    args[i].stack = &s;
+    if (pthread_create(&threads[i], NULL, elimstack_pairs, &args[i]) != 0)
+      perror("Error creating thread");
+  }
+  for (int i = 0; i < NUM_THREADS; i++) {
+    if (pthread_join(threads[i], NULL) != 0)
+      perror("Error joining thread");
+  }
+
+  // every value pushed was popped once, and the stack is empty again
+  long pushed = 0, popped = 0;
+  for (int i = 0; i < NUM_THREADS; i++) {
+    ASSERT_TRUE(args[i].values_valid);
+    pushed += args[i].pushed;
+    popped += args[i].popped;
+  }
+  ASSERT_EQ(pushed, popped);
+  ASSERT_TRUE(elimstack_empty(&s));
+
+  // clean up
+  elimstack_destroy(&s);
+}
@@ -0,0 +1,246 @@
+#include "elimstack.hh"
+
+#include <sched.h>
+
+// What a slot's word holds: a state in the high half and an element in the
+// low half. Only the thread that made an offer withdraws or clears it, so a
+// slot never returns to an earlier word behind that thread's back.
+enum {
+  SLOT_EMPTY,  // nothing offered
+  SLOT_PUSH,   // a push waits with its element
+  SLOT_POP,    // a pop waits
+  SLOT_TAKEN,  // a pop took the waiting push's element; the push clears it
+  SLOT_GIVEN,  // a push gave its element to the waiting pop; the pop clears it
+};
+
+// How an attempt to meet a partner in a slot went
+typedef enum exchange_result { EXCHANGE_MET, EXCHANGE_BUSY, EXCHANGE_TIMEOUT } exchange_result_t;
+
+// Slots the calling thread picks from, adapted to how busy they look
+static __thread int thread_range = 1;
+
+// Random number state of the calling thread, seeded on first use
+static __thread unsigned int rng_state = 0;
+static unsigned int next_seed = 0;
+
+/**
+ * @brief  Make a slot word
+ * @note
+ * @param  state: SLOT_ state
+ * @param  element: element offered or handed over
+ * @retval the word
+ */
+static uint64_t slot_word(int state, int element) {
+  return (uint64_t)state << 32 | (uint32_t)element;
+}
+
+/**
+ * @brief  Get the state of a slot word
+ * @note
+ * @param  word: slot word
+ * @retval its SLOT_ state
+ */
+static int slot_state(uint64_t word) {
+  return (int)(word >> 32);
+}
+
+/**
+ * @brief  Get the element of a slot word
+ * @note
+ * @param  word: slot word
+ * @retval its element
+ */
+static int slot_element(uint64_t word) {
+  return (int)(uint32_t)word;
+}
+
+/**
+ * @brief  Pick a slot for the calling thread
+ * @note   xorshift over the thread's current range
+ * @param  *stack: stack whose array to pick from
+ * @retval the slot
+ */
+static elimstack_slot_t *pick_slot(my_elimstack_t *stack) {
+  if (rng_state == 0)
+    rng_state = __atomic_add_fetch(&next_seed, 0x9e3779b9u, __ATOMIC_RELAXED) | 1;
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return &stack->slots[rng_state % thread_range];
+}
+
+/**
+ * @brief  Adapt the calling thread's range to how an exchange went
+ * @note   Halve it after waiting in vain, double it after finding a slot busy
+ * @param  result: how the exchange went
+ * @retval None
+ */
+static void adapt_range(exchange_result_t result) {
+  if (result == EXCHANGE_TIMEOUT && thread_range > 1)
+    thread_range /= 2;
+  else if (result == EXCHANGE_BUSY && thread_range < ELIMSTACK_SLOTS)
+    thread_range *= 2;
+}
+
+/**
+ * @brief  Wait for a partner to answer an offer in a slot
+ * @note
+ * @param  *slot: slot holding the offer
+ * @param  answer: state the partner moves the slot to
+ * @param  *word: set to the slot's word once answered
+ * @retval whether the partner answered
+ */
+static bool wait_for_answer(elimstack_slot_t *slot, int answer, uint64_t *word) {
+  for (int i = 0; i < ELIMSTACK_WAIT; i++) {
+    sched_yield();
+    *word = __atomic_load_n(&slot->word, __ATOMIC_ACQUIRE);
+    if (slot_state(*word) == answer)
+      return true;
+  }
+  return false;
+}
+
+/**
+ * @brief  Try to hand an element to a pop in a slot
+ * @note   Answers a waiting pop, or offers the element and waits for one
+ * @param  *slot: slot to use
+ * @param  element: element to push
+ * @retval how it went; EXCHANGE_MET means the element was popped
+ */
+static exchange_result_t exchange_push(elimstack_slot_t *slot, int element) {
+  uint64_t word = __atomic_load_n(&slot->word, __ATOMIC_ACQUIRE);
+  if (slot_state(word) == SLOT_POP) {
+    if (!__atomic_compare_exchange_n(&slot->word, &word, slot_word(SLOT_GIVEN, element), false, __ATOMIC_ACQ_REL,
+                                     __ATOMIC_RELAXED))
+      return EXCHANGE_BUSY;
+    __atomic_fetch_add(&slot->exchanges, 1, __ATOMIC_RELAXED);
+    return EXCHANGE_MET;
+  }
+
+  uint64_t offer = slot_word(SLOT_PUSH, element);
+  if (slot_state(word) != SLOT_EMPTY ||
+      !__atomic_compare_exchange_n(&slot->word, &word, offer, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+    return EXCHANGE_BUSY;
+  if (!wait_for_answer(slot, SLOT_TAKEN, &word)) {
+    // withdraw, unless a pop takes the element first
+    if (__atomic_compare_exchange_n(&slot->word, &offer, slot_word(SLOT_EMPTY, 0), false, __ATOMIC_ACQ_REL,
+                                    __ATOMIC_ACQUIRE))
+      return EXCHANGE_TIMEOUT;
+  }
+  __atomic_store_n(&slot->word, slot_word(SLOT_EMPTY, 0), __ATOMIC_RELEASE);
+  return EXCHANGE_MET;
+}
+
+/**
+ * @brief  Try to take an element from a push in a slot
+ * @note   Answers a waiting push, or offers to pop and waits for one
+ * @param  *slot: slot to use
+ * @param  *element: set to the element taken
+ * @retval how it went; EXCHANGE_MET means *element was set
+ */
+static exchange_result_t exchange_pop(elimstack_slot_t *slot, int *element) {
+  uint64_t word = __atomic_load_n(&slot->word, __ATOMIC_ACQUIRE);
+  if (slot_state(word) == SLOT_PUSH) {
+    if (!__atomic_compare_exchange_n(&slot->word, &word, slot_word(SLOT_TAKEN, 0), false, __ATOMIC_ACQ_REL,
+                                     __ATOMIC_RELAXED))
+      return EXCHANGE_BUSY;
+    __atomic_fetch_add(&slot->exchanges, 1, __ATOMIC_RELAXED);
+    *element = slot_element(word);
+    return EXCHANGE_MET;
+  }
+
+  uint64_t offer = slot_word(SLOT_POP, 0);
+  if (slot_state(word) != SLOT_EMPTY ||
+      !__atomic_compare_exchange_n(&slot->word, &word, offer, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+    return EXCHANGE_BUSY;
+  if (!wait_for_answer(slot, SLOT_GIVEN, &word)) {
+    // withdraw, unless a push gives an element first
+    if (__atomic_compare_exchange_n(&slot->word, &offer, slot_word(SLOT_EMPTY, 0), false, __ATOMIC_ACQ_REL,
+                                    __ATOMIC_ACQUIRE))
+      return EXCHANGE_TIMEOUT;
+    word = offer;
+  }
+  *element = slot_element(word);
+  __atomic_store_n(&slot->word, slot_word(SLOT_EMPTY, 0), __ATOMIC_RELEASE);
+  return EXCHANGE_MET;
+}
+
+/**
+ * @brief  Initialize a stack
+ * @note
+ * @param  *stack: stack to initialize
+ * @retval None
+ */
+void elimstack_init(my_elimstack_t *stack) {
+  lfstack_init(&stack->stack);
+  for (int i = 0; i < ELIMSTACK_SLOTS; i++) {
+    stack->slots[i].word = slot_word(SLOT_EMPTY, 0);
+    stack->slots[i].exchanges = 0;
+  }
+}
+
+/**
+ * @brief  Destroy a stack
+ * @note
+ * @param  *stack: stack to destroy
+ * @retval None
+ */
+void elimstack_destroy(my_elimstack_t *stack) {
+  lfstack_destroy(&stack->stack);
+}
+
+/**
+ * @brief  Push an element onto a stack
+ * @note   Alternates between the top and the elimination array until one works
+ * @param  *stack: stack to push onto
+ * @param  element: element to push
+ * @retval None
+ */
+void elimstack_push(my_elimstack_t *stack, int element) {
+  while (!lfstack_try_push(&stack->stack, element)) {
+    exchange_result_t result = exchange_push(pick_slot(stack), element);
+    adapt_range(result);
+    if (result == EXCHANGE_MET)
+      return;
+  }
+}
+
+/**
+ * @brief  Check if a stack is empty
+ * @note   Elements being handed over in the array are not counted
+ * @param  *stack: stack to check
+ * @retval whether it had no top node
+ */
+bool elimstack_empty(my_elimstack_t *stack) {
+  return lfstack_empty(&stack->stack);
+}
+
+/**
+ * @brief  Pop an element off of a stack
+ * @note   Alternates between the top and the elimination array until one works
+ * @param  *stack: stack to pop from
+ * @retval the element, or -1 if the stack is empty
+ */
+int elimstack_pop(my_elimstack_t *stack) {
+  int element;
+  while (!lfstack_try_pop(&stack->stack, &element)) {
+    exchange_result_t result = exchange_pop(pick_slot(stack), &element);
+    adapt_range(result);
+    if (result == EXCHANGE_MET)
+      break;
+  }
+  return element;
+}
+
+/**
+ * @brief  Get the number of push-pop pairs that met in the elimination array
+ * @note
+ * @param  *stack: stack to check
+ * @retval exchanges over all slots
+ */
+unsigned long elimstack_exchanges(my_elimstack_t *stack) {
+  unsigned long total = 0;
+  for (int i = 0; i < ELIMSTACK_SLOTS; i++)
+    total += __atomic_load_n(&stack->slots[i].exchanges, __ATOMIC_RELAXED);
+  return total;
+}
@@ -0,0 +1,57 @@
+#ifndef ELIMSTACK_H
+#define ELIMSTACK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "lfstack.hh"
+
+// Elimination-backoff stack (Hendler, Shavit and Yerushalmi) over the
+// lock-free stack. Every operation first tries the stack's top once. If
+// another thread changed the top first, instead of retrying there it backs
+// off to a random slot of an elimination array, where a push and a pop that
+// meet exchange the element directly: the pop returns the push's element
+// and neither touches the top. An operation that finds no partner in time
+// goes back to the top. The more threads contend, the more pairs meet, so
+// balanced push-pop loads scale with threads rather than queueing on one
+// cache line.
+//
+// Each thread narrows the part of the array it picks from when it waits in
+// vain and widens it when it finds slots busy, so partners meet quickly at
+// low contention and spread out at high contention.
+
+// Slots in the elimination array, each on its own cache line
+#define ELIMSTACK_SLOTS 16
+
+// Times an offer in a slot is checked for a partner before it is withdrawn
+#define ELIMSTACK_WAIT 16
+
+typedef struct elimstack_slot {
+  uint64_t word;            // what is waiting in the slot, and its element
+  unsigned long exchanges;  // pushes and pops that met in this slot
+} __attribute__((aligned(64))) elimstack_slot_t;
+
+typedef struct my_elimstack {
+  my_lfstack_t stack;
+  elimstack_slot_t slots[ELIMSTACK_SLOTS];
+} my_elimstack_t;
+
+// Initialize a stack
+void elimstack_init(my_elimstack_t* stack);
+
+// Destroy a stack. No other operation may be running.
+void elimstack_destroy(my_elimstack_t* stack);
+
+// Push an element onto a stack
+void elimstack_push(my_elimstack_t* stack, int element);
+
+// Check if a stack is empty
+bool elimstack_empty(my_elimstack_t* stack);
+
+// Pop an element off of a stack, or -1 if it is empty
+int elimstack_pop(my_elimstack_t* stack);
+
+// Get the number of push-pop pairs that met in the elimination array so far
+unsigned long elimstack_exchanges(my_elimstack_t* stack);
+
+#endif
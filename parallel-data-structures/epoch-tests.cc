@@ -0,0 +1,146 @@
+#include <gtest/gtest.h>
+
+#include "epoch.hh"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/****** Epoch Reclamation Invariants ******/
+
+// Invariant 1
+// An object retired while a reader is inside a section is not freed until
+// that reader has left.
+
+// Invariant 2
+// Every retired object is eventually freed once readers leave and writers
+// keep reclaiming, or when the domain is destroyed.
+
+/****** Begin Tests ******/
+
+#define MAGIC 0x213213
+
+typedef struct counted {
+  int magic;
+  int *freed;
+} counted_t;
+
+/**
+ * @brief  Free function that counts and poisons what it frees
+ * @note
+ * @param  *ptr: counted_t to free
+ * @retval None
+ */
+void counted_free(void *ptr) {
+  counted_t *obj = (counted_t *)ptr;
+  __atomic_add_fetch(obj->freed, 1, __ATOMIC_SEQ_CST);
+  obj->magic = 0;
+  free(obj);
+}
+
+/**
+ * @brief  Allocate a counted object
+ * @note
+ * @param  *freed: counter to bump when it is freed
+ * @retval pointer to the new object
+ */
+counted_t *counted_new(int *freed) {
+  counted_t *obj = (counted_t *)malloc(sizeof(counted_t));
+  obj->magic = MAGIC;
+  obj->freed = freed;
+  return obj;
+}
+
+// Invariants 1 and 2 on a single thread
+TEST(EpochTest, ReaderDelaysReclamation) {
+  epoch_t epoch;
+  epoch_init(&epoch);
+  int freed = 0;
+
+  unsigned long e = epoch_enter(&epoch);
+  epoch_retire(&epoch, counted_new(&freed), counted_free);
+
+  // the reader is still inside, however often we try
+  for (int i = 0; i < 10; i++)
+    epoch_reclaim(&epoch);
+  ASSERT_EQ(0, freed);
+
+  // once it leaves, a couple of epochs later the object is gone
+  epoch_exit(&epoch, e);
+  for (int i = 0; i < 3; i++)
+    epoch_reclaim(&epoch);
+  ASSERT_EQ(1, freed);
+
+  // destroying the domain frees whatever is left
+  epoch_retire(&epoch, counted_new(&freed), counted_free);
+  epoch_destroy(&epoch);
+  ASSERT_EQ(2, freed);
+}
+
+#define SWAPS 20000
+#define NUM_READERS 3
+
+typedef struct swap_test {
+  epoch_t epoch;
+  counted_t *current;
+  bool done;
+  int bad_reads;
+} swap_test_t;
+
+/**
+ * @brief  Keep dereferencing the current object until the writer is done
+ * @note
+ * @param  *arg: shared test state
+ * @retval None
+ */
+void *swap_reader(void *arg) {
+  swap_test_t *t = (swap_test_t *)arg;
+  while (!__atomic_load_n(&t->done, __ATOMIC_SEQ_CST)) {
+    unsigned long e = epoch_enter(&t->epoch);
+    counted_t *obj = __atomic_load_n(&t->current, __ATOMIC_ACQUIRE);
+    if (obj->magic != MAGIC)
+      __atomic_add_fetch(&t->bad_reads, 1, __ATOMIC_SEQ_CST);
+    epoch_exit(&t->epoch, e);
+  }
+  return NULL;
+}
+
+// Invariant 1 with a writer replacing and retiring the object readers use
+TEST(EpochTest, ConcurrentSwaps) {
+  swap_test_t t;
+  epoch_init(&t.epoch);
+  int freed = 0;
+  t.current = counted_new(&freed);
+  t.done = false;
+  t.bad_reads = 0;
+
+  pthread_t readers[NUM_READERS];
+  for (int i = 0; i < NUM_READERS; i++) {
+    if (pthread_create(&readers[i], NULL, swap_reader, &t) != 0)
+      perror("Error creating thread");
+  }
+
+  for (int i = 0; i < SWAPS; i++) {
+    counted_t *old = __atomic_exchange_n(&t.current, counted_new(&freed), __ATOMIC_SEQ_CST);
+    epoch_retire(&t.epoch, old, counted_free);
+    epoch_reclaim(&t.epoch);
+    // let a reader that was preempted inside a section leave it, otherwise on
+    // a single core the whole loop can run before the epoch is able to move
+    if (i % 1000 == 0)
+      sched_yield();
+  }
+
+  __atomic_store_n(&t.done, true, __ATOMIC_SEQ_CST);
+  for (int i = 0; i < NUM_READERS; i++) {
+    if (pthread_join(readers[i], NULL) != 0)
+      perror("Error joining thread");
+  }
+
+  ASSERT_EQ(0, t.bad_reads);
+  // reclamation kept up instead of deferring everything to the end
+  ASSERT_GT(freed, 0);
+
+  epoch_destroy(&t.epoch);
+  ASSERT_EQ(SWAPS, freed);
+  free(t.current);
+}
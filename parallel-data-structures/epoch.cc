@@ -0,0 +1,144 @@
+#include "epoch.hh"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+// Reader slot of the calling thread, assigned round-robin on first use
+static __thread int thread_slot = -1;
+static int next_slot = 0;
+
+/**
+ * @brief  Get the reader counters of the calling thread
+ * @note
+ * @param  *epoch: epoch domain whose counters to use
+ * @retval pointer to the thread's slot
+ */
+static epoch_slot_t *reader_slot(epoch_t *epoch) {
+  if (thread_slot == -1)
+    thread_slot = __atomic_fetch_add(&next_slot, 1, __ATOMIC_RELAXED) % EPOCH_SLOTS;
+  return &epoch->slots[thread_slot];
+}
+
+/**
+ * @brief  Free every object in a limbo list and empty it
+ * @note
+ * @param  *limbo: list to free
+ * @retval None
+ */
+static void limbo_free_all(epoch_limbo_t *limbo) {
+  for (size_t i = 0; i < limbo->count; i++)
+    limbo->items[i].free_fn(limbo->items[i].ptr);
+  limbo->count = 0;
+}
+
+/**
+ * @brief  Initialize an epoch domain
+ * @note
+ * @param  *epoch: domain to initialize
+ * @retval None
+ */
+void epoch_init(epoch_t *epoch) {
+  for (int i = 0; i < EPOCH_SLOTS; i++) {
+    for (int e = 0; e < 3; e++)
+      epoch->slots[i].active[e] = 0;
+  }
+  epoch->global = 0;
+  pthread_mutex_init(&epoch->limbo_lock, NULL);
+  for (int e = 0; e < 3; e++) {
+    epoch->limbo[e].items = NULL;
+    epoch->limbo[e].count = 0;
+    epoch->limbo[e].capacity = 0;
+  }
+}
+
+/**
+ * @brief  Destroy an epoch domain
+ * @note   Frees every retired object, so no reader may be inside
+ * @param  *epoch: domain to destroy
+ * @retval None
+ */
+void epoch_destroy(epoch_t *epoch) {
+  for (int e = 0; e < 3; e++) {
+    limbo_free_all(&epoch->limbo[e]);
+    free(epoch->limbo[e].items);
+    epoch->limbo[e].items = NULL;
+    epoch->limbo[e].capacity = 0;
+  }
+  pthread_mutex_destroy(&epoch->limbo_lock);
+}
+
+/**
+ * @brief  Enter a read-side section
+ * @note   Shared objects loaded after this call stay valid until epoch_exit
+ * @param  *epoch: domain to enter
+ * @retval the epoch the reader registered in, to pass to epoch_exit
+ */
+unsigned long epoch_enter(epoch_t *epoch) {
+  int *active = reader_slot(epoch)->active;
+  while (true) {
+    unsigned long e = __atomic_load_n(&epoch->global, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&active[e % 3], 1, __ATOMIC_SEQ_CST);
+    // if the epoch moved on before we were counted, a reclaimer may not have
+    // seen us; register again in the current epoch
+    if (__atomic_load_n(&epoch->global, __ATOMIC_SEQ_CST) == e)
+      return e;
+    __atomic_sub_fetch(&active[e % 3], 1, __ATOMIC_SEQ_CST);
+  }
+}
+
+/**
+ * @brief  Leave a read-side section
+ * @note
+ * @param  *epoch: domain to leave
+ * @param  entered: value returned by epoch_enter
+ * @retval None
+ */
+void epoch_exit(epoch_t *epoch, unsigned long entered) {
+  __atomic_sub_fetch(&reader_slot(epoch)->active[entered % 3], 1, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * @brief  Retire an object that new readers can no longer reach
+ * @note
+ * @param  *epoch: domain the readers of the object use
+ * @param  *ptr: object to free later
+ * @param  free_fn: function that frees the object
+ * @retval None
+ */
+void epoch_retire(epoch_t *epoch, void *ptr, void (*free_fn)(void *)) {
+  pthread_mutex_lock(&epoch->limbo_lock);
+  epoch_limbo_t *limbo = &epoch->limbo[epoch->global % 3];
+  if (limbo->count == limbo->capacity) {
+    limbo->capacity = limbo->capacity == 0 ? 64 : limbo->capacity * 2;
+    limbo->items = (epoch_retired_t *)realloc(limbo->items, limbo->capacity * sizeof(epoch_retired_t));
+  }
+  limbo->items[limbo->count].ptr = ptr;
+  limbo->items[limbo->count].free_fn = free_fn;
+  limbo->count++;
+  pthread_mutex_unlock(&epoch->limbo_lock);
+}
+
+/**
+ * @brief  Advance the global epoch if no reader is left in the previous one
+ * @note   Readers still inside only delay reclamation, they never block the caller
+ * @param  *epoch: domain to reclaim from
+ * @retval None
+ */
+void epoch_reclaim(epoch_t *epoch) {
+  pthread_mutex_lock(&epoch->limbo_lock);
+  unsigned long e = epoch->global;
+
+  // give up while any reader of epoch e-1 is still inside
+  for (int i = 0; i < EPOCH_SLOTS; i++) {
+    if (__atomic_load_n(&epoch->slots[i].active[(e + 2) % 3], __ATOMIC_SEQ_CST) != 0) {
+      pthread_mutex_unlock(&epoch->limbo_lock);
+      return;
+    }
+  }
+
+  // readers of epoch e registered after everything retired during e-1 was
+  // unlinked, so those objects can go; their list is reused for epoch e+2
+  limbo_free_all(&epoch->limbo[(e + 2) % 3]);
+  __atomic_store_n(&epoch->global, e + 1, __ATOMIC_SEQ_CST);
+  pthread_mutex_unlock(&epoch->limbo_lock);
+}
@@ -0,0 +1,62 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+// Epoch-based reclamation. Readers bracket every access to shared objects
+// with epoch_enter/epoch_exit; writers hand unlinked objects to epoch_retire
+// and they are freed once no reader that could still see them is left.
+//
+// The global epoch only moves from e to e+1 once no reader is left inside
+// epoch e-1. Readers of epoch e registered after anything retired during e-1
+// was unlinked, so those objects are freed at that point. Readers only ever
+// write their own thread's counter.
+
+// Number of reader counters. Threads are assigned one round-robin, so readers
+// on different cores normally increment different cache lines.
+#define EPOCH_SLOTS 32
+
+typedef struct epoch_slot {
+  int active[3];  // readers inside a section, indexed by epoch mod 3
+} __attribute__((aligned(64))) epoch_slot_t;
+
+typedef struct epoch_retired {
+  void* ptr;
+  void (*free_fn)(void*);
+} epoch_retired_t;
+
+typedef struct epoch_limbo {
+  epoch_retired_t* items;
+  size_t count;
+  size_t capacity;
+} epoch_limbo_t;
+
+typedef struct epoch {
+  epoch_slot_t slots[EPOCH_SLOTS];
+  unsigned long global __attribute__((aligned(64)));
+  pthread_mutex_t limbo_lock;  // protects the limbo lists and advancing the epoch
+  epoch_limbo_t limbo[3];      // objects retired during each epoch, mod 3
+} epoch_t;
+
+// Initialize an epoch domain
+void epoch_init(epoch_t* epoch);
+
+// Destroy an epoch domain, freeing everything still retired. No reader may be inside.
+void epoch_destroy(epoch_t* epoch);
+
+// Enter a read-side section. Pass the result to epoch_exit.
+unsigned long epoch_enter(epoch_t* epoch);
+
+// Leave a read-side section
+void epoch_exit(epoch_t* epoch, unsigned long entered);
+
+// Free an object with free_fn once no reader can still hold a reference to it.
+// The object must already be unreachable for new readers.
+void epoch_retire(epoch_t* epoch, void* ptr, void (*free_fn)(void*));
+
+// Advance the epoch if possible and free whatever became safe to free. Never blocks on readers.
+void epoch_reclaim(epoch_t* epoch);
+
+#endif
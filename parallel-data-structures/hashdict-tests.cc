@@ -0,0 +1,177 @@
+#include <gtest/gtest.h>
+
+#include "hashdict.hh"
+#include <pthread.h>
+#include <stdio.h>
+
+/****** Dictionary Invariants ******/
+
+// Invariant 1
+// Value for any key should not change, unless specified.
+
+// Invariant 2
+// There are no duplicate entires with the same key, including while entries
+// are being moved from the old table to the new one during a resize.
+
+/****** Synchronization ******/
+
+// Under what circumstances can accesses to your dictionary structure can
+// proceed in parallel? Answer below.
+//
+// Any two accesses to keys that hash to different lock stripes, whether they
+// read or write.
+//
+
+// When will two accesses to your dictionary structure be ordered by
+// synchronization? Answer below.
+//
+// Accesses to keys in the same stripe are ordered by the stripe's lock. Only
+// swapping in a new table takes every stripe lock, and that never waits on
+// moving entries.
+//
+
+/****** Begin Tests ******/
+
+// Basic functionality for the dictionary
+TEST(HashDictionaryTest, BasicDictionaryOps) {
+  my_hashdict_t d;
+  hashdict_init(&d);
+
+  // Make sure the dictionary does not contain keys A, B, and C
+  ASSERT_FALSE(hashdict_contains(&d, "A"));
+  ASSERT_FALSE(hashdict_contains(&d, "B"));
+  ASSERT_FALSE(hashdict_contains(&d, "C"));
+
+  // Add some values
+  hashdict_set(&d, "A", 1);
+  hashdict_set(&d, "B", 2);
+  hashdict_set(&d, "C", 3);
+
+  // Make sure these values are in the dictionary
+  ASSERT_TRUE(hashdict_contains(&d, "A"));
+  ASSERT_EQ(1, hashdict_get(&d, "A"));
+  ASSERT_EQ(2, hashdict_get(&d, "B"));
+  ASSERT_EQ(3, hashdict_get(&d, "C"));
+
+  // Set some new values
+  hashdict_set(&d, "A", 10);
+  hashdict_set(&d, "B", 20);
+  hashdict_set(&d, "C", 30);
+  ASSERT_EQ(10, hashdict_get(&d, "A"));
+  ASSERT_EQ(20, hashdict_get(&d, "B"));
+  ASSERT_EQ(30, hashdict_get(&d, "C"));
+
+  // Remove the values
+  hashdict_remove(&d, "A");
+  hashdict_remove(&d, "B");
+  hashdict_remove(&d, "C");
+
+  // Make sure we get -1 for each value
+  ASSERT_FALSE(hashdict_contains(&d, "A"));
+  ASSERT_EQ(-1, hashdict_get(&d, "A"));
+  ASSERT_EQ(-1, hashdict_get(&d, "B"));
+  ASSERT_EQ(-1, hashdict_get(&d, "C"));
+
+  // Clean up
+  hashdict_destroy(&d);
+}
+
+// Keys are copied, so the caller's buffer can be reused
+TEST(HashDictionaryTest, KeysAreCopied) {
+  my_hashdict_t d;
+  hashdict_init(&d);
+
+  char key[16];
+  for (int i = 0; i < 100; i++) {
+    snprintf(key, sizeof(key), "key%d", i);
+    hashdict_set(&d, key, i);
+  }
+  for (int i = 0; i < 100; i++) {
+    snprintf(key, sizeof(key), "key%d", i);
+    ASSERT_EQ(i, hashdict_get(&d, key));
+  }
+
+  hashdict_destroy(&d);
+}
+
+#define KEYS_PER_THREAD 20000
+#define NUM_THREADS 4
+
+typedef struct hash_thread_args {
+  int id;
+  my_hashdict_t *d;
+} hash_thread_args_t;
+
+/**
+ * @brief  Insert a disjoint range of keys, overwrite them, and remove every
+ * third one, while other threads do the same and the table resizes underneath
+ * @note
+ * @param  *thread_args: struct with the thread id and the dictionary
+ * @retval None
+ */
+void *hash_thread_run(void *thread_args) {
+  hash_thread_args_t *arguments = (hash_thread_args_t *)thread_args;
+  char key[32];
+  for (int i = 0; i < KEYS_PER_THREAD; i++) {
+    snprintf(key, sizeof(key), "t%d-%d", arguments->id, i);
+    hashdict_set(arguments->d, key, i);
+  }
+  for (int i = 0; i < KEYS_PER_THREAD; i++) {
+    snprintf(key, sizeof(key), "t%d-%d", arguments->id, i);
+    if (i % 3 == 0)
+      hashdict_remove(arguments->d, key);
+    else
+      hashdict_set(arguments->d, key, -i);
+  }
+  return NULL;
+}
+
+/**
+ * @brief  Check both invariants while several resizes happen concurrently
+ * @note
+ * @retval
+ */
+TEST(HashDictionaryTest, ConcurrentWritersDuringResize) {
+  my_hashdict_t d;
+  hashdict_init(&d);
+
+  pthread_t threads[NUM_THREADS];
+  hash_thread_args_t arguments[NUM_THREADS];
+
+  // Spawn the threads with the appropriate information
+  for (int i = 0; i < NUM_THREADS; i++) {
+    arguments[i].id = i;
+    arguments[i].d = &d;
+    int ret = pthread_create(&threads[i], NULL, hash_thread_run, &arguments[i]);
+    if (ret != 0)
+      perror("Error creating thread");
+  }
+
+  // Join the threads
+  for (int i = 0; i < NUM_THREADS; i++) {
+    int ret = pthread_join(threads[i], NULL);
+    if (ret != 0)
+      perror("Error joining thread");
+  }
+
+  // The table must have grown well past its initial size
+  ASSERT_GT(d.table->num_buckets, (size_t)HASHDICT_INITIAL_BUCKETS);
+
+  // Every surviving key holds its last value; removing it once removes it for good
+  char key[32];
+  for (int t = 0; t < NUM_THREADS; t++) {
+    for (int i = 0; i < KEYS_PER_THREAD; i++) {
+      snprintf(key, sizeof(key), "t%d-%d", t, i);
+      if (i % 3 == 0) {
+        ASSERT_FALSE(hashdict_contains(&d, key));
+      } else {
+        ASSERT_EQ(-i, hashdict_get(&d, key));
+        hashdict_remove(&d, key);
+        ASSERT_FALSE(hashdict_contains(&d, key));
+      }
+    }
+  }
+
+  // clean up
+  hashdict_destroy(&d);
+}
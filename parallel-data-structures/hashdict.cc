@@ -0,0 +1,359 @@
+#include "hashdict.hh"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief  Hash a key with 64-bit FNV-1a
+ * @note
+ * @param  *key: key to hash
+ * @retval the hash of the key
+ */
+static unsigned long hash_key(const char *key) {
+  unsigned long hash = 14695981039346656037UL;
+  for (const unsigned char *c = (const unsigned char *)key; *c != '\0'; c++) {
+    hash ^= *c;
+    hash *= 1099511628211UL;
+  }
+  return hash;
+}
+
+/**
+ * @brief  Allocate an empty table
+ * @note
+ * @param  num_buckets: number of buckets, a power of two no smaller than HASHDICT_STRIPES
+ * @retval pointer to the new table
+ */
+static hashdict_table_t *table_create(size_t num_buckets) {
+  hashdict_table_t *table = (hashdict_table_t *)malloc(sizeof(hashdict_table_t));
+  table->num_buckets = num_buckets;
+  table->buckets = (hashdict_entry_t **)calloc(num_buckets, sizeof(hashdict_entry_t *));
+  return table;
+}
+
+/**
+ * @brief  Free a table and, optionally, every entry still in it
+ * @note
+ * @param  *table: table to free
+ * @param  free_entries: whether to free the entries as well
+ * @retval None
+ */
+static void table_free(hashdict_table_t *table, bool free_entries) {
+  if (free_entries) {
+    for (size_t b = 0; b < table->num_buckets; b++) {
+      hashdict_entry_t *cur = table->buckets[b];
+      while (cur != NULL) {
+        hashdict_entry_t *next = cur->next;
+        free(cur);
+        cur = next;
+      }
+    }
+  }
+  free(table->buckets);
+  free(table);
+}
+
+/**
+ * @brief  Lock every stripe, in order
+ * @note   Only used to swap tables, so it never waits on a whole-table rehash
+ * @param  *dict: dictionary to lock
+ * @retval None
+ */
+static void lock_all_stripes(my_hashdict_t *dict) {
+  for (int s = 0; s < HASHDICT_STRIPES; s++)
+    pthread_mutex_lock(&dict->stripes[s].lock);
+}
+
+/**
+ * @brief  Unlock every stripe
+ * @note
+ * @param  *dict: dictionary to unlock
+ * @retval None
+ */
+static void unlock_all_stripes(my_hashdict_t *dict) {
+  for (int s = HASHDICT_STRIPES - 1; s >= 0; s--)
+    pthread_mutex_unlock(&dict->stripes[s].lock);
+}
+
+/**
+ * @brief  Move every entry of one old bucket into the current table
+ * @note   The caller holds the bucket's stripe lock. Moving a bucket twice is harmless.
+ * @param  *dict: dictionary being resized
+ * @param  b: index of the bucket in the old table
+ * @retval None
+ */
+static void migrate_bucket(my_hashdict_t *dict, size_t b) {
+  hashdict_table_t *table = dict->table;
+  hashdict_entry_t *cur = dict->old_table->buckets[b];
+  while (cur != NULL) {
+    hashdict_entry_t *next = cur->next;
+    hashdict_entry_t **bucket = &table->buckets[cur->hash & (table->num_buckets - 1)];
+    cur->next = *bucket;
+    *bucket = cur;
+    cur = next;
+  }
+  dict->old_table->buckets[b] = NULL;
+}
+
+/**
+ * @brief  Move the next few old buckets belonging to a stripe
+ * @note   The caller holds the stripe lock
+ * @param  *dict: dictionary being resized
+ * @param  s: index of the stripe
+ * @param  count: maximum number of buckets to move
+ * @retval true if this call moved the last old bucket of the whole table
+ */
+static bool migrate_stripe(my_hashdict_t *dict, int s, size_t count) {
+  hashdict_stripe_t *stripe = &dict->stripes[s];
+  size_t share = dict->old_table->num_buckets / HASHDICT_STRIPES;
+  if (stripe->migrate_cursor == share)
+    return false;
+
+  while (stripe->migrate_cursor < share && count-- > 0) {
+    migrate_bucket(dict, s + stripe->migrate_cursor * HASHDICT_STRIPES);
+    stripe->migrate_cursor++;
+  }
+  if (stripe->migrate_cursor < share)
+    return false;
+  return __atomic_sub_fetch(&dict->stripes_pending, 1, __ATOMIC_SEQ_CST) == 0;
+}
+
+/**
+ * @brief  Free the old table once every stripe has moved its buckets out of it
+ * @note
+ * @param  *dict: dictionary being resized
+ * @retval None
+ */
+static void finish_resize(my_hashdict_t *dict) {
+  pthread_mutex_lock(&dict->resize_lock);
+  lock_all_stripes(dict);
+  hashdict_table_t *old = NULL;
+  if (dict->old_table != NULL && dict->stripes_pending == 0) {
+    old = dict->old_table;
+    dict->old_table = NULL;
+  }
+  unlock_all_stripes(dict);
+  pthread_mutex_unlock(&dict->resize_lock);
+  if (old != NULL)
+    table_free(old, false);
+}
+
+/**
+ * @brief  Double the number of buckets
+ * @note   Only allocates the new table; entries move over a few buckets at a
+ *         time as later operations lock their stripes
+ * @param  *dict: dictionary to grow
+ * @param  seen_buckets: bucket count the caller decided to grow from
+ * @retval None
+ */
+static void grow_table(my_hashdict_t *dict, size_t seen_buckets) {
+  pthread_mutex_lock(&dict->resize_lock);
+  if (dict->table->num_buckets != seen_buckets) {
+    // someone else already grew the table
+    pthread_mutex_unlock(&dict->resize_lock);
+    return;
+  }
+
+  // a previous resize is still in progress: finish it one stripe at a time
+  if (dict->old_table != NULL) {
+    for (int s = 0; s < HASHDICT_STRIPES; s++) {
+      pthread_mutex_lock(&dict->stripes[s].lock);
+      migrate_stripe(dict, s, (size_t)-1);
+      pthread_mutex_unlock(&dict->stripes[s].lock);
+    }
+    lock_all_stripes(dict);
+    hashdict_table_t *old = dict->old_table;
+    dict->old_table = NULL;
+    unlock_all_stripes(dict);
+    table_free(old, false);
+  }
+
+  hashdict_table_t *table = table_create(seen_buckets * 2);
+  lock_all_stripes(dict);
+  dict->old_table = dict->table;
+  dict->table = table;
+  for (int s = 0; s < HASHDICT_STRIPES; s++)
+    dict->stripes[s].migrate_cursor = 0;
+  dict->stripes_pending = HASHDICT_STRIPES;
+  unlock_all_stripes(dict);
+  pthread_mutex_unlock(&dict->resize_lock);
+}
+
+/**
+ * @brief  Lock the stripe of a key and make sure its bucket is in the current table
+ * @note   Also helps an ongoing resize along by moving a few more old buckets
+ * @param  *dict: dictionary to lock
+ * @param  hash: hash of the key
+ * @param  *finished: set to whether this call completed an ongoing resize
+ * @retval the locked stripe
+ */
+static hashdict_stripe_t *lock_stripe(my_hashdict_t *dict, unsigned long hash, bool *finished) {
+  int s = hash & (HASHDICT_STRIPES - 1);
+  hashdict_stripe_t *stripe = &dict->stripes[s];
+  pthread_mutex_lock(&stripe->lock);
+  *finished = false;
+  if (dict->old_table != NULL) {
+    migrate_bucket(dict, hash & (dict->old_table->num_buckets - 1));
+    *finished = migrate_stripe(dict, s, HASHDICT_MIGRATE_BATCH);
+  }
+  return stripe;
+}
+
+/**
+ * @brief  Unlock a stripe and start or finish a resize if needed
+ * @note
+ * @param  *dict: dictionary to unlock
+ * @param  *stripe: stripe returned by lock_stripe
+ * @param  finished: the value lock_stripe reported
+ * @retval None
+ */
+static void unlock_stripe(my_hashdict_t *dict, hashdict_stripe_t *stripe, bool finished) {
+  size_t num_buckets = dict->table->num_buckets;
+  bool grow = stripe->count > HASHDICT_MAX_LOAD * (num_buckets / HASHDICT_STRIPES);
+  pthread_mutex_unlock(&stripe->lock);
+
+  if (finished)
+    finish_resize(dict);
+  if (grow)
+    grow_table(dict, num_buckets);
+}
+
+/**
+ * @brief  Find the link pointing at the entry for a key in the current table
+ * @note   The caller holds the key's stripe lock
+ * @param  *dict: dictionary to search
+ * @param  *key: key to look for
+ * @param  hash: hash of the key
+ * @retval pointer to the link holding the entry, or to the bucket's terminating NULL
+ */
+static hashdict_entry_t **find_link(my_hashdict_t *dict, const char *key, unsigned long hash) {
+  hashdict_table_t *table = dict->table;
+  hashdict_entry_t **link = &table->buckets[hash & (table->num_buckets - 1)];
+  while (*link != NULL && ((*link)->hash != hash || strcmp((*link)->key, key) != 0))
+    link = &(*link)->next;
+  return link;
+}
+
+/**
+ * @brief  Initialize the dictionary
+ * @note
+ * @param  *dict: dictionary to initialize
+ * @retval None
+ */
+void hashdict_init(my_hashdict_t *dict) {
+  for (int s = 0; s < HASHDICT_STRIPES; s++) {
+    pthread_mutex_init(&dict->stripes[s].lock, NULL);
+    dict->stripes[s].count = 0;
+    dict->stripes[s].migrate_cursor = 0;
+  }
+  dict->table = table_create(HASHDICT_INITIAL_BUCKETS);
+  dict->old_table = NULL;
+  dict->stripes_pending = 0;
+  pthread_mutex_init(&dict->resize_lock, NULL);
+}
+
+/**
+ * @brief  Destroy the dictionary
+ * @note
+ * @param  *dict: dictionary to destroy
+ * @retval None
+ */
+void hashdict_destroy(my_hashdict_t *dict) {
+  pthread_mutex_lock(&dict->resize_lock);
+  lock_all_stripes(dict);
+  table_free(dict->table, true);
+  if (dict->old_table != NULL)
+    table_free(dict->old_table, true);
+  dict->table = NULL;
+  dict->old_table = NULL;
+  unlock_all_stripes(dict);
+  pthread_mutex_unlock(&dict->resize_lock);
+}
+
+/**
+ * @brief  Add a new entry to the dictionary, or overwrite the value of an existing one
+ * @note   The key is copied into the entry
+ * @param  *dict: pointer to the dictionary the entry is to be added
+ * @param  *key: key of the new entry
+ * @param  value: value of the new entry
+ * @retval None
+ */
+void hashdict_set(my_hashdict_t *dict, const char *key, int value) {
+  unsigned long hash = hash_key(key);
+  bool finished;
+  hashdict_stripe_t *stripe = lock_stripe(dict, hash, &finished);
+
+  hashdict_entry_t **link = find_link(dict, key, hash);
+  if (*link != NULL) {
+    (*link)->value = value;
+  } else {
+    size_t len = strlen(key);
+    hashdict_entry_t *entry = (hashdict_entry_t *)malloc(sizeof(hashdict_entry_t) + len + 1);
+    entry->key = (char *)(entry + 1);
+    memcpy(entry->key, key, len + 1);
+    entry->hash = hash;
+    entry->value = value;
+    entry->next = NULL;
+    *link = entry;
+    stripe->count++;
+  }
+
+  unlock_stripe(dict, stripe, finished);
+}
+
+/**
+ * @brief  Function to check if the given key is in the dictionary
+ * @note
+ * @param  *dict: dictionary to check
+ * @param  *key: key to check the existence of
+ * @retval boolean
+ */
+bool hashdict_contains(my_hashdict_t *dict, const char *key) {
+  unsigned long hash = hash_key(key);
+  bool finished;
+  hashdict_stripe_t *stripe = lock_stripe(dict, hash, &finished);
+  bool ret = *find_link(dict, key, hash) != NULL;
+  unlock_stripe(dict, stripe, finished);
+  return ret;
+}
+
+/**
+ * @brief  Function to get the value for a given key
+ * @note
+ * @param  *dict: dictionary from which the value is retreived
+ * @param  *key: key of the interested entry
+ * @retval the value of the corresponding key, if not present -1
+ */
+int hashdict_get(my_hashdict_t *dict, const char *key) {
+  unsigned long hash = hash_key(key);
+  bool finished;
+  hashdict_stripe_t *stripe = lock_stripe(dict, hash, &finished);
+  hashdict_entry_t *entry = *find_link(dict, key, hash);
+  int ret = entry == NULL ? -1 : entry->value;
+  unlock_stripe(dict, stripe, finished);
+  return ret;
+}
+
+/**
+ * @brief  Function to remove an entry
+ * @note
+ * @param  *dict: dictionary from which to remove an entry
+ * @param  *key: key of the entry to remove
+ * @retval None
+ */
+void hashdict_remove(my_hashdict_t *dict, const char *key) {
+  unsigned long hash = hash_key(key);
+  bool finished;
+  hashdict_stripe_t *stripe = lock_stripe(dict, hash, &finished);
+
+  hashdict_entry_t **link = find_link(dict, key, hash);
+  hashdict_entry_t *entry = *link;
+  if (entry != NULL) {
+    *link = entry->next;
+    stripe->count--;
+  }
+
+  unlock_stripe(dict, stripe, finished);
+  free(entry);
+}
@@ -0,0 +1,64 @@
+#ifndef HASHDICT_H
+#define HASHDICT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+// Number of lock stripes. Bucket counts are powers of two no smaller than this,
+// so a key maps to the same stripe in the current and the old table.
+#define HASHDICT_STRIPES 64
+#define HASHDICT_INITIAL_BUCKETS 256
+// Average entries per bucket before the table doubles
+#define HASHDICT_MAX_LOAD 2
+// Old buckets moved to the new table by each operation during a resize
+#define HASHDICT_MIGRATE_BATCH 4
+
+typedef struct hashdict_entry {
+  struct hashdict_entry* next;
+  unsigned long hash;
+  int value;
+  char* key;  // stored right after the entry
+} hashdict_entry_t;
+
+typedef struct hashdict_table {
+  size_t num_buckets;
+  hashdict_entry_t** buckets;
+} hashdict_table_t;
+
+// Each stripe sits on its own cache line so writers to different stripes do
+// not share any lock state.
+typedef struct hashdict_stripe {
+  pthread_mutex_t lock;
+  size_t count;           // entries whose key hashes to this stripe
+  size_t migrate_cursor;  // old buckets of this stripe already moved
+} __attribute__((aligned(64))) hashdict_stripe_t;
+
+typedef struct my_hashdict {
+  hashdict_stripe_t stripes[HASHDICT_STRIPES];
+  // Only swapped while holding every stripe lock, so they are stable under any one
+  hashdict_table_t* table;
+  hashdict_table_t* old_table;  // table being migrated away from, or NULL
+  int stripes_pending;          // stripes that still have old buckets to move
+  pthread_mutex_t resize_lock;
+} my_hashdict_t;
+
+// Initialize a dictionary
+void hashdict_init(my_hashdict_t* dict);
+
+// Destroy a dictionary
+void hashdict_destroy(my_hashdict_t* dict);
+
+// Set a value in a dictionary
+void hashdict_set(my_hashdict_t* dict, const char* key, int value);
+
+// Check if a dictionary contains a key
+bool hashdict_contains(my_hashdict_t* dict, const char* key);
+
+// Get a value in a dictionary
+int hashdict_get(my_hashdict_t* dict, const char* key);
+
+// Remove a value from a dictionary
+void hashdict_remove(my_hashdict_t* dict, const char* key);
+
+#endif
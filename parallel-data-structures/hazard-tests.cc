@@ -0,0 +1,114 @@
+#include <gtest/gtest.h>
+
+#include "hazard.hh"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/****** Hazard Pointer Invariants ******/
+
+// Invariant 1
+// A node retired while some thread's hazard pointer names it is not freed
+// until that hazard pointer is cleared.
+
+// Invariant 2
+// Every retired node is eventually freed once no hazard pointer names it,
+// even if the thread that retired it has exited.
+
+/****** Begin Tests ******/
+
+#define MAGIC 0x213213
+
+typedef struct counted {
+  int magic;
+  int *freed;
+} counted_t;
+
+/**
+ * @brief  Free function that counts and poisons what it frees
+ * @note
+ * @param  *ptr: counted_t to free
+ * @retval None
+ */
+void counted_free(void *ptr) {
+  counted_t *obj = (counted_t *)ptr;
+  __atomic_add_fetch(obj->freed, 1, __ATOMIC_SEQ_CST);
+  obj->magic = 0;
+  free(obj);
+}
+
+/**
+ * @brief  Allocate a counted object
+ * @note
+ * @param  *freed: counter to bump when it is freed
+ * @retval pointer to the new object
+ */
+counted_t *counted_new(int *freed) {
+  counted_t *obj = (counted_t *)malloc(sizeof(counted_t));
+  obj->magic = MAGIC;
+  obj->freed = freed;
+  return obj;
+}
+
+// Filler nodes freed so far; some outlive the test that retired them
+static int filler_freed = 0;
+
+/**
+ * @brief  Retire enough unprotected filler nodes that the calling thread scans
+ * @note
+ * @retval None
+ */
+void retire_batch(void) {
+  for (int i = 0; i < HAZARD_RETIRE_BATCH; i++)
+    hazard_retire(counted_new(&filler_freed), counted_free);
+}
+
+// Invariants 1 and 2 on a single thread
+TEST(HazardTest, ProtectedNodeIsKept) {
+  int kept_freed = 0;
+  counted_t *kept = counted_new(&kept_freed);
+  hazard_set(0, kept);
+  hazard_retire(kept, counted_free);
+
+  // scans free the other nodes but not the protected one
+  retire_batch();
+  ASSERT_LT(0, __atomic_load_n(&filler_freed, __ATOMIC_SEQ_CST));
+  ASSERT_EQ(0, kept_freed);
+  ASSERT_EQ(MAGIC, kept->magic);
+
+  // once it is cleared, the next scan frees it
+  hazard_clear();
+  retire_batch();
+  ASSERT_EQ(1, kept_freed);
+}
+
+/**
+ * @brief  Retire a node and exit
+ * @note
+ * @param  *arg: counted_t to retire
+ * @retval None
+ */
+void *hazard_retire_and_exit(void *arg) {
+  hazard_retire(arg, counted_free);
+  return NULL;
+}
+
+// Invariant 2 for a node still protected when the retiring thread exits
+TEST(HazardTest, ExitedThreadsNodesAreFreed) {
+  int kept_freed = 0;
+  counted_t *kept = counted_new(&kept_freed);
+  hazard_set(1, kept);
+
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, hazard_retire_and_exit, kept) != 0)
+    perror("Error creating thread");
+  if (pthread_join(thread, NULL) != 0)
+    perror("Error joining thread");
+  ASSERT_EQ(0, kept_freed);
+  ASSERT_EQ(MAGIC, kept->magic);
+
+  // the exited thread left it behind; this thread's next scan adopts and frees it
+  hazard_clear();
+  retire_batch();
+  ASSERT_EQ(1, kept_freed);
+}
@@ -0,0 +1,207 @@
+#include "hazard.hh"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct hazard_record {
+  void *hazard[HAZARD_PER_THREAD];
+  int in_use;
+} __attribute__((aligned(64))) hazard_record_t;
+
+typedef struct hazard_retired {
+  void *ptr;
+  void (*free_fn)(void *);
+} hazard_retired_t;
+
+// Retired nodes left behind by threads that exited while other threads still
+// protected them; adopted by the next thread that scans
+typedef struct orphan_batch {
+  struct orphan_batch *next;
+  int count;
+  hazard_retired_t nodes[];
+} orphan_batch_t;
+
+// Hazard records, and how many have ever been claimed
+static hazard_record_t records[HAZARD_MAX_THREADS];
+static int num_records = 0;
+static orphan_batch_t *orphans = NULL;
+
+// Releases a thread's record when it exits
+static pthread_key_t record_key;
+static pthread_once_t record_key_once = PTHREAD_ONCE_INIT;
+
+// Record and retired nodes of the calling thread
+static __thread hazard_record_t *thread_record = NULL;
+static __thread hazard_retired_t *retired = NULL;
+static __thread int num_retired = 0;
+static __thread int retired_capacity = 0;
+
+/**
+ * @brief  Order node pointers for sorting and searching
+ * @note
+ * @param  *a: pointer to the first node pointer
+ * @param  *b: pointer to the second node pointer
+ * @retval negative, zero or positive like strcmp
+ */
+static int pointer_compare(const void *a, const void *b) {
+  uintptr_t x = (uintptr_t)*(void *const *)a;
+  uintptr_t y = (uintptr_t)*(void *const *)b;
+  return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief  Add a node to the calling thread's retired list
+ * @note
+ * @param  node: node and how to free it
+ * @retval None
+ */
+static void retired_append(hazard_retired_t node) {
+  if (num_retired == retired_capacity) {
+    retired_capacity = retired_capacity == 0 ? HAZARD_RETIRE_BATCH : retired_capacity * 2;
+    retired = (hazard_retired_t *)realloc(retired, retired_capacity * sizeof(hazard_retired_t));
+  }
+  retired[num_retired++] = node;
+}
+
+/**
+ * @brief  Free every retired node that no hazard record protects
+ * @note   Orphaned nodes are adopted first, so they get freed too
+ * @retval None
+ */
+static void scan(void) {
+  orphan_batch_t *batch = __atomic_exchange_n(&orphans, NULL, __ATOMIC_ACQUIRE);
+  while (batch != NULL) {
+    orphan_batch_t *next = batch->next;
+    for (int i = 0; i < batch->count; i++)
+      retired_append(batch->nodes[i]);
+    free(batch);
+    batch = next;
+  }
+
+  // the retiring thread's seq_cst unlinking of a node comes before this load,
+  // so a thread whose hazard is not seen yet will see the node unlinked
+  int n = __atomic_load_n(&num_records, __ATOMIC_SEQ_CST);
+  void *protected_nodes[HAZARD_PER_THREAD * HAZARD_MAX_THREADS];
+  int num_protected = 0;
+  for (int i = 0; i < n; i++) {
+    for (int h = 0; h < HAZARD_PER_THREAD; h++) {
+      void *node = __atomic_load_n(&records[i].hazard[h], __ATOMIC_SEQ_CST);
+      if (node != NULL)
+        protected_nodes[num_protected++] = node;
+    }
+  }
+  qsort(protected_nodes, num_protected, sizeof(void *), pointer_compare);
+
+  int kept = 0;
+  for (int i = 0; i < num_retired; i++) {
+    if (bsearch(&retired[i].ptr, protected_nodes, num_protected, sizeof(void *), pointer_compare) != NULL)
+      retired[kept++] = retired[i];
+    else
+      retired[i].free_fn(retired[i].ptr);
+  }
+  num_retired = kept;
+}
+
+/**
+ * @brief  Give up a thread's hazard record when it exits
+ * @note   Nodes still protected by other threads are left as an orphan batch
+ * @param  *arg: the thread's record
+ * @retval None
+ */
+static void release_record(void *arg) {
+  hazard_record_t *record = (hazard_record_t *)arg;
+  for (int h = 0; h < HAZARD_PER_THREAD; h++)
+    __atomic_store_n(&record->hazard[h], NULL, __ATOMIC_RELEASE);
+  scan();
+  if (num_retired > 0) {
+    orphan_batch_t *batch = (orphan_batch_t *)malloc(sizeof(orphan_batch_t) + num_retired * sizeof(hazard_retired_t));
+    batch->count = num_retired;
+    for (int i = 0; i < num_retired; i++)
+      batch->nodes[i] = retired[i];
+    batch->next = __atomic_load_n(&orphans, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&orphans, &batch->next, batch, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+  }
+  free(retired);
+  retired = NULL;
+  num_retired = 0;
+  retired_capacity = 0;
+  thread_record = NULL;
+  __atomic_store_n(&record->in_use, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief  Create the key that releases records at thread exit
+ * @note
+ * @retval None
+ */
+static void create_record_key(void) {
+  pthread_key_create(&record_key, release_record);
+}
+
+/**
+ * @brief  Get the hazard record of the calling thread, claiming one on first use
+ * @note   Aborts if more than HAZARD_MAX_THREADS threads hold records at once
+ * @retval the thread's record
+ */
+static hazard_record_t *my_record(void) {
+  if (thread_record != NULL)
+    return thread_record;
+  pthread_once(&record_key_once, create_record_key);
+  for (int i = 0; i < HAZARD_MAX_THREADS; i++) {
+    int free_record = 0;
+    if (__atomic_load_n(&records[i].in_use, __ATOMIC_RELAXED) == 0 &&
+        __atomic_compare_exchange_n(&records[i].in_use, &free_record, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      int n = __atomic_load_n(&num_records, __ATOMIC_RELAXED);
+      while (n < i + 1 &&
+             !__atomic_compare_exchange_n(&num_records, &n, i + 1, true, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+      }
+      thread_record = &records[i];
+      pthread_setspecific(record_key, thread_record);
+      return thread_record;
+    }
+  }
+  fprintf(stderr, "hazard: more than %d threads\n", HAZARD_MAX_THREADS);
+  abort();
+}
+
+/**
+ * @brief  Publish a node in one of the calling thread's hazard pointers
+ * @note   Sequentially consistent, so a scan that starts after the caller
+ *         checks the node is still reachable sees it
+ * @param  h: hazard pointer, below HAZARD_PER_THREAD
+ * @param  *node: node to protect, or NULL
+ * @retval None
+ */
+void hazard_set(int h, void *node) {
+  __atomic_store_n(&my_record()->hazard[h], node, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * @brief  Clear the calling thread's hazard pointers
+ * @note
+ * @retval None
+ */
+void hazard_clear(void) {
+  hazard_record_t *record = my_record();
+  for (int h = 0; h < HAZARD_PER_THREAD; h++)
+    __atomic_store_n(&record->hazard[h], NULL, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief  Free a node once no hazard pointer names it
+ * @note   Scans the hazard records every HAZARD_RETIRE_BATCH nodes
+ * @param  *ptr: node no thread can reach anymore without protecting it first
+ * @param  free_fn: function that frees it
+ * @retval None
+ */
+void hazard_retire(void *ptr, void (*free_fn)(void *)) {
+  // claim a record now, so the thread's retired nodes are handed on at exit
+  my_record();
+  hazard_retired_t node = {ptr, free_fn};
+  retired_append(node);
+  if (num_retired >= HAZARD_RETIRE_BATCH)
+    scan();
+}
@@ -0,0 +1,36 @@
+#ifndef HAZARD_H
+#define HAZARD_H
+
+// Hazard pointers. Before dereferencing a shared node, a thread publishes it
+// in one of its hazard pointers and then checks that the node is still
+// reachable; nodes handed to hazard_retire are only freed once no hazard
+// pointer names them. Unlike epochs, a stalled thread keeps at most
+// HAZARD_PER_THREAD nodes alive, and a node can never be freed and reused
+// while a thread holds it, so a compare-and-swap on a protected node's
+// address cannot succeed on a different node at the same address (ABA).
+//
+// The hazard pointers are shared by every container that uses them.
+
+// Most threads that can hold hazard pointers at once. A thread claims its
+// record on its first use and hands it back when it exits.
+#define HAZARD_MAX_THREADS 256
+
+// Hazard pointers of each thread
+#define HAZARD_PER_THREAD 2
+
+// Retired nodes a thread collects before scanning the hazard records. At most
+// HAZARD_PER_THREAD per record can be protected, so every scan frees at least half.
+#define HAZARD_RETIRE_BATCH (2 * HAZARD_PER_THREAD * HAZARD_MAX_THREADS)
+
+// Publish a node in the calling thread's hazard pointer h. The caller must
+// then check that the node is still reachable before dereferencing it.
+void hazard_set(int h, void* node);
+
+// Clear all of the calling thread's hazard pointers
+void hazard_clear(void);
+
+// Free a node with free_fn once no hazard pointer names it. The node must
+// already be unreachable for threads that have not protected it yet.
+void hazard_retire(void* ptr, void (*free_fn)(void*));
+
+#endif
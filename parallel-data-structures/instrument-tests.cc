@@ -0,0 +1,161 @@
+#include <gtest/gtest.h>
+
+#include "instrument.hh"
+#include "queue.hh"
+#include "rwlock.hh"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+/****** Begin Tests ******/
+
+// Percentiles land in the right bucket and never exceed what was recorded
+TEST(InstrumentTest, Histogram) {
+  instrument_histogram_t hist;
+  memset(&hist, 0, sizeof(hist));
+  ASSERT_EQ(0u, instrument_count(&hist));
+  ASSERT_EQ(0u, instrument_percentile(&hist, 50));
+
+  // 90 short durations and 10 long ones
+  for (int i = 0; i < 90; i++)
+    instrument_record(&hist, 100 + i);
+  for (int i = 0; i < 10; i++)
+    instrument_record(&hist, 1000000 + i);
+  ASSERT_EQ(100u, instrument_count(&hist));
+  ASSERT_EQ(1000009u, hist.max_ns);
+
+  uint64_t p50 = instrument_percentile(&hist, 50);
+  ASSERT_GE(p50, 140u);
+  ASSERT_LE(p50, 140u * 5 / 4);
+  uint64_t p90 = instrument_percentile(&hist, 90);
+  ASSERT_GE(p90, 189u);
+  ASSERT_LE(p90, 189u * 5 / 4);
+  uint64_t p99 = instrument_percentile(&hist, 99);
+  ASSERT_GE(p99, 1000000u);
+  ASSERT_LE(p99, 1000009u);
+  ASSERT_EQ(1000009u, instrument_percentile(&hist, 100));
+
+  // tiny and huge durations have buckets too
+  instrument_record(&hist, 0);
+  instrument_record(&hist, ~(uint64_t)0 >> 4);
+  ASSERT_EQ(102u, instrument_count(&hist));
+  ASSERT_EQ(~(uint64_t)0 >> 4, instrument_percentile(&hist, 100));
+}
+
+#define NUM_THREADS 4
+#define OPS_PER_THREAD 5000
+
+/**
+ * @brief  Put and take elements
+ * @note
+ * @param  *arg: queue to use
+ * @retval None
+ */
+void *queue_run(void *arg) {
+  my_queue_t *queue = (my_queue_t *)arg;
+  for (int i = 0; i < OPS_PER_THREAD; i++) {
+    queue_put(queue, i);
+    if (i % 2 == 0)
+      queue_take(queue);
+  }
+  queue_empty(queue);
+  return NULL;
+}
+
+// Every operation and lock acquisition of a queue is counted
+TEST(InstrumentTest, QueueStatistics) {
+  my_queue_t queue;
+  queue_init(&queue);
+
+  pthread_t threads[NUM_THREADS];
+  for (int i = 0; i < NUM_THREADS; i++) {
+    if (pthread_create(&threads[i], NULL, queue_run, &queue) != 0)
+      perror("Error creating thread");
+  }
+  for (int i = 0; i < NUM_THREADS; i++) {
+    if (pthread_join(threads[i], NULL) != 0)
+      perror("Error joining thread");
+  }
+
+  instrument_t *inst = &queue.instrument;
+  unsigned long puts = NUM_THREADS * OPS_PER_THREAD;
+  unsigned long takes = NUM_THREADS * OPS_PER_THREAD / 2;
+  ASSERT_EQ(puts, instrument_count(&inst->ops[0]));
+  ASSERT_EQ(takes, instrument_count(&inst->ops[1]));
+  ASSERT_EQ((unsigned long)NUM_THREADS, instrument_count(&inst->ops[2]));
+  ASSERT_EQ(puts + takes + NUM_THREADS, instrument_count(&inst->wait));
+  ASSERT_EQ(puts + takes + NUM_THREADS, instrument_count(&inst->hold));
+  ASSERT_LE(inst->contended, puts + takes + NUM_THREADS);
+
+  // an operation takes at least as long as its lock hold
+  ASSERT_GE(instrument_percentile(&inst->ops[0], 100), instrument_percentile(&inst->hold, 0));
+
+  char buffer[4096];
+  FILE *file = fmemopen(buffer, sizeof(buffer), "w");
+  instrument_dump(inst, file);
+  fclose(file);
+  ASSERT_TRUE(strstr(buffer, "queue") != NULL);
+  ASSERT_TRUE(strstr(buffer, "lock wait") != NULL);
+  ASSERT_TRUE(strstr(buffer, "take") != NULL);
+
+  // clean up
+  queue_destroy(&queue);
+}
+
+typedef struct rw_args {
+  rwlock_t *lock;
+  int id;
+  int *shared;
+} rw_args_t;
+
+/**
+ * @brief  Mostly read, sometimes write
+ * @note
+ * @param  *arg: rw_args_t
+ * @retval None
+ */
+void *rw_run(void *arg) {
+  rw_args_t *args = (rw_args_t *)arg;
+  for (int i = 0; i < OPS_PER_THREAD; i++) {
+    if (i % 10 == args->id) {
+      rwlock_acquire_writelock(args->lock);
+      (*args->shared)++;
+      rwlock_release_writelock(args->lock);
+    } else {
+      rwlock_acquire_readlock(args->lock);
+      rwlock_release_readlock(args->lock);
+    }
+  }
+  return NULL;
+}
+
+// Both sides of a reader-writer lock are timed, and writers' holds
+TEST(InstrumentTest, RwlockStatistics) {
+  rwlock_t lock;
+  rwlock_init(&lock, RWLOCK_PREFER_WRITERS);
+  int shared = 0;
+
+  pthread_t threads[NUM_THREADS];
+  rw_args_t args[NUM_THREADS];
+  for (int i = 0; i < NUM_THREADS; i++) {
+    args[i].lock = &lock;
+    args[i].id = i;
+    args[i].shared = &shared;
+    if (pthread_create(&threads[i], NULL, rw_run, &args[i]) != 0)
+      perror("Error creating thread");
+  }
+  for (int i = 0; i < NUM_THREADS; i++) {
+    if (pthread_join(threads[i], NULL) != 0)
+      perror("Error joining thread");
+  }
+
+  unsigned long writes = NUM_THREADS * OPS_PER_THREAD / 10;
+  ASSERT_EQ((int)writes, shared);
+  ASSERT_EQ(NUM_THREADS * OPS_PER_THREAD - writes, instrument_count(&lock.instrument.ops[0]));
+  ASSERT_EQ(writes, instrument_count(&lock.instrument.ops[1]));
+  ASSERT_EQ((unsigned long)NUM_THREADS * OPS_PER_THREAD, instrument_count(&lock.instrument.wait));
+  ASSERT_EQ(writes, instrument_count(&lock.instrument.hold));
+
+  // clean up
+  rwlock_destroy(&lock);
+}
@@ -0,0 +1,196 @@
+#include "instrument.hh"
+
+#include <string.h>
+#include <time.h>
+
+/**
+ * @brief  Find the histogram bucket of a duration
+ * @note   Durations below 4ns get a bucket each; above that, the position of
+ *         the highest set bit and the two bits after it pick the bucket
+ * @param  ns: duration
+ * @retval bucket index
+ */
+static int bucket_of(uint64_t ns) {
+  if (ns < 4)
+    return (int)ns;
+  int msb = 63 - __builtin_clzll(ns);
+  int bucket = 4 * (msb - 1) + (int)((ns >> (msb - 2)) & 3);
+  return bucket < INSTRUMENT_BUCKETS ? bucket : INSTRUMENT_BUCKETS - 1;
+}
+
+/**
+ * @brief  Find the shortest duration a bucket counts
+ * @note
+ * @param  bucket: bucket index
+ * @retval duration in nanoseconds
+ */
+static uint64_t bucket_start(int bucket) {
+  if (bucket < 4)
+    return (uint64_t)bucket;
+  int msb = bucket / 4 + 1;
+  return (uint64_t)(4 + bucket % 4) << (msb - 2);
+}
+
+/**
+ * @brief  Initialize the statistics of a container
+ * @note
+ * @param  *inst: statistics to initialize
+ * @param  *name: name of the container in dumps
+ * @param  *op_names: names of the container's operations
+ * @param  num_ops: number of operations, at most INSTRUMENT_MAX_OPS
+ * @retval None
+ */
+void instrument_init(instrument_t *inst, const char *name, const char *const *op_names, int num_ops) {
+  memset(inst, 0, sizeof(*inst));
+  inst->name = name;
+  inst->op_names = op_names;
+  inst->num_ops = num_ops < INSTRUMENT_MAX_OPS ? num_ops : INSTRUMENT_MAX_OPS;
+}
+
+/**
+ * @brief  Read the clock
+ * @note
+ * @retval nanoseconds on a monotonic clock
+ */
+uint64_t instrument_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @brief  Add a duration to a histogram
+ * @note   Relaxed atomics: recording orders nothing, and a dump may be a few
+ *         durations behind
+ * @param  *hist: histogram to add to
+ * @param  ns: duration
+ * @retval None
+ */
+void instrument_record(instrument_histogram_t *hist, uint64_t ns) {
+  __atomic_fetch_add(&hist->counts[bucket_of(ns)], 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&hist->total_ns, ns, __ATOMIC_RELAXED);
+  uint64_t max = __atomic_load_n(&hist->max_ns, __ATOMIC_RELAXED);
+  while (ns > max &&
+         !__atomic_compare_exchange_n(&hist->max_ns, &max, ns, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+  }
+}
+
+/**
+ * @brief  Count the durations in a histogram
+ * @note
+ * @param  *hist: histogram to count
+ * @retval number of durations
+ */
+unsigned long instrument_count(const instrument_histogram_t *hist) {
+  unsigned long count = 0;
+  for (int i = 0; i < INSTRUMENT_BUCKETS; i++)
+    count += __atomic_load_n(&hist->counts[i], __ATOMIC_RELAXED);
+  return count;
+}
+
+/**
+ * @brief  Estimate a percentile of a histogram
+ * @note   Never more than the longest duration recorded
+ * @param  *hist: histogram to read
+ * @param  percentile: between 0 and 100
+ * @retval duration in nanoseconds
+ */
+uint64_t instrument_percentile(const instrument_histogram_t *hist, double percentile) {
+  unsigned long count = instrument_count(hist);
+  if (count == 0)
+    return 0;
+  double target = percentile / 100 * count;
+  uint64_t max = __atomic_load_n(&hist->max_ns, __ATOMIC_RELAXED);
+  unsigned long seen = 0;
+  for (int i = 0; i < INSTRUMENT_BUCKETS - 1; i++) {
+    seen += __atomic_load_n(&hist->counts[i], __ATOMIC_RELAXED);
+    if (seen > 0 && seen >= target) {
+      uint64_t end = bucket_start(i + 1) - 1;
+      return end < max ? end : max;
+    }
+  }
+  return max;
+}
+
+typedef struct instrument_held {
+  const pthread_mutex_t *mutex;
+  uint64_t since;
+} instrument_held_t;
+
+// Mutexes the calling thread locked with instrument_lock, and when
+static __thread instrument_held_t held[INSTRUMENT_MAX_HELD];
+static __thread int num_held = 0;
+
+/**
+ * @brief  Lock a mutex, recording how long it took
+ * @note   The hold time starts in the calling thread's list of held mutexes,
+ *         so a container with several locks can share one set of statistics
+ * @param  *inst: statistics of the container the mutex belongs to
+ * @param  *mutex: mutex to lock
+ * @retval None
+ */
+void instrument_lock(instrument_t *inst, pthread_mutex_t *mutex) {
+  uint64_t start = instrument_now();
+  if (pthread_mutex_trylock(mutex) != 0) {
+    __atomic_fetch_add(&inst->contended, 1, __ATOMIC_RELAXED);
+    pthread_mutex_lock(mutex);
+  }
+  uint64_t now = instrument_now();
+  instrument_record(&inst->wait, now - start);
+  if (num_held < INSTRUMENT_MAX_HELD) {
+    held[num_held].mutex = mutex;
+    held[num_held].since = now;
+    num_held++;
+  }
+}
+
+/**
+ * @brief  Unlock a mutex, recording how long it was held
+ * @note
+ * @param  *inst: statistics of the container the mutex belongs to
+ * @param  *mutex: mutex to unlock
+ * @retval None
+ */
+void instrument_unlock(instrument_t *inst, pthread_mutex_t *mutex) {
+  for (int i = num_held - 1; i >= 0; i--) {
+    if (held[i].mutex == mutex) {
+      instrument_record(&inst->hold, instrument_now() - held[i].since);
+      held[i] = held[--num_held];
+      break;
+    }
+  }
+  pthread_mutex_unlock(mutex);
+}
+
+/**
+ * @brief  Write one histogram as a line of a dump
+ * @note
+ * @param  *file: file to write to
+ * @param  *label: what the histogram measures
+ * @param  *hist: histogram to write
+ * @retval None
+ */
+static void dump_histogram(FILE *file, const char *label, const instrument_histogram_t *hist) {
+  unsigned long count = instrument_count(hist);
+  uint64_t total = __atomic_load_n(&hist->total_ns, __ATOMIC_RELAXED);
+  fprintf(file, "  %-12s %10lu  mean %10.0f  p50 %10llu  p90 %10llu  p99 %10llu  max %10llu\n", label, count,
+          count > 0 ? (double)total / count : 0.0, (unsigned long long)instrument_percentile(hist, 50),
+          (unsigned long long)instrument_percentile(hist, 90), (unsigned long long)instrument_percentile(hist, 99),
+          (unsigned long long)__atomic_load_n(&hist->max_ns, __ATOMIC_RELAXED));
+}
+
+/**
+ * @brief  Write the statistics of a container
+ * @note
+ * @param  *inst: statistics to write
+ * @param  *file: file to write to
+ * @retval None
+ */
+void instrument_dump(const instrument_t *inst, FILE *file) {
+  fprintf(file, "%s %p: %lu contended lock acquisitions, times in ns\n", inst->name, (const void *)inst,
+          __atomic_load_n(&inst->contended, __ATOMIC_RELAXED));
+  dump_histogram(file, "lock wait", &inst->wait);
+  dump_histogram(file, "lock hold", &inst->hold);
+  for (int i = 0; i < inst->num_ops; i++)
+    dump_histogram(file, inst->op_names[i], &inst->ops[i]);
+}
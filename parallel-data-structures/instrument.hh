@@ -0,0 +1,93 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+
+// Opt-in statistics for the containers: how long threads wait for and hold
+// their locks, and how long each operation takes, per container instance.
+// Build with -DINSTRUMENT (make INSTRUMENT=1) to turn them on. Otherwise the
+// macros at the bottom expand to plain locking or to nothing, and containers
+// carry no statistics at all.
+
+// Histogram buckets. Each power of two of nanoseconds is split into four
+// buckets, so percentiles are accurate to within 25%; the last bucket also
+// counts everything longer than about half an hour.
+#define INSTRUMENT_BUCKETS 160
+
+// Most operations a container can report on
+#define INSTRUMENT_MAX_OPS 8
+
+// Most instrumented mutexes one thread can time holding at once
+#define INSTRUMENT_MAX_HELD 4
+
+typedef struct instrument_histogram {
+  unsigned long counts[INSTRUMENT_BUCKETS];
+  uint64_t total_ns;
+  uint64_t max_ns;
+} instrument_histogram_t;
+
+typedef struct instrument {
+  const char* name;
+  const char* const* op_names;
+  int num_ops;
+  unsigned long contended;      // lock acquisitions that found the lock taken
+  instrument_histogram_t wait;  // time to acquire the lock
+  instrument_histogram_t hold;  // time the lock was held exclusively
+  uint64_t held_since;          // for INSTRUMENT_HOLD_*, only touched by the holder of the lock
+  instrument_histogram_t ops[INSTRUMENT_MAX_OPS];
+} instrument_t;
+
+// Initialize the statistics of a container whose operations are named by
+// op_names, which must outlive it
+void instrument_init(instrument_t* inst, const char* name, const char* const* op_names, int num_ops);
+
+// Current time in nanoseconds on a monotonic clock
+uint64_t instrument_now(void);
+
+// Add a duration to a histogram
+void instrument_record(instrument_histogram_t* hist, uint64_t ns);
+
+// Number of durations in a histogram
+unsigned long instrument_count(const instrument_histogram_t* hist);
+
+// Duration that percentile percent of a histogram's durations do not exceed,
+// rounded up to the end of its bucket. 0 for an empty histogram.
+uint64_t instrument_percentile(const instrument_histogram_t* hist, double percentile);
+
+// Lock a mutex, recording the wait and starting the hold time. A container
+// may time several mutexes with the same statistics, and a thread may hold up
+// to INSTRUMENT_MAX_HELD of them at once; holds beyond that go unrecorded.
+void instrument_lock(instrument_t* inst, pthread_mutex_t* mutex);
+
+// Unlock a mutex locked with instrument_lock, recording the hold time
+void instrument_unlock(instrument_t* inst, pthread_mutex_t* mutex);
+
+// Write counts, means and percentiles of everything recorded to a file.
+// Other threads may keep recording meanwhile.
+void instrument_dump(const instrument_t* inst, FILE* file);
+
+#ifdef INSTRUMENT
+#define INSTRUMENT_FIELD(field) instrument_t field;
+#define INSTRUMENT_INIT(inst, name, op_names, num_ops) instrument_init(inst, name, op_names, num_ops)
+#define INSTRUMENT_LOCK(inst, mutex) instrument_lock(inst, mutex)
+#define INSTRUMENT_UNLOCK(inst, mutex) instrument_unlock(inst, mutex)
+#define INSTRUMENT_START(var) uint64_t var = instrument_now()
+#define INSTRUMENT_OP(inst, op, start) instrument_record(&(inst)->ops[op], instrument_now() - (start))
+#define INSTRUMENT_WAITED(inst, start) instrument_record(&(inst)->wait, instrument_now() - (start))
+#define INSTRUMENT_HOLD_BEGIN(inst) ((inst)->held_since = instrument_now())
+#define INSTRUMENT_HOLD_END(inst) instrument_record(&(inst)->hold, instrument_now() - (inst)->held_since)
+#else
+#define INSTRUMENT_FIELD(field)
+#define INSTRUMENT_INIT(inst, name, op_names, num_ops)
+#define INSTRUMENT_LOCK(inst, mutex) pthread_mutex_lock(mutex)
+#define INSTRUMENT_UNLOCK(inst, mutex) pthread_mutex_unlock(mutex)
+#define INSTRUMENT_START(var)
+#define INSTRUMENT_OP(inst, op, start)
+#define INSTRUMENT_WAITED(inst, start)
+#define INSTRUMENT_HOLD_BEGIN(inst)
+#define INSTRUMENT_HOLD_END(inst)
+#endif
+
+#endif
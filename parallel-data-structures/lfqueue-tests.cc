@@ -0,0 +1,179 @@
+#include <gtest/gtest.h>
+
+#include "hazard.hh"
+#include "lfqueue.hh"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/****** Queue Invariants ******/
+
+// Invariant 1
+// For every value V that has been put onto the queue p times and returned by take q times, there must be p-q copies of this value on the queue. This only holds if p >= q.
+
+// Invariant 2
+// No value should ever be returned by taken if it was not first passed to put by some thread.
+
+// Invariant 3
+// If a thread puts value A and then puts value B, and no other thread puts these specific values, A must not be taken from the queue before taking B.
+
+/****** Begin Tests ******/
+
+// Basic queue functionality
+TEST(LockFreeQueueTest, BasicQueueOps) {
+  my_lfqueue_t q;
+  lfqueue_init(&q);
+
+  // Make sure the queue is empty and taking from it returns -1
+  ASSERT_TRUE(lfqueue_empty(&q));
+  ASSERT_EQ(-1, lfqueue_take(&q));
+
+  // Add some items to the queue
+  lfqueue_put(&q, 1);
+  lfqueue_put(&q, 2);
+  lfqueue_put(&q, 3);
+  ASSERT_FALSE(lfqueue_empty(&q));
+
+  // Take the values from the queue and check them
+  ASSERT_EQ(1, lfqueue_take(&q));
+  ASSERT_EQ(2, lfqueue_take(&q));
+  ASSERT_EQ(3, lfqueue_take(&q));
+  ASSERT_TRUE(lfqueue_empty(&q));
+  ASSERT_EQ(-1, lfqueue_take(&q));
+
+  // Destroying a queue with elements left frees them
+  lfqueue_put(&q, 4);
+  lfqueue_destroy(&q);
+}
+
+// Taken nodes are freed in batches, many times over
+TEST(LockFreeQueueTest, ManyRetiredNodes) {
+  my_lfqueue_t q;
+  lfqueue_init(&q);
+  for (int round = 0; round < 10; round++) {
+    for (int i = 0; i < HAZARD_RETIRE_BATCH; i++)
+      lfqueue_put(&q, i);
+    for (int i = 0; i < HAZARD_RETIRE_BATCH; i++)
+      ASSERT_EQ(i, lfqueue_take(&q));
+  }
+  ASSERT_TRUE(lfqueue_empty(&q));
+  lfqueue_destroy(&q);
+}
+
+#define NUM_THREADS 6
+#define ROUNDS_PER_THREAD 20000
+
+typedef struct lfqueue_thread_args {
+  int id;
+  my_lfqueue_t *queue;
+  int *taken;  // how often each value was taken, shared by all threads
+  bool never_empty;
+  bool in_order;
+} lfqueue_thread_args_t;
+
+/**
+ * @brief  Put id * ROUNDS_PER_THREAD + i and take one element, for increasing i
+ * @note   The queue holds at most one element per thread, so its head and
+ *         tail keep meeting and puts keep leaving the tail behind for takes
+ *         to help along
+ * @param  *arg: lfqueue_thread_args_t
+ * @retval None
+ */
+void *lfqueue_alternate(void *arg) {
+  lfqueue_thread_args_t *args = (lfqueue_thread_args_t *)arg;
+  int last[NUM_THREADS];
+  for (int i = 0; i < NUM_THREADS; i++)
+    last[i] = -1;
+  args->never_empty = true;
+  args->in_order = true;
+  for (int i = 0; i < ROUNDS_PER_THREAD; i++) {
+    lfqueue_put(args->queue, args->id * ROUNDS_PER_THREAD + i);
+    // this thread's own put is still ahead of every take that has not
+    // finished, so the queue cannot be empty here
+    int taken = lfqueue_take(args->queue);
+    if (taken < 0 || taken >= NUM_THREADS * ROUNDS_PER_THREAD) {
+      args->never_empty = false;
+      continue;
+    }
+    int producer = taken / ROUNDS_PER_THREAD;
+    if (taken <= last[producer])
+      args->in_order = false;
+    last[producer] = taken;
+    __atomic_add_fetch(&args->taken[taken], 1, __ATOMIC_RELAXED);
+  }
+  return NULL;
+}
+
+// Invariants 1 to 3 with every thread putting and taking in turn, so the
+// queue stays nearly empty
+TEST(LockFreeQueueTest, AlternatingPutAndTake) {
+  my_lfqueue_t q;
+  lfqueue_init(&q);
+
+  int *taken = (int *)calloc(NUM_THREADS * ROUNDS_PER_THREAD, sizeof(int));
+  pthread_t threads[NUM_THREADS];
+  lfqueue_thread_args_t args[NUM_THREADS];
+  for (int i = 0; i < NUM_THREADS; i++) {
+    args[i].id = i;
+    args[i].queue = &q;
+    args[i].taken = taken;
+    if (pthread_create(&threads[i], NULL, lfqueue_alternate, &args[i]) != 0)
+      perror("Error creating thread");
+  }
+  for (int i = 0; i < NUM_THREADS; i++) {
+    if (pthread_join(threads[i], NULL) != 0)
+      perror("Error joining thread");
+  }
+
+  // every value was taken once, and the queue is empty again
+  for (int i = 0; i < NUM_THREADS; i++) {
+    ASSERT_TRUE(args[i].never_empty);
+    ASSERT_TRUE(args[i].in_order);
+  }
+  for (int i = 0; i < NUM_THREADS * ROUNDS_PER_THREAD; i++)
+    ASSERT_EQ(1, taken[i]);
+  ASSERT_TRUE(lfqueue_empty(&q));
+
+  // clean up
+  free(taken);
+  lfqueue_destroy(&q);
+}
+
+#define CHURN_ROUNDS 50
+#define CHURN_THREADS 8
+
+/**
+ * @brief  Put a few values and take as many, then exit
+ * @note
+ * @param  *arg: queue to use
+ * @retval None
+ */
+void *lfqueue_churn(void *arg) {
+  my_lfqueue_t *queue = (my_lfqueue_t *)arg;
+  for (int i = 0; i < 100; i++)
+    lfqueue_put(queue, i);
+  for (int i = 0; i < 100; i++)
+    lfqueue_take(queue);
+  return NULL;
+}
+
+// Threads come and go far more often than there are hazard records, so
+// records have to be handed back at exit along with the nodes still retired
+TEST(LockFreeQueueTest, ThreadChurn) {
+  my_lfqueue_t q;
+  lfqueue_init(&q);
+  for (int round = 0; round < CHURN_ROUNDS; round++) {
+    pthread_t threads[CHURN_THREADS];
+    for (int i = 0; i < CHURN_THREADS; i++) {
+      if (pthread_create(&threads[i], NULL, lfqueue_churn, &q) != 0)
+        perror("Error creating thread");
+    }
+    for (int i = 0; i < CHURN_THREADS; i++) {
+      if (pthread_join(threads[i], NULL) != 0)
+        perror("Error joining thread");
+    }
+  }
+  // every thread took as many as it put
+  ASSERT_TRUE(lfqueue_empty(&q));
+  lfqueue_destroy(&q);
+}
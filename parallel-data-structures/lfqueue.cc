@@ -0,0 +1,146 @@
+#include "lfqueue.hh"
+#include "hazard.hh"
+
+#include <stdlib.h>
+
+// Operations the instrumentation times
+enum { LFQUEUE_OP_PUT, LFQUEUE_OP_TAKE, LFQUEUE_OP_EMPTY, LFQUEUE_NUM_OPS };
+#ifdef INSTRUMENT
+static const char *const lfqueue_op_names[LFQUEUE_NUM_OPS] = {"put", "take", "empty"};
+#endif
+
+/**
+ * @brief  Load a node pointer and protect the node from being freed
+ * @note   Publishes the node, then checks that it is still where it was loaded
+ *         from, so no scan that started after it was unlinked can miss it
+ * @param  **src: pointer to load
+ * @param  h: hazard pointer to publish the node in
+ * @retval the protected node
+ */
+static lfqueue_node_t *protect(lfqueue_node_t **src, int h) {
+  lfqueue_node_t *node = __atomic_load_n(src, __ATOMIC_SEQ_CST);
+  while (true) {
+    hazard_set(h, node);
+    lfqueue_node_t *again = __atomic_load_n(src, __ATOMIC_SEQ_CST);
+    if (again == node)
+      return node;
+    node = again;
+  }
+}
+
+/**
+ * @brief  Initialize a queue
+ * @note
+ * @param  *queue: queue to initialize
+ * @retval None
+ */
+void lfqueue_init(my_lfqueue_t *queue) {
+  lfqueue_node_t *dummy = (lfqueue_node_t *)malloc(sizeof(lfqueue_node_t));
+  dummy->next = NULL;
+  queue->head = dummy;
+  queue->tail = dummy;
+  INSTRUMENT_INIT(&queue->instrument, "lfqueue", lfqueue_op_names, LFQUEUE_NUM_OPS);
+}
+
+/**
+ * @brief  Destroy a queue
+ * @note   Nodes already taken are freed by the threads that retired them
+ * @param  *queue: queue to destroy
+ * @retval None
+ */
+void lfqueue_destroy(my_lfqueue_t *queue) {
+  lfqueue_node_t *cur = queue->head;
+  while (cur != NULL) {
+    lfqueue_node_t *next = cur->next;
+    free(cur);
+    cur = next;
+  }
+  queue->head = NULL;
+  queue->tail = NULL;
+}
+
+/**
+ * @brief  Put an element at the end of a queue
+ * @note
+ * @param  *queue: queue to put into
+ * @param  element: element to put
+ * @retval None
+ */
+void lfqueue_put(my_lfqueue_t *queue, int element) {
+  INSTRUMENT_START(start);
+  lfqueue_node_t *node = (lfqueue_node_t *)malloc(sizeof(lfqueue_node_t));
+  node->data = element;
+  node->next = NULL;
+
+  while (true) {
+    lfqueue_node_t *tail = protect(&queue->tail, 0);
+    lfqueue_node_t *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (next != NULL) {
+      // another put linked its node but has not swung the tail yet; help it
+      __atomic_compare_exchange_n(&queue->tail, &tail, next, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+      continue;
+    }
+    if (__atomic_compare_exchange_n(&tail->next, &next, node, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+      // linked; if this fails someone already helped
+      __atomic_compare_exchange_n(&queue->tail, &tail, node, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+      break;
+    }
+  }
+  hazard_clear();
+  INSTRUMENT_OP(&queue->instrument, LFQUEUE_OP_PUT, start);
+}
+
+/**
+ * @brief  Check if a queue is empty
+ * @note
+ * @param  *queue: queue to check
+ * @retval whether the dummy node had no successor
+ */
+bool lfqueue_empty(my_lfqueue_t *queue) {
+  INSTRUMENT_START(start);
+  lfqueue_node_t *head = protect(&queue->head, 0);
+  bool ret = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE) == NULL;
+  hazard_clear();
+  INSTRUMENT_OP(&queue->instrument, LFQUEUE_OP_EMPTY, start);
+  return ret;
+}
+
+/**
+ * @brief  Take an element off the front of a queue
+ * @note   The first element's node becomes the new dummy, and the old dummy
+ *         is retired
+ * @param  *queue: queue to take from
+ * @retval the element, or -1 if the queue is empty
+ */
+int lfqueue_take(my_lfqueue_t *queue) {
+  INSTRUMENT_START(start);
+  int ret = -1;
+  while (true) {
+    lfqueue_node_t *head = protect(&queue->head, 0);
+    lfqueue_node_t *next = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+    if (next == NULL)
+      break;
+    // next stays linked, and so safe, for as long as head is still the head
+    hazard_set(1, next);
+    if (__atomic_load_n(&queue->head, __ATOMIC_SEQ_CST) != head)
+      continue;
+
+    // never let the head pass the tail; help the lagging put first
+    lfqueue_node_t *tail = __atomic_load_n(&queue->tail, __ATOMIC_SEQ_CST);
+    if (tail == head) {
+      __atomic_compare_exchange_n(&queue->tail, &tail, next, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+      continue;
+    }
+    int data = next->data;
+    if (__atomic_compare_exchange_n(&queue->head, &head, next, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+      ret = data;
+      hazard_clear();
+      hazard_retire(head, free);
+      INSTRUMENT_OP(&queue->instrument, LFQUEUE_OP_TAKE, start);
+      return ret;
+    }
+  }
+  hazard_clear();
+  INSTRUMENT_OP(&queue->instrument, LFQUEUE_OP_TAKE, start);
+  return ret;
+}
@@ -0,0 +1,46 @@
+#ifndef LFQUEUE_H
+#define LFQUEUE_H
+
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "instrument.hh"
+
+// Lock-free queue (Michael and Scott). Like the two-lock queue it starts with
+// a dummy node, but puts link new nodes and swing the tail with
+// compare-and-swap, and takes swing the head the same way. Any thread that
+// finds the tail lagging behind helps move it, so a thread stalled in the
+// middle of an operation never blocks the others.
+//
+// Taken nodes are freed with hazard pointers (hazard.hh): before
+// dereferencing a node, a thread publishes it in one of its hazard pointers,
+// and retired nodes are only freed once none names them. At most
+// HAZARD_MAX_THREADS threads can use lock-free queues at once.
+
+typedef struct lfqueue_node {
+  int data;
+  struct lfqueue_node* next;
+} lfqueue_node_t;
+
+typedef struct my_lfqueue {
+  lfqueue_node_t* head __attribute__((aligned(64)));  // dummy node, taken from after here
+  lfqueue_node_t* tail __attribute__((aligned(64)));  // at or one node behind the last node
+  INSTRUMENT_FIELD(instrument)
+} my_lfqueue_t;
+
+// Initialize a queue
+void lfqueue_init(my_lfqueue_t* queue);
+
+// Destroy a queue. No other operation may be running.
+void lfqueue_destroy(my_lfqueue_t* queue);
+
+// Put an element at the end of a queue
+void lfqueue_put(my_lfqueue_t* queue, int element);
+
+// Check if a queue is empty
+bool lfqueue_empty(my_lfqueue_t* queue);
+
+// Take an element off the front of a queue, or -1 if it is empty
+int lfqueue_take(my_lfqueue_t* queue);
+
+#endif
@@ -0,0 +1,214 @@
+#include <gtest/gtest.h>
+
+#include "lfstack.hh"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/****** Stack Invariants ******/
+
+// Invariant 1
+// For every value V that has been pushed onto the stack p times and returned by pop q times, there must be p-q copies of this value on the stack. This only holds if p >= q.
+
+// Invariant 2
+// No value should ever be returned by pop if it was not first passed to push by some thread.
+
+// Invariant 3
+// If a thread pushes value A and then pushes value B, and no other thread pushes these specific values, A must not be popped from the stack before popping B.
+
+/****** Begin Tests ******/
+
+// Basic stack functionality
+TEST(LockFreeStackTest, BasicStackOps) {
+  my_lfstack_t s;
+  lfstack_init(&s);
+
+  // Make sure the stack is empty and popping from it returns -1
+  ASSERT_TRUE(lfstack_empty(&s));
+  ASSERT_EQ(-1, lfstack_pop(&s));
+
+  // Push some values and make sure they come off in the right order
+  lfstack_push(&s, 1);
+  lfstack_push(&s, 2);
+  lfstack_push(&s, 3);
+  ASSERT_FALSE(lfstack_empty(&s));
+  ASSERT_EQ(3, lfstack_pop(&s));
+  ASSERT_EQ(2, lfstack_pop(&s));
+  ASSERT_EQ(1, lfstack_pop(&s));
+  ASSERT_TRUE(lfstack_empty(&s));
+  ASSERT_EQ(-1, lfstack_pop(&s));
+
+  // Destroying a stack with elements left frees them
+  lfstack_push(&s, 4);
+  lfstack_destroy(&s);
+}
+
+// Single compare-and-swap pushes and pops always succeed without contention
+TEST(LockFreeStackTest, TryStackOps) {
+  my_lfstack_t s;
+  lfstack_init(&s);
+
+  int element = 42;
+  ASSERT_TRUE(lfstack_try_pop(&s, &element));
+  ASSERT_EQ(-1, element);
+
+  ASSERT_TRUE(lfstack_try_push(&s, 1));
+  ASSERT_TRUE(lfstack_try_push(&s, 2));
+  ASSERT_TRUE(lfstack_try_pop(&s, &element));
+  ASSERT_EQ(2, element);
+  ASSERT_EQ(1, lfstack_pop(&s));
+  ASSERT_TRUE(lfstack_empty(&s));
+
+  // clean up
+  lfstack_destroy(&s);
+}
+
+#define NUM_PUSHERS 3
+#define NUM_POPPERS 3
+#define VALUES_PER_PUSHER 20000
+
+typedef struct lfstack_thread_args {
+  int id;
+  my_lfstack_t *stack;
+  int *popped;  // how often each value was popped, shared by all threads
+  int count;
+  bool in_order;
+} lfstack_thread_args_t;
+
+/**
+ * @brief  Push id * VALUES_PER_PUSHER + i for increasing i
+ * @note
+ * @param  *arg: lfstack_thread_args_t
+ * @retval None
+ */
+void *lfstack_pusher(void *arg) {
+  lfstack_thread_args_t *args = (lfstack_thread_args_t *)arg;
+  for (int i = 0; i < VALUES_PER_PUSHER; i++)
+    lfstack_push(args->stack, args->id * VALUES_PER_PUSHER + i);
+  return NULL;
+}
+
+/**
+ * @brief  Pop until the stack is empty, checking each pusher's order
+ * @note   Nothing is pushed meanwhile, so every pusher's values come off
+ *         newest first
+ * @param  *arg: lfstack_thread_args_t
+ * @retval None
+ */
+void *lfstack_popper(void *arg) {
+  lfstack_thread_args_t *args = (lfstack_thread_args_t *)arg;
+  int last[NUM_PUSHERS];
+  for (int i = 0; i < NUM_PUSHERS; i++)
+    last[i] = (i + 1) * VALUES_PER_PUSHER;
+  args->count = 0;
+  args->in_order = true;
+  int popped;
+  while ((popped = lfstack_pop(args->stack)) != -1) {
+    args->count++;
+    int pusher = popped / VALUES_PER_PUSHER;
+    if (popped >= last[pusher])
+      args->in_order = false;
+    last[pusher] = popped;
+    __atomic_add_fetch(&args->popped[popped], 1, __ATOMIC_RELAXED);
+  }
+  return NULL;
+}
+
+// Invariants 1 to 3 with the stack filled by several pushers, then emptied
+// by several poppers
+TEST(LockFreeStackTest, ConcurrentFillThenDrain) {
+  my_lfstack_t s;
+  lfstack_init(&s);
+
+  int *popped = (int *)calloc(NUM_PUSHERS * VALUES_PER_PUSHER, sizeof(int));
+  pthread_t threads[NUM_PUSHERS + NUM_POPPERS];
+  lfstack_thread_args_t args[NUM_PUSHERS + NUM_POPPERS];
+  for (int i = 0; i < NUM_PUSHERS + NUM_POPPERS; i++) {
+    args[i].id = i;
+    args[i].stack = &s;
+    args[i].popped = popped;
+  }
+  for (int i = 0; i < NUM_PUSHERS; i++) {
+    if (pthread_create(&threads[i], NULL, lfstack_pusher, &args[i]) != 0)
+      perror("Error creating thread");
+  }
+  for (int i = 0; i < NUM_PUSHERS; i++) {
+    if (pthread_join(threads[i], NULL) != 0)
+      perror("Error joining thread");
+  }
+  for (int i = NUM_PUSHERS; i < NUM_PUSHERS + NUM_POPPERS; i++) {
+    if (pthread_create(&threads[i], NULL, lfstack_popper, &args[i]) != 0)
+      perror("Error creating thread");
+  }
+  for (int i = NUM_PUSHERS; i < NUM_PUSHERS + NUM_POPPERS; i++) {
+    if (pthread_join(threads[i], NULL) != 0)
+      perror("Error joining thread");
+  }
+
+  // a pop only found the stack empty once every value was off, and each came off once
+  int count = 0;
+  for (int i = NUM_PUSHERS; i < NUM_PUSHERS + NUM_POPPERS; i++) {
+    ASSERT_TRUE(args[i].in_order);
+    count += args[i].count;
+  }
+  ASSERT_EQ(NUM_PUSHERS * VALUES_PER_PUSHER, count);
+  for (int i = 0; i < NUM_PUSHERS * VALUES_PER_PUSHER; i++)
+    ASSERT_EQ(1, popped[i]);
+  ASSERT_TRUE(lfstack_empty(&s));
+
+  // clean up
+  free(popped);
+  lfstack_destroy(&s);
+}
+
+#define RECYCLE_THREADS 4
+#define RECYCLE_VALUES 4
+#define RECYCLE_ROUNDS 200000
+
+/**
+ * @brief  Pop a value and push it straight back, over and over
+ * @note   Freed nodes are reused at once, so the same few nodes keep
+ *         returning to the top: the setting where ABA would corrupt the stack
+ * @param  *arg: stack to use
+ * @retval None
+ */
+void *lfstack_recycle(void *arg) {
+  my_lfstack_t *stack = (my_lfstack_t *)arg;
+  for (int i = 0; i < RECYCLE_ROUNDS; i++) {
+    int popped = lfstack_pop(stack);
+    if (popped != -1)
+      lfstack_push(stack, popped);
+  }
+  return NULL;
+}
+
+// Invariants 1 and 2 with a handful of nodes popped and pushed back by many threads
+TEST(LockFreeStackTest, RecycledNodes) {
+  my_lfstack_t s;
+  lfstack_init(&s);
+  for (int i = 0; i < RECYCLE_VALUES; i++)
+    lfstack_push(&s, i);
+
+  pthread_t threads[RECYCLE_THREADS];
+  for (int i = 0; i < RECYCLE_THREADS; i++) {
+    if (pthread_create(&threads[i], NULL, lfstack_recycle, &s) != 0)
+      perror("Error creating thread");
+  }
+  for (int i = 0; i < RECYCLE_THREADS; i++) {
+    if (pthread_join(threads[i], NULL) != 0)
+      perror("Error joining thread");
+  }
+
+  // exactly the values pushed at the start are left, once each
+  bool seen[RECYCLE_VALUES] = {};
+  for (int i = 0; i < RECYCLE_VALUES; i++) {
+    int popped = lfstack_pop(&s);
+    ASSERT_TRUE(popped >= 0 && popped < RECYCLE_VALUES);
+    ASSERT_FALSE(seen[popped]);
+    seen[popped] = true;
+  }
+  ASSERT_TRUE(lfstack_empty(&s));
+
+  // clean up
+  lfstack_destroy(&s);
+}
@@ -0,0 +1,165 @@
+#include "lfstack.hh"
+#include "hazard.hh"
+#include "nodepool.hh"
+
+#include <stdlib.h>
+
+// Nodes come from the shared node pool
+static_assert(sizeof(lfstack_node_t) <= NODEPOOL_NODE_SIZE, "nodes must fit the node pool");
+
+// Operations the instrumentation times
+enum { LFSTACK_OP_PUSH, LFSTACK_OP_POP, LFSTACK_OP_EMPTY, LFSTACK_OP_TRY_PUSH, LFSTACK_OP_TRY_POP, LFSTACK_NUM_OPS };
+#ifdef INSTRUMENT
+static const char *const lfstack_op_names[LFSTACK_NUM_OPS] = {"push", "pop", "empty", "try_push", "try_pop"};
+#endif
+
+/**
+ * @brief  Protect the top node of a stack from being freed
+ * @note   Publishes the node, then checks that it is still the top, so no
+ *         scan that started after it was popped can miss it
+ * @param  *stack: stack to look at
+ * @retval the protected top node, NULL if the stack was empty
+ */
+static lfstack_node_t *protect_top(my_lfstack_t *stack) {
+  lfstack_node_t *node = __atomic_load_n(&stack->top, __ATOMIC_SEQ_CST);
+  while (node != NULL) {
+    hazard_set(0, node);
+    lfstack_node_t *again = __atomic_load_n(&stack->top, __ATOMIC_SEQ_CST);
+    if (again == node)
+      break;
+    node = again;
+  }
+  return node;
+}
+
+/**
+ * @brief  Initialize a stack
+ * @note
+ * @param  *stack: stack to initialize
+ * @retval None
+ */
+void lfstack_init(my_lfstack_t *stack) {
+  stack->top = NULL;
+  INSTRUMENT_INIT(&stack->instrument, "lfstack", lfstack_op_names, LFSTACK_NUM_OPS);
+}
+
+/**
+ * @brief  Destroy a stack
+ * @note
+ * @param  *stack: stack to destroy
+ * @retval None
+ */
+void lfstack_destroy(my_lfstack_t *stack) {
+  lfstack_node_t *cur = stack->top;
+  while (cur != NULL) {
+    lfstack_node_t *next = cur->next;
+    nodepool_free(cur);
+    cur = next;
+  }
+  stack->top = NULL;
+}
+
+/**
+ * @brief  Push an element onto a stack
+ * @note   The release compare-and-swap publishes the node's contents
+ * @param  *stack: stack to push onto
+ * @param  element: element to push
+ * @retval None
+ */
+void lfstack_push(my_lfstack_t *stack, int element) {
+  INSTRUMENT_START(start);
+  lfstack_node_t *node = (lfstack_node_t *)nodepool_alloc();
+  node->data = element;
+  lfstack_node_t *top = __atomic_load_n(&stack->top, __ATOMIC_RELAXED);
+  do {
+    __atomic_store_n(&node->next, top, __ATOMIC_RELAXED);
+  } while (!__atomic_compare_exchange_n(&stack->top, &top, node, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+  INSTRUMENT_OP(&stack->instrument, LFSTACK_OP_PUSH, start);
+}
+
+/**
+ * @brief  Check if a stack is empty
+ * @note
+ * @param  *stack: stack to check
+ * @retval whether it had no top node
+ */
+bool lfstack_empty(my_lfstack_t *stack) {
+  INSTRUMENT_START(start);
+  bool ret = __atomic_load_n(&stack->top, __ATOMIC_ACQUIRE) == NULL;
+  INSTRUMENT_OP(&stack->instrument, LFSTACK_OP_EMPTY, start);
+  return ret;
+}
+
+/**
+ * @brief  Pop an element off of a stack
+ * @note   The top node is protected before its successor is read, so it
+ *         cannot be popped, freed and pushed again before the compare-and-swap
+ * @param  *stack: stack to pop from
+ * @retval the element, or -1 if the stack is empty
+ */
+int lfstack_pop(my_lfstack_t *stack) {
+  INSTRUMENT_START(start);
+  lfstack_node_t *node;
+  while (true) {
+    node = protect_top(stack);
+    if (node == NULL) {
+      hazard_clear();
+      INSTRUMENT_OP(&stack->instrument, LFSTACK_OP_POP, start);
+      return -1;
+    }
+    lfstack_node_t *expected = node;
+    if (__atomic_compare_exchange_n(&stack->top, &expected, __atomic_load_n(&node->next, __ATOMIC_RELAXED), false,
+                                    __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+      break;
+  }
+  hazard_clear();
+  int ret = node->data;
+  hazard_retire(node, nodepool_free);
+  INSTRUMENT_OP(&stack->instrument, LFSTACK_OP_POP, start);
+  return ret;
+}
+
+/**
+ * @brief  Push an element onto a stack with one compare-and-swap
+ * @note
+ * @param  *stack: stack to push onto
+ * @param  element: element to push
+ * @retval false if another thread changed the top first
+ */
+bool lfstack_try_push(my_lfstack_t *stack, int element) {
+  INSTRUMENT_START(start);
+  lfstack_node_t *node = (lfstack_node_t *)nodepool_alloc();
+  node->data = element;
+  lfstack_node_t *top = __atomic_load_n(&stack->top, __ATOMIC_RELAXED);
+  __atomic_store_n(&node->next, top, __ATOMIC_RELAXED);
+  bool ret = __atomic_compare_exchange_n(&stack->top, &top, node, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+  if (!ret)
+    nodepool_free(node);
+  INSTRUMENT_OP(&stack->instrument, LFSTACK_OP_TRY_PUSH, start);
+  return ret;
+}
+
+/**
+ * @brief  Pop an element off of a stack with one compare-and-swap
+ * @note
+ * @param  *stack: stack to pop from
+ * @param  *element: set to the element, or -1 if the stack is empty
+ * @retval false if another thread changed the top first
+ */
+bool lfstack_try_pop(my_lfstack_t *stack, int *element) {
+  INSTRUMENT_START(start);
+  lfstack_node_t *node = protect_top(stack);
+  lfstack_node_t *expected = node;
+  bool ret = node == NULL || __atomic_compare_exchange_n(&stack->top, &expected,
+                                                         __atomic_load_n(&node->next, __ATOMIC_RELAXED), false,
+                                                         __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+  hazard_clear();
+  if (node == NULL) {
+    *element = -1;
+  } else if (ret) {
+    *element = node->data;
+    hazard_retire(node, nodepool_free);
+  }
+  INSTRUMENT_OP(&stack->instrument, LFSTACK_OP_TRY_POP, start);
+  return ret;
+}
@@ -0,0 +1,55 @@
+#ifndef LFSTACK_H
+#define LFSTACK_H
+
+#include <stdbool.h>
+
+#include "instrument.hh"
+
+// Lock-free stack (Treiber). The top of the stack is swung with a single
+// compare-and-swap in both push and pop, so no thread ever waits for another
+// to finish its operation.
+//
+// A pop reads the top node's successor before its compare-and-swap, and in
+// the meantime the node may be popped, freed and pushed again (ABA), so that
+// the compare-and-swap succeeds and installs a stale successor. Pops protect
+// the top node with a hazard pointer (hazard.hh) before reading its
+// successor, and popped nodes are retired rather than freed, so a node can
+// only return to the top once no pop holds it. The hazard pointers are
+// shared with the lock-free queue; at most HAZARD_MAX_THREADS threads can
+// use them at once.
+
+typedef struct lfstack_node {
+  int data;
+  struct lfstack_node* next;
+} lfstack_node_t;
+
+typedef struct my_lfstack {
+  lfstack_node_t* top __attribute__((aligned(64)));
+  INSTRUMENT_FIELD(instrument)
+} my_lfstack_t;
+
+// Initialize a stack
+void lfstack_init(my_lfstack_t* stack);
+
+// Destroy a stack. No other operation may be running.
+void lfstack_destroy(my_lfstack_t* stack);
+
+// Push an element onto a stack
+void lfstack_push(my_lfstack_t* stack, int element);
+
+// Check if a stack is empty
+bool lfstack_empty(my_lfstack_t* stack);
+
+// Pop an element off of a stack, or -1 if it is empty
+int lfstack_pop(my_lfstack_t* stack);
+
+// Push an element with a single compare-and-swap. Returns false, without
+// pushing, if another thread changed the top first.
+bool lfstack_try_push(my_lfstack_t* stack, int element);
+
+// Pop an element into *element with a single compare-and-swap, or set it to
+// -1 if the stack is empty. Returns false, without popping, if another thread
+// changed the top first.
+bool lfstack_try_pop(my_lfstack_t* stack, int* element);
+
+#endif
@@ -0,0 +1,172 @@
+#include <gtest/gtest.h>
+
+#include "nodepool.hh"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+
+/****** Begin Tests ******/
+
+// Freed nodes are handed out again before any new memory is reserved
+TEST(NodePoolTest, NodesAreReused) {
+  void *nodes[NODEPOOL_CACHE * 4];
+  for (int i = 0; i < NODEPOOL_CACHE * 4; i++) {
+    nodes[i] = nodepool_alloc();
+    // every byte of a node is usable
+    memset(nodes[i], i & 0xff, NODEPOOL_NODE_SIZE);
+  }
+  nodepool_stats_t before;
+  nodepool_stats(&before);
+  ASSERT_GE(before.reserved, (size_t)NODEPOOL_CACHE * 4 * NODEPOOL_NODE_SIZE);
+
+  // nodes are distinct
+  for (int i = 1; i < NODEPOOL_CACHE * 4; i++) {
+    ASSERT_NE(nodes[i - 1], nodes[i]);
+  }
+
+  for (int round = 0; round < 100; round++) {
+    for (int i = 0; i < NODEPOOL_CACHE * 4; i++)
+      nodepool_free(nodes[i]);
+    for (int i = 0; i < NODEPOOL_CACHE * 4; i++)
+      nodes[i] = nodepool_alloc();
+  }
+  nodepool_stats_t after;
+  nodepool_stats(&after);
+  ASSERT_EQ(before.reserved, after.reserved);
+
+  for (int i = 0; i < NODEPOOL_CACHE * 4; i++)
+    nodepool_free(nodes[i]);
+}
+
+#define TRANSFERS 200000
+#define RING 1024
+
+typedef struct handoff {
+  void *slots[RING];
+  long put;
+  long taken;
+} handoff_t;
+
+/**
+ * @brief  Allocate nodes and hand them to the consumer
+ * @note
+ * @param  *arg: handoff_t
+ * @retval None
+ */
+void *pool_producer(void *arg) {
+  handoff_t *h = (handoff_t *)arg;
+  for (long i = 0; i < TRANSFERS; i++) {
+    while (i - __atomic_load_n(&h->taken, __ATOMIC_ACQUIRE) >= RING)
+      sched_yield();
+    long *node = (long *)nodepool_alloc();
+    *node = i;
+    h->slots[i % RING] = node;
+    __atomic_store_n(&h->put, i + 1, __ATOMIC_RELEASE);
+  }
+  return NULL;
+}
+
+/**
+ * @brief  Take nodes from the producer, check them and free them
+ * @note
+ * @param  *arg: handoff_t
+ * @retval number of nodes that held the wrong value
+ */
+void *pool_consumer(void *arg) {
+  handoff_t *h = (handoff_t *)arg;
+  long wrong = 0;
+  for (long i = 0; i < TRANSFERS; i++) {
+    while (__atomic_load_n(&h->put, __ATOMIC_ACQUIRE) <= i)
+      sched_yield();
+    long *node = (long *)h->slots[i % RING];
+    if (*node != i)
+      wrong++;
+    nodepool_free(node);
+    __atomic_store_n(&h->taken, i + 1, __ATOMIC_RELEASE);
+  }
+  return (void *)wrong;
+}
+
+// One thread allocates and another frees: nodes travel back through the
+// depot, so the pool stops growing once the pipeline is full
+TEST(NodePoolTest, ProducerConsumerRecycling) {
+  handoff_t h;
+  h.put = 0;
+  h.taken = 0;
+  nodepool_stats_t before;
+  nodepool_stats(&before);
+
+  pthread_t producer, consumer;
+  if (pthread_create(&producer, NULL, pool_producer, &h) != 0)
+    perror("Error creating thread");
+  if (pthread_create(&consumer, NULL, pool_consumer, &h) != 0)
+    perror("Error creating thread");
+  void *wrong;
+  if (pthread_join(producer, NULL) != 0)
+    perror("Error joining thread");
+  if (pthread_join(consumer, &wrong) != 0)
+    perror("Error joining thread");
+  ASSERT_EQ(0, (long)wrong);
+
+  // the pipeline and both threads' free lists, far less than every transfer
+  nodepool_stats_t after;
+  nodepool_stats(&after);
+  ASSERT_LE(after.reserved - before.reserved, (size_t)(RING + 4 * NODEPOOL_CACHE) * NODEPOOL_NODE_SIZE + 2 * NODEPOOL_CHUNK);
+
+  // both threads have exited, so their free lists are in the depot
+  ASSERT_GE(after.depot, (size_t)NODEPOOL_BATCH);
+}
+
+// Frees a thread's node from a thread-exit destructor that runs after the pool's own
+static pthread_key_t late_free_key;
+
+/**
+ * @brief  Free a node while the thread exits
+ * @note   Destructor of late_free_key
+ * @param  *node: node to free
+ * @retval None
+ */
+void late_free(void *node) {
+  nodepool_free(node);
+}
+
+/**
+ * @brief  Allocate a node and leave it to late_free
+ * @note
+ * @param  *arg: unused
+ * @retval None
+ */
+void *pool_late_freer(void *arg) {
+  pthread_setspecific(late_free_key, nodepool_alloc());
+  return NULL;
+}
+
+// A node freed after the thread's free list went back to the depot follows it
+// there rather than staying on the exited thread's list
+TEST(NodePoolTest, FreeAfterThreadExit) {
+  // register this thread with the pool first, so the pool's destructor is
+  // created before late_free's and runs first; and fill the depot, so the
+  // thread below takes its nodes from there
+  void *nodes[NODEPOOL_CACHE * 2];
+  for (int i = 0; i < NODEPOOL_CACHE * 2; i++)
+    nodes[i] = nodepool_alloc();
+  for (int i = 0; i < NODEPOOL_CACHE * 2; i++)
+    nodepool_free(nodes[i]);
+  pthread_key_create(&late_free_key, late_free);
+  nodepool_stats_t before;
+  nodepool_stats(&before);
+  ASSERT_GE(before.depot, (size_t)NODEPOOL_BATCH);
+
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, pool_late_freer, NULL) != 0)
+    perror("Error creating thread");
+  if (pthread_join(thread, NULL) != 0)
+    perror("Error joining thread");
+
+  // the thread took a batch and gave back all of it, the late node included
+  nodepool_stats_t after;
+  nodepool_stats(&after);
+  ASSERT_EQ(before.depot, after.depot);
+  pthread_key_delete(late_free_key);
+}
@@ -0,0 +1,184 @@
+#include "nodepool.hh"
+
+#include <stdlib.h>
+
+// A free node: the next node on its list, and for the first node of a batch
+// in the depot, the next batch
+typedef struct free_node {
+  struct free_node *next;
+  struct free_node *next_batch;
+} free_node_t;
+
+static_assert(sizeof(free_node_t) <= NODEPOOL_NODE_SIZE, "a node must hold two pointers");
+
+typedef struct chunk {
+  struct chunk *next;
+} chunk_t;
+
+// Shared by all threads; only touched once per batch
+static struct {
+  pthread_mutex_t lock;
+  free_node_t *batches;  // batches of free nodes
+  size_t nodes;          // nodes in batches
+  chunk_t *chunks;       // every chunk ever reserved
+  char *next;            // unused part of the newest chunk
+  size_t left;
+  size_t reserved;
+} depot = {PTHREAD_MUTEX_INITIALIZER, NULL, 0, NULL, NULL, 0, 0};
+
+// Returns a thread's free list to the depot when it exits
+static pthread_key_t cache_key;
+static pthread_once_t cache_key_once = PTHREAD_ONCE_INIT;
+
+// Free list of the calling thread
+static __thread free_node_t *cache = NULL;
+static __thread int cached = 0;
+static __thread bool registered = false;
+
+/**
+ * @brief  Put a list of nodes into the depot as one batch
+ * @note
+ * @param  *first: first node of the list
+ * @param  count: length of the list
+ * @retval None
+ */
+static void depot_push(free_node_t *first, int count) {
+  pthread_mutex_lock(&depot.lock);
+  first->next_batch = depot.batches;
+  depot.batches = first;
+  depot.nodes += count;
+  pthread_mutex_unlock(&depot.lock);
+}
+
+/**
+ * @brief  Return the calling thread's free list to the depot
+ * @note   Runs when the thread exits. A node freed afterwards, say by
+ *         another destructor, registers the thread again, so this runs again.
+ * @param  *arg: unused
+ * @retval None
+ */
+static void release_cache(void *arg) {
+  if (cache != NULL)
+    depot_push(cache, cached);
+  cache = NULL;
+  cached = 0;
+  registered = false;
+}
+
+/**
+ * @brief  Create the key that returns free lists at thread exit
+ * @note
+ * @retval None
+ */
+static void create_cache_key(void) {
+  pthread_key_create(&cache_key, release_cache);
+}
+
+/**
+ * @brief  Make sure the calling thread's free list goes back when it exits
+ * @note
+ * @retval None
+ */
+static void register_thread(void) {
+  pthread_once(&cache_key_once, create_cache_key);
+  // any non-NULL value makes the destructor run
+  pthread_setspecific(cache_key, &cache);
+  registered = true;
+}
+
+/**
+ * @brief  Refill the calling thread's empty free list
+ * @note   Takes a batch from the depot if there is one, otherwise carves a
+ *         batch of new nodes, reserving a new chunk if needed
+ * @retval None
+ */
+static void refill(void) {
+  if (!registered)
+    register_thread();
+
+  pthread_mutex_lock(&depot.lock);
+  free_node_t *batch = depot.batches;
+  if (batch != NULL) {
+    depot.batches = batch->next_batch;
+    int count = 0;
+    for (free_node_t *node = batch; node != NULL; node = node->next)
+      count++;
+    depot.nodes -= count;
+    pthread_mutex_unlock(&depot.lock);
+    cache = batch;
+    cached = count;
+    return;
+  }
+
+  for (int i = 0; i < NODEPOOL_BATCH; i++) {
+    if (depot.left < NODEPOOL_NODE_SIZE) {
+      chunk_t *chunk = (chunk_t *)aligned_alloc(NODEPOOL_NODE_SIZE, NODEPOOL_CHUNK);
+      chunk->next = depot.chunks;
+      depot.chunks = chunk;
+      depot.next = (char *)chunk + NODEPOOL_NODE_SIZE;
+      depot.left = NODEPOOL_CHUNK - NODEPOOL_NODE_SIZE;
+      depot.reserved += NODEPOOL_CHUNK;
+    }
+    free_node_t *node = (free_node_t *)depot.next;
+    depot.next += NODEPOOL_NODE_SIZE;
+    depot.left -= NODEPOOL_NODE_SIZE;
+    node->next = cache;
+    cache = node;
+  }
+  cached = NODEPOOL_BATCH;
+  pthread_mutex_unlock(&depot.lock);
+}
+
+/**
+ * @brief  Allocate a node
+ * @note
+ * @retval node of NODEPOOL_NODE_SIZE bytes
+ */
+void *nodepool_alloc(void) {
+  if (cache == NULL)
+    refill();
+  free_node_t *node = cache;
+  cache = node->next;
+  cached--;
+  return node;
+}
+
+/**
+ * @brief  Return a node to the pool
+ * @note   Goes on the calling thread's free list; once that holds
+ *         NODEPOOL_CACHE nodes, the ones freed longest ago move to the depot
+ * @param  *ptr: node from nodepool_alloc
+ * @retval None
+ */
+void nodepool_free(void *ptr) {
+  if (!registered)
+    register_thread();
+  free_node_t *node = (free_node_t *)ptr;
+  node->next = cache;
+  cache = node;
+  cached++;
+  if (cached < NODEPOOL_CACHE)
+    return;
+
+  // keep the NODEPOOL_CACHE - NODEPOOL_BATCH most recently freed nodes
+  free_node_t *last = cache;
+  for (int i = 1; i < NODEPOOL_CACHE - NODEPOOL_BATCH; i++)
+    last = last->next;
+  free_node_t *batch = last->next;
+  last->next = NULL;
+  cached -= NODEPOOL_BATCH;
+  depot_push(batch, NODEPOOL_BATCH);
+}
+
+/**
+ * @brief  Get the pool's counters
+ * @note
+ * @param  *stats: set to the counters
+ * @retval None
+ */
+void nodepool_stats(nodepool_stats_t *stats) {
+  pthread_mutex_lock(&depot.lock);
+  stats->reserved = depot.reserved;
+  stats->depot = depot.nodes;
+  pthread_mutex_unlock(&depot.lock);
+}
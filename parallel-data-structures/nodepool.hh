@@ -0,0 +1,42 @@
+#ifndef NODEPOOL_H
+#define NODEPOOL_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+// Pool of fixed-size nodes shared by the queue and the stack. Every thread
+// keeps freed nodes on a free list of its own and allocates from it, so
+// steady-state puts and takes never call malloc or free. A thread whose list
+// grows too long hands a batch of nodes to a shared depot, where a thread
+// that runs out picks them up, so producers and consumers on different
+// threads trade nodes a batch at a time. Nodes are carved from chunks that
+// are never returned to the system; the pool only grows to its peak use.
+
+// Size of every node; a node must hold at least two pointers. Every node is
+// aligned to its size, so the low bits of a node's address are always zero.
+#define NODEPOOL_NODE_SIZE 16
+
+// Nodes moved between a thread's free list and the depot at a time
+#define NODEPOOL_BATCH 128
+
+// Longest a thread's free list gets before a batch goes to the depot
+#define NODEPOOL_CACHE (2 * NODEPOOL_BATCH)
+
+// Size of the chunks new nodes are carved from
+#define NODEPOOL_CHUNK (64 * 1024)
+
+typedef struct nodepool_stats {
+  size_t reserved;  // bytes in chunks taken from malloc
+  size_t depot;     // nodes waiting in the depot
+} nodepool_stats_t;
+
+// Allocate a node of NODEPOOL_NODE_SIZE bytes
+void* nodepool_alloc(void);
+
+// Return a node to the pool. Any thread may free any node.
+void nodepool_free(void* node);
+
+// Get the pool's counters. Nodes on threads' own free lists are not counted.
+void nodepool_stats(nodepool_stats_t* stats);
+
+#endif
@@ -0,0 +1,129 @@
+#include "instrument.hh"
+#include "pqueue.hh"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/****** Priority Queue Benchmark ******/
+
+// Sustained put-take: the queue is filled with PREFILL elements, then the same
+// number of put-take pairs is split across 1 to 64 threads, each putting an
+// element with a random priority and then taking one, so the queue stays at
+// about the same size throughout. Reported for
+//   heap:       the binary heap under one lock
+//   multiqueue: the MultiQueue, with twice as many heaps as threads
+// in millions of operations per second.
+
+#define PREFILL 100000
+#define TOTAL_PAIRS 1000000
+#define MAX_THREADS 64
+#define SHARDS_PER_THREAD 2
+
+typedef enum backend { HEAP, MULTIQUEUE, NUM_BACKENDS } backend_t;
+
+static const char *backend_names[NUM_BACKENDS] = {"heap", "multiqueue"};
+
+typedef struct bench_queue {
+  backend_t backend;
+  my_pqueue_t heap;
+  my_multiqueue_t multiqueue;
+} bench_queue_t;
+
+typedef struct bench_thread {
+  bench_queue_t *q;
+  unsigned int seed;
+  int pairs;
+  int failures;
+} bench_thread_t;
+
+/**
+ * @brief  Run one thread's share of the put-take pairs
+ * @note   The queue never runs empty, since it starts with PREFILL elements
+ *         and every thread puts before it takes
+ * @param  *arg: bench_thread_t
+ * @retval None
+ */
+static void *bench_run(void *arg) {
+  bench_thread_t *t = (bench_thread_t *)arg;
+  for (int i = 0; i < t->pairs; i++) {
+    int priority = rand_r(&t->seed) % TOTAL_PAIRS;
+    int taken;
+    bool ok;
+    if (t->q->backend == HEAP) {
+      pqueue_put(&t->q->heap, i, priority);
+      ok = pqueue_take(&t->q->heap, &taken, NULL);
+    } else {
+      multiqueue_put(&t->q->multiqueue, i, priority);
+      ok = multiqueue_take(&t->q->multiqueue, &taken, NULL);
+    }
+    if (!ok)
+      t->failures++;
+  }
+  return NULL;
+}
+
+/**
+ * @brief  Time the put-take pairs on one backend with a given number of threads
+ * @note
+ * @param  backend: backend to run
+ * @param  num_threads: number of threads sharing the work
+ * @param  *failures: incremented for every take that found the queue empty
+ * @retval millions of operations per second
+ */
+static double bench_sustained(backend_t backend, int num_threads, int *failures) {
+  bench_queue_t q;
+  q.backend = backend;
+  pqueue_init(&q.heap);
+  multiqueue_init(&q.multiqueue, SHARDS_PER_THREAD * num_threads);
+  unsigned int seed = 1;
+  for (int i = 0; i < PREFILL; i++) {
+    if (backend == HEAP)
+      pqueue_put(&q.heap, i, rand_r(&seed) % TOTAL_PAIRS);
+    else
+      multiqueue_put(&q.multiqueue, i, rand_r(&seed) % TOTAL_PAIRS);
+  }
+
+  pthread_t threads[MAX_THREADS];
+  bench_thread_t args[MAX_THREADS];
+  uint64_t start = instrument_now();
+  for (int i = 0; i < num_threads; i++) {
+    args[i].q = &q;
+    args[i].seed = i + 2;
+    args[i].pairs = TOTAL_PAIRS / num_threads;
+    args[i].failures = 0;
+    if (pthread_create(&threads[i], NULL, bench_run, &args[i]) != 0)
+      perror("Error creating thread");
+  }
+  for (int i = 0; i < num_threads; i++) {
+    if (pthread_join(threads[i], NULL) != 0)
+      perror("Error joining thread");
+    *failures += args[i].failures;
+  }
+  uint64_t end = instrument_now();
+
+  pqueue_destroy(&q.heap);
+  multiqueue_destroy(&q.multiqueue);
+  return 2.0 * (TOTAL_PAIRS / num_threads) * num_threads / ((end - start) / 1e3);
+}
+
+int main(int argc, char **argv) {
+  int failures = 0;
+
+  printf("prefill: %d, put-take pairs: %d, Mops/s by threads\n", PREFILL, TOTAL_PAIRS);
+  printf("%-10s", "threads");
+  for (int b = 0; b < NUM_BACKENDS; b++)
+    printf("%12s", backend_names[b]);
+  printf("\n");
+  for (int threads = 1; threads <= MAX_THREADS; threads *= 2) {
+    printf("%-10d", threads);
+    for (int b = 0; b < NUM_BACKENDS; b++)
+      printf("%12.2f", bench_sustained((backend_t)b, threads, &failures));
+    printf("\n");
+  }
+
+  if (failures != 0) {
+    printf("FAILED: %d checks did not match\n", failures);
+    return 1;
+  }
+  return 0;
+}
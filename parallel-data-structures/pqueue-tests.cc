@@ -0,0 +1,266 @@
+#include <gtest/gtest.h>
+
+#include "pqueue.hh"
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/****** Priority Queue Invariants ******/
+
+// Invariant 1
+// Every value put is taken exactly once, together with the priority it was put with.
+
+// Invariant 2
+// A take from my_pqueue_t returns an element with the lowest priority in the queue. A MultiQueue
+// with a single heap behaves the same; with more heaps takes are only roughly in priority order.
+
+/****** Begin Tests ******/
+
+#define BASIC_VALUES 1000
+
+// Basic heap functionality
+TEST(PriorityQueueTest, BasicQueueOps) {
+  my_pqueue_t q;
+  pqueue_init(&q);
+
+  int element = 42, priority = 42;
+  ASSERT_TRUE(pqueue_empty(&q));
+  ASSERT_FALSE(pqueue_take(&q, &element, &priority));
+  ASSERT_EQ(42, element);
+
+  // Put priorities in a scrambled order, with each priority twice
+  for (int i = 0; i < BASIC_VALUES; i++)
+    pqueue_put(&q, i, (i * 7919) % (BASIC_VALUES / 2));
+  ASSERT_FALSE(pqueue_empty(&q));
+
+  int last = -1;
+  for (int i = 0; i < BASIC_VALUES; i++) {
+    ASSERT_TRUE(pqueue_take(&q, &element, &priority));
+    ASSERT_EQ((element * 7919) % (BASIC_VALUES / 2), priority);
+    ASSERT_LE(last, priority);
+    last = priority;
+  }
+  ASSERT_TRUE(pqueue_empty(&q));
+
+  // The priority can be left out
+  pqueue_put(&q, 5, 1);
+  ASSERT_TRUE(pqueue_take(&q, &element, NULL));
+  ASSERT_EQ(5, element);
+
+  // clean up
+  pqueue_put(&q, 6, 1);
+  pqueue_destroy(&q);
+}
+
+// A MultiQueue with one heap is exact; with several, every element still comes out
+TEST(MultiQueueTest, BasicQueueOps) {
+  my_multiqueue_t q;
+  int element, priority;
+
+  multiqueue_init(&q, 1);
+  for (int i = 0; i < BASIC_VALUES; i++)
+    multiqueue_put(&q, i, (i * 7919) % BASIC_VALUES);
+  int last = -1;
+  for (int i = 0; i < BASIC_VALUES; i++) {
+    ASSERT_TRUE(multiqueue_take(&q, &element, &priority));
+    ASSERT_EQ((element * 7919) % BASIC_VALUES, priority);
+    ASSERT_LE(last, priority);
+    last = priority;
+  }
+  ASSERT_TRUE(multiqueue_empty(&q));
+  ASSERT_FALSE(multiqueue_take(&q, &element, &priority));
+  multiqueue_destroy(&q);
+
+  multiqueue_init(&q, 8);
+  ASSERT_TRUE(multiqueue_empty(&q));
+  for (int i = 0; i < BASIC_VALUES; i++)
+    multiqueue_put(&q, i, (i * 7919) % BASIC_VALUES);
+  ASSERT_FALSE(multiqueue_empty(&q));
+  bool seen[BASIC_VALUES] = {};
+  for (int i = 0; i < BASIC_VALUES; i++) {
+    ASSERT_TRUE(multiqueue_take(&q, &element, NULL));
+    ASSERT_FALSE(seen[element]);
+    seen[element] = true;
+  }
+  ASSERT_TRUE(multiqueue_empty(&q));
+  ASSERT_FALSE(multiqueue_take(&q, &element, &priority));
+
+  // clean up
+  multiqueue_put(&q, 1, 1);
+  multiqueue_destroy(&q);
+}
+
+// The lowest and highest priorities are ordinary priorities in both variants
+TEST(MultiQueueTest, ExtremePriorities) {
+  int element, priority;
+
+  my_pqueue_t heap;
+  pqueue_init(&heap);
+  pqueue_put(&heap, 7, INT_MAX);
+  pqueue_put(&heap, 8, INT_MIN);
+  ASSERT_TRUE(pqueue_take(&heap, &element, &priority));
+  ASSERT_EQ(8, element);
+  ASSERT_EQ(INT_MIN, priority);
+  ASSERT_TRUE(pqueue_take(&heap, &element, &priority));
+  ASSERT_EQ(7, element);
+  ASSERT_EQ(INT_MAX, priority);
+  ASSERT_TRUE(pqueue_empty(&heap));
+  pqueue_destroy(&heap);
+
+  my_multiqueue_t q;
+  multiqueue_init(&q, 4);
+  multiqueue_put(&q, 7, INT_MAX);
+  ASSERT_FALSE(multiqueue_empty(&q));
+  ASSERT_TRUE(multiqueue_take(&q, &element, &priority));
+  ASSERT_EQ(7, element);
+  ASSERT_EQ(INT_MAX, priority);
+  ASSERT_TRUE(multiqueue_empty(&q));
+
+  multiqueue_put(&q, 8, INT_MIN);
+  ASSERT_FALSE(multiqueue_empty(&q));
+  ASSERT_TRUE(multiqueue_take(&q, &element, &priority));
+  ASSERT_EQ(8, element);
+  ASSERT_EQ(INT_MIN, priority);
+  ASSERT_TRUE(multiqueue_empty(&q));
+  ASSERT_FALSE(multiqueue_take(&q, &element, &priority));
+  multiqueue_destroy(&q);
+}
+
+#define NUM_PRODUCERS 3
+#define NUM_CONSUMERS 3
+#define VALUES_PER_PRODUCER 20000
+#define NUM_VALUES (NUM_PRODUCERS * VALUES_PER_PRODUCER)
+#define NUM_SHARDS 8
+
+typedef struct pqueue_thread_args {
+  int id;
+  my_pqueue_t *heap;            // used if not NULL
+  my_multiqueue_t *multiqueue;  // used otherwise
+  int *taken;                   // how often each value was taken, shared by all threads
+  int count;
+  bool priorities_match;
+  bool in_priority_order;
+} pqueue_thread_args_t;
+
+/**
+ * @brief  Priority every test value is put with, scrambled against the value
+ * @note
+ * @param  value: value put
+ * @retval its priority
+ */
+static int priority_of(int value) {
+  return (int)((long)value * 7919 % NUM_VALUES);
+}
+
+/**
+ * @brief  Put id * VALUES_PER_PRODUCER + i for increasing i
+ * @note
+ * @param  *arg: pqueue_thread_args_t
+ * @retval None
+ */
+void *pqueue_producer(void *arg) {
+  pqueue_thread_args_t *args = (pqueue_thread_args_t *)arg;
+  for (int i = 0; i < VALUES_PER_PRODUCER; i++) {
+    int value = args->id * VALUES_PER_PRODUCER + i;
+    if (args->heap != NULL)
+      pqueue_put(args->heap, value, priority_of(value));
+    else
+      multiqueue_put(args->multiqueue, value, priority_of(value));
+  }
+  return NULL;
+}
+
+/**
+ * @brief  Take until the queue is empty, checking what comes out
+ * @note   Nothing is put meanwhile, so each take from the heap finds a
+ *         priority no more urgent than this thread's previous one
+ * @param  *arg: pqueue_thread_args_t
+ * @retval None
+ */
+void *pqueue_consumer(void *arg) {
+  pqueue_thread_args_t *args = (pqueue_thread_args_t *)arg;
+  args->count = 0;
+  args->priorities_match = true;
+  args->in_priority_order = true;
+  int taken, priority, last = -1;
+  while (args->heap != NULL ? pqueue_take(args->heap, &taken, &priority)
+                            : multiqueue_take(args->multiqueue, &taken, &priority)) {
+    args->count++;
+    if (priority != priority_of(taken))
+      args->priorities_match = false;
+    if (priority < last)
+      args->in_priority_order = false;
+    last = priority;
+    __atomic_add_fetch(&args->taken[taken], 1, __ATOMIC_RELAXED);
+  }
+  return NULL;
+}
+
+/**
+ * @brief  Fill one queue from producers, then drain it with consumers, and
+ *         check invariants 1 and 2
+ * @note
+ * @param  *heap: heap to use, or NULL
+ * @param  *multiqueue: MultiQueue to use if heap is NULL
+ * @retval None
+ */
+static void check_fill_then_drain(my_pqueue_t *heap, my_multiqueue_t *multiqueue) {
+  int *taken = (int *)calloc(NUM_VALUES, sizeof(int));
+  pthread_t threads[NUM_PRODUCERS + NUM_CONSUMERS];
+  pqueue_thread_args_t args[NUM_PRODUCERS + NUM_CONSUMERS];
+  for (int i = 0; i < NUM_PRODUCERS + NUM_CONSUMERS; i++) {
+    args[i].id = i;
+    args[i].heap = heap;
+    args[i].multiqueue = multiqueue;
+    args[i].taken = taken;
+  }
+  for (int i = 0; i < NUM_PRODUCERS; i++) {
+    if (pthread_create(&threads[i], NULL, pqueue_producer, &args[i]) != 0)
+      perror("Error creating thread");
+  }
+  for (int i = 0; i < NUM_PRODUCERS; i++) {
+    if (pthread_join(threads[i], NULL) != 0)
+      perror("Error joining thread");
+  }
+  for (int i = NUM_PRODUCERS; i < NUM_PRODUCERS + NUM_CONSUMERS; i++) {
+    if (pthread_create(&threads[i], NULL, pqueue_consumer, &args[i]) != 0)
+      perror("Error creating thread");
+  }
+  for (int i = NUM_PRODUCERS; i < NUM_PRODUCERS + NUM_CONSUMERS; i++) {
+    if (pthread_join(threads[i], NULL) != 0)
+      perror("Error joining thread");
+  }
+
+  // a take only failed once every value was out, and each came out once with
+  // its own priority; the heap handed them out in priority order
+  int count = 0;
+  for (int i = NUM_PRODUCERS; i < NUM_PRODUCERS + NUM_CONSUMERS; i++) {
+    ASSERT_TRUE(args[i].priorities_match);
+    ASSERT_TRUE(heap == NULL || args[i].in_priority_order);
+    count += args[i].count;
+  }
+  ASSERT_EQ(NUM_VALUES, count);
+  for (int i = 0; i < NUM_VALUES; i++)
+    ASSERT_EQ(1, taken[i]);
+  free(taken);
+}
+
+// Invariants 1 and 2 for the heap, filled and drained by several threads
+TEST(PriorityQueueTest, ConcurrentFillThenDrain) {
+  my_pqueue_t q;
+  pqueue_init(&q);
+  check_fill_then_drain(&q, NULL);
+  ASSERT_TRUE(pqueue_empty(&q));
+  pqueue_destroy(&q);
+}
+
+// Invariant 1 for the MultiQueue, whose takes must not give up while any
+// heap still holds an element, even when the two heaps they pick are empty
+TEST(MultiQueueTest, ConcurrentFillThenDrain) {
+  my_multiqueue_t q;
+  multiqueue_init(&q, NUM_SHARDS);
+  check_fill_then_drain(NULL, &q);
+  ASSERT_TRUE(multiqueue_empty(&q));
+  multiqueue_destroy(&q);
+}
@@ -0,0 +1,306 @@
+#include "pqueue.hh"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// Operations the instrumentation times
+enum { PQUEUE_OP_PUT, PQUEUE_OP_TAKE, PQUEUE_OP_EMPTY, PQUEUE_NUM_OPS };
+#ifdef INSTRUMENT
+static const char *const pqueue_op_names[PQUEUE_NUM_OPS] = {"put", "take", "empty"};
+#endif
+
+// Random number state of the calling thread, seeded on first use
+static __thread unsigned int rng_state = 0;
+static unsigned int next_seed = 0;
+
+/**
+ * @brief  Get a random number for the calling thread
+ * @note   xorshift; only used to pick heaps
+ * @retval pseudo-random number
+ */
+static unsigned int random_next(void) {
+  if (rng_state == 0)
+    rng_state = __atomic_add_fetch(&next_seed, 0x9e3779b9u, __ATOMIC_RELAXED) | 1;
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return rng_state;
+}
+
+/**
+ * @brief  Initialize an empty heap
+ * @note
+ * @param  *heap: heap to initialize
+ * @retval None
+ */
+static void heap_init(pqueue_heap_t *heap) {
+  heap->entries = NULL;
+  heap->count = 0;
+  heap->capacity = 0;
+}
+
+/**
+ * @brief  Add an entry to a heap
+ * @note   Sifts the entry up from the bottom
+ * @param  *heap: heap to add to
+ * @param  element: element of the entry
+ * @param  priority: priority of the entry
+ * @retval None
+ */
+static void heap_push(pqueue_heap_t *heap, int element, int priority) {
+  if (heap->count == heap->capacity) {
+    heap->capacity = heap->capacity == 0 ? 64 : heap->capacity * 2;
+    heap->entries = (pqueue_entry_t *)realloc(heap->entries, heap->capacity * sizeof(pqueue_entry_t));
+  }
+  size_t i = heap->count++;
+  while (i > 0) {
+    size_t parent = (i - 1) / 2;
+    if (heap->entries[parent].priority <= priority)
+      break;
+    heap->entries[i] = heap->entries[parent];
+    i = parent;
+  }
+  heap->entries[i].priority = priority;
+  heap->entries[i].element = element;
+}
+
+/**
+ * @brief  Remove the most urgent entry of a non-empty heap
+ * @note   Sifts the last entry down from the root
+ * @param  *heap: heap to remove from
+ * @retval the entry removed
+ */
+static pqueue_entry_t heap_pop(pqueue_heap_t *heap) {
+  pqueue_entry_t top = heap->entries[0];
+  pqueue_entry_t last = heap->entries[--heap->count];
+  size_t i = 0;
+  while (true) {
+    size_t child = 2 * i + 1;
+    if (child >= heap->count)
+      break;
+    if (child + 1 < heap->count && heap->entries[child + 1].priority < heap->entries[child].priority)
+      child++;
+    if (last.priority <= heap->entries[child].priority)
+      break;
+    heap->entries[i] = heap->entries[child];
+    i = child;
+  }
+  if (heap->count > 0)
+    heap->entries[i] = last;
+  return top;
+}
+
+/**
+ * @brief  Get the priority of a heap's most urgent entry
+ * @note   Widened to 64 bits so that INT64_MAX can mark an empty heap without
+ *         taking a priority away from the elements
+ * @param  *heap: heap to look at
+ * @retval its priority, INT64_MAX if the heap is empty
+ */
+static int64_t heap_top(pqueue_heap_t *heap) {
+  return heap->count > 0 ? heap->entries[0].priority : INT64_MAX;
+}
+
+/**
+ * @brief  Initialize a priority queue
+ * @note
+ * @param  *queue: queue to initialize
+ * @retval None
+ */
+void pqueue_init(my_pqueue_t *queue) {
+  heap_init(&queue->heap);
+  pthread_mutex_init(&queue->lock, NULL);
+  INSTRUMENT_INIT(&queue->instrument, "pqueue", pqueue_op_names, PQUEUE_NUM_OPS);
+}
+
+/**
+ * @brief  Destroy a priority queue
+ * @note
+ * @param  *queue: queue to destroy
+ * @retval None
+ */
+void pqueue_destroy(my_pqueue_t *queue) {
+  free(queue->heap.entries);
+  heap_init(&queue->heap);
+  pthread_mutex_destroy(&queue->lock);
+}
+
+/**
+ * @brief  Put an element into a priority queue
+ * @note
+ * @param  *queue: queue to put into
+ * @param  element: element to put
+ * @param  priority: lower is more urgent
+ * @retval None
+ */
+void pqueue_put(my_pqueue_t *queue, int element, int priority) {
+  INSTRUMENT_START(start);
+  INSTRUMENT_LOCK(&queue->instrument, &queue->lock);
+  heap_push(&queue->heap, element, priority);
+  INSTRUMENT_UNLOCK(&queue->instrument, &queue->lock);
+  INSTRUMENT_OP(&queue->instrument, PQUEUE_OP_PUT, start);
+}
+
+/**
+ * @brief  Check if a priority queue is empty
+ * @note
+ * @param  *queue: queue to check
+ * @retval whether it holds no elements
+ */
+bool pqueue_empty(my_pqueue_t *queue) {
+  INSTRUMENT_START(start);
+  INSTRUMENT_LOCK(&queue->instrument, &queue->lock);
+  bool ret = queue->heap.count == 0;
+  INSTRUMENT_UNLOCK(&queue->instrument, &queue->lock);
+  INSTRUMENT_OP(&queue->instrument, PQUEUE_OP_EMPTY, start);
+  return ret;
+}
+
+/**
+ * @brief  Take the most urgent element of a priority queue
+ * @note
+ * @param  *queue: queue to take from
+ * @param  *element: set to the element
+ * @param  *priority: set to its priority, may be NULL
+ * @retval false if the queue was empty
+ */
+bool pqueue_take(my_pqueue_t *queue, int *element, int *priority) {
+  INSTRUMENT_START(start);
+  INSTRUMENT_LOCK(&queue->instrument, &queue->lock);
+  bool ret = queue->heap.count > 0;
+  pqueue_entry_t top;
+  if (ret)
+    top = heap_pop(&queue->heap);
+  INSTRUMENT_UNLOCK(&queue->instrument, &queue->lock);
+  if (ret) {
+    *element = top.element;
+    if (priority != NULL)
+      *priority = top.priority;
+  }
+  INSTRUMENT_OP(&queue->instrument, PQUEUE_OP_TAKE, start);
+  return ret;
+}
+
+/**
+ * @brief  Initialize a MultiQueue
+ * @note
+ * @param  *queue: queue to initialize
+ * @param  num_shards: number of heaps, at least 1
+ * @retval None
+ */
+void multiqueue_init(my_multiqueue_t *queue, int num_shards) {
+  queue->num_shards = num_shards > 0 ? num_shards : 1;
+  queue->shards = (multiqueue_shard_t *)aligned_alloc(64, queue->num_shards * sizeof(multiqueue_shard_t));
+  for (int i = 0; i < queue->num_shards; i++) {
+    heap_init(&queue->shards[i].heap);
+    pthread_mutex_init(&queue->shards[i].lock, NULL);
+    queue->shards[i].top = INT64_MAX;
+  }
+}
+
+/**
+ * @brief  Destroy a MultiQueue
+ * @note
+ * @param  *queue: queue to destroy
+ * @retval None
+ */
+void multiqueue_destroy(my_multiqueue_t *queue) {
+  for (int i = 0; i < queue->num_shards; i++) {
+    free(queue->shards[i].heap.entries);
+    pthread_mutex_destroy(&queue->shards[i].lock);
+  }
+  free(queue->shards);
+  queue->shards = NULL;
+}
+
+/**
+ * @brief  Put an element into a MultiQueue
+ * @note   Tries random heaps until one is not locked
+ * @param  *queue: queue to put into
+ * @param  element: element to put
+ * @param  priority: lower is more urgent
+ * @retval None
+ */
+void multiqueue_put(my_multiqueue_t *queue, int element, int priority) {
+  multiqueue_shard_t *shard;
+  do {
+    shard = &queue->shards[random_next() % queue->num_shards];
+  } while (pthread_mutex_trylock(&shard->lock) != 0);
+  heap_push(&shard->heap, element, priority);
+  __atomic_store_n(&shard->top, heap_top(&shard->heap), __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&shard->lock);
+}
+
+/**
+ * @brief  Check if a MultiQueue is empty
+ * @note   Reads every heap's top without locking
+ * @param  *queue: queue to check
+ * @retval whether every heap looked empty
+ */
+bool multiqueue_empty(my_multiqueue_t *queue) {
+  for (int i = 0; i < queue->num_shards; i++) {
+    if (__atomic_load_n(&queue->shards[i].top, __ATOMIC_RELAXED) != INT64_MAX)
+      return false;
+  }
+  return true;
+}
+
+/**
+ * @brief  Take the most urgent element of a locked heap
+ * @note   Unlocks the heap
+ * @param  *shard: locked heap
+ * @param  *element: set to the element
+ * @param  *priority: set to its priority, may be NULL
+ * @retval false if the heap was empty
+ */
+static bool shard_take(multiqueue_shard_t *shard, int *element, int *priority) {
+  if (shard->heap.count == 0) {
+    pthread_mutex_unlock(&shard->lock);
+    return false;
+  }
+  pqueue_entry_t top = heap_pop(&shard->heap);
+  __atomic_store_n(&shard->top, heap_top(&shard->heap), __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&shard->lock);
+  *element = top.element;
+  if (priority != NULL)
+    *priority = top.priority;
+  return true;
+}
+
+/**
+ * @brief  Take one of the most urgent elements of a MultiQueue
+ * @note   Compares the tops of two random heaps and takes from the more
+ *         urgent one. When both look empty or too many picks are locked or
+ *         emptied under it, falls back to checking every heap in turn.
+ * @param  *queue: queue to take from
+ * @param  *element: set to the element
+ * @param  *priority: set to its priority, may be NULL
+ * @retval false if every heap was empty
+ */
+bool multiqueue_take(my_multiqueue_t *queue, int *element, int *priority) {
+  int n = queue->num_shards;
+  for (int attempt = 0; attempt < 2 * n; attempt++) {
+    multiqueue_shard_t *a = &queue->shards[random_next() % n];
+    multiqueue_shard_t *b = &queue->shards[random_next() % n];
+    int64_t top_a = __atomic_load_n(&a->top, __ATOMIC_RELAXED);
+    int64_t top_b = __atomic_load_n(&b->top, __ATOMIC_RELAXED);
+    if (top_a == INT64_MAX && top_b == INT64_MAX)
+      break;
+    multiqueue_shard_t *shard = top_a <= top_b ? a : b;
+    if (pthread_mutex_trylock(&shard->lock) != 0)
+      continue;
+    if (shard_take(shard, element, priority))
+      return true;
+  }
+
+  int first = random_next() % n;
+  for (int i = 0; i < n; i++) {
+    multiqueue_shard_t *shard = &queue->shards[(first + i) % n];
+    if (__atomic_load_n(&shard->top, __ATOMIC_RELAXED) == INT64_MAX)
+      continue;
+    pthread_mutex_lock(&shard->lock);
+    if (shard_take(shard, element, priority))
+      return true;
+  }
+  return false;
+}
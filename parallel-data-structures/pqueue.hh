@@ -0,0 +1,86 @@
+#ifndef PQUEUE_H
+#define PQUEUE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "instrument.hh"
+
+// Concurrent priority queues. Every element is put with a priority, and the
+// element with the lowest priority value is the most urgent.
+//
+// my_pqueue_t is a binary heap under one mutex: takes always return the most
+// urgent element, and every operation is serialized.
+//
+// my_multiqueue_t (Rihani, Sanders and Dementiev) spreads elements over
+// several heaps, each with its own lock. A put goes to a random heap; a take
+// looks at the tops of two random heaps and takes from the more urgent one.
+// Takes are relaxed: they return one of the most urgent elements, not
+// necessarily the most urgent, in exchange for threads rarely touching the
+// same heap.
+
+typedef struct pqueue_entry {
+  int priority;
+  int element;
+} pqueue_entry_t;
+
+typedef struct pqueue_heap {
+  pqueue_entry_t* entries;
+  size_t count;
+  size_t capacity;
+} pqueue_heap_t;
+
+typedef struct my_pqueue {
+  pqueue_heap_t heap;
+  pthread_mutex_t lock;
+  INSTRUMENT_FIELD(instrument)
+} my_pqueue_t;
+
+typedef struct multiqueue_shard {
+  pqueue_heap_t heap;
+  pthread_mutex_t lock;
+  int64_t top;  // priority of the heap's most urgent element, INT64_MAX if empty; read without the lock
+} __attribute__((aligned(64))) multiqueue_shard_t;
+
+typedef struct my_multiqueue {
+  int num_shards;
+  multiqueue_shard_t* shards;
+} my_multiqueue_t;
+
+// Initialize a priority queue
+void pqueue_init(my_pqueue_t* queue);
+
+// Destroy a priority queue
+void pqueue_destroy(my_pqueue_t* queue);
+
+// Put an element into a priority queue
+void pqueue_put(my_pqueue_t* queue, int element, int priority);
+
+// Check if a priority queue is empty
+bool pqueue_empty(my_pqueue_t* queue);
+
+// Take the most urgent element of a priority queue into *element, and its
+// priority into *priority unless that is NULL. Returns false if it is empty.
+bool pqueue_take(my_pqueue_t* queue, int* element, int* priority);
+
+// Initialize a MultiQueue with num_shards heaps. Around twice the number of
+// threads using it works well.
+void multiqueue_init(my_multiqueue_t* queue, int num_shards);
+
+// Destroy a MultiQueue
+void multiqueue_destroy(my_multiqueue_t* queue);
+
+// Put an element into a MultiQueue
+void multiqueue_put(my_multiqueue_t* queue, int element, int priority);
+
+// Check if a MultiQueue is empty
+bool multiqueue_empty(my_multiqueue_t* queue);
+
+// Take one of the most urgent elements of a MultiQueue into *element, and its
+// priority into *priority unless that is NULL. Returns false only if every
+// heap was found empty.
+bool multiqueue_take(my_multiqueue_t* queue, int* element, int* priority);
+
+#endif
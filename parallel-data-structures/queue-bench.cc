@@ -0,0 +1,256 @@
+#include "instrument.hh"
+#include "lfqueue.hh"
+#include "queue.hh"
+#include "ringqueue.hh"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/****** Queue Benchmarks ******/
+
+// Enqueue latency by depth: put N elements into an empty queue, timing every
+// put, and report the latencies separately for each decade of queue depth
+// (below 10, 10 to 100, ...). With puts appending at the tail, every decade
+// should show about the same latency; a put that walked the list would get
+// ten times slower per decade. The elements are then taken back in order.
+//
+// Contention: the same number of put-take pairs is split across 1 to 64
+// threads, for
+//   two-lock:  the queue with separate head and tail locks
+//   lock-free: the lock-free queue
+//   ring:      the bounded ring-buffer queue, with blocking puts and takes
+// and the throughput of each is reported.
+//
+// Bursts: one thread puts TOTAL_PAIRS elements in bursts while another takes
+// them in batches of the same size, with queue_put_many and queue_take_many,
+// for burst sizes from 1 (plain puts and takes) to 1024.
+
+#define DEFAULT_ELEMENTS 10000000
+#define DEPTH_DECADES 10
+#define TOTAL_PAIRS 1000000
+#define MAX_THREADS 64
+#define RING_CAPACITY 1024
+#define MAX_BURST 1024
+
+typedef enum backend { TWO_LOCK, LOCK_FREE, RING, NUM_BACKENDS } backend_t;
+
+static const char *backend_names[NUM_BACKENDS] = {"two-lock", "lock-free", "ring"};
+
+typedef struct bench_queue {
+  backend_t backend;
+  my_queue_t locked;
+  my_lfqueue_t lock_free;
+  my_ringqueue_t ring;
+} bench_queue_t;
+
+typedef struct bench_thread {
+  bench_queue_t *q;
+  int pairs;
+  int failures;
+} bench_thread_t;
+
+/**
+ * @brief  Run one thread's share of the put-take pairs
+ * @note   The queue is never empty when a take starts, since every thread
+ *         puts before it takes
+ * @param  *arg: bench_thread_t
+ * @retval None
+ */
+static void *bench_run(void *arg) {
+  bench_thread_t *t = (bench_thread_t *)arg;
+  for (int i = 0; i < t->pairs; i++) {
+    int taken;
+    switch (t->q->backend) {
+      case TWO_LOCK:
+        queue_put(&t->q->locked, i);
+        taken = queue_take(&t->q->locked);
+        break;
+      case LOCK_FREE:
+        lfqueue_put(&t->q->lock_free, i);
+        taken = lfqueue_take(&t->q->lock_free);
+        break;
+      default:
+        ringqueue_put(&t->q->ring, i);
+        taken = ringqueue_take(&t->q->ring);
+    }
+    if (taken == -1)
+      t->failures++;
+  }
+  return NULL;
+}
+
+/**
+ * @brief  Time the put-take pairs on one backend with a given number of threads
+ * @note
+ * @param  backend: backend to run
+ * @param  num_threads: number of threads sharing the work
+ * @param  *failures: incremented for every take that found the queue empty
+ * @retval millions of operations per second
+ */
+static double bench_contention(backend_t backend, int num_threads, int *failures) {
+  bench_queue_t q;
+  q.backend = backend;
+  queue_init(&q.locked);
+  lfqueue_init(&q.lock_free);
+  ringqueue_init(&q.ring, RING_CAPACITY);
+
+  pthread_t threads[MAX_THREADS];
+  bench_thread_t args[MAX_THREADS];
+  uint64_t start = instrument_now();
+  for (int i = 0; i < num_threads; i++) {
+    args[i].q = &q;
+    args[i].pairs = TOTAL_PAIRS / num_threads;
+    args[i].failures = 0;
+    if (pthread_create(&threads[i], NULL, bench_run, &args[i]) != 0)
+      perror("Error creating thread");
+  }
+  for (int i = 0; i < num_threads; i++) {
+    if (pthread_join(threads[i], NULL) != 0)
+      perror("Error joining thread");
+    *failures += args[i].failures;
+  }
+  uint64_t end = instrument_now();
+
+  queue_destroy(&q.locked);
+  lfqueue_destroy(&q.lock_free);
+  ringqueue_destroy(&q.ring);
+  return 2.0 * (TOTAL_PAIRS / num_threads) * num_threads / ((end - start) / 1e3);
+}
+
+typedef struct burst_producer {
+  my_queue_t *queue;
+  int burst;
+} burst_producer_t;
+
+/**
+ * @brief  Put 0 to TOTAL_PAIRS - 1 in bursts
+ * @note
+ * @param  *arg: burst_producer_t
+ * @retval None
+ */
+static void *burst_run(void *arg) {
+  burst_producer_t *p = (burst_producer_t *)arg;
+  int elements[MAX_BURST];
+  for (int i = 0; i < TOTAL_PAIRS; i += p->burst) {
+    int n = TOTAL_PAIRS - i < p->burst ? TOTAL_PAIRS - i : p->burst;
+    for (int j = 0; j < n; j++)
+      elements[j] = i + j;
+    if (n == 1)
+      queue_put(p->queue, elements[0]);
+    else
+      queue_put_many(p->queue, elements, n);
+  }
+  return NULL;
+}
+
+/**
+ * @brief  Time one producer and one consumer moving elements in bursts
+ * @note
+ * @param  burst: elements per put and per take
+ * @param  *failures: incremented for every element taken out of order
+ * @retval millions of elements per second
+ */
+static double bench_bursts(int burst, int *failures) {
+  my_queue_t queue;
+  queue_init(&queue);
+  burst_producer_t producer = {&queue, burst};
+  uint64_t start = instrument_now();
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, burst_run, &producer) != 0)
+    perror("Error creating thread");
+
+  int elements[MAX_BURST];
+  int expected = 0;
+  while (expected < TOTAL_PAIRS) {
+    int n;
+    if (burst == 1)
+      n = queue_try_take(&queue, &elements[0]) ? 1 : 0;
+    else
+      n = queue_take_many(&queue, elements, burst);
+    if (n == 0)
+      sched_yield();
+    for (int i = 0; i < n; i++) {
+      if (elements[i] != expected++)
+        (*failures)++;
+    }
+  }
+  if (pthread_join(thread, NULL) != 0)
+    perror("Error joining thread");
+  uint64_t end = instrument_now();
+  queue_destroy(&queue);
+  return TOTAL_PAIRS / ((end - start) / 1e3);
+}
+
+int main(int argc, char **argv) {
+  long num_elements = argc > 1 ? atol(argv[1]) : DEFAULT_ELEMENTS;
+  int failures = 0;
+
+  my_queue_t queue;
+  queue_init(&queue);
+
+  instrument_histogram_t *decades = (instrument_histogram_t *)calloc(DEPTH_DECADES, sizeof(instrument_histogram_t));
+  long decade_end = 10;
+  int decade = 0;
+  uint64_t put_start = instrument_now();
+  for (long i = 0; i < num_elements; i++) {
+    if (i == decade_end && decade < DEPTH_DECADES - 1) {
+      decade++;
+      decade_end *= 10;
+    }
+    uint64_t start = instrument_now();
+    queue_put(&queue, (int)i);
+    instrument_record(&decades[decade], instrument_now() - start);
+  }
+  uint64_t put_end = instrument_now();
+
+  for (long i = 0; i < num_elements; i++) {
+    if (queue_take(&queue) != (int)i)
+      failures++;
+  }
+  if (!queue_empty(&queue))
+    failures++;
+  uint64_t take_end = instrument_now();
+  queue_destroy(&queue);
+
+  double n = num_elements > 0 ? num_elements : 1;
+  printf("elements:     %ld\n", num_elements);
+  printf("put:          %8.3f s  %8.1f ns/op\n", (put_end - put_start) / 1e9, (put_end - put_start) / n);
+  printf("take:         %8.3f s  %8.1f ns/op\n", (take_end - put_end) / 1e9, (take_end - put_end) / n);
+  printf("put latency by queue depth, in ns:\n");
+  long depth = 0;
+  decade_end = 10;
+  for (int i = 0; i <= decade; i++) {
+    unsigned long count = instrument_count(&decades[i]);
+    printf("  %9ld - %-9ld %9lu puts  mean %8.1f  p50 %6llu  p99 %6llu  max %9llu\n", depth, decade_end - 1, count,
+           count > 0 ? (double)decades[i].total_ns / count : 0.0,
+           (unsigned long long)instrument_percentile(&decades[i], 50),
+           (unsigned long long)instrument_percentile(&decades[i], 99), (unsigned long long)decades[i].max_ns);
+    depth = decade_end;
+    decade_end *= 10;
+  }
+  free(decades);
+
+  printf("put-take pairs: %d, Mops/s by threads\n", TOTAL_PAIRS);
+  printf("%-10s", "threads");
+  for (int b = 0; b < NUM_BACKENDS; b++)
+    printf("%12s", backend_names[b]);
+  printf("\n");
+  for (int threads = 1; threads <= MAX_THREADS; threads *= 2) {
+    printf("%-10d", threads);
+    for (int b = 0; b < NUM_BACKENDS; b++)
+      printf("%12.2f", bench_contention((backend_t)b, threads, &failures));
+    printf("\n");
+  }
+
+  printf("bursts: %d elements, Melements/s by burst size\n", TOTAL_PAIRS);
+  for (int burst = 1; burst <= MAX_BURST; burst *= 4)
+    printf("%-10d%12.2f\n", burst, bench_bursts(burst, &failures));
+
+  if (failures != 0) {
+    printf("FAILED: %d checks did not match\n", failures);
+    return 1;
+  }
+  return 0;
+}
@@ -1,6 +1,9 @@
 #include <gtest/gtest.h>
 
 #include "queue.hh"
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
 
 /****** Queue Invariants ******/
 
@@ -393,3 +396,358 @@ TEST(queueTest, Invariant3_Pop)
   free(thread_ret[1]);
   queue_destroy(&q);
 }
+
+// Number of producers and consumers, and how many values each producer puts
+#define NUM_PRODUCERS 2
+#define NUM_CONSUMERS 2
+#define VALUES_PER_PRODUCER 20000
+
+// struct for the producers and consumers running at the same time
+typedef struct thread_arguments_concurrent
+{
+  int id;
+  my_queue_t *queue;
+  int *remaining;
+  long sum;
+  bool inOrder;
+} thread_args_concurrent_t;
+
+// Function for a producer: put id * VALUES_PER_PRODUCER + i for increasing i
+void *thread_run_producer(void *thread_args)
+{
+  thread_args_concurrent_t *arguments = (thread_args_concurrent_t *)thread_args;
+  for (int i = 0; i < VALUES_PER_PRODUCER; i++)
+  {
+    queue_put(arguments->queue, arguments->id * VALUES_PER_PRODUCER + i);
+  }
+  return NULL;
+}
+
+// Function for a consumer: take until every value has been taken by some consumer, checking that each producer's values come out in order
+void *thread_run_consumer(void *thread_args)
+{
+  thread_args_concurrent_t *arguments = (thread_args_concurrent_t *)thread_args;
+  int lastTaken[NUM_PRODUCERS];
+  for (int i = 0; i < NUM_PRODUCERS; i++)
+  {
+    lastTaken[i] = -1;
+  }
+  arguments->sum = 0;
+  arguments->inOrder = true;
+  while (__atomic_load_n(arguments->remaining, __ATOMIC_RELAXED) > 0)
+  {
+    int taken = queue_take(arguments->queue);
+    if (taken == -1)
+    {
+      sched_yield();
+      continue;
+    }
+    __atomic_fetch_sub(arguments->remaining, 1, __ATOMIC_RELAXED);
+    int producer = taken / VALUES_PER_PRODUCER;
+    if (taken <= lastTaken[producer])
+    {
+      arguments->inOrder = false;
+    }
+    lastTaken[producer] = taken;
+    arguments->sum += taken;
+  }
+  return NULL;
+}
+
+// Invariants 1 to 3 with producers and consumers running at the same time, so puts and takes overlap
+TEST(queueTest, ConcurrentPutAndTake)
+{
+  my_queue_t q;
+  queue_init(&q);
+
+  int remaining = NUM_PRODUCERS * VALUES_PER_PRODUCER;
+  pthread_t threads[NUM_PRODUCERS + NUM_CONSUMERS];
+  thread_args_concurrent_t arguments[NUM_PRODUCERS + NUM_CONSUMERS];
+
+  // Launch the consumers first so they start out taking from an empty queue
+  for (int i = 0; i < NUM_PRODUCERS + NUM_CONSUMERS; i++)
+  {
+    int id = (i + NUM_PRODUCERS) % (NUM_PRODUCERS + NUM_CONSUMERS);
+    arguments[id].id = id;
+    arguments[id].queue = &q;
+    arguments[id].remaining = &remaining;
+    int ret = pthread_create(&threads[id], NULL, id < NUM_PRODUCERS ? thread_run_producer : thread_run_consumer, &arguments[id]);
+    if (ret != 0)
+      perror("Error creating thread");
+  }
+  for (int i = 0; i < NUM_PRODUCERS + NUM_CONSUMERS; i++)
+  {
+    int ret = pthread_join(threads[i], NULL);
+    if (ret != 0)
+      perror("Error joining threads");
+  }
+
+  // Every value was taken exactly once and the queue is empty again
+  long n = NUM_PRODUCERS * VALUES_PER_PRODUCER;
+  long sum = 0;
+  for (int i = NUM_PRODUCERS; i < NUM_PRODUCERS + NUM_CONSUMERS; i++)
+  {
+    ASSERT_TRUE(arguments[i].inOrder);
+    sum += arguments[i].sum;
+  }
+  ASSERT_EQ(n * (n - 1) / 2, sum);
+  ASSERT_TRUE(queue_empty(&q));
+  ASSERT_EQ(0, q.size);
+  ASSERT_EQ(-1, queue_take(&q));
+
+  // Clean up
+  queue_destroy(&q);
+}
+
+// -1 is an ordinary element for queue_try_take, and a timed take gives up on an empty queue
+TEST(QueueTest, TryAndTimedTake)
+{
+  my_queue_t q;
+  queue_init(&q);
+
+  // Nothing to take
+  int taken = 42;
+  ASSERT_FALSE(queue_try_take(&q, &taken));
+  ASSERT_EQ(42, taken);
+
+  // A timed take waits out its timeout, then fails
+  struct timespec before, after;
+  clock_gettime(CLOCK_MONOTONIC, &before);
+  ASSERT_FALSE(queue_take_timed(&q, &taken, 50));
+  clock_gettime(CLOCK_MONOTONIC, &after);
+  long waitedMs = (after.tv_sec - before.tv_sec) * 1000 + (after.tv_nsec - before.tv_nsec) / 1000000;
+  ASSERT_GE(waitedMs, 49);
+
+  // -1 goes in and comes out like any other value
+  queue_put(&q, -1);
+  queue_put(&q, 7);
+  ASSERT_TRUE(queue_try_take(&q, &taken));
+  ASSERT_EQ(-1, taken);
+  ASSERT_TRUE(queue_take_timed(&q, &taken, 50));
+  ASSERT_EQ(7, taken);
+  ASSERT_TRUE(queue_empty(&q));
+
+  // Clean up
+  queue_destroy(&q);
+}
+
+// Number of sleeping consumers and what each of them takes
+#define NUM_SLEEPERS 4
+#define VALUES_PER_SLEEPER 5000
+
+// struct for the consumers sleeping in queue_take_wait
+typedef struct thread_arguments_sleeper
+{
+  my_queue_t *queue;
+  long sum;
+  int timedOut;
+} thread_args_sleeper_t;
+
+// Function for a sleeping consumer: take its share with queue_take_wait, half of it with a generous timeout instead
+void *thread_run_sleeper(void *thread_args)
+{
+  thread_args_sleeper_t *arguments = (thread_args_sleeper_t *)thread_args;
+  arguments->sum = 0;
+  arguments->timedOut = 0;
+  for (int i = 0; i < VALUES_PER_SLEEPER; i++)
+  {
+    int taken;
+    if (i % 2 == 0)
+    {
+      taken = queue_take_wait(arguments->queue);
+    }
+    else if (!queue_take_timed(arguments->queue, &taken, 10000))
+    {
+      arguments->timedOut++;
+      continue;
+    }
+    arguments->sum += taken;
+  }
+  return NULL;
+}
+
+// Consumers that start on an empty queue sleep until puts wake them, and every value reaches exactly one of them
+TEST(QueueTest, TakeWaitWakesConsumers)
+{
+  my_queue_t q;
+  queue_init(&q);
+
+  pthread_t threads[NUM_SLEEPERS];
+  thread_args_sleeper_t arguments[NUM_SLEEPERS];
+  for (int i = 0; i < NUM_SLEEPERS; i++)
+  {
+    arguments[i].queue = &q;
+    int ret = pthread_create(&threads[i], NULL, thread_run_sleeper, &arguments[i]);
+    if (ret != 0)
+      perror("Error creating thread");
+  }
+
+  // Give the consumers time to fall asleep, then put their values one at a time
+  usleep(10000);
+  long n = NUM_SLEEPERS * VALUES_PER_SLEEPER;
+  for (int i = 0; i < n; i++)
+  {
+    queue_put(&q, i);
+    if (i % 1000 == 0)
+    {
+      sched_yield();
+    }
+  }
+
+  for (int i = 0; i < NUM_SLEEPERS; i++)
+  {
+    int ret = pthread_join(threads[i], NULL);
+    if (ret != 0)
+      perror("Error joining threads");
+  }
+  long sum = 0;
+  for (int i = 0; i < NUM_SLEEPERS; i++)
+  {
+    ASSERT_EQ(0, arguments[i].timedOut);
+    sum += arguments[i].sum;
+  }
+  ASSERT_EQ(n * (n - 1) / 2, sum);
+  ASSERT_TRUE(queue_empty(&q));
+  ASSERT_EQ(0, q.waiters);
+
+  // Clean up
+  queue_destroy(&q);
+}
+
+// Batches go in and come out in order, and a batch take stops at the end of the queue
+TEST(QueueTest, PutManyTakeMany)
+{
+  my_queue_t q;
+  queue_init(&q);
+
+  int elements[10];
+  for (int i = 0; i < 10; i++)
+  {
+    elements[i] = i;
+  }
+  queue_put_many(&q, elements, 0);
+  ASSERT_TRUE(queue_empty(&q));
+  queue_put_many(&q, elements, 10);
+  queue_put(&q, 10);
+  ASSERT_EQ(11, q.size);
+
+  // Take a batch, then a single element, then whatever is left
+  int taken[16];
+  ASSERT_EQ(4, queue_take_many(&q, taken, 4));
+  for (int i = 0; i < 4; i++)
+  {
+    ASSERT_EQ(i, taken[i]);
+  }
+  ASSERT_EQ(4, queue_take(&q));
+  ASSERT_EQ(6, queue_take_many(&q, taken, 16));
+  for (int i = 0; i < 6; i++)
+  {
+    ASSERT_EQ(i + 5, taken[i]);
+  }
+  ASSERT_EQ(0, queue_take_many(&q, taken, 16));
+  ASSERT_TRUE(queue_empty(&q));
+  ASSERT_EQ(0, q.size);
+
+  // The queue still works after being emptied by a batch
+  queue_put(&q, 11);
+  ASSERT_EQ(1, queue_take_many(&q, taken, 16));
+  ASSERT_EQ(11, taken[0]);
+
+  // Clean up
+  queue_destroy(&q);
+}
+
+// Size of the bursts the producers put and the consumers take
+#define BURST 64
+#define BURSTS_PER_PRODUCER 300
+
+// Function for a bursty producer: put id * BURST * BURSTS_PER_PRODUCER + i for increasing i, BURST values at a time
+void *thread_run_burst_producer(void *thread_args)
+{
+  thread_args_concurrent_t *arguments = (thread_args_concurrent_t *)thread_args;
+  int burst[BURST];
+  for (int b = 0; b < BURSTS_PER_PRODUCER; b++)
+  {
+    for (int i = 0; i < BURST; i++)
+    {
+      burst[i] = (arguments->id * BURSTS_PER_PRODUCER + b) * BURST + i;
+    }
+    queue_put_many(arguments->queue, burst, BURST);
+  }
+  return NULL;
+}
+
+// Function for a batch consumer: take up to BURST values at a time until every value was taken, checking each producer's order
+void *thread_run_burst_consumer(void *thread_args)
+{
+  thread_args_concurrent_t *arguments = (thread_args_concurrent_t *)thread_args;
+  int lastTaken[NUM_PRODUCERS];
+  for (int i = 0; i < NUM_PRODUCERS; i++)
+  {
+    lastTaken[i] = -1;
+  }
+  arguments->sum = 0;
+  arguments->inOrder = true;
+  int batch[BURST];
+  while (__atomic_load_n(arguments->remaining, __ATOMIC_RELAXED) > 0)
+  {
+    int n = queue_take_many(arguments->queue, batch, BURST);
+    if (n == 0)
+    {
+      sched_yield();
+      continue;
+    }
+    __atomic_fetch_sub(arguments->remaining, n, __ATOMIC_RELAXED);
+    for (int i = 0; i < n; i++)
+    {
+      int producer = batch[i] / (BURST * BURSTS_PER_PRODUCER);
+      if (batch[i] <= lastTaken[producer])
+      {
+        arguments->inOrder = false;
+      }
+      lastTaken[producer] = batch[i];
+      arguments->sum += batch[i];
+    }
+  }
+  return NULL;
+}
+
+// Invariants 1 to 3 with producers putting bursts and consumers taking batches at the same time
+TEST(QueueTest, ConcurrentBursts)
+{
+  my_queue_t q;
+  queue_init(&q);
+
+  int remaining = NUM_PRODUCERS * BURSTS_PER_PRODUCER * BURST;
+  pthread_t threads[NUM_PRODUCERS + NUM_CONSUMERS];
+  thread_args_concurrent_t arguments[NUM_PRODUCERS + NUM_CONSUMERS];
+  for (int i = 0; i < NUM_PRODUCERS + NUM_CONSUMERS; i++)
+  {
+    arguments[i].id = i;
+    arguments[i].queue = &q;
+    arguments[i].remaining = &remaining;
+    int ret = pthread_create(&threads[i], NULL, i < NUM_PRODUCERS ? thread_run_burst_producer : thread_run_burst_consumer, &arguments[i]);
+    if (ret != 0)
+      perror("Error creating thread");
+  }
+  for (int i = 0; i < NUM_PRODUCERS + NUM_CONSUMERS; i++)
+  {
+    int ret = pthread_join(threads[i], NULL);
+    if (ret != 0)
+      perror("Error joining threads");
+  }
+
+  long n = NUM_PRODUCERS * BURSTS_PER_PRODUCER * BURST;
+  long sum = 0;
+  for (int i = NUM_PRODUCERS; i < NUM_PRODUCERS + NUM_CONSUMERS; i++)
+  {
+    ASSERT_TRUE(arguments[i].inOrder);
+    sum += arguments[i].sum;
+  }
+  ASSERT_EQ(n * (n - 1) / 2, sum);
+  ASSERT_TRUE(queue_empty(&q));
+  ASSERT_EQ(0, q.size);
+
+  // Clean up
+  queue_destroy(&q);
+}
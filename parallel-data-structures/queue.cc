@@ -1,100 +1,286 @@
 #include "queue.hh"
+#include "nodepool.hh"
 #include <pthread.h>
 #include <stdlib.h>
+#include <time.h>
+
+// Nodes come from the shared node pool
+static_assert(sizeof(node_t) <= NODEPOOL_NODE_SIZE, "nodes must fit the node pool");
+
+// Operations the instrumentation times
+enum
+{
+    QUEUE_OP_PUT,
+    QUEUE_OP_TAKE,
+    QUEUE_OP_EMPTY,
+    QUEUE_OP_TAKE_WAIT,
+    QUEUE_OP_TAKE_TIMED,
+    QUEUE_OP_PUT_MANY,
+    QUEUE_OP_TAKE_MANY,
+    QUEUE_NUM_OPS
+};
+#ifdef INSTRUMENT
+static const char *const queue_op_names[QUEUE_NUM_OPS] = {"put", "take", "empty", "take_wait", "take_timed", "put_many", "take_many"};
+#endif
 
 // Initialize a new queue
 void queue_init(my_queue_t *queue)
 {
-    // Initialize and lock lock and intialize the queue with appropriate information
-    pthread_mutex_init(&queue->lock, NULL);
-    pthread_mutex_lock(&queue->lock);
+    // Initialize the locks and start the list with a dummy node
+    pthread_mutex_init(&queue->head_lock, NULL);
+    pthread_mutex_init(&queue->tail_lock, NULL);
+    // Sleeping takes time out on the monotonic clock, so clock changes don't shorten or stretch their waits
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&queue->not_empty, &attr);
+    pthread_condattr_destroy(&attr);
+    queue->waiters = 0;
+    INSTRUMENT_INIT(&queue->instrument, "queue", queue_op_names, QUEUE_NUM_OPS);
+    node_t *dummy = (node_t *)nodepool_alloc();
+    dummy->next = NULL;
+    queue->head = dummy;
+    queue->tail = dummy;
     queue->size = 0;
-    queue->last = NULL;
-    pthread_mutex_unlock(&queue->lock);
 }
 
 // Destroy a queue
 void queue_destroy(my_queue_t *queue)
 {
-    // Lock the lock and traverse the queue, deleting each value
-    pthread_mutex_lock(&queue->lock);
-    node_t *cur = queue->last;
+    // Lock both ends and traverse the queue, deleting each node including the dummy
+    pthread_mutex_lock(&queue->head_lock);
+    pthread_mutex_lock(&queue->tail_lock);
+    node_t *cur = queue->head;
     while (cur != NULL)
     {
         node_t *next = cur->next;
-        free(cur);
+        nodepool_free(cur);
         cur = next;
     }
+    queue->head = NULL;
+    queue->tail = NULL;
     // unlock
-    pthread_mutex_unlock(&queue->lock);
+    pthread_mutex_unlock(&queue->tail_lock);
+    pthread_mutex_unlock(&queue->head_lock);
+}
+
+// Append a chain of n linked nodes, first to last, and wake up to n sleeping takes
+static void append_chain(my_queue_t *queue, node_t *first, node_t *last, int n)
+{
+    // Lock the tail and link the chain after it. A take may be reading the
+    // tail's next at the same time when the queue is empty, so publish the chain
+    // with an atomic store, ordered before reading the number of waiters.
+    INSTRUMENT_LOCK(&queue->instrument, &queue->tail_lock);
+    __atomic_store_n(&queue->tail->next, first, __ATOMIC_SEQ_CST);
+    queue->tail = last;
+    INSTRUMENT_UNLOCK(&queue->instrument, &queue->tail_lock);
+    __atomic_fetch_add(&queue->size, n, __ATOMIC_RELAXED);
+
+    // Wake a sleeping take per element. A take that has not counted itself yet will see the chain when it checks again.
+    if (__atomic_load_n(&queue->waiters, __ATOMIC_SEQ_CST) > 0)
+    {
+        INSTRUMENT_LOCK(&queue->instrument, &queue->head_lock);
+        // waiters only changes with the head lock held
+        for (int i = 0; i < n && i < queue->waiters; i++)
+        {
+            pthread_cond_signal(&queue->not_empty);
+        }
+        INSTRUMENT_UNLOCK(&queue->instrument, &queue->head_lock);
+    }
 }
 
 // Put an element at the end of a queue
 void queue_put(my_queue_t *queue, int element)
 {
+    INSTRUMENT_START(start);
     // Allocate space for a node, assign appropriate values
-    node_t *newNode = (node_t *)malloc(sizeof(node_t));
+    node_t *newNode = (node_t *)nodepool_alloc();
     newNode->data = element;
     newNode->next = NULL;
+    append_chain(queue, newNode, newNode, 1);
+    INSTRUMENT_OP(&queue->instrument, QUEUE_OP_PUT, start);
+}
 
-    // Lock the lock and traverse to the end of list and append new node
-    pthread_mutex_lock(&queue->lock);
-    node_t *cur = queue->last;
-
-    if (cur == NULL)
+// Put n elements at the end of a queue, in order, under a single lock acquisition
+void queue_put_many(my_queue_t *queue, const int *elements, int n)
+{
+    if (n <= 0)
     {
-        queue->last = newNode;
+        return;
     }
-    else
+    INSTRUMENT_START(start);
+    // Build the chain before taking any lock
+    node_t *first = (node_t *)nodepool_alloc();
+    first->data = elements[0];
+    node_t *last = first;
+    for (int i = 1; i < n; i++)
     {
-        node_t *trailCur = queue->last;
-        while (cur != NULL)
-        {
-            trailCur = cur;
-            cur = cur->next;
-        }
-        trailCur->next = newNode;
+        node_t *newNode = (node_t *)nodepool_alloc();
+        newNode->data = elements[i];
+        last->next = newNode;
+        last = newNode;
     }
-    // Increment size and unlock the lock
-    queue->size++;
-    pthread_mutex_unlock(&queue->lock);
+    last->next = NULL;
+    append_chain(queue, first, last, n);
+    INSTRUMENT_OP(&queue->instrument, QUEUE_OP_PUT_MANY, start);
 }
 
 // Check if a queue is empty
 bool queue_empty(my_queue_t *queue)
 {
-    // Lock the lock and check if the queue is of size 0 or not
-    pthread_mutex_lock(&queue->lock);
-    bool ret = false;
-    if (queue->size == 0)
-    {
-        ret = true;
-    }
+    INSTRUMENT_START(start);
+    // Lock the head and check if the dummy node has a successor
+    INSTRUMENT_LOCK(&queue->instrument, &queue->head_lock);
+    bool ret = __atomic_load_n(&queue->head->next, __ATOMIC_ACQUIRE) == NULL;
     // Unlock and return
-    pthread_mutex_unlock(&queue->lock);
+    INSTRUMENT_UNLOCK(&queue->instrument, &queue->head_lock);
+    INSTRUMENT_OP(&queue->instrument, QUEUE_OP_EMPTY, start);
     return ret;
 }
 
+// Unlink the first element with the head lock held. Returns the old dummy node for the caller to free after unlocking, or NULL if the queue is empty.
+static node_t *unlink_first(my_queue_t *queue, int *element)
+{
+    node_t *dummy = queue->head;
+    node_t *first = __atomic_load_n(&dummy->next, __ATOMIC_SEQ_CST);
+    if (first == NULL)
+    {
+        return NULL;
+    }
+    // The first element's node becomes the new dummy
+    *element = first->data;
+    queue->head = first;
+    return dummy;
+}
+
+// Free a dummy node returned by unlink_first once the head lock is released. No put can reach it anymore since the tail has moved past it.
+static void release_first(my_queue_t *queue, node_t *dummy)
+{
+    __atomic_fetch_sub(&queue->size, 1, __ATOMIC_RELAXED);
+    nodepool_free(dummy);
+}
+
 // Take an element off the front of a queue
+bool queue_try_take(my_queue_t *queue, int *element)
+{
+    INSTRUMENT_START(start);
+    INSTRUMENT_LOCK(&queue->instrument, &queue->head_lock);
+    node_t *dummy = unlink_first(queue, element);
+    INSTRUMENT_UNLOCK(&queue->instrument, &queue->head_lock);
+    if (dummy != NULL)
+    {
+        release_first(queue, dummy);
+    }
+    INSTRUMENT_OP(&queue->instrument, QUEUE_OP_TAKE, start);
+    return dummy != NULL;
+}
+
+// Take an element off the front of a queue, -1 if it is empty
 int queue_take(my_queue_t *queue)
 {
     int ret;
-    // Lock the lock, if the size is 0 return -1, an error
-    pthread_mutex_lock(&queue->lock);
-    if (queue->size == 0)
+    if (!queue_try_take(queue, &ret))
     {
         ret = -1;
     }
-    else
+    return ret;
+}
+
+// Take up to max elements off the front of a queue into elements, in order, under a single lock acquisition
+int queue_take_many(my_queue_t *queue, int *elements, int max)
+{
+    INSTRUMENT_START(start);
+    // Walk up to max nodes past the dummy; the last one taken becomes the new dummy
+    INSTRUMENT_LOCK(&queue->instrument, &queue->head_lock);
+    node_t *dummy = queue->head;
+    node_t *cur = dummy;
+    int taken = 0;
+    while (taken < max)
     {
-        // Take the last element and assign the new last. Free the element and decrement the size
-        node_t *newLast = queue->last->next;
-        ret = queue->last->data;
-        free(queue->last);
-        queue->last = newLast;
-        queue->size--;
+        node_t *next = __atomic_load_n(&cur->next, __ATOMIC_SEQ_CST);
+        if (next == NULL)
+        {
+            break;
+        }
+        elements[taken++] = next->data;
+        cur = next;
     }
-    // Unlock and return
-    pthread_mutex_unlock(&queue->lock);
+    queue->head = cur;
+    INSTRUMENT_UNLOCK(&queue->instrument, &queue->head_lock);
+
+    // Free the old dummy and every node before the new one outside the lock
+    if (taken > 0)
+    {
+        __atomic_fetch_sub(&queue->size, taken, __ATOMIC_RELAXED);
+        while (dummy != cur)
+        {
+            node_t *next = dummy->next;
+            nodepool_free(dummy);
+            dummy = next;
+        }
+    }
+    INSTRUMENT_OP(&queue->instrument, QUEUE_OP_TAKE_MANY, start);
+    return taken;
+}
+
+// Take an element off the front of a queue, sleeping until there is one or the deadline passes (no deadline if NULL)
+static bool take_sleeping(my_queue_t *queue, int *element, const struct timespec *deadline)
+{
+    INSTRUMENT_LOCK(&queue->instrument, &queue->head_lock);
+    node_t *dummy;
+    while ((dummy = unlink_first(queue, element)) == NULL)
+    {
+        // Count ourselves before checking again, so a put either sees us or we see its node
+        __atomic_fetch_add(&queue->waiters, 1, __ATOMIC_SEQ_CST);
+        dummy = unlink_first(queue, element);
+        if (dummy == NULL)
+        {
+            int err = deadline == NULL ? pthread_cond_wait(&queue->not_empty, &queue->head_lock)
+                                       : pthread_cond_timedwait(&queue->not_empty, &queue->head_lock, deadline);
+            __atomic_fetch_sub(&queue->waiters, 1, __ATOMIC_RELAXED);
+            if (err != 0)
+            {
+                // Timed out; take what a put may have left after all
+                dummy = unlink_first(queue, element);
+                break;
+            }
+            continue;
+        }
+        __atomic_fetch_sub(&queue->waiters, 1, __ATOMIC_RELAXED);
+        break;
+    }
+    INSTRUMENT_UNLOCK(&queue->instrument, &queue->head_lock);
+    if (dummy != NULL)
+    {
+        release_first(queue, dummy);
+    }
+    return dummy != NULL;
+}
+
+// Take an element off the front of a queue, waiting for one if it is empty
+int queue_take_wait(my_queue_t *queue)
+{
+    INSTRUMENT_START(start);
+    int ret;
+    take_sleeping(queue, &ret, NULL);
+    INSTRUMENT_OP(&queue->instrument, QUEUE_OP_TAKE_WAIT, start);
+    return ret;
+}
+
+// Take an element off the front of a queue, waiting up to timeout_ms for one if it is empty
+bool queue_take_timed(my_queue_t *queue, int *element, long timeout_ms)
+{
+    INSTRUMENT_START(start);
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    bool ret = take_sleeping(queue, element, &deadline);
+    INSTRUMENT_OP(&queue->instrument, QUEUE_OP_TAKE_TIMED, start);
     return ret;
 }
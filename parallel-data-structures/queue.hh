@@ -4,15 +4,25 @@
 #include <stdbool.h>
 #include <pthread.h>
 
+#include "instrument.hh"
+
 typedef struct node {
   int data;
   struct node* next;
 } node_t;
 
+// Two-lock queue. The list always starts with a dummy node whose successor is
+// the first element, so puts only touch the tail and its lock and takes only
+// the head and its lock, and a put and a take never wait for each other.
 typedef struct my_queue {
-  int size;
-  node_t* last;
-  pthread_mutex_t lock;
+  node_t* head;  // dummy node, taken from after here
+  pthread_mutex_t head_lock;
+  pthread_cond_t not_empty;  // waited on with head_lock held
+  int waiters;               // takes sleeping on not_empty
+  node_t* tail __attribute__((aligned(64)));  // put after here
+  pthread_mutex_t tail_lock;
+  int size __attribute__((aligned(64)));  // updated after the list, so only exact when idle
+  INSTRUMENT_FIELD(instrument)
 } my_queue_t;
 
 // Initialize a queue
@@ -24,10 +34,32 @@ void queue_destroy(my_queue_t* queue);
 // Put an element at the end of a queue
 void queue_put(my_queue_t* queue, int element);
 
+// Put n elements at the end of a queue, in order and with nothing put by
+// other threads in between. The whole chain is linked in with one lock
+// acquisition.
+void queue_put_many(my_queue_t* queue, const int* elements, int n);
+
 // Chekc if a queue is empty
 bool queue_empty(my_queue_t* queue);
 
-// Take an element off the front of a queue
+// Take an element off the front of a queue, or -1 if it is empty. Cannot
+// tell a -1 element from an empty queue; see queue_try_take.
 int queue_take(my_queue_t* queue);
 
+// Take an element off the front of a queue into *element, or return false if
+// it is empty
+bool queue_try_take(my_queue_t* queue, int* element);
+
+// Take up to max elements off the front of a queue into elements, in order,
+// with one lock acquisition. Returns how many were taken, 0 if it was empty.
+int queue_take_many(my_queue_t* queue, int* elements, int max);
+
+// Take an element off the front of a queue, sleeping while it is empty. Every
+// put wakes at most one sleeping take.
+int queue_take_wait(my_queue_t* queue);
+
+// Take an element off the front of a queue into *element, sleeping while it
+// is empty for up to timeout_ms milliseconds. Returns false if it timed out.
+bool queue_take_timed(my_queue_t* queue, int* element, long timeout_ms);
+
 #endif
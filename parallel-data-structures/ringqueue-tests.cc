@@ -0,0 +1,227 @@
+#include <gtest/gtest.h>
+
+#include "ringqueue.hh"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+/****** Queue Invariants ******/
+
+// Invariant 1
+// For every value V that has been put onto the queue p times and returned by take q times, there must be p-q copies of this value on the queue. This only holds if p >= q.
+
+// Invariant 2
+// No value should ever be returned by taken if it was not first passed to put by some thread.
+
+// Invariant 3
+// If a thread puts value A and then puts value B, and no other thread puts these specific values, A must not be taken from the queue before taking B.
+
+// Invariant 4
+// The queue never holds more elements than its capacity.
+
+/****** Begin Tests ******/
+
+// Basic queue functionality, including a full queue
+TEST(RingQueueTest, BasicQueueOps) {
+  my_ringqueue_t q;
+  ringqueue_init(&q, 5);
+  ASSERT_EQ(8u, ringqueue_capacity(&q));
+
+  // Make sure the queue is empty and try_take fails
+  int element = 42;
+  ASSERT_TRUE(ringqueue_empty(&q));
+  ASSERT_FALSE(ringqueue_try_take(&q, &element));
+  ASSERT_EQ(42, element);
+
+  // Fill the queue; one more does not fit
+  for (int i = 0; i < 8; i++)
+    ASSERT_TRUE(ringqueue_try_put(&q, i));
+  ASSERT_FALSE(ringqueue_try_put(&q, 8));
+  ASSERT_FALSE(ringqueue_empty(&q));
+
+  // -1 is an ordinary element
+  ASSERT_TRUE(ringqueue_try_take(&q, &element));
+  ASSERT_EQ(0, element);
+  ASSERT_TRUE(ringqueue_try_put(&q, -1));
+
+  // Take the values from the queue and check them
+  for (int i = 1; i < 8; i++)
+    ASSERT_EQ(i, ringqueue_take(&q));
+  ASSERT_EQ(-1, ringqueue_take(&q));
+  ASSERT_TRUE(ringqueue_empty(&q));
+
+  // clean up
+  ringqueue_destroy(&q);
+}
+
+// Slots are reused lap after lap
+TEST(RingQueueTest, Wraparound) {
+  my_ringqueue_t q;
+  ringqueue_init(&q, 4);
+  int next_put = 0, next_take = 0;
+  for (int round = 0; round < 1000; round++) {
+    // leave a different number of elements behind every round
+    for (int i = 0; i < round % 4 + 1; i++) {
+      if (ringqueue_try_put(&q, next_put))
+        next_put++;
+    }
+    for (int i = 0; i < round % 3 + 1; i++) {
+      int element;
+      if (ringqueue_try_take(&q, &element)) {
+        ASSERT_EQ(next_take, element);
+        next_take++;
+      }
+    }
+    ASSERT_LE(next_put - next_take, 4);
+  }
+  ringqueue_destroy(&q);
+}
+
+#define NUM_THREADS 6
+#define FILL_CAPACITY 1024
+#define FILL_ROUNDS 20
+
+typedef struct ring_thread_args {
+  int id;
+  my_ringqueue_t *queue;
+  int *taken;  // how often each value was taken, shared by all threads
+  int count;   // elements this thread put or took
+  bool in_order;
+} ring_thread_args_t;
+
+/**
+ * @brief  Put id * FILL_CAPACITY + i for increasing i until try_put finds the queue full
+ * @note
+ * @param  *arg: ring_thread_args_t
+ * @retval None
+ */
+void *ring_filler(void *arg) {
+  ring_thread_args_t *args = (ring_thread_args_t *)arg;
+  args->count = 0;
+  while (ringqueue_try_put(args->queue, args->id * FILL_CAPACITY + args->count))
+    args->count++;
+  return NULL;
+}
+
+/**
+ * @brief  Take until try_take finds the queue empty, checking each filler's order
+ * @note
+ * @param  *arg: ring_thread_args_t
+ * @retval None
+ */
+void *ring_drainer(void *arg) {
+  ring_thread_args_t *args = (ring_thread_args_t *)arg;
+  int last[NUM_THREADS];
+  for (int i = 0; i < NUM_THREADS; i++)
+    last[i] = -1;
+  args->count = 0;
+  args->in_order = true;
+  int taken;
+  while (ringqueue_try_take(args->queue, &taken)) {
+    args->count++;
+    int filler = taken / FILL_CAPACITY;
+    if (taken <= last[filler])
+      args->in_order = false;
+    last[filler] = taken;
+    __atomic_add_fetch(&args->taken[taken], 1, __ATOMIC_RELAXED);
+  }
+  return NULL;
+}
+
+/**
+ * @brief  Run one thread per args entry and wait for all of them
+ * @note
+ * @param  *run: thread function
+ * @param  *args: NUM_THREADS arguments
+ * @retval None
+ */
+static void run_threads(void *(*run)(void *), ring_thread_args_t *args) {
+  pthread_t threads[NUM_THREADS];
+  for (int i = 0; i < NUM_THREADS; i++) {
+    if (pthread_create(&threads[i], NULL, run, &args[i]) != 0)
+      perror("Error creating thread");
+  }
+  for (int i = 0; i < NUM_THREADS; i++) {
+    if (pthread_join(threads[i], NULL) != 0)
+      perror("Error joining thread");
+  }
+}
+
+// Invariants 1 to 4 with threads racing to fill the queue with try_put
+// until it is full, then to drain it with try_take until it is empty
+TEST(RingQueueTest, ConcurrentFillAndDrain) {
+  my_ringqueue_t q;
+  ringqueue_init(&q, FILL_CAPACITY);
+  int taken[NUM_THREADS * FILL_CAPACITY];
+  ring_thread_args_t args[NUM_THREADS];
+  for (int i = 0; i < NUM_THREADS; i++) {
+    args[i].id = i;
+    args[i].queue = &q;
+    args[i].taken = taken;
+  }
+
+  for (int round = 0; round < FILL_ROUNDS; round++) {
+    // try_put fails exactly when the capacity is used up
+    run_threads(ring_filler, args);
+    int put = 0, filled[NUM_THREADS];
+    for (int i = 0; i < NUM_THREADS; i++) {
+      filled[i] = args[i].count;
+      put += filled[i];
+    }
+    ASSERT_EQ(FILL_CAPACITY, put);
+
+    // try_take fails exactly when every element was taken, each one once
+    memset(taken, 0, sizeof(taken));
+    run_threads(ring_drainer, args);
+    int drained = 0;
+    for (int i = 0; i < NUM_THREADS; i++) {
+      ASSERT_TRUE(args[i].in_order);
+      drained += args[i].count;
+    }
+    ASSERT_EQ(FILL_CAPACITY, drained);
+    for (int i = 0; i < NUM_THREADS * FILL_CAPACITY; i++)
+      ASSERT_EQ(i % FILL_CAPACITY < filled[i / FILL_CAPACITY] ? 1 : 0, taken[i]);
+    ASSERT_TRUE(ringqueue_empty(&q));
+  }
+
+  // clean up
+  ringqueue_destroy(&q);
+}
+
+#define HANDOFF_VALUES 100000
+
+/**
+ * @brief  Put 0 to HANDOFF_VALUES - 1, waiting while the queue is full
+ * @note
+ * @param  *arg: queue to put into
+ * @retval None
+ */
+void *ring_handoff_producer(void *arg) {
+  my_ringqueue_t *queue = (my_ringqueue_t *)arg;
+  for (int i = 0; i < HANDOFF_VALUES; i++)
+    ringqueue_put(queue, i);
+  return NULL;
+}
+
+// A producer and a consumer hand elements over through the smallest queue,
+// so both keep going to sleep on it; a lost wakeup hangs the test
+TEST(RingQueueTest, BlockingHandoff) {
+  my_ringqueue_t q;
+  ringqueue_init(&q, 2);
+
+  pthread_t producer;
+  if (pthread_create(&producer, NULL, ring_handoff_producer, &q) != 0)
+    perror("Error creating thread");
+  int wrong = 0;
+  for (int i = 0; i < HANDOFF_VALUES; i++) {
+    if (ringqueue_take(&q) != i)
+      wrong++;
+  }
+  if (pthread_join(producer, NULL) != 0)
+    perror("Error joining thread");
+  ASSERT_EQ(0, wrong);
+  ASSERT_TRUE(ringqueue_empty(&q));
+
+  // clean up
+  ringqueue_destroy(&q);
+}
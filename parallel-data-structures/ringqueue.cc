@@ -0,0 +1,252 @@
+#include "ringqueue.hh"
+
+#include <linux/futex.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Operations the instrumentation times
+enum { RINGQUEUE_OP_PUT, RINGQUEUE_OP_TAKE, RINGQUEUE_OP_TRY_PUT, RINGQUEUE_OP_TRY_TAKE, RINGQUEUE_NUM_OPS };
+#ifdef INSTRUMENT
+static const char *const ringqueue_op_names[RINGQUEUE_NUM_OPS] = {"put", "take", "try_put", "try_take"};
+#endif
+
+/**
+ * @brief  Tell threads waiting on an event that it may have happened
+ * @note   Without waiters this is a fence and a load, so puts and takes
+ *         that nobody waits for never write the shared event line. The fence
+ *         pairs with the fence in event_prepare: either this sees the
+ *         waiter, or the waiter's re-check after announcing itself sees what
+ *         was published before the signal.
+ * @param  *event: event that happened
+ * @retval None
+ */
+static void event_signal(ringqueue_event_t *event) {
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&event->waiters, __ATOMIC_RELAXED) > 0) {
+    __atomic_fetch_add(&event->seq, 1, __ATOMIC_SEQ_CST);
+    syscall(SYS_futex, &event->seq, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+  }
+}
+
+/**
+ * @brief  Announce a thread about to wait on an event
+ * @note   The fence after the increment pairs with the one in event_signal,
+ *         so the caller's re-check, even with acquire loads, sees what was
+ *         published before a signal that missed the increment
+ * @param  *event: event to wait for
+ * @retval the counter to pass to event_wait, read after announcing
+ */
+static int event_prepare(ringqueue_event_t *event) {
+  __atomic_fetch_add(&event->waiters, 1, __ATOMIC_SEQ_CST);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  return __atomic_load_n(&event->seq, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * @brief  Sleep until an event is signaled after event_prepare, then stop waiting
+ * @note   Returns at once if it was already signaled
+ * @param  *event: event to wait for
+ * @param  seq: value returned by event_prepare
+ * @retval None
+ */
+static void event_wait(ringqueue_event_t *event, int seq) {
+  syscall(SYS_futex, &event->seq, FUTEX_WAIT_PRIVATE, seq, NULL, NULL, 0);
+  __atomic_fetch_sub(&event->waiters, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief  Stop waiting on an event without sleeping
+ * @note
+ * @param  *event: event prepared for
+ * @retval None
+ */
+static void event_cancel(ringqueue_event_t *event) {
+  __atomic_fetch_sub(&event->waiters, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief  Initialize a queue
+ * @note
+ * @param  *queue: queue to initialize
+ * @param  capacity: least number of elements it must hold
+ * @retval None
+ */
+void ringqueue_init(my_ringqueue_t *queue, size_t capacity) {
+  size_t size = 2;
+  while (size < capacity)
+    size *= 2;
+  queue->slots = (ringqueue_slot_t *)malloc(size * sizeof(ringqueue_slot_t));
+  for (size_t i = 0; i < size; i++)
+    queue->slots[i].seq = i;
+  queue->mask = size - 1;
+  queue->put_pos = 0;
+  queue->take_pos = 0;
+  queue->not_empty.seq = 0;
+  queue->not_empty.waiters = 0;
+  queue->not_full.seq = 0;
+  queue->not_full.waiters = 0;
+  INSTRUMENT_INIT(&queue->instrument, "ringqueue", ringqueue_op_names, RINGQUEUE_NUM_OPS);
+}
+
+/**
+ * @brief  Destroy a queue
+ * @note
+ * @param  *queue: queue to destroy
+ * @retval None
+ */
+void ringqueue_destroy(my_ringqueue_t *queue) {
+  free(queue->slots);
+  queue->slots = NULL;
+}
+
+/**
+ * @brief  Get the capacity of a queue
+ * @note
+ * @param  *queue: queue to check
+ * @retval number of elements it can hold
+ */
+size_t ringqueue_capacity(my_ringqueue_t *queue) {
+  return queue->mask + 1;
+}
+
+/**
+ * @brief  Put an element into a queue unless it is full
+ * @note   Waiting takers are woken afterwards
+ * @param  *queue: queue to put into
+ * @param  element: element to put
+ * @retval whether the element was put
+ */
+static bool try_put(my_ringqueue_t *queue, int element) {
+  unsigned long pos = __atomic_load_n(&queue->put_pos, __ATOMIC_RELAXED);
+  ringqueue_slot_t *slot;
+  while (true) {
+    slot = &queue->slots[pos & queue->mask];
+    long diff = (long)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+    if (diff == 0) {
+      // the slot was emptied on the previous lap; claim it
+      if (__atomic_compare_exchange_n(&queue->put_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        break;
+    } else if (diff < 0) {
+      // the slot still holds the element put a lap ago
+      return false;
+    } else {
+      pos = __atomic_load_n(&queue->put_pos, __ATOMIC_RELAXED);
+    }
+  }
+  slot->data = element;
+  __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+  event_signal(&queue->not_empty);
+  return true;
+}
+
+/**
+ * @brief  Take an element out of a queue unless it is empty
+ * @note   Waiting putters are woken afterwards
+ * @param  *queue: queue to take from
+ * @param  *element: set to the element taken
+ * @retval whether an element was taken
+ */
+static bool try_take(my_ringqueue_t *queue, int *element) {
+  unsigned long pos = __atomic_load_n(&queue->take_pos, __ATOMIC_RELAXED);
+  ringqueue_slot_t *slot;
+  while (true) {
+    slot = &queue->slots[pos & queue->mask];
+    long diff = (long)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - (pos + 1));
+    if (diff == 0) {
+      // the slot was filled on this lap; claim it
+      if (__atomic_compare_exchange_n(&queue->take_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        break;
+    } else if (diff < 0) {
+      // nothing was put into the slot on this lap yet
+      return false;
+    } else {
+      pos = __atomic_load_n(&queue->take_pos, __ATOMIC_RELAXED);
+    }
+  }
+  *element = slot->data;
+  __atomic_store_n(&slot->seq, pos + queue->mask + 1, __ATOMIC_RELEASE);
+  event_signal(&queue->not_full);
+  return true;
+}
+
+/**
+ * @brief  Put an element into a queue unless it is full
+ * @note
+ * @param  *queue: queue to put into
+ * @param  element: element to put
+ * @retval whether the element was put
+ */
+bool ringqueue_try_put(my_ringqueue_t *queue, int element) {
+  INSTRUMENT_START(start);
+  bool ret = try_put(queue, element);
+  INSTRUMENT_OP(&queue->instrument, RINGQUEUE_OP_TRY_PUT, start);
+  return ret;
+}
+
+/**
+ * @brief  Take an element out of a queue unless it is empty
+ * @note
+ * @param  *queue: queue to take from
+ * @param  *element: set to the element taken
+ * @retval whether an element was taken
+ */
+bool ringqueue_try_take(my_ringqueue_t *queue, int *element) {
+  INSTRUMENT_START(start);
+  bool ret = try_take(queue, element);
+  INSTRUMENT_OP(&queue->instrument, RINGQUEUE_OP_TRY_TAKE, start);
+  return ret;
+}
+
+/**
+ * @brief  Put an element into a queue, waiting while it is full
+ * @note
+ * @param  *queue: queue to put into
+ * @param  element: element to put
+ * @retval None
+ */
+void ringqueue_put(my_ringqueue_t *queue, int element) {
+  INSTRUMENT_START(start);
+  while (!try_put(queue, element)) {
+    int seq = event_prepare(&queue->not_full);
+    if (try_put(queue, element)) {
+      event_cancel(&queue->not_full);
+      break;
+    }
+    event_wait(&queue->not_full, seq);
+  }
+  INSTRUMENT_OP(&queue->instrument, RINGQUEUE_OP_PUT, start);
+}
+
+/**
+ * @brief  Take an element out of a queue, waiting while it is empty
+ * @note
+ * @param  *queue: queue to take from
+ * @retval the element
+ */
+int ringqueue_take(my_ringqueue_t *queue) {
+  INSTRUMENT_START(start);
+  int element;
+  while (!try_take(queue, &element)) {
+    int seq = event_prepare(&queue->not_empty);
+    if (try_take(queue, &element)) {
+      event_cancel(&queue->not_empty);
+      break;
+    }
+    event_wait(&queue->not_empty, seq);
+  }
+  INSTRUMENT_OP(&queue->instrument, RINGQUEUE_OP_TAKE, start);
+  return element;
+}
+
+/**
+ * @brief  Check if a queue is empty
+ * @note
+ * @param  *queue: queue to check
+ * @retval whether the next slot to take from was not filled yet
+ */
+bool ringqueue_empty(my_ringqueue_t *queue) {
+  unsigned long pos = __atomic_load_n(&queue->take_pos, __ATOMIC_RELAXED);
+  ringqueue_slot_t *slot = &queue->slots[pos & queue->mask];
+  return (long)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - (pos + 1)) < 0;
+}
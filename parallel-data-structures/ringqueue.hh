@@ -0,0 +1,68 @@
+#ifndef RINGQUEUE_H
+#define RINGQUEUE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "instrument.hh"
+
+// Bounded queue on a preallocated ring of slots (Vyukov's bounded MPMC
+// queue). Puts and takes claim a position with compare-and-swap, and every
+// slot carries a sequence number that says whether it holds an element for
+// the current lap, so nothing is allocated after initialization. A thread
+// stalled between claiming a slot and filling or emptying it holds up only
+// the operations that reach that slot a lap later.
+//
+// try_put and try_take fail instead of waiting. put and take wait on a futex
+// while the queue is full or empty, so a slow consumer pushes back on its
+// producers instead of letting the queue grow.
+
+// Threads waiting for one side of the queue, and a counter bumped whenever
+// that side may have changed, which they sleep on
+typedef struct ringqueue_event {
+  int seq;
+  int waiters;
+} __attribute__((aligned(64))) ringqueue_event_t;
+
+typedef struct ringqueue_slot {
+  unsigned long seq;  // position + 1 once filled, position + capacity once emptied
+  int data;
+} ringqueue_slot_t;
+
+typedef struct my_ringqueue {
+  ringqueue_slot_t* slots;
+  unsigned long mask;  // capacity - 1
+  unsigned long put_pos __attribute__((aligned(64)));
+  unsigned long take_pos __attribute__((aligned(64)));
+  ringqueue_event_t not_empty;
+  ringqueue_event_t not_full;
+  INSTRUMENT_FIELD(instrument)
+} my_ringqueue_t;
+
+// Initialize a queue holding at least capacity elements. The capacity is
+// rounded up to a power of two, and at least 2.
+void ringqueue_init(my_ringqueue_t* queue, size_t capacity);
+
+// Destroy a queue. No other operation may be running.
+void ringqueue_destroy(my_ringqueue_t* queue);
+
+// Number of elements a queue can hold
+size_t ringqueue_capacity(my_ringqueue_t* queue);
+
+// Put an element at the end of a queue, or return false if it is full
+bool ringqueue_try_put(my_ringqueue_t* queue, int element);
+
+// Take an element off the front of a queue into *element, or return false if
+// it is empty
+bool ringqueue_try_take(my_ringqueue_t* queue, int* element);
+
+// Put an element at the end of a queue, waiting while it is full
+void ringqueue_put(my_ringqueue_t* queue, int element);
+
+// Take an element off the front of a queue, waiting while it is empty
+int ringqueue_take(my_ringqueue_t* queue);
+
+// Check if a queue is empty
+bool ringqueue_empty(my_ringqueue_t* queue);
+
+#endif
@@ -0,0 +1,154 @@
+#include <gtest/gtest.h>
+
+#include "rwlock.hh"
+#include <pthread.h>
+#include <stdio.h>
+
+/****** Reader-Writer Lock Invariants ******/
+
+// Invariant 1
+// A writer never holds the lock at the same time as any other writer or reader.
+
+// Invariant 2
+// With writer preference, a writer gets the lock even while readers keep
+// arriving, and readers blocked by a writer get in before the next writer.
+
+/****** Begin Tests ******/
+
+#define NUM_READERS 4
+#define NUM_WRITERS 2
+#define WRITES_PER_WRITER 2000
+
+typedef struct lock_test {
+  rwlock_t lock;
+  // writers keep these equal; a reader that sees them differ overlapped a writer
+  int a;
+  int b;
+  bool done;
+  int max_reads;  // reads per reader, or 0 to read until the writers are done
+  int torn_reads;
+  int reads;
+} lock_test_t;
+
+/**
+ * @brief  Read both fields under the read lock until the writers are done, or
+ * for a fixed number of reads
+ * @note
+ * @param  *arg: shared test state
+ * @retval None
+ */
+void *reader_run(void *arg) {
+  lock_test_t *t = (lock_test_t *)arg;
+  int reads = 0;
+  while (!__atomic_load_n(&t->done, __ATOMIC_SEQ_CST) && (t->max_reads == 0 || reads++ < t->max_reads)) {
+    rwlock_acquire_readlock(&t->lock);
+    int a = t->a;
+    sched_yield();
+    int b = t->b;
+    rwlock_release_readlock(&t->lock);
+    if (a != b)
+      __atomic_add_fetch(&t->torn_reads, 1, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&t->reads, 1, __ATOMIC_SEQ_CST);
+  }
+  return NULL;
+}
+
+/**
+ * @brief  Increment both fields under the write lock
+ * @note
+ * @param  *arg: shared test state
+ * @retval None
+ */
+void *writer_run(void *arg) {
+  lock_test_t *t = (lock_test_t *)arg;
+  for (int i = 0; i < WRITES_PER_WRITER; i++) {
+    rwlock_acquire_writelock(&t->lock);
+    t->a++;
+    sched_yield();
+    t->b++;
+    rwlock_release_writelock(&t->lock);
+  }
+  return NULL;
+}
+
+/**
+ * @brief  Run readers and writers against each other and check what they saw
+ * @note   With max_reads of 0 the readers never stop on their own, so the test
+ *         hangs rather than fails if writers starve
+ * @param  preference: preference to test
+ * @param  max_reads: reads per reader, or 0 to read until the writers are done
+ * @retval None
+ */
+void run_lock_test(rwlock_preference_t preference, int max_reads) {
+  lock_test_t t;
+  rwlock_init(&t.lock, preference);
+  t.a = 0;
+  t.b = 0;
+  t.done = false;
+  t.max_reads = max_reads;
+  t.torn_reads = 0;
+  t.reads = 0;
+
+  pthread_t readers[NUM_READERS];
+  pthread_t writers[NUM_WRITERS];
+  for (int i = 0; i < NUM_READERS; i++) {
+    if (pthread_create(&readers[i], NULL, reader_run, &t) != 0)
+      perror("Error creating thread");
+  }
+  for (int i = 0; i < NUM_WRITERS; i++) {
+    if (pthread_create(&writers[i], NULL, writer_run, &t) != 0)
+      perror("Error creating thread");
+  }
+
+  // the writers finish while the readers are still going
+  for (int i = 0; i < NUM_WRITERS; i++) {
+    if (pthread_join(writers[i], NULL) != 0)
+      perror("Error joining thread");
+  }
+  __atomic_store_n(&t.done, true, __ATOMIC_SEQ_CST);
+  for (int i = 0; i < NUM_READERS; i++) {
+    if (pthread_join(readers[i], NULL) != 0)
+      perror("Error joining thread");
+  }
+
+  ASSERT_EQ(NUM_WRITERS * WRITES_PER_WRITER, t.a);
+  ASSERT_EQ(t.a, t.b);
+  ASSERT_EQ(0, t.torn_reads);
+  ASSERT_GT(t.reads, 0);
+
+  rwlock_destroy(&t.lock);
+}
+
+// Invariants 1 and 2 with writer preference
+TEST(RWLockTest, PreferWriters) {
+  run_lock_test(RWLOCK_PREFER_WRITERS, 0);
+}
+
+// Invariant 1 with reader preference. Readers that never stop could starve
+// the writers here, so they stop after a while.
+TEST(RWLockTest, PreferReaders) {
+  run_lock_test(RWLOCK_PREFER_READERS, 1000);
+}
+
+// A thread can hold read locks on two locks at once
+TEST(RWLockTest, NestedReadLocks) {
+  rwlock_t l1, l2;
+  rwlock_init(&l1, RWLOCK_PREFER_WRITERS);
+  rwlock_init(&l2, RWLOCK_PREFER_READERS);
+
+  rwlock_acquire_readlock(&l1);
+  rwlock_acquire_readlock(&l2);
+  rwlock_acquire_readlock(&l1);
+  rwlock_release_readlock(&l1);
+  rwlock_release_readlock(&l2);
+  rwlock_release_readlock(&l1);
+
+  // no readers are left, so the write locks are free
+  rwlock_acquire_writelock(&l1);
+  rwlock_acquire_writelock(&l2);
+  rwlock_release_writelock(&l2);
+  rwlock_release_writelock(&l1);
+
+  rwlock_destroy(&l1);
+  rwlock_destroy(&l2);
+}
@@ -0,0 +1,203 @@
+#include "rwlock.hh"
+
+#include <pthread.h>
+#include <sched.h>
+
+// Reader slot of the calling thread, assigned round-robin on first use
+static __thread int thread_slot = -1;
+static int next_slot = 0;
+
+// Operations the instrumentation times
+enum { RWLOCK_OP_READLOCK, RWLOCK_OP_WRITELOCK, RWLOCK_NUM_OPS };
+#ifdef INSTRUMENT
+static const char *const rwlock_op_names[RWLOCK_NUM_OPS] = {"readlock", "writelock"};
+#endif
+
+/**
+ * @brief  Get the reader counter the calling thread increments
+ * @note
+ * @param  *rw: lock whose counters to use
+ * @retval pointer to the thread's reader counter
+ */
+static int *reader_count(rwlock_t *rw) {
+  if (thread_slot == -1)
+    thread_slot = __atomic_fetch_add(&next_slot, 1, __ATOMIC_RELAXED) % RWLOCK_READER_SLOTS;
+  return &rw->slots[thread_slot].readers;
+}
+
+/**
+ * @brief  Check whether any reader holds the lock
+ * @note
+ * @param  *rw: lock to check
+ * @retval true if at least one reader counter is non-zero
+ */
+static bool readers_present(rwlock_t *rw) {
+  for (int i = 0; i < RWLOCK_READER_SLOTS; i++) {
+    if (__atomic_load_n(&rw->slots[i].readers, __ATOMIC_SEQ_CST) != 0)
+      return true;
+  }
+  return false;
+}
+
+/**
+ * @brief  Initialize a reader-writer lock
+ * @note
+ * @param  *rw: lock to initialize
+ * @param  preference: whether waiting writers or arriving readers go first
+ * @retval None
+ */
+void rwlock_init(rwlock_t *rw, rwlock_preference_t preference) {
+  for (int i = 0; i < RWLOCK_READER_SLOTS; i++)
+    rw->slots[i].readers = 0;
+  rw->writer = 0;
+  rw->preference = preference;
+  rw->waiting_readers = 0;
+  rw->admitted_readers = 0;
+  pthread_mutex_init(&rw->writer_lock, NULL);
+  pthread_mutex_init(&rw->wait_lock, NULL);
+  pthread_cond_init(&rw->reader_cond, NULL);
+  pthread_cond_init(&rw->writer_cond, NULL);
+  INSTRUMENT_INIT(&rw->instrument, "rwlock", rwlock_op_names, RWLOCK_NUM_OPS);
+}
+
+/**
+ * @brief  Destroy a reader-writer lock
+ * @note   The lock must not be held
+ * @param  *rw: lock to destroy
+ * @retval None
+ */
+void rwlock_destroy(rwlock_t *rw) {
+  pthread_mutex_destroy(&rw->writer_lock);
+  pthread_mutex_destroy(&rw->wait_lock);
+  pthread_cond_destroy(&rw->reader_cond);
+  pthread_cond_destroy(&rw->writer_cond);
+}
+
+/**
+ * @brief  Acquire the lock for reading
+ * @note   Uncontended, this is one increment of the thread's own counter and
+ *         one load of the writer flag; no shared cache line is written
+ * @param  *rw: lock to acquire
+ * @retval None
+ */
+static void acquire_readlock(rwlock_t *rw) {
+  int *count = reader_count(rw);
+  while (true) {
+    // announce ourselves, then back out if a writer got there first
+    __atomic_add_fetch(count, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&rw->writer, __ATOMIC_SEQ_CST) == 0)
+      return;
+    __atomic_sub_fetch(count, 1, __ATOMIC_SEQ_CST);
+
+    // sleep until the writer is done
+    pthread_mutex_lock(&rw->wait_lock);
+    bool waited = false;
+    rw->waiting_readers++;
+    while (__atomic_load_n(&rw->writer, __ATOMIC_SEQ_CST) != 0) {
+      pthread_cond_wait(&rw->reader_cond, &rw->wait_lock);
+      waited = true;
+    }
+    rw->waiting_readers--;
+    pthread_mutex_unlock(&rw->wait_lock);
+
+    if (waited && rw->preference == RWLOCK_PREFER_WRITERS) {
+      // we were admitted by a releasing writer, which holds the next writer
+      // back until every admitted reader is in
+      __atomic_add_fetch(count, 1, __ATOMIC_SEQ_CST);
+      pthread_mutex_lock(&rw->wait_lock);
+      if (--rw->admitted_readers == 0)
+        pthread_cond_signal(&rw->writer_cond);
+      pthread_mutex_unlock(&rw->wait_lock);
+      return;
+    }
+  }
+}
+
+/**
+ * @brief  Acquire the lock for reading, timing the wait if instrumented
+ * @note
+ * @param  *rw: lock to acquire
+ * @retval None
+ */
+void rwlock_acquire_readlock(rwlock_t *rw) {
+  INSTRUMENT_START(start);
+  acquire_readlock(rw);
+  INSTRUMENT_WAITED(&rw->instrument, start);
+  INSTRUMENT_OP(&rw->instrument, RWLOCK_OP_READLOCK, start);
+}
+
+/**
+ * @brief  Release a read lock
+ * @note
+ * @param  *rw: lock to release
+ * @retval None
+ */
+void rwlock_release_readlock(rwlock_t *rw) {
+  __atomic_sub_fetch(reader_count(rw), 1, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * @brief  Acquire the lock for writing
+ * @note
+ * @param  *rw: lock to acquire
+ * @retval None
+ */
+static void acquire_writelock(rwlock_t *rw) {
+  pthread_mutex_lock(&rw->writer_lock);
+
+  if (rw->preference == RWLOCK_PREFER_WRITERS) {
+    // let the readers the previous writer admitted in first, then close the
+    // door to new readers and wait for the ones inside to leave
+    pthread_mutex_lock(&rw->wait_lock);
+    while (rw->admitted_readers > 0)
+      pthread_cond_wait(&rw->writer_cond, &rw->wait_lock);
+    __atomic_store_n(&rw->writer, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&rw->wait_lock);
+    while (readers_present(rw))
+      sched_yield();
+    return;
+  }
+
+  // reader preference: only take the lock at a moment with no readers inside
+  while (true) {
+    __atomic_store_n(&rw->writer, 1, __ATOMIC_SEQ_CST);
+    if (!readers_present(rw))
+      return;
+    pthread_mutex_lock(&rw->wait_lock);
+    __atomic_store_n(&rw->writer, 0, __ATOMIC_SEQ_CST);
+    pthread_cond_broadcast(&rw->reader_cond);
+    pthread_mutex_unlock(&rw->wait_lock);
+    sched_yield();
+  }
+}
+
+/**
+ * @brief  Acquire the lock for writing, timing the wait if instrumented
+ * @note
+ * @param  *rw: lock to acquire
+ * @retval None
+ */
+void rwlock_acquire_writelock(rwlock_t *rw) {
+  INSTRUMENT_START(start);
+  acquire_writelock(rw);
+  INSTRUMENT_WAITED(&rw->instrument, start);
+  INSTRUMENT_OP(&rw->instrument, RWLOCK_OP_WRITELOCK, start);
+  INSTRUMENT_HOLD_BEGIN(&rw->instrument);
+}
+
+/**
+ * @brief  Release a write lock
+ * @note
+ * @param  *rw: lock to release
+ * @retval None
+ */
+void rwlock_release_writelock(rwlock_t *rw) {
+  INSTRUMENT_HOLD_END(&rw->instrument);
+  pthread_mutex_lock(&rw->wait_lock);
+  __atomic_store_n(&rw->writer, 0, __ATOMIC_SEQ_CST);
+  if (rw->preference == RWLOCK_PREFER_WRITERS)
+    rw->admitted_readers += rw->waiting_readers;
+  pthread_cond_broadcast(&rw->reader_cond);
+  pthread_mutex_unlock(&rw->wait_lock);
+  pthread_mutex_unlock(&rw->writer_lock);
+}
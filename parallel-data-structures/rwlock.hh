@@ -0,0 +1,58 @@
+#ifndef RWLOCK_H
+#define RWLOCK_H
+
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "instrument.hh"
+
+// Number of reader counters. Each thread is assigned one the first time it
+// takes a read lock, so readers on different cores increment different
+// cache lines instead of one shared count.
+#define RWLOCK_READER_SLOTS 32
+
+typedef enum rwlock_preference {
+  // New readers wait behind a waiting writer. Readers that were blocked by a
+  // writer are all let in before the next writer, so neither side starves.
+  RWLOCK_PREFER_WRITERS,
+  // Readers only wait while a writer actually holds the lock; a steady stream
+  // of readers can keep writers out.
+  RWLOCK_PREFER_READERS
+} rwlock_preference_t;
+
+typedef struct rwlock_slot {
+  int readers;
+} __attribute__((aligned(64))) rwlock_slot_t;
+
+typedef struct rwlock_t {
+  rwlock_slot_t slots[RWLOCK_READER_SLOTS];
+  int writer;  // set while a writer holds the lock or waits for readers to leave
+  rwlock_preference_t preference;
+  pthread_mutex_t writer_lock;  // serializes writers
+  pthread_mutex_t wait_lock;    // protects the fields below
+  int waiting_readers;          // readers blocked by a writer
+  int admitted_readers;         // blocked readers let in by the last writer, not yet counted
+  pthread_cond_t reader_cond;
+  pthread_cond_t writer_cond;
+  INSTRUMENT_FIELD(instrument)  // waits for either side, holds of the write side
+} rwlock_t;
+
+// Initialize a reader-writer lock
+void rwlock_init(rwlock_t* rw, rwlock_preference_t preference);
+
+// Destroy a reader-writer lock
+void rwlock_destroy(rwlock_t* rw);
+
+// Acquire a reader-writer lock for reading
+void rwlock_acquire_readlock(rwlock_t* rw);
+
+// Release a read lock
+void rwlock_release_readlock(rwlock_t* rw);
+
+// Acquire a reader-writer lock for writing
+void rwlock_acquire_writelock(rwlock_t* rw);
+
+// Release a write lock
+void rwlock_release_writelock(rwlock_t* rw);
+
+#endif
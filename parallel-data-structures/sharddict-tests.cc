@@ -0,0 +1,274 @@
+#include <gtest/gtest.h>
+
+#include "sharddict.hh"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/****** Dictionary Invariants ******/
+
+// Invariant 1
+// Value for any key should not change, unless specified.
+
+// Invariant 2
+// Every key lives in the shard its hash picks, and each shard is a valid
+// B-tree dictionary of its own.
+
+/****** Synchronization ******/
+
+// Under what circumstances can accesses to your dictionary structure can
+// proceed in parallel? Answer below.
+//
+// Reads always can. Writes can when their keys fall in different shards,
+// since every shard has its own writer lock.
+//
+
+// When will two accesses to your dictionary structure be ordered by
+// synchronization? Answer below.
+//
+// Two writes to the same shard are ordered by that shard's writer lock, and a
+// read by the root it loads. Accesses to different shards are not ordered.
+//
+
+/****** Begin Tests ******/
+
+// Basic functionality for the dictionary
+TEST(ShardDictionaryTest, BasicDictionaryOps) {
+  my_sharddict_t d;
+  sharddict_init(&d, 4, NULL);
+
+  // Make sure the dictionary does not contain keys A, B, and C
+  ASSERT_FALSE(sharddict_contains(&d, "A"));
+  ASSERT_FALSE(sharddict_contains(&d, "B"));
+  ASSERT_FALSE(sharddict_contains(&d, "C"));
+
+  // Add some values
+  sharddict_set(&d, "A", 1);
+  sharddict_set(&d, "B", 2);
+  sharddict_set(&d, "C", 3);
+
+  // Make sure these values are in the dictionary
+  ASSERT_TRUE(sharddict_contains(&d, "A"));
+  ASSERT_EQ(1, sharddict_get(&d, "A"));
+  ASSERT_EQ(2, sharddict_get(&d, "B"));
+  ASSERT_EQ(3, sharddict_get(&d, "C"));
+
+  // Set some new values
+  sharddict_set(&d, "A", 10);
+  sharddict_set(&d, "B", 20);
+  sharddict_set(&d, "C", 30);
+  ASSERT_EQ(10, sharddict_get(&d, "A"));
+  ASSERT_EQ(20, sharddict_get(&d, "B"));
+  ASSERT_EQ(30, sharddict_get(&d, "C"));
+
+  // Remove the values
+  sharddict_remove(&d, "A");
+  sharddict_remove(&d, "B");
+  sharddict_remove(&d, "C");
+  sharddict_remove(&d, "C");
+
+  // Make sure we get -1 for each value
+  ASSERT_FALSE(sharddict_contains(&d, "A"));
+  ASSERT_EQ(-1, sharddict_get(&d, "A"));
+  ASSERT_EQ(-1, sharddict_get(&d, "B"));
+  ASSERT_EQ(-1, sharddict_get(&d, "C"));
+
+  // Clean up
+  sharddict_destroy(&d);
+}
+
+// Invariant 2, and statistics that add up to the operations performed
+TEST(ShardDictionaryTest, ShardsAndStats) {
+  my_sharddict_t d;
+  int nodes[8];
+  for (int i = 0; i < 8; i++)
+    nodes[i] = i % 2 == 0 ? -1 : 0;
+  sharddict_init(&d, 8, nodes);
+
+  char key[32];
+  for (int i = 0; i < 20000; i++) {
+    snprintf(key, sizeof(key), "key%05d", i);
+    sharddict_set(&d, key, i);
+  }
+  for (int i = 0; i < 20000; i += 2) {
+    snprintf(key, sizeof(key), "key%05d", i);
+    sharddict_remove(&d, key);
+  }
+
+  int per_shard[8] = {0};
+  for (int i = 0; i < 20000; i++) {
+    snprintf(key, sizeof(key), "key%05d", i);
+    int shard = sharddict_shard_of(&d, key);
+    ASSERT_GE(shard, 0);
+    ASSERT_LT(shard, 8);
+    if (i % 2 == 1) {
+      ASSERT_EQ(i, dict_get(&d.shards[shard]->dict, key));
+      per_shard[shard]++;
+    }
+    ASSERT_EQ(i % 2 == 0 ? -1 : i, sharddict_get(&d, key));
+    for (int s = 0; s < 8; s++) {
+      if (s != shard) {
+        ASSERT_FALSE(dict_contains(&d.shards[s]->dict, key));
+      }
+    }
+  }
+
+  unsigned long gets = 0, hits = 0, sets = 0, removes = 0;
+  for (int s = 0; s < 8; s++) {
+    // keys spread evenly enough that no shard is far off its share
+    ASSERT_GT(per_shard[s], 10000 / 8 / 2);
+    ASSERT_LT(per_shard[s], 10000 / 8 * 2);
+    sharddict_stats_t stats;
+    sharddict_stats(&d, s, &stats);
+    ASSERT_EQ(nodes[s], stats.numa_node);
+    if (nodes[s] == -1) {
+      ASSERT_FALSE(stats.bound);
+    }
+    ASSERT_GT(stats.bytes, 0u);
+    gets += stats.gets;
+    hits += stats.hits;
+    sets += stats.sets;
+    removes += stats.removes;
+  }
+  ASSERT_EQ(20000u, gets);
+  ASSERT_EQ(10000u, hits);
+  ASSERT_EQ(20000u, sets);
+  ASSERT_EQ(10000u, removes);
+
+  // clean up
+  sharddict_destroy(&d);
+}
+
+// Freed nodes go back to their shard's heap and are reused
+TEST(ShardDictionaryTest, MemoryIsReused) {
+  my_sharddict_t d;
+  sharddict_init(&d, 2, NULL);
+  char key[32];
+  size_t peak = 0;
+  for (int round = 0; round < 5; round++) {
+    for (int i = 0; i < 5000; i++) {
+      snprintf(key, sizeof(key), "key%05d", i);
+      sharddict_set(&d, key, round);
+    }
+    for (int i = 0; i < 5000; i++) {
+      snprintf(key, sizeof(key), "key%05d", i);
+      sharddict_remove(&d, key);
+    }
+    sharddict_stats_t stats[2];
+    sharddict_stats(&d, 0, &stats[0]);
+    sharddict_stats(&d, 1, &stats[1]);
+    size_t bytes = stats[0].bytes + stats[1].bytes;
+    if (round == 0)
+      peak = bytes;
+    // only the interned keys and nodes still waiting for their epoch remain
+    ASSERT_LE(bytes, peak);
+  }
+  ASSERT_EQ(-1, sharddict_get(&d, "key00000"));
+  sharddict_destroy(&d);
+}
+
+// Set to make every mmap fail, as when the process is out of address space
+static bool fail_mmap = false;
+
+/**
+ * @brief  Stand-in for mmap that fails while fail_mmap is set
+ * @note   Defined in the test binary, so the shard heaps call it instead of
+ *         the C library's; otherwise it passes the call on to the kernel
+ * @retval the mapping, or MAP_FAILED
+ */
+void *mmap(void *addr, size_t len, int prot, int flags, int fd, off_t offset) noexcept {
+  if (__atomic_load_n(&fail_mmap, __ATOMIC_RELAXED))
+    return MAP_FAILED;
+  return (void *)syscall(SYS_mmap, addr, len, prot, flags, fd, offset);
+}
+
+// Blocks too large for a size class fall back to the C heap when mmap fails
+TEST(ShardDictionaryTest, LargeBlocksWithoutMmap) {
+  my_sharddict_t d;
+  sharddict_init(&d, 1, NULL);
+
+  // a key over 1 MiB makes the key arena ask the shard's heap for a block of
+  // pages of its own
+  size_t len = 2 << 20;
+  char *key = (char *)malloc(len + 1);
+  memset(key, 'k', len);
+  key[len] = '\0';
+  __atomic_store_n(&fail_mmap, true, __ATOMIC_RELAXED);
+  sharddict_set(&d, key, 7);
+  sharddict_set(&d, "short", 8);
+  ASSERT_EQ(7, sharddict_get(&d, key));
+  ASSERT_EQ(8, sharddict_get(&d, "short"));
+  sharddict_remove(&d, key);
+  ASSERT_FALSE(sharddict_contains(&d, key));
+
+  // clean up; the block goes back to free rather than munmap
+  sharddict_destroy(&d);
+  __atomic_store_n(&fail_mmap, false, __ATOMIC_RELAXED);
+  free(key);
+}
+
+#define KEYS_PER_THREAD 5000
+#define NUM_THREADS 4
+
+typedef struct shard_thread_args {
+  int id;
+  my_sharddict_t *d;
+} shard_thread_args_t;
+
+/**
+ * @brief  Pin to a node, then set, overwrite and remove the thread's own keys
+ * @note
+ * @param  *thread_args: struct with the thread id and the dictionary
+ * @retval None
+ */
+void *shard_thread_run(void *thread_args) {
+  shard_thread_args_t *arguments = (shard_thread_args_t *)thread_args;
+  sharddict_pin_thread(arguments->id % sharddict_num_nodes());
+  char key[32];
+  for (int i = 0; i < KEYS_PER_THREAD; i++) {
+    snprintf(key, sizeof(key), "t%d-%05d", arguments->id, i);
+    sharddict_set(arguments->d, key, i);
+  }
+  for (int i = 0; i < KEYS_PER_THREAD; i++) {
+    snprintf(key, sizeof(key), "t%d-%05d", arguments->id, i);
+    if (i % 3 == 0)
+      sharddict_remove(arguments->d, key);
+    else
+      sharddict_set(arguments->d, key, -i);
+  }
+  return NULL;
+}
+
+// Invariant 1 with threads writing to every shard at once
+TEST(ShardDictionaryTest, ConcurrentWriters) {
+  my_sharddict_t d;
+  sharddict_init(&d, 4, NULL);
+
+  pthread_t threads[NUM_THREADS];
+  shard_thread_args_t arguments[NUM_THREADS];
+  for (int i = 0; i < NUM_THREADS; i++) {
+    arguments[i].id = i;
+    arguments[i].d = &d;
+    if (pthread_create(&threads[i], NULL, shard_thread_run, &arguments[i]) != 0)
+      perror("Error creating thread");
+  }
+  for (int i = 0; i < NUM_THREADS; i++) {
+    if (pthread_join(threads[i], NULL) != 0)
+      perror("Error joining thread");
+  }
+
+  char key[32];
+  for (int t = 0; t < NUM_THREADS; t++) {
+    for (int i = 0; i < KEYS_PER_THREAD; i++) {
+      snprintf(key, sizeof(key), "t%d-%05d", t, i);
+      ASSERT_EQ(i % 3 == 0 ? -1 : -i, sharddict_get(&d, key));
+    }
+  }
+
+  // clean up
+  sharddict_destroy(&d);
+}
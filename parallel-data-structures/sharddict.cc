@@ -0,0 +1,509 @@
+#include "sharddict.hh"
+
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+// Memory policy that places pages on one node while it has room, from
+// <numaif.h>, which would add a dependency on libnuma
+#define HEAP_MPOL_PREFERRED 1
+
+// Counter slot of the calling thread, assigned round-robin on first use
+static __thread int stat_slot = -1;
+static int next_stat_slot = 0;
+
+// Header in front of every block a shard's heap hands out
+typedef struct heap_block {
+  sharddict_heap_t *heap;
+  size_t size : 63;   // size of the block including this header
+  size_t mapped : 1;  // for blocks with pages of their own: false if they came from aligned_alloc
+} heap_block_t;
+static_assert(sizeof(heap_block_t) == 16, "blocks must stay 16-byte aligned after their header");
+
+/**
+ * @brief  Ask the kernel to place pages on a NUMA node
+ * @note   Only affects pages that have not been touched yet
+ * @param  *addr: page-aligned start of the pages
+ * @param  len: number of bytes
+ * @param  numa_node: node to place them on, or -1 to leave them alone
+ * @retval whether the placement was accepted
+ */
+static bool bind_pages(void *addr, size_t len, int numa_node) {
+#ifdef SYS_mbind
+  if (numa_node < 0 || numa_node >= SHARDDICT_MAX_NODES)
+    return false;
+  unsigned long mask[SHARDDICT_MAX_NODES / (8 * sizeof(unsigned long))];
+  memset(mask, 0, sizeof(mask));
+  mask[numa_node / (8 * sizeof(unsigned long))] |= 1UL << (numa_node % (8 * sizeof(unsigned long)));
+  // the kernel ignores the last bit of maxnode
+  return syscall(SYS_mbind, addr, len, HEAP_MPOL_PREFERRED, mask, SHARDDICT_MAX_NODES + 1, 0) == 0;
+#else
+  return false;
+#endif
+}
+
+/**
+ * @brief  Map fresh pages placed on a NUMA node
+ * @note
+ * @param  size: number of bytes, a multiple of the page size
+ * @param  numa_node: node to place them on, or -1
+ * @param  *bound: set to whether the placement was accepted, may be NULL
+ * @retval the pages, or NULL
+ */
+static void *map_pages(size_t size, int numa_node, bool *bound) {
+  void *pages = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (pages == MAP_FAILED)
+    return NULL;
+  bool accepted = bind_pages(pages, size, numa_node);
+  if (bound != NULL)
+    *bound = accepted;
+  return pages;
+}
+
+/**
+ * @brief  Get fresh pages placed on a NUMA node, or unplaced memory if they cannot be mapped
+ * @note
+ * @param  size: number of bytes, a multiple of the page size
+ * @param  numa_node: node to place them on, or -1
+ * @param  *bound: set to whether the placement was accepted, may be NULL
+ * @param  *mapped: set to whether the memory was mapped; pass it to release_pages
+ * @retval the memory, or NULL if aligned_alloc failed too
+ */
+static void *get_pages(size_t size, int numa_node, bool *bound, bool *mapped) {
+  void *pages = map_pages(size, numa_node, bound);
+  *mapped = pages != NULL;
+  if (pages != NULL)
+    return pages;
+  if (bound != NULL)
+    *bound = false;
+  return aligned_alloc(64, size);
+}
+
+/**
+ * @brief  Give back memory from get_pages
+ * @note
+ * @param  *pages: memory to give back
+ * @param  size: number of bytes passed to get_pages
+ * @param  mapped: whether get_pages mapped it
+ * @retval None
+ */
+static void release_pages(void *pages, size_t size, bool mapped) {
+  if (mapped)
+    munmap(pages, size);
+  else
+    free(pages);
+}
+
+/**
+ * @brief  Round a size up to whole pages
+ * @note
+ * @param  size: number of bytes
+ * @retval rounded size
+ */
+static size_t page_round(size_t size) {
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  return (size + page - 1) & ~(page - 1);
+}
+
+/**
+ * @brief  Find the size class of a block
+ * @note
+ * @param  size: size of the block including its header
+ * @param  *rounded: set to the size of blocks in the class
+ * @retval the class, or -1 for blocks that get pages of their own
+ */
+static int size_class(size_t size, size_t *rounded) {
+  if (size <= 4096) {
+    int c = size == 0 ? 0 : (int)((size + 63) / 64) - 1;
+    *rounded = (size_t)(c + 1) * 64;
+    return c;
+  }
+  size_t base = 4096;
+  int doublings = 0;
+  while (size > base * 2) {
+    base *= 2;
+    doublings++;
+  }
+  if (doublings >= (SHARDDICT_SIZE_CLASSES - SHARDDICT_SMALL_CLASSES) / 4)
+    return -1;
+  size_t step = base / 4;
+  size_t quarters = (size - base + step - 1) / step;
+  *rounded = base + quarters * step;
+  return SHARDDICT_SMALL_CLASSES + 4 * doublings + (int)quarters - 1;
+}
+
+/**
+ * @brief  Start a new region and carve the next blocks from it
+ * @note   Called with the heap lock held. What is left of the old region is
+ *         abandoned. Falls back to unplaced memory if mmap fails.
+ * @param  *heap: heap to grow
+ * @retval whether a region was allocated
+ */
+static bool heap_grow(sharddict_heap_t *heap) {
+  bool bound, mapped;
+  sharddict_region_t *region = (sharddict_region_t *)get_pages(SHARDDICT_REGION, heap->numa_node, &bound, &mapped);
+  if (region == NULL)
+    return false;
+  __atomic_store_n(&heap->bound, bound, __ATOMIC_RELAXED);
+  region->size = SHARDDICT_REGION;
+  region->mapped = mapped;
+  region->next = heap->regions;
+  heap->regions = region;
+  // keep blocks 64-byte aligned
+  heap->next = (char *)region + 64;
+  heap->left = SHARDDICT_REGION - 64;
+  return true;
+}
+
+/**
+ * @brief  Allocate memory from a shard's heap
+ * @note   Used as the shard dictionary's alloc_fn
+ * @param  size: number of bytes
+ * @param  *arg: sharddict_heap_t
+ * @retval 16-byte aligned memory, or NULL
+ */
+static void *heap_alloc(size_t size, void *arg) {
+  sharddict_heap_t *heap = (sharddict_heap_t *)arg;
+  size_t rounded;
+  int c = size_class(size + sizeof(heap_block_t), &rounded);
+  heap_block_t *block;
+  bool mapped = false;
+  if (c < 0) {
+    rounded = page_round(size + sizeof(heap_block_t));
+    block = (heap_block_t *)get_pages(rounded, heap->numa_node, NULL, &mapped);
+    if (block == NULL)
+      return NULL;
+  } else {
+    pthread_mutex_lock(&heap->lock);
+    block = (heap_block_t *)heap->free_lists[c];
+    if (block != NULL) {
+      heap->free_lists[c] = *(void **)(block + 1);
+    } else {
+      if (heap->left < rounded && !heap_grow(heap)) {
+        pthread_mutex_unlock(&heap->lock);
+        return NULL;
+      }
+      block = (heap_block_t *)heap->next;
+      heap->next += rounded;
+      heap->left -= rounded;
+    }
+    pthread_mutex_unlock(&heap->lock);
+  }
+  block->heap = heap;
+  block->size = rounded;
+  block->mapped = mapped;
+  __atomic_add_fetch(&heap->bytes, rounded, __ATOMIC_RELAXED);
+  return block + 1;
+}
+
+/**
+ * @brief  Give memory back to the heap it came from
+ * @note   Used as the shard dictionary's free_fn
+ * @param  *ptr: memory from heap_alloc
+ * @retval None
+ */
+static void heap_free(void *ptr) {
+  heap_block_t *block = (heap_block_t *)ptr - 1;
+  sharddict_heap_t *heap = block->heap;
+  size_t rounded;
+  int c = size_class(block->size, &rounded);
+  __atomic_sub_fetch(&heap->bytes, block->size, __ATOMIC_RELAXED);
+  if (c < 0) {
+    release_pages(block, block->size, block->mapped);
+    return;
+  }
+  pthread_mutex_lock(&heap->lock);
+  *(void **)(block + 1) = heap->free_lists[c];
+  heap->free_lists[c] = block;
+  pthread_mutex_unlock(&heap->lock);
+}
+
+/**
+ * @brief  Initialize a heap with its first region
+ * @note
+ * @param  *heap: heap to initialize
+ * @param  numa_node: node to place its memory on, or -1
+ * @retval None
+ */
+static void heap_init(sharddict_heap_t *heap, int numa_node) {
+  pthread_mutex_init(&heap->lock, NULL);
+  heap->numa_node = numa_node;
+  heap->bound = false;
+  heap->regions = NULL;
+  heap->next = NULL;
+  heap->left = 0;
+  memset(heap->free_lists, 0, sizeof(heap->free_lists));
+  heap->bytes = 0;
+  heap_grow(heap);
+}
+
+/**
+ * @brief  Unmap every region of a heap
+ * @note   Blocks with pages of their own must already be freed
+ * @param  *heap: heap to destroy
+ * @retval None
+ */
+static void heap_destroy(sharddict_heap_t *heap) {
+  sharddict_region_t *region = heap->regions;
+  while (region != NULL) {
+    sharddict_region_t *next = region->next;
+    release_pages(region, region->size, region->mapped);
+    region = next;
+  }
+  heap->regions = NULL;
+  pthread_mutex_destroy(&heap->lock);
+}
+
+/**
+ * @brief  Get the calling thread's counters in a shard
+ * @note
+ * @param  *shard: shard being accessed
+ * @retval the counters
+ */
+static sharddict_counters_t *counters(sharddict_shard_t *shard) {
+  if (stat_slot == -1)
+    stat_slot = __atomic_fetch_add(&next_stat_slot, 1, __ATOMIC_RELAXED) % SHARDDICT_STAT_SLOTS;
+  return &shard->counters[stat_slot];
+}
+
+/**
+ * @brief  Count an operation
+ * @note   Relaxed, since the counters order nothing
+ * @param  *counter: counter to increment
+ * @retval None
+ */
+static void count(unsigned long *counter) {
+  __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief  Find the shard that holds a key
+ * @note
+ * @param  *dict: dictionary
+ * @param  *key: key to look up
+ * @retval the shard
+ */
+static sharddict_shard_t *shard_for(my_sharddict_t *dict, const char *key) {
+  return dict->shards[sharddict_shard_of(dict, key)];
+}
+
+/**
+ * @brief  Initialize the dictionary
+ * @note   Each shard, with its root and writer lock, lives on its own node
+ * @param  *dict: dictionary to initialize
+ * @param  num_shards: number of shards
+ * @param  *nodes: NUMA node of each shard, or NULL to spread them over the machine
+ * @retval None
+ */
+void sharddict_init(my_sharddict_t *dict, int num_shards, const int *nodes) {
+  int num_nodes = sharddict_num_nodes();
+  dict->num_shards = num_shards;
+  dict->shards = (sharddict_shard_t **)malloc(num_shards * sizeof(sharddict_shard_t *));
+  for (int i = 0; i < num_shards; i++) {
+    int numa_node = nodes != NULL ? nodes[i] : i % num_nodes;
+    bool mapped;
+    sharddict_shard_t *shard =
+        (sharddict_shard_t *)get_pages(page_round(sizeof(sharddict_shard_t)), numa_node, NULL, &mapped);
+    if (shard == NULL) {
+      fprintf(stderr, "sharddict: cannot allocate shard %d\n", i);
+      abort();
+    }
+    shard->mapped = mapped;
+    heap_init(&shard->heap, numa_node);
+    dict_init(&shard->dict);
+    dict_allocator_t alloc = {heap_alloc, heap_free, &shard->heap};
+    dict_set_allocator(&shard->dict, &alloc);
+    memset(shard->counters, 0, sizeof(shard->counters));
+    dict->shards[i] = shard;
+  }
+}
+
+/**
+ * @brief  Destroy the dictionary
+ * @note
+ * @param  *dict: dictionary to destroy
+ * @retval None
+ */
+void sharddict_destroy(my_sharddict_t *dict) {
+  for (int i = 0; i < dict->num_shards; i++) {
+    sharddict_shard_t *shard = dict->shards[i];
+    dict_destroy(&shard->dict);
+    heap_destroy(&shard->heap);
+    release_pages(shard, page_round(sizeof(sharddict_shard_t)), shard->mapped);
+  }
+  free(dict->shards);
+  dict->shards = NULL;
+  dict->num_shards = 0;
+}
+
+/**
+ * @brief  Set a value in the dictionary
+ * @note
+ * @param  *dict: dictionary to modify
+ * @param  *key: key to set
+ * @param  value: value to set
+ * @retval None
+ */
+void sharddict_set(my_sharddict_t *dict, const char *key, int value) {
+  sharddict_shard_t *shard = shard_for(dict, key);
+  count(&counters(shard)->sets);
+  dict_set(&shard->dict, key, value);
+}
+
+/**
+ * @brief  Check if the dictionary contains a key
+ * @note
+ * @param  *dict: dictionary to check
+ * @param  *key: key to look for
+ * @retval boolean
+ */
+bool sharddict_contains(my_sharddict_t *dict, const char *key) {
+  sharddict_shard_t *shard = shard_for(dict, key);
+  sharddict_counters_t *c = counters(shard);
+  count(&c->gets);
+  bool found = dict_contains(&shard->dict, key);
+  if (found)
+    count(&c->hits);
+  return found;
+}
+
+/**
+ * @brief  Get a value from the dictionary
+ * @note
+ * @param  *dict: dictionary to read
+ * @param  *key: key to look up
+ * @retval the value, or -1 if the key is not present
+ */
+int sharddict_get(my_sharddict_t *dict, const char *key) {
+  sharddict_shard_t *shard = shard_for(dict, key);
+  sharddict_counters_t *c = counters(shard);
+  count(&c->gets);
+  int value = -1;
+  if (dict_get_value(&shard->dict, key, &value))
+    count(&c->hits);
+  return value;
+}
+
+/**
+ * @brief  Remove a value from the dictionary
+ * @note
+ * @param  *dict: dictionary to modify
+ * @param  *key: key to remove
+ * @retval None
+ */
+void sharddict_remove(my_sharddict_t *dict, const char *key) {
+  sharddict_shard_t *shard = shard_for(dict, key);
+  count(&counters(shard)->removes);
+  dict_remove(&shard->dict, key);
+}
+
+/**
+ * @brief  Get the shard that holds a key
+ * @note   Uses the high half of an FNV-1a hash, since each shard's intern
+ *         table indexes by the low bits of the same hash
+ * @param  *dict: dictionary
+ * @param  *key: key to look up
+ * @retval shard index
+ */
+int sharddict_shard_of(my_sharddict_t *dict, const char *key) {
+  uint64_t hash = 14695981039346656037UL;
+  for (const char *c = key; *c != '\0'; c++) {
+    hash ^= (unsigned char)*c;
+    hash *= 1099511628211UL;
+  }
+  return (int)(((hash >> 32) * (uint64_t)dict->num_shards) >> 32);
+}
+
+/**
+ * @brief  Get the counters and placement of a shard
+ * @note
+ * @param  *dict: dictionary
+ * @param  shard: shard index
+ * @param  *stats: filled in with the shard's statistics
+ * @retval None
+ */
+void sharddict_stats(my_sharddict_t *dict, int shard, sharddict_stats_t *stats) {
+  sharddict_shard_t *s = dict->shards[shard];
+  stats->numa_node = s->heap.numa_node;
+  stats->bound = __atomic_load_n(&s->heap.bound, __ATOMIC_RELAXED);
+  stats->gets = stats->hits = stats->sets = stats->removes = 0;
+  for (int i = 0; i < SHARDDICT_STAT_SLOTS; i++) {
+    stats->gets += __atomic_load_n(&s->counters[i].gets, __ATOMIC_RELAXED);
+    stats->hits += __atomic_load_n(&s->counters[i].hits, __ATOMIC_RELAXED);
+    stats->sets += __atomic_load_n(&s->counters[i].sets, __ATOMIC_RELAXED);
+    stats->removes += __atomic_load_n(&s->counters[i].removes, __ATOMIC_RELAXED);
+  }
+  stats->bytes = __atomic_load_n(&s->heap.bytes, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief  Read a list like "0-3,8,10-11" from a sysfs file
+ * @note
+ * @param  *path: file to read
+ * @param  *items: filled in with the numbers in the list
+ * @param  max: capacity of items
+ * @retval number of items, or -1 if the file could not be read
+ */
+static int read_list(const char *path, int *items, int max) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL)
+    return -1;
+  int count = 0, first, last;
+  while (fscanf(file, "%d", &first) == 1) {
+    last = first;
+    int c = fgetc(file);
+    if (c == '-') {
+      if (fscanf(file, "%d", &last) != 1)
+        break;
+      c = fgetc(file);
+    }
+    for (int i = first; i <= last && count < max; i++)
+      items[count++] = i;
+    if (c != ',')
+      break;
+  }
+  fclose(file);
+  return count;
+}
+
+/**
+ * @brief  Count the machine's NUMA nodes
+ * @note
+ * @retval number of nodes, at least 1
+ */
+int sharddict_num_nodes(void) {
+  int nodes[SHARDDICT_MAX_NODES];
+  int count = read_list("/sys/devices/system/node/online", nodes, SHARDDICT_MAX_NODES);
+  return count > 0 ? nodes[count - 1] + 1 : 1;
+}
+
+/**
+ * @brief  Restrict the calling thread to the CPUs of a NUMA node
+ * @note
+ * @param  numa_node: node to run on
+ * @retval whether the thread was pinned
+ */
+bool sharddict_pin_thread(int numa_node) {
+#ifdef __linux__
+  char path[64];
+  int cpus[CPU_SETSIZE];
+  snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", numa_node);
+  int count = read_list(path, cpus, CPU_SETSIZE);
+  if (count <= 0)
+    return false;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int i = 0; i < count; i++)
+    CPU_SET(cpus[i], &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+  return false;
+#endif
+}
@@ -0,0 +1,112 @@
+#ifndef SHARDDICT_H
+#define SHARDDICT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "dict.hh"
+
+// Dictionary split by key hash into independent B-tree dictionaries, each with
+// its own writer lock, epoch domain and memory. A shard can keep its nodes,
+// keys and values on a chosen NUMA node, so threads pinned to that node reach
+// its data in local memory.
+
+// Largest number of NUMA nodes a shard can be placed on
+#define SHARDDICT_MAX_NODES 1024
+
+// Counter slots per shard. Threads are assigned one round-robin, so threads
+// on different cores normally count on different cache lines.
+#define SHARDDICT_STAT_SLOTS 16
+
+// Blocks of up to 4 KiB come in 64-byte steps, larger ones up to 1 MiB in
+// quarter steps between powers of two. Anything larger is mapped on its own.
+#define SHARDDICT_SMALL_CLASSES 64
+#define SHARDDICT_SIZE_CLASSES (SHARDDICT_SMALL_CLASSES + 4 * 8)
+
+// Size of the regions a shard's heap carves its blocks from
+#define SHARDDICT_REGION (4 << 20)
+
+typedef struct sharddict_region {
+  struct sharddict_region* next;
+  size_t size;
+  bool mapped;  // false if mmap failed and it came from aligned_alloc
+} sharddict_region_t;
+
+// Memory of one shard, mapped region by region with the shard's placement.
+// Freed blocks are kept for reuse on per-size-class lists.
+typedef struct sharddict_heap {
+  pthread_mutex_t lock;
+  int numa_node;  // -1 for the default placement
+  bool bound;     // whether the kernel accepted the placement
+  sharddict_region_t* regions;
+  char* next;   // unused part of the newest region
+  size_t left;
+  void* free_lists[SHARDDICT_SIZE_CLASSES];
+  size_t bytes;  // bytes in blocks that are in use
+} sharddict_heap_t;
+
+typedef struct sharddict_counters {
+  unsigned long gets;
+  unsigned long hits;
+  unsigned long sets;
+  unsigned long removes;
+} __attribute__((aligned(64))) sharddict_counters_t;
+
+typedef struct sharddict_shard {
+  my_dict_t dict;
+  sharddict_heap_t heap;
+  sharddict_counters_t counters[SHARDDICT_STAT_SLOTS];
+  bool mapped;  // false if mmap failed and it came from aligned_alloc
+} sharddict_shard_t;
+
+typedef struct my_sharddict {
+  int num_shards;
+  sharddict_shard_t** shards;  // each mapped on its own node
+} my_sharddict_t;
+
+typedef struct sharddict_stats {
+  int numa_node;
+  bool bound;
+  unsigned long gets;  // gets and contains
+  unsigned long hits;  // gets and contains that found the key
+  unsigned long sets;
+  unsigned long removes;
+  size_t bytes;  // memory in use by the shard's nodes, keys and values
+} sharddict_stats_t;
+
+// Initialize a dictionary with num_shards shards. Shard i is placed on NUMA
+// node nodes[i], or -1 for the default placement; with nodes NULL the shards
+// are spread round-robin over the machine's nodes.
+void sharddict_init(my_sharddict_t* dict, int num_shards, const int* nodes);
+
+// Destroy a dictionary
+void sharddict_destroy(my_sharddict_t* dict);
+
+// Set a value in a dictionary. The key is copied.
+void sharddict_set(my_sharddict_t* dict, const char* key, int value);
+
+// Check if a dictionary contains a key
+bool sharddict_contains(my_sharddict_t* dict, const char* key);
+
+// Get a value in a dictionary, or -1 if the key is not present
+int sharddict_get(my_sharddict_t* dict, const char* key);
+
+// Remove a value from a dictionary
+void sharddict_remove(my_sharddict_t* dict, const char* key);
+
+// Get the shard that holds a key
+int sharddict_shard_of(my_sharddict_t* dict, const char* key);
+
+// Get the counters and placement of a shard. Counters are read without
+// stopping other threads, so they may miss operations in progress.
+void sharddict_stats(my_sharddict_t* dict, int shard, sharddict_stats_t* stats);
+
+// Number of NUMA nodes on this machine, 1 where NUMA is not supported
+int sharddict_num_nodes(void);
+
+// Restrict the calling thread to the CPUs of a NUMA node, so it runs next to
+// the shards placed there. Returns whether the thread was pinned.
+bool sharddict_pin_thread(int numa_node);
+
+#endif
@@ -0,0 +1,202 @@
+#include "dict.hh"
+#include "rwlock.hh"
+#include "skipdict.hh"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/****** Dictionary Contention Benchmark ******/
+
+// Threads run a mix of 80% gets, 10% sets and 10% removes on random keys of a
+// shared dictionary. The same total work is split across 1 to 64 threads, for
+//   skiplist: the lock-free skip list
+//   btree:    the copy-on-write B-tree, with lock-free reads and one writer at a time
+//   rw-btree: the same B-tree with every operation under a reader-writer lock,
+//             the way the dictionary used to be synchronized
+// and the throughput of each is reported.
+
+#define KEY_SPACE 200000
+#define TOTAL_OPS 800000
+#define MAX_THREADS 64
+
+typedef enum backend { SKIPLIST, BTREE, RW_BTREE, NUM_BACKENDS } backend_t;
+
+static const char *backend_names[NUM_BACKENDS] = {"skiplist", "btree", "rw-btree"};
+
+typedef struct bench_dict {
+  backend_t backend;
+  my_skipdict_t skip;
+  my_dict_t tree;
+  rwlock_t lock;
+} bench_dict_t;
+
+typedef struct bench_thread {
+  bench_dict_t *d;
+  int ops;
+  unsigned int seed;
+} bench_thread_t;
+
+static char keys[KEY_SPACE][16];
+
+/**
+ * @brief  Get the current time in seconds
+ * @note
+ * @retval seconds on a monotonic clock
+ */
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief  Look up a key in the benchmarked backend
+ * @note
+ * @param  *d: dictionary under test
+ * @param  *key: key to look up
+ * @retval the value, or -1
+ */
+static int bench_get(bench_dict_t *d, const char *key) {
+  switch (d->backend) {
+    case SKIPLIST:
+      return skipdict_get(&d->skip, key);
+    case BTREE:
+      return dict_get(&d->tree, key);
+    default: {
+      rwlock_acquire_readlock(&d->lock);
+      int value = dict_get(&d->tree, key);
+      rwlock_release_readlock(&d->lock);
+      return value;
+    }
+  }
+}
+
+/**
+ * @brief  Set a key in the benchmarked backend
+ * @note
+ * @param  *d: dictionary under test
+ * @param  *key: key to set
+ * @param  value: value to set
+ * @retval None
+ */
+static void bench_set(bench_dict_t *d, const char *key, int value) {
+  switch (d->backend) {
+    case SKIPLIST:
+      skipdict_set(&d->skip, key, value);
+      break;
+    case BTREE:
+      dict_set(&d->tree, key, value);
+      break;
+    default:
+      rwlock_acquire_writelock(&d->lock);
+      dict_set(&d->tree, key, value);
+      rwlock_release_writelock(&d->lock);
+  }
+}
+
+/**
+ * @brief  Remove a key from the benchmarked backend
+ * @note
+ * @param  *d: dictionary under test
+ * @param  *key: key to remove
+ * @retval None
+ */
+static void bench_remove(bench_dict_t *d, const char *key) {
+  switch (d->backend) {
+    case SKIPLIST:
+      skipdict_remove(&d->skip, key);
+      break;
+    case BTREE:
+      dict_remove(&d->tree, key);
+      break;
+    default:
+      rwlock_acquire_writelock(&d->lock);
+      dict_remove(&d->tree, key);
+      rwlock_release_writelock(&d->lock);
+  }
+}
+
+/**
+ * @brief  Run one thread's share of the operations
+ * @note
+ * @param  *arg: bench_thread_t
+ * @retval None
+ */
+static void *bench_run(void *arg) {
+  bench_thread_t *t = (bench_thread_t *)arg;
+  for (int i = 0; i < t->ops; i++) {
+    int r = rand_r(&t->seed);
+    const char *key = keys[(r >> 4) % KEY_SPACE];
+    switch (r % 10) {
+      case 0:
+        bench_set(t->d, key, i);
+        break;
+      case 1:
+        bench_remove(t->d, key);
+        break;
+      default:
+        bench_get(t->d, key);
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief  Time the workload on one backend with a given number of threads
+ * @note   The dictionary starts with every other key present
+ * @param  backend: backend to run
+ * @param  num_threads: number of threads sharing the work
+ * @retval millions of operations per second
+ */
+static double bench_backend(backend_t backend, int num_threads) {
+  static bench_dict_t d;
+  d.backend = backend;
+  if (backend == SKIPLIST)
+    skipdict_init(&d.skip);
+  else
+    dict_init(&d.tree);
+  rwlock_init(&d.lock, RWLOCK_PREFER_WRITERS);
+  for (int i = 0; i < KEY_SPACE; i += 2)
+    bench_set(&d, keys[i], i);
+
+  pthread_t threads[MAX_THREADS];
+  bench_thread_t args[MAX_THREADS];
+  double start = now();
+  for (int i = 0; i < num_threads; i++) {
+    args[i].d = &d;
+    args[i].ops = TOTAL_OPS / num_threads;
+    args[i].seed = i + 1;
+    if (pthread_create(&threads[i], NULL, bench_run, &args[i]) != 0)
+      perror("Error creating thread");
+  }
+  for (int i = 0; i < num_threads; i++) {
+    if (pthread_join(threads[i], NULL) != 0)
+      perror("Error joining thread");
+  }
+  double elapsed = now() - start;
+
+  if (backend == SKIPLIST)
+    skipdict_destroy(&d.skip);
+  else
+    dict_destroy(&d.tree);
+  rwlock_destroy(&d.lock);
+  return TOTAL_OPS / num_threads * num_threads / elapsed / 1e6;
+}
+
+int main(int argc, char **argv) {
+  for (int i = 0; i < KEY_SPACE; i++)
+    snprintf(keys[i], sizeof(keys[i]), "key%07d", i);
+
+  printf("threads");
+  for (int b = 0; b < NUM_BACKENDS; b++)
+    printf("  %10s", backend_names[b]);
+  printf("   (Mops/s, 80%% get / 10%% set / 10%% remove)\n");
+  for (int num_threads = 1; num_threads <= MAX_THREADS; num_threads *= 2) {
+    printf("%7d", num_threads);
+    for (int b = 0; b < NUM_BACKENDS; b++)
+      printf("  %10.2f", bench_backend((backend_t)b, num_threads));
+    printf("\n");
+  }
+  return 0;
+}
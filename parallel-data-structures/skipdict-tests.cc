@@ -0,0 +1,317 @@
+#include <gtest/gtest.h>
+
+#include "skipdict.hh"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+/****** Dictionary Invariants ******/
+
+// Invariant 1
+// Value for any key should not change, unless specified.
+
+// Invariant 2
+// There are no duplicate entires with the same key, and level 0 holds the
+// keys in strictly increasing order.
+
+/****** Synchronization ******/
+
+// Under what circumstances can accesses to your dictionary structure can
+// proceed in parallel? Answer below.
+//
+// Always. No operation takes a lock: reads only follow pointers, and writers
+// to different keys only ever retry a compare-and-swap when another writer
+// changed the same next pointer first.
+//
+
+// When will two accesses to your dictionary structure be ordered by
+// synchronization? Answer below.
+//
+// A set is ordered by the compare-and-swap that links its node into level 0
+// (or the store to an existing node's value), and a remove by the one that
+// marks the node's level 0 pointer. Reads that reach a node after either see it.
+//
+
+/****** Begin Tests ******/
+
+/**
+ * @brief  Check that level 0 is sorted without duplicates and every upper
+ * level is a subsequence of it
+ * @note   Only call while no other thread uses the dictionary
+ * @param  *d: dictionary to check
+ * @retval number of keys
+ */
+int check_skiplist(my_skipdict_t *d) {
+  int count = 0;
+  for (int l = 0; l < SKIPDICT_MAX_LEVEL; l++) {
+    const char *prev = NULL;
+    for (skipdict_node_t *node = d->head->next[l]; node != NULL; node = node->next[l]) {
+      EXPECT_LT(l, node->levels);
+      if (prev != NULL) {
+        EXPECT_LT(strcmp(prev, node->key), 0);
+      }
+      prev = node->key;
+      if (l == 0)
+        count++;
+    }
+  }
+  return count;
+}
+
+// Basic functionality for the dictionary
+TEST(SkipDictionaryTest, BasicDictionaryOps) {
+  my_skipdict_t d;
+  skipdict_init(&d);
+
+  // Make sure the dictionary does not contain keys A, B, and C
+  ASSERT_FALSE(skipdict_contains(&d, "A"));
+  ASSERT_FALSE(skipdict_contains(&d, "B"));
+  ASSERT_FALSE(skipdict_contains(&d, "C"));
+
+  // Add some values
+  skipdict_set(&d, "A", 1);
+  skipdict_set(&d, "B", 2);
+  skipdict_set(&d, "C", 3);
+
+  // Make sure these values are in the dictionary
+  ASSERT_TRUE(skipdict_contains(&d, "A"));
+  ASSERT_EQ(1, skipdict_get(&d, "A"));
+  ASSERT_EQ(2, skipdict_get(&d, "B"));
+  ASSERT_EQ(3, skipdict_get(&d, "C"));
+
+  // Set some new values
+  skipdict_set(&d, "A", 10);
+  skipdict_set(&d, "B", 20);
+  skipdict_set(&d, "C", 30);
+  ASSERT_EQ(10, skipdict_get(&d, "A"));
+  ASSERT_EQ(20, skipdict_get(&d, "B"));
+  ASSERT_EQ(30, skipdict_get(&d, "C"));
+  ASSERT_EQ(3, check_skiplist(&d));
+
+  // Remove the values
+  skipdict_remove(&d, "A");
+  skipdict_remove(&d, "B");
+  skipdict_remove(&d, "C");
+  skipdict_remove(&d, "C");
+
+  // Make sure we get -1 for each value
+  ASSERT_FALSE(skipdict_contains(&d, "A"));
+  ASSERT_EQ(-1, skipdict_get(&d, "A"));
+  ASSERT_EQ(-1, skipdict_get(&d, "B"));
+  ASSERT_EQ(-1, skipdict_get(&d, "C"));
+  ASSERT_EQ(0, check_skiplist(&d));
+
+  // Clean up
+  skipdict_destroy(&d);
+}
+
+typedef struct collected {
+  char keys[64][16];
+  int count;
+} collected_t;
+
+/**
+ * @brief  Scan callback collecting keys
+ * @note
+ * @param  *key: key of the entry
+ * @param  value: value of the entry
+ * @param  *arg: collected_t
+ * @retval whether to keep scanning
+ */
+bool collect_key(const char *key, int value, void *arg) {
+  collected_t *c = (collected_t *)arg;
+  snprintf(c->keys[c->count++], sizeof(c->keys[0]), "%s", key);
+  return c->count < 64;
+}
+
+// Scans visit the keys in range in order, whatever order they were added in
+TEST(SkipDictionaryTest, OrderedScans) {
+  my_skipdict_t d;
+  skipdict_init(&d);
+
+  char key[16];
+  for (int i = 0; i < 100; i++) {
+    snprintf(key, sizeof(key), "k%02d", i * 37 % 100);
+    skipdict_set(&d, key, i);
+  }
+  ASSERT_EQ(100, check_skiplist(&d));
+
+  collected_t c;
+  c.count = 0;
+  skipdict_scan(&d, "k10", "k20", collect_key, &c);
+  ASSERT_EQ(10, c.count);
+  for (int i = 0; i < 10; i++) {
+    snprintf(key, sizeof(key), "k%02d", 10 + i);
+    ASSERT_STREQ(key, c.keys[i]);
+  }
+
+  c.count = 0;
+  skipdict_scan(&d, "k95", NULL, collect_key, &c);
+  ASSERT_EQ(5, c.count);
+  c.count = 0;
+  skipdict_scan(&d, NULL, "k03", collect_key, &c);
+  ASSERT_EQ(3, c.count);
+  ASSERT_STREQ("k00", c.keys[0]);
+
+  // clean up
+  skipdict_destroy(&d);
+}
+
+#define KEYS_PER_THREAD 20000
+#define NUM_THREADS 4
+
+typedef struct skip_thread_args {
+  int id;
+  my_skipdict_t *d;
+} skip_thread_args_t;
+
+/**
+ * @brief  Insert keys interleaved with the other threads' keys, overwrite them,
+ * and remove every third one
+ * @note
+ * @param  *thread_args: struct with the thread id and the dictionary
+ * @retval None
+ */
+void *skip_thread_run(void *thread_args) {
+  skip_thread_args_t *arguments = (skip_thread_args_t *)thread_args;
+  char key[32];
+  for (int i = 0; i < KEYS_PER_THREAD; i++) {
+    snprintf(key, sizeof(key), "%06d-t%d", i, arguments->id);
+    skipdict_set(arguments->d, key, i);
+  }
+  for (int i = 0; i < KEYS_PER_THREAD; i++) {
+    snprintf(key, sizeof(key), "%06d-t%d", i, arguments->id);
+    if (i % 3 == 0)
+      skipdict_remove(arguments->d, key);
+    else
+      skipdict_set(arguments->d, key, -i);
+  }
+  return NULL;
+}
+
+/**
+ * @brief  Check both invariants with writers racing on neighbouring keys
+ * @note
+ * @retval
+ */
+TEST(SkipDictionaryTest, ConcurrentWriters) {
+  my_skipdict_t d;
+  skipdict_init(&d);
+
+  pthread_t threads[NUM_THREADS];
+  skip_thread_args_t arguments[NUM_THREADS];
+  for (int i = 0; i < NUM_THREADS; i++) {
+    arguments[i].id = i;
+    arguments[i].d = &d;
+    if (pthread_create(&threads[i], NULL, skip_thread_run, &arguments[i]) != 0)
+      perror("Error creating thread");
+  }
+  for (int i = 0; i < NUM_THREADS; i++) {
+    if (pthread_join(threads[i], NULL) != 0)
+      perror("Error joining thread");
+  }
+
+  ASSERT_EQ(NUM_THREADS * (KEYS_PER_THREAD - (KEYS_PER_THREAD + 2) / 3), check_skiplist(&d));
+  char key[32];
+  for (int t = 0; t < NUM_THREADS; t++) {
+    for (int i = 0; i < KEYS_PER_THREAD; i++) {
+      snprintf(key, sizeof(key), "%06d-t%d", i, t);
+      if (i % 3 == 0) {
+        ASSERT_FALSE(skipdict_contains(&d, key));
+      } else {
+        ASSERT_EQ(-i, skipdict_get(&d, key));
+      }
+    }
+  }
+
+  // clean up
+  skipdict_destroy(&d);
+}
+
+#define CHURN_KEYS 64
+#define CHURN_OPS 50000
+
+typedef struct churn_args {
+  my_skipdict_t *d;
+  int id;
+  bool done;
+  int bad_reads;
+} churn_args_t;
+
+/**
+ * @brief  Add and remove the same few keys over and over
+ * @note
+ * @param  *arg: churn_args_t
+ * @retval None
+ */
+void *churn_writer(void *arg) {
+  churn_args_t *args = (churn_args_t *)arg;
+  unsigned int seed = args->id;
+  char key[16];
+  for (int i = 0; i < CHURN_OPS; i++) {
+    snprintf(key, sizeof(key), "c%02d", rand_r(&seed) % CHURN_KEYS);
+    if (rand_r(&seed) % 2 == 0)
+      skipdict_set(args->d, key, 1);
+    else
+      skipdict_remove(args->d, key);
+  }
+  return NULL;
+}
+
+/**
+ * @brief  Read keys nobody writes, whose neighbours are constantly replaced
+ * @note
+ * @param  *arg: churn_args_t
+ * @retval None
+ */
+void *churn_reader(void *arg) {
+  churn_args_t *args = (churn_args_t *)arg;
+  char key[16];
+  int i = 0;
+  while (!__atomic_load_n(&args->done, __ATOMIC_SEQ_CST)) {
+    snprintf(key, sizeof(key), "c%02d+", i);
+    if (skipdict_get(args->d, key) != i)
+      __atomic_add_fetch(&args->bad_reads, 1, __ATOMIC_SEQ_CST);
+    i = (i + 1) % CHURN_KEYS;
+  }
+  return NULL;
+}
+
+// Invariant 1 for keys surrounded by nodes being added, removed and freed,
+// with several writers racing on the same keys
+TEST(SkipDictionaryTest, ReadersDuringChurn) {
+  my_skipdict_t d;
+  skipdict_init(&d);
+  char key[16];
+  for (int i = 0; i < CHURN_KEYS; i++) {
+    snprintf(key, sizeof(key), "c%02d+", i);
+    skipdict_set(&d, key, i);
+  }
+
+  churn_args_t writer_args[NUM_THREADS];
+  churn_args_t reader_args = {&d, 0, false, 0};
+  pthread_t writers[NUM_THREADS], reader;
+  if (pthread_create(&reader, NULL, churn_reader, &reader_args) != 0)
+    perror("Error creating thread");
+  for (int i = 0; i < NUM_THREADS; i++) {
+    writer_args[i].d = &d;
+    writer_args[i].id = i + 1;
+    if (pthread_create(&writers[i], NULL, churn_writer, &writer_args[i]) != 0)
+      perror("Error creating thread");
+  }
+  for (int i = 0; i < NUM_THREADS; i++) {
+    if (pthread_join(writers[i], NULL) != 0)
+      perror("Error joining thread");
+  }
+  __atomic_store_n(&reader_args.done, true, __ATOMIC_SEQ_CST);
+  if (pthread_join(reader, NULL) != 0)
+    perror("Error joining thread");
+
+  ASSERT_EQ(0, reader_args.bad_reads);
+  int count = check_skiplist(&d);
+  ASSERT_GE(count, CHURN_KEYS);
+  ASSERT_LE(count, 2 * CHURN_KEYS);
+
+  // clean up
+  skipdict_destroy(&d);
+}
@@ -0,0 +1,346 @@
+#include "skipdict.hh"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// State of the calling thread's tower height generator
+static __thread uint32_t level_seed = 0;
+static uint32_t next_seed = 0x9e3779b9;
+
+/**
+ * @brief  Check whether a next pointer marks its node as removed at that level
+ * @note
+ * @param  *next: next pointer as loaded
+ * @retval boolean
+ */
+static bool is_marked(const skipdict_node_t *next) {
+  return ((uintptr_t)next & 1) != 0;
+}
+
+/**
+ * @brief  Strip the removal mark from a next pointer
+ * @note
+ * @param  *next: next pointer as loaded
+ * @retval the node it points to
+ */
+static skipdict_node_t *unmarked(skipdict_node_t *next) {
+  return (skipdict_node_t *)((uintptr_t)next & ~(uintptr_t)1);
+}
+
+/**
+ * @brief  Add the removal mark to a next pointer
+ * @note
+ * @param  *next: next pointer to mark
+ * @retval the marked pointer
+ */
+static skipdict_node_t *marked(skipdict_node_t *next) {
+  return (skipdict_node_t *)((uintptr_t)next | 1);
+}
+
+/**
+ * @brief  Pick the height of a new tower
+ * @note   Each extra level with probability 1/2, from a per-thread xorshift generator
+ * @retval number of levels, between 1 and SKIPDICT_MAX_LEVEL
+ */
+static int random_levels(void) {
+  if (level_seed == 0)
+    level_seed = __atomic_add_fetch(&next_seed, 0x9e3779b9, __ATOMIC_RELAXED) | 1;
+  level_seed ^= level_seed << 13;
+  level_seed ^= level_seed >> 17;
+  level_seed ^= level_seed << 5;
+  uint32_t bits = level_seed;
+  int levels = 1;
+  while ((bits & 1) != 0 && levels < SKIPDICT_MAX_LEVEL) {
+    levels++;
+    bits >>= 1;
+  }
+  return levels;
+}
+
+/**
+ * @brief  Allocate a node with a tower of the given height
+ * @note   Only the used part of the tower is allocated, followed by the key
+ * @param  levels: height of the tower
+ * @param  *key: key to copy, or NULL for the head
+ * @param  value: value of the entry
+ * @retval pointer to the new node
+ */
+static skipdict_node_t *node_create(int levels, const char *key, int value) {
+  size_t tower = offsetof(skipdict_node_t, next) + levels * sizeof(skipdict_node_t *);
+  size_t key_size = key == NULL ? 0 : strlen(key) + 1;
+  skipdict_node_t *node = (skipdict_node_t *)malloc(tower + key_size);
+  if (key != NULL) {
+    memcpy((char *)node + tower, key, key_size);
+    node->key = (char *)node + tower;
+  } else {
+    node->key = NULL;
+  }
+  node->value = value;
+  node->levels = levels;
+  node->pending = 2;
+  for (int l = 0; l < levels; l++)
+    node->next[l] = NULL;
+  return node;
+}
+
+/**
+ * @brief  Initialize the dictionary
+ * @note
+ * @param  *dict: dictionary to initialize
+ * @retval None
+ */
+void skipdict_init(my_skipdict_t *dict) {
+  dict->head = node_create(SKIPDICT_MAX_LEVEL, NULL, 0);
+  epoch_init(&dict->epoch);
+}
+
+/**
+ * @brief  Destroy the dictionary
+ * @note   Every node still in the list is on level 0, and every removed one
+ *         has been retired, so both are freed exactly once
+ * @param  *dict: dictionary to destroy
+ * @retval None
+ */
+void skipdict_destroy(my_skipdict_t *dict) {
+  skipdict_node_t *node = unmarked(dict->head->next[0]);
+  while (node != NULL) {
+    skipdict_node_t *next = unmarked(node->next[0]);
+    free(node);
+    node = next;
+  }
+  free(dict->head);
+  dict->head = NULL;
+  epoch_destroy(&dict->epoch);
+}
+
+/**
+ * @brief  Find the nodes around a key on every level, unlinking removed nodes on the way
+ * @note   Must be called inside an epoch section
+ * @param  *dict: dictionary to search
+ * @param  *key: key to look for
+ * @param  **preds: set to the last node before the key on each level
+ * @param  **succs: set to the first node not before the key on each level
+ * @retval whether succs[0] holds the key
+ */
+static bool skipdict_find(my_skipdict_t *dict, const char *key, skipdict_node_t **preds, skipdict_node_t **succs) {
+retry:
+  skipdict_node_t *pred = dict->head;
+  for (int l = SKIPDICT_MAX_LEVEL - 1; l >= 0; l--) {
+    skipdict_node_t *curr = unmarked(__atomic_load_n(&pred->next[l], __ATOMIC_ACQUIRE));
+    while (curr != NULL) {
+      skipdict_node_t *succ = __atomic_load_n(&curr->next[l], __ATOMIC_ACQUIRE);
+      if (is_marked(succ)) {
+        // curr is being removed; unlink it here, or start over if pred changed
+        skipdict_node_t *expected = curr;
+        if (!__atomic_compare_exchange_n(&pred->next[l], &expected, unmarked(succ), false, __ATOMIC_ACQ_REL,
+                                         __ATOMIC_ACQUIRE))
+          goto retry;
+        curr = unmarked(succ);
+        continue;
+      }
+      if (strcmp(curr->key, key) >= 0)
+        break;
+      pred = curr;
+      curr = succ;
+    }
+    preds[l] = pred;
+    succs[l] = curr;
+  }
+  return succs[0] != NULL && strcmp(succs[0]->key, key) == 0;
+}
+
+/**
+ * @brief  Finish the inserter's or remover's part in a node's life
+ * @note   The second of the two to finish hands the node to the epoch domain.
+ *         By then the remover has marked every level and one of them has run a
+ *         search after the last link was made, so the node is unreachable.
+ * @param  *dict: dictionary the node belongs to
+ * @param  *node: node to release
+ * @retval None
+ */
+static void node_release(my_skipdict_t *dict, skipdict_node_t *node) {
+  if (__atomic_sub_fetch(&node->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+    epoch_retire(&dict->epoch, node, free);
+    epoch_reclaim(&dict->epoch);
+  }
+}
+
+/**
+ * @brief  Add a new entry to the dictionary, or update the value of an existing one
+ * @note   Linking level 0 adds the entry; the levels above are only shortcuts
+ *         and are linked afterwards, unless a remover gets there first
+ * @param  *dict: dictionary to which the entry is to be added
+ * @param  *key: key of the entry
+ * @param  value: value of the entry
+ * @retval None
+ */
+void skipdict_set(my_skipdict_t *dict, const char *key, int value) {
+  skipdict_node_t *preds[SKIPDICT_MAX_LEVEL];
+  skipdict_node_t *succs[SKIPDICT_MAX_LEVEL];
+  skipdict_node_t *node = NULL;
+  unsigned long e = epoch_enter(&dict->epoch);
+
+  while (true) {
+    if (skipdict_find(dict, key, preds, succs)) {
+      __atomic_store_n(&succs[0]->value, value, __ATOMIC_RELEASE);
+      free(node);
+      epoch_exit(&dict->epoch, e);
+      return;
+    }
+    if (node == NULL)
+      node = node_create(random_levels(), key, value);
+    for (int l = 0; l < node->levels; l++)
+      node->next[l] = succs[l];
+    skipdict_node_t *expected = succs[0];
+    if (__atomic_compare_exchange_n(&preds[0]->next[0], &expected, node, false, __ATOMIC_RELEASE,
+                                    __ATOMIC_RELAXED))
+      break;
+  }
+
+  for (int l = 1; l < node->levels; l++) {
+    while (true) {
+      // point the tower at the current successor, unless removal has started
+      skipdict_node_t *next = __atomic_load_n(&node->next[l], __ATOMIC_ACQUIRE);
+      if (is_marked(next))
+        goto done;
+      if (next != succs[l] &&
+          !__atomic_compare_exchange_n(&node->next[l], &next, succs[l], false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        continue;
+      skipdict_node_t *expected = succs[l];
+      if (__atomic_compare_exchange_n(&preds[l]->next[l], &expected, node, false, __ATOMIC_RELEASE,
+                                      __ATOMIC_RELAXED))
+        break;
+      skipdict_find(dict, key, preds, succs);
+    }
+  }
+
+done:
+  // a remover may have finished while levels were still being linked; its
+  // search could not unlink what did not exist yet, so search again
+  if (is_marked(__atomic_load_n(&node->next[0], __ATOMIC_ACQUIRE)))
+    skipdict_find(dict, key, preds, succs);
+  node_release(dict, node);
+  epoch_exit(&dict->epoch, e);
+}
+
+/**
+ * @brief  Find the node holding a key without modifying the list
+ * @note   Must be called inside an epoch section
+ * @param  *dict: dictionary to search
+ * @param  *key: key to look for
+ * @retval the first node on level 0 not before the key, or NULL
+ */
+static skipdict_node_t *skipdict_lower_bound(my_skipdict_t *dict, const char *key) {
+  skipdict_node_t *pred = dict->head;
+  skipdict_node_t *curr = NULL;
+  for (int l = SKIPDICT_MAX_LEVEL - 1; l >= 0; l--) {
+    curr = unmarked(__atomic_load_n(&pred->next[l], __ATOMIC_ACQUIRE));
+    while (curr != NULL) {
+      skipdict_node_t *succ = __atomic_load_n(&curr->next[l], __ATOMIC_ACQUIRE);
+      // step over removed nodes instead of unlinking them
+      if (is_marked(succ)) {
+        curr = unmarked(succ);
+        continue;
+      }
+      if (strcmp(curr->key, key) >= 0)
+        break;
+      pred = curr;
+      curr = succ;
+    }
+  }
+  return curr;
+}
+
+/**
+ * @brief  Function to check if the given key is in the dictionary
+ * @note   Never writes to shared memory apart from the epoch counter
+ * @param  *dict: dictionary to check
+ * @param  *key: key to check the existence of
+ * @retval boolean
+ */
+bool skipdict_contains(my_skipdict_t *dict, const char *key) {
+  unsigned long e = epoch_enter(&dict->epoch);
+  skipdict_node_t *node = skipdict_lower_bound(dict, key);
+  bool ret = node != NULL && strcmp(node->key, key) == 0;
+  epoch_exit(&dict->epoch, e);
+  return ret;
+}
+
+/**
+ * @brief  Function to get the value for a given key
+ * @note   Never writes to shared memory apart from the epoch counter
+ * @param  *dict: dictionary from which the value is retreived
+ * @param  *key: key of the interested entry
+ * @retval the value of the corresponding key, if not present -1
+ */
+int skipdict_get(my_skipdict_t *dict, const char *key) {
+  unsigned long e = epoch_enter(&dict->epoch);
+  skipdict_node_t *node = skipdict_lower_bound(dict, key);
+  int ret = node != NULL && strcmp(node->key, key) == 0 ? __atomic_load_n(&node->value, __ATOMIC_ACQUIRE) : -1;
+  epoch_exit(&dict->epoch, e);
+  return ret;
+}
+
+/**
+ * @brief  Function to remove an entry
+ * @note   Marks the tower from the top down; whoever marks level 0 removed the key
+ * @param  *dict: dictionary from which to remove an entry
+ * @param  *key: key of the entry to remove
+ * @retval None
+ */
+void skipdict_remove(my_skipdict_t *dict, const char *key) {
+  skipdict_node_t *preds[SKIPDICT_MAX_LEVEL];
+  skipdict_node_t *succs[SKIPDICT_MAX_LEVEL];
+  unsigned long e = epoch_enter(&dict->epoch);
+  if (!skipdict_find(dict, key, preds, succs)) {
+    epoch_exit(&dict->epoch, e);
+    return;
+  }
+
+  skipdict_node_t *node = succs[0];
+  for (int l = node->levels - 1; l >= 1; l--) {
+    skipdict_node_t *next = __atomic_load_n(&node->next[l], __ATOMIC_ACQUIRE);
+    while (!is_marked(next) &&
+           !__atomic_compare_exchange_n(&node->next[l], &next, marked(next), false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+      ;
+  }
+  skipdict_node_t *next = __atomic_load_n(&node->next[0], __ATOMIC_ACQUIRE);
+  while (!is_marked(next)) {
+    if (__atomic_compare_exchange_n(&node->next[0], &next, marked(next), false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      // unlink it everywhere before letting go
+      skipdict_find(dict, key, preds, succs);
+      node_release(dict, node);
+      break;
+    }
+  }
+  epoch_exit(&dict->epoch, e);
+}
+
+/**
+ * @brief  Visit the entries with keys in [from, to), in key order
+ * @note   Walks level 0 inside one epoch section, skipping removed nodes
+ * @param  *dict: dictionary to scan
+ * @param  *from: smallest key to visit, or NULL to start at the first key
+ * @param  *to: key to stop before, or NULL to run to the last key
+ * @param  fn: function called for each entry; returning false stops the scan
+ * @param  *arg: passed to fn
+ * @retval None
+ */
+void skipdict_scan(my_skipdict_t *dict, const char *from, const char *to, skipdict_scan_fn fn, void *arg) {
+  unsigned long e = epoch_enter(&dict->epoch);
+  skipdict_node_t *node =
+      from == NULL ? unmarked(__atomic_load_n(&dict->head->next[0], __ATOMIC_ACQUIRE)) : skipdict_lower_bound(dict, from);
+  while (node != NULL) {
+    skipdict_node_t *next = __atomic_load_n(&node->next[0], __ATOMIC_ACQUIRE);
+    if (!is_marked(next)) {
+      if (to != NULL && strcmp(node->key, to) >= 0)
+        break;
+      if (!fn(node->key, __atomic_load_n(&node->value, __ATOMIC_ACQUIRE), arg))
+        break;
+    }
+    node = unmarked(next);
+  }
+  epoch_exit(&dict->epoch, e);
+}
@@ -0,0 +1,58 @@
+#ifndef SKIPDICT_H
+#define SKIPDICT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "epoch.hh"
+
+// Lock-free skip list. Towers are linked with compare-and-swap and removed by
+// marking the low bit of their next pointers, top level first; marking level 0
+// is what removes the key. Any traversal that meets a marked node unlinks it,
+// and unlinked nodes are freed through the epoch domain.
+
+// Tallest tower. Each level holds about half the nodes of the one below, so
+// this covers around 2^24 keys before the top level gets crowded.
+#define SKIPDICT_MAX_LEVEL 24
+
+typedef struct skipdict_node {
+  const char* key;  // stored right after the tower, NULL for the head
+  int value;
+  int levels;   // height of the tower
+  int pending;  // inserter and remover that still have to finish before the node is freed
+  struct skipdict_node* next[SKIPDICT_MAX_LEVEL];  // only levels entries are allocated
+} skipdict_node_t;
+
+typedef struct my_skipdict {
+  skipdict_node_t* head;
+  epoch_t epoch;
+} my_skipdict_t;
+
+// Initialize a dictionary
+void skipdict_init(my_skipdict_t* dict);
+
+// Destroy a dictionary. No other operation may be running.
+void skipdict_destroy(my_skipdict_t* dict);
+
+// Set a value in a dictionary. The key is copied.
+void skipdict_set(my_skipdict_t* dict, const char* key, int value);
+
+// Check if a dictionary contains a key
+bool skipdict_contains(my_skipdict_t* dict, const char* key);
+
+// Get a value in a dictionary, or -1 if the key is not present
+int skipdict_get(my_skipdict_t* dict, const char* key);
+
+// Remove a value from a dictionary
+void skipdict_remove(my_skipdict_t* dict, const char* key);
+
+// Called for each entry of a scan, in key order. The key is only valid during
+// the call. Return false to stop the scan.
+typedef bool (*skipdict_scan_fn)(const char* key, int value, void* arg);
+
+// Visit the entries with keys in [from, to) in key order. A NULL bound leaves
+// that end open. Entries added or removed during the scan may or may not be seen.
+void skipdict_scan(my_skipdict_t* dict, const char* from, const char* to, skipdict_scan_fn fn, void* arg);
+
+#endif
@@ -0,0 +1,118 @@
+#include "instrument.hh"
+#include "queue.hh"
+#include "spscqueue.hh"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/****** Single Producer, Single Consumer Benchmark ******/
+
+// One thread puts 0 to N - 1 and another takes them, for
+//   spsc:     the single-producer single-consumer ring
+//   two-lock: the general queue, with the producer held to the same number
+//             of elements in flight
+// The consumer checks the order, and for every element records how long it
+// took from just before its put to just after its take. Throughput and the
+// percentiles of that latency are reported.
+
+#define DEFAULT_ELEMENTS 2000000
+#define CAPACITY 1024
+
+typedef enum backend { SPSC, TWO_LOCK, NUM_BACKENDS } backend_t;
+
+static const char *backend_names[NUM_BACKENDS] = {"spsc", "two-lock"};
+
+typedef struct bench_pipe {
+  backend_t backend;
+  my_spscqueue_t spsc;
+  my_queue_t locked;
+  long num_elements;
+  uint64_t *put_times;  // written by the producer before each put
+} bench_pipe_t;
+
+/**
+ * @brief  Put every element, waiting while CAPACITY elements are in flight
+ * @note
+ * @param  *arg: bench_pipe_t
+ * @retval None
+ */
+static void *bench_producer(void *arg) {
+  bench_pipe_t *p = (bench_pipe_t *)arg;
+  for (long i = 0; i < p->num_elements; i++) {
+    if (p->backend == SPSC) {
+      p->put_times[i] = instrument_now();
+      while (!spscqueue_try_put(&p->spsc, (int)i)) {
+        sched_yield();
+        p->put_times[i] = instrument_now();
+      }
+    } else {
+      while (__atomic_load_n(&p->locked.size, __ATOMIC_RELAXED) >= CAPACITY)
+        sched_yield();
+      p->put_times[i] = instrument_now();
+      queue_put(&p->locked, (int)i);
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief  Move every element from a producer thread to this one
+ * @note
+ * @param  backend: queue to move them through
+ * @param  num_elements: how many
+ * @param  *latency: histogram of put-to-take times
+ * @param  *failures: incremented for every element taken out of order
+ * @retval millions of elements per second
+ */
+static double bench_pipeline(backend_t backend, long num_elements, instrument_histogram_t *latency, int *failures) {
+  bench_pipe_t p;
+  p.backend = backend;
+  spscqueue_init(&p.spsc, CAPACITY);
+  queue_init(&p.locked);
+  p.num_elements = num_elements;
+  p.put_times = (uint64_t *)malloc(num_elements * sizeof(uint64_t));
+
+  uint64_t start = instrument_now();
+  pthread_t producer;
+  if (pthread_create(&producer, NULL, bench_producer, &p) != 0)
+    perror("Error creating thread");
+  for (long i = 0; i < num_elements; i++) {
+    int element;
+    while (!(backend == SPSC ? spscqueue_try_take(&p.spsc, &element) : queue_try_take(&p.locked, &element)))
+      sched_yield();
+    instrument_record(latency, instrument_now() - p.put_times[i]);
+    if (element != (int)i)
+      (*failures)++;
+  }
+  if (pthread_join(producer, NULL) != 0)
+    perror("Error joining thread");
+  uint64_t end = instrument_now();
+
+  free(p.put_times);
+  spscqueue_destroy(&p.spsc);
+  queue_destroy(&p.locked);
+  return num_elements / ((end - start) / 1e3);
+}
+
+int main(int argc, char **argv) {
+  long num_elements = argc > 1 ? atol(argv[1]) : DEFAULT_ELEMENTS;
+  int failures = 0;
+
+  printf("elements: %ld, in flight: at most %d, latency in ns\n", num_elements, CAPACITY);
+  printf("%-10s %10s %10s %10s %10s %10s\n", "queue", "Mops/s", "p50", "p99", "p99.9", "max");
+  for (int b = 0; b < NUM_BACKENDS; b++) {
+    instrument_histogram_t latency = {};
+    double mops = bench_pipeline((backend_t)b, num_elements, &latency, &failures);
+    printf("%-10s %10.2f %10llu %10llu %10llu %10llu\n", backend_names[b], mops,
+           (unsigned long long)instrument_percentile(&latency, 50),
+           (unsigned long long)instrument_percentile(&latency, 99),
+           (unsigned long long)instrument_percentile(&latency, 99.9), (unsigned long long)latency.max_ns);
+  }
+
+  if (failures != 0) {
+    printf("FAILED: %d checks did not match\n", failures);
+    return 1;
+  }
+  return 0;
+}
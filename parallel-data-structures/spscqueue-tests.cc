@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+
+#include "spscqueue.hh"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+
+/****** Queue Invariants ******/
+
+// Invariant 1
+// Every value put is taken exactly once, in the order it was put.
+
+// Invariant 2
+// The queue never holds more elements than its capacity.
+
+/****** Begin Tests ******/
+
+// Basic queue functionality, including a full queue
+TEST(SpscQueueTest, BasicQueueOps) {
+  my_spscqueue_t q;
+  spscqueue_init(&q, 3);
+  ASSERT_EQ(4u, spscqueue_capacity(&q));
+
+  int element = 42;
+  ASSERT_TRUE(spscqueue_empty(&q));
+  ASSERT_FALSE(spscqueue_try_take(&q, &element));
+  ASSERT_EQ(42, element);
+
+  // Fill the queue; one more does not fit until something is taken
+  for (int i = 0; i < 4; i++)
+    ASSERT_TRUE(spscqueue_try_put(&q, i - 1));
+  ASSERT_FALSE(spscqueue_try_put(&q, 3));
+  ASSERT_FALSE(spscqueue_empty(&q));
+  ASSERT_TRUE(spscqueue_try_take(&q, &element));
+  ASSERT_EQ(-1, element);
+  ASSERT_TRUE(spscqueue_try_put(&q, 3));
+
+  for (int i = 0; i < 4; i++) {
+    ASSERT_TRUE(spscqueue_try_take(&q, &element));
+    ASSERT_EQ(i, element);
+  }
+  ASSERT_TRUE(spscqueue_empty(&q));
+  ASSERT_FALSE(spscqueue_try_take(&q, &element));
+
+  // clean up
+  spscqueue_destroy(&q);
+}
+
+#define PIPELINE_VALUES 1000000
+#define PIPELINE_CAPACITY 64
+
+/**
+ * @brief  Put 0 to PIPELINE_VALUES - 1, yielding while the queue is full
+ * @note
+ * @param  *arg: queue to put into
+ * @retval None
+ */
+void *spsc_producer(void *arg) {
+  my_spscqueue_t *q = (my_spscqueue_t *)arg;
+  for (int i = 0; i < PIPELINE_VALUES; i++) {
+    while (!spscqueue_try_put(q, i))
+      sched_yield();
+  }
+  return NULL;
+}
+
+// Invariants 1 and 2 with a producer and a consumer thread running at once
+TEST(SpscQueueTest, Pipeline) {
+  my_spscqueue_t q;
+  spscqueue_init(&q, PIPELINE_CAPACITY);
+
+  pthread_t producer;
+  if (pthread_create(&producer, NULL, spsc_producer, &q) != 0)
+    perror("Error creating thread");
+
+  int out_of_order = 0;
+  for (int i = 0; i < PIPELINE_VALUES; i++) {
+    int element;
+    while (!spscqueue_try_take(&q, &element))
+      sched_yield();
+    if (element != i)
+      out_of_order++;
+    // the producer is never more than a ring ahead
+    if (__atomic_load_n(&q.tail, __ATOMIC_ACQUIRE) - (unsigned long)(i + 1) > PIPELINE_CAPACITY)
+      out_of_order++;
+  }
+  if (pthread_join(producer, NULL) != 0)
+    perror("Error joining thread");
+  ASSERT_EQ(0, out_of_order);
+  ASSERT_TRUE(spscqueue_empty(&q));
+
+  // clean up
+  spscqueue_destroy(&q);
+}
@@ -0,0 +1,93 @@
+#include "spscqueue.hh"
+
+#include <stdlib.h>
+
+/**
+ * @brief  Initialize a queue
+ * @note
+ * @param  *queue: queue to initialize
+ * @param  capacity: least number of elements it must hold
+ * @retval None
+ */
+void spscqueue_init(my_spscqueue_t *queue, size_t capacity) {
+  size_t size = 1;
+  while (size < capacity)
+    size *= 2;
+  queue->slots = (int *)malloc(size * sizeof(int));
+  queue->mask = size - 1;
+  queue->tail = 0;
+  queue->cached_head = 0;
+  queue->head = 0;
+  queue->cached_tail = 0;
+}
+
+/**
+ * @brief  Destroy a queue
+ * @note
+ * @param  *queue: queue to destroy
+ * @retval None
+ */
+void spscqueue_destroy(my_spscqueue_t *queue) {
+  free(queue->slots);
+  queue->slots = NULL;
+}
+
+/**
+ * @brief  Get the capacity of a queue
+ * @note
+ * @param  *queue: queue to check
+ * @retval number of elements it can hold
+ */
+size_t spscqueue_capacity(my_spscqueue_t *queue) {
+  return queue->mask + 1;
+}
+
+/**
+ * @brief  Put an element into a queue unless it is full
+ * @note   The release store of the tail publishes the slot to the consumer
+ * @param  *queue: queue to put into
+ * @param  element: element to put
+ * @retval whether the element was put
+ */
+bool spscqueue_try_put(my_spscqueue_t *queue, int element) {
+  unsigned long tail = queue->tail;
+  if (tail - queue->cached_head > queue->mask) {
+    // looks full; see how far the consumer got
+    queue->cached_head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+    if (tail - queue->cached_head > queue->mask)
+      return false;
+  }
+  queue->slots[tail & queue->mask] = element;
+  __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+/**
+ * @brief  Take an element out of a queue unless it is empty
+ * @note   The release store of the head hands the slot back to the producer
+ * @param  *queue: queue to take from
+ * @param  *element: set to the element taken
+ * @retval whether an element was taken
+ */
+bool spscqueue_try_take(my_spscqueue_t *queue, int *element) {
+  unsigned long head = queue->head;
+  if (head == queue->cached_tail) {
+    // looks empty; see how far the producer got
+    queue->cached_tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+    if (head == queue->cached_tail)
+      return false;
+  }
+  *element = queue->slots[head & queue->mask];
+  __atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+/**
+ * @brief  Check if a queue is empty
+ * @note
+ * @param  *queue: queue to check
+ * @retval whether every element put was taken
+ */
+bool spscqueue_empty(my_spscqueue_t *queue) {
+  return __atomic_load_n(&queue->head, __ATOMIC_RELAXED) == __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,48 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Bounded queue for exactly one producer thread and one consumer thread. The
+// producer only writes the tail and the consumer only writes the head, so an
+// operation is a plain slot access plus one release store. Each side keeps
+// its own copy of the other side's index and only reloads it when the ring
+// looks full or empty, so in steady state the two threads do not touch each
+// other's cache lines except for the slots themselves.
+
+typedef struct my_spscqueue {
+  int* slots;
+  unsigned long mask;  // capacity - 1
+
+  // written by the producer
+  unsigned long tail __attribute__((aligned(64)));
+  unsigned long cached_head;  // head as last seen by the producer
+
+  // written by the consumer
+  unsigned long head __attribute__((aligned(64)));
+  unsigned long cached_tail;  // tail as last seen by the consumer
+} my_spscqueue_t;
+
+// Initialize a queue holding at least capacity elements. The capacity is
+// rounded up to a power of two.
+void spscqueue_init(my_spscqueue_t* queue, size_t capacity);
+
+// Destroy a queue. Neither thread may be using it.
+void spscqueue_destroy(my_spscqueue_t* queue);
+
+// Number of elements a queue can hold
+size_t spscqueue_capacity(my_spscqueue_t* queue);
+
+// Put an element at the end of a queue, or return false if it is full. Only
+// the producer thread may call this.
+bool spscqueue_try_put(my_spscqueue_t* queue, int element);
+
+// Take an element off the front of a queue into *element, or return false if
+// it is empty. Only the consumer thread may call this.
+bool spscqueue_try_take(my_spscqueue_t* queue, int* element);
+
+// Check if a queue is empty. Exact only when called by the consumer.
+bool spscqueue_empty(my_spscqueue_t* queue);
+
+#endif
@@ -0,0 +1,127 @@
+#include "elimstack.hh"
+#include "instrument.hh"
+#include "lfstack.hh"
+#include "stack.hh"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/****** Stack Benchmark ******/
+
+// Push-pop pairs: the same number of push-pop pairs is split across 1 to 64
+// threads, each pushing an element and then popping one, for
+//   locked:      the stack under one mutex
+//   lock-free:   the Treiber stack
+//   elimination: the Treiber stack with an elimination array, which should
+//                gain as more threads collide
+// and the throughput of each is reported in millions of operations per second.
+
+#define TOTAL_PAIRS 1000000
+#define MAX_THREADS 64
+
+typedef enum backend { LOCKED, LOCK_FREE, ELIMINATION, NUM_BACKENDS } backend_t;
+
+static const char *backend_names[NUM_BACKENDS] = {"locked", "lock-free", "elimination"};
+
+typedef struct bench_stack {
+  backend_t backend;
+  my_stack_t locked;
+  my_lfstack_t lock_free;
+  my_elimstack_t elimination;
+} bench_stack_t;
+
+typedef struct bench_thread {
+  bench_stack_t *s;
+  int pairs;
+  int failures;
+} bench_thread_t;
+
+/**
+ * @brief  Run one thread's share of the push-pop pairs
+ * @note   The stack is never empty when a pop starts, since every thread
+ *         pushes before it pops
+ * @param  *arg: bench_thread_t
+ * @retval None
+ */
+static void *bench_run(void *arg) {
+  bench_thread_t *t = (bench_thread_t *)arg;
+  for (int i = 0; i < t->pairs; i++) {
+    int popped;
+    switch (t->s->backend) {
+      case LOCKED:
+        stack_push(&t->s->locked, i);
+        popped = stack_pop(&t->s->locked);
+        break;
+      case LOCK_FREE:
+        lfstack_push(&t->s->lock_free, i);
+        popped = lfstack_pop(&t->s->lock_free);
+        break;
+      default:
+        elimstack_push(&t->s->elimination, i);
+        popped = elimstack_pop(&t->s->elimination);
+    }
+    if (popped == -1)
+      t->failures++;
+  }
+  return NULL;
+}
+
+/**
+ * @brief  Time the push-pop pairs on one backend with a given number of threads
+ * @note
+ * @param  backend: backend to run
+ * @param  num_threads: number of threads sharing the work
+ * @param  *failures: incremented for every pop that found the stack empty
+ * @retval millions of operations per second
+ */
+static double bench_contention(backend_t backend, int num_threads, int *failures) {
+  bench_stack_t s;
+  s.backend = backend;
+  stack_init(&s.locked);
+  lfstack_init(&s.lock_free);
+  elimstack_init(&s.elimination);
+
+  pthread_t threads[MAX_THREADS];
+  bench_thread_t args[MAX_THREADS];
+  uint64_t start = instrument_now();
+  for (int i = 0; i < num_threads; i++) {
+    args[i].s = &s;
+    args[i].pairs = TOTAL_PAIRS / num_threads;
+    args[i].failures = 0;
+    if (pthread_create(&threads[i], NULL, bench_run, &args[i]) != 0)
+      perror("Error creating thread");
+  }
+  for (int i = 0; i < num_threads; i++) {
+    if (pthread_join(threads[i], NULL) != 0)
+      perror("Error joining thread");
+    *failures += args[i].failures;
+  }
+  uint64_t end = instrument_now();
+
+  stack_destroy(&s.locked);
+  lfstack_destroy(&s.lock_free);
+  elimstack_destroy(&s.elimination);
+  return 2.0 * (TOTAL_PAIRS / num_threads) * num_threads / ((end - start) / 1e3);
+}
+
+int main(int argc, char **argv) {
+  int failures = 0;
+
+  printf("push-pop pairs: %d, Mops/s by threads\n", TOTAL_PAIRS);
+  printf("%-10s", "threads");
+  for (int b = 0; b < NUM_BACKENDS; b++)
+    printf("%12s", backend_names[b]);
+  printf("\n");
+  for (int threads = 1; threads <= MAX_THREADS; threads *= 2) {
+    printf("%-10d", threads);
+    for (int b = 0; b < NUM_BACKENDS; b++)
+      printf("%12.2f", bench_contention((backend_t)b, threads, &failures));
+    printf("\n");
+  }
+
+  if (failures != 0) {
+    printf("FAILED: %d checks did not match\n", failures);
+    return 1;
+  }
+  return 0;
+}
@@ -1,11 +1,22 @@
 #include "stack.hh"
+#include "nodepool.hh"
 #include <pthread.h>
 #include <stdlib.h>
 
+// Nodes come from the shared node pool
+static_assert(sizeof(node_t) <= NODEPOOL_NODE_SIZE, "nodes must fit the node pool");
+
+// Operations the instrumentation times
+enum { STACK_OP_PUSH, STACK_OP_POP, STACK_OP_EMPTY, STACK_NUM_OPS };
+#ifdef INSTRUMENT
+static const char *const stack_op_names[STACK_NUM_OPS] = {"push", "pop", "empty"};
+#endif
+
 // Initialize a stack
 void stack_init(my_stack_t *stack) {
     // Lock the mutex lock and initialize the size and top fields
     pthread_mutex_init(&stack->lock, NULL);
+    INSTRUMENT_INIT(&stack->instrument, "stack", stack_op_names, STACK_NUM_OPS);
     pthread_mutex_lock(&stack->lock);
     stack->size = 0;
     stack->top = NULL;
@@ -20,7 +31,7 @@ void stack_destroy(my_stack_t *stack) {
     node_t *cur = stack->top;
     while (cur != NULL) {
         node_t *next = cur->next;
-        free(cur);
+        nodepool_free(cur);
         cur = next;
     }
     // unlock
@@ -29,44 +40,50 @@ void stack_destroy(my_stack_t *stack) {
 
 // Push an element onto a stack
 void stack_push(my_stack_t *stack, int element) {
+    INSTRUMENT_START(start);
     // Alocate space for a new node and assign values
-    node_t *newNode = (node_t *)malloc(sizeof(node_t));
+    node_t *newNode = (node_t *)nodepool_alloc();
     newNode->data = element;
     // Lock the lock and add node to the head
-    pthread_mutex_lock(&stack->lock);
+    INSTRUMENT_LOCK(&stack->instrument, &stack->lock);
     newNode->next = stack->top;
     stack->top = newNode;
     stack->size++;
-    pthread_mutex_unlock(&stack->lock);
+    INSTRUMENT_UNLOCK(&stack->instrument, &stack->lock);
+    INSTRUMENT_OP(&stack->instrument, STACK_OP_PUSH, start);
 }
 
 // Check if a stack is empty
 bool stack_empty(my_stack_t *stack) {
+    INSTRUMENT_START(start);
     // Lock the lock and check if the size is 0 or not
-    pthread_mutex_lock(&stack->lock);
+    INSTRUMENT_LOCK(&stack->instrument, &stack->lock);
     bool ret = false;
     if (stack->size == 0) {
         ret = true;
     }
-    pthread_mutex_unlock(&stack->lock);
+    INSTRUMENT_UNLOCK(&stack->instrument, &stack->lock);
+    INSTRUMENT_OP(&stack->instrument, STACK_OP_EMPTY, start);
     return ret;
 }
 
 // Pop an element off of a stack
 int stack_pop(my_stack_t *stack) {
+    INSTRUMENT_START(start);
     int ret;
     // Lock the lock and find the element to pop. Store the value to return and unlock.
-    pthread_mutex_lock(&stack->lock);
+    INSTRUMENT_LOCK(&stack->instrument, &stack->lock);
     if (stack->size == 0) {
         ret = -1;
     } else {
         node_t *newHead = stack->top->next;
         ret = stack->top->data;
-        free(stack->top);
+        nodepool_free(stack->top);
         stack->top = newHead;
         stack->size--;
     }
 
-    pthread_mutex_unlock(&stack->lock);
+    INSTRUMENT_UNLOCK(&stack->instrument, &stack->lock);
+    INSTRUMENT_OP(&stack->instrument, STACK_OP_POP, start);
     return ret;
 }
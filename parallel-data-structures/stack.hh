@@ -4,6 +4,8 @@
 #include <pthread.h>
 #include <stdbool.h>
 
+#include "instrument.hh"
+
 typedef struct my_node {
   int data;
   struct my_node *next;
@@ -13,6 +15,7 @@ typedef struct my_stack {
   int size;
   node_t *top;
   pthread_mutex_t lock;
+  INSTRUMENT_FIELD(instrument)
 } my_stack_t;
 
 // Initialize a stack